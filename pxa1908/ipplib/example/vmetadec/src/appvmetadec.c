@@ -34,12 +34,28 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 /*vmeta os api*/
 #include "vdec_os_api.h"
 
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+
 //temporary
 #define STREAM_BUF_SIZE                 (2047 * 1024) /*must equal to or greater than 64k*/
 #define STREAM_BUF_NUM                  4
 #define PICTURE_BUF_NUM                 20
 #define LESSINFO_MAX_FRAME              10
 
+#define MAX_BENCH_SESSION               16
+#define MAX_BENCH_LINE                  2048
+#define MAX_CONF_STREAM                 256
+#define CONF_GOLDEN_EXT                 ".chksum"
+
 static int g_bOptChksum = 1;
 int bFreePicBufFlag[PICTURE_BUF_NUM]; /* declaring as global variable is for manchac requirement*/
 //#define IPP_Printf
@@ -56,8 +72,148 @@ typedef struct _IppVmetaDecParSetEx {
     Ipp32s              bDisableFewerDpb;           /*disable fewer dpb mode*/
     Ipp32s              bLessInfo;                  /*only keep log info for begin 10 frames and non-each frame log*/
     Ipp32s              bNoResoChange;              /*disable resolution change for h264*/
+    Ipp32s              nResWidth;                  /*reserve a display buffer carve-out for this max width, 0: off*/
+    Ipp32s              nResHeight;                 /*max height of the carve-out*/
+    Ipp32s              nResNum;                    /*number of display buffers in the carve-out*/
+    Ipp32s              bFramer;                    /*split the input into access units in the app*/
 }IppVmetaDecParSetEx;
 
+/*per-session result of the multi-instance benchmark*/
+typedef struct _VmetaDecStat {
+    int                 nRet;
+    int                 nTotalFrames;
+    Ipp32u              nTotalTime;                 /*app level, us*/
+    Ipp32u              nLockWait;                  /*hw lock wait, ms*/
+    Ipp32u              nLockHold;                  /*hw lock hold, ms*/
+    Ipp32u              nFrameTime[4];              /*frame time p50, p90, p99, max (ms)*/
+    int                 nMismatch;                  /*index of the first frame off the golden list, -1 if none*/
+}VmetaDecStat;
+
+static VmetaDecStat *g_pDecStat = NULL;            /*filled by VmetaDecoder when set*/
+static char g_BenchFile[MAX_BENCH_LINE] = {'\0'};
+static char g_GoldenFile[MAX_BENCH_LINE] = {'\0'};
+static char g_ConfDir[MAX_BENCH_LINE] = {'\0'};
+static char g_ConfReport[MAX_BENCH_LINE] = "vmeta_conf_report.csv";
+static int g_nConfJobs = 2;
+
+/*
+* golden checksum list: the CHKSUM>> lines written by -c:1, compared while decoding
+* so that conformance runs need no yuv output.
+*/
+typedef struct _VmetaGolden {
+    Ipp32u              (*pSum)[8];
+    char                *pType;                     /*'F', 'T' or 'B'*/
+    int                 nNum;
+    int                 nPos;                       /*next line to compare*/
+    int                 nFrame;                     /*pictures compared*/
+    int                 nMismatch;                  /*picture index of the first mismatch, -1 if none*/
+}VmetaGolden;
+
+static int VmetaGoldenLoad(VmetaGolden *pGolden, char *pFileName)
+{
+    IPP_FILE *fp;
+    char pLine[256];
+    Ipp32u v[8];
+    char t;
+    int nMax = 0;
+
+    IPP_Memset(pGolden, 0, sizeof(VmetaGolden));
+    pGolden->nMismatch = -1;
+    fp = IPP_Fopen(pFileName, "r");
+    if (!fp) {
+        return -1;
+    }
+    while (IPP_Fgets(pLine, sizeof(pLine), fp)) {
+        if (9 != sscanf(pLine, "CHKSUM>> [%c] %x-%x-%x-%x-%x-%x-%x-%x", &t,
+                &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7])) {
+            continue;
+        }
+        if (pGolden->nNum == nMax) {
+            nMax = nMax ? 2 * nMax : 1024;
+            pGolden->pSum   = realloc(pGolden->pSum, nMax * sizeof(pGolden->pSum[0]));
+            pGolden->pType  = realloc(pGolden->pType, nMax);
+            if ((NULL == pGolden->pSum) || (NULL == pGolden->pType)) {
+                IPP_Fclose(fp);
+                return -1;
+            }
+        }
+        IPP_Memcpy(pGolden->pSum[pGolden->nNum], v, sizeof(v));
+        pGolden->pType[pGolden->nNum] = t;
+        pGolden->nNum++;
+    }
+    IPP_Fclose(fp);
+    return 0;
+}
+
+static void VmetaGoldenFree(VmetaGolden *pGolden)
+{
+    free(pGolden->pSum);
+    free(pGolden->pType);
+    pGolden->pSum   = NULL;
+    pGolden->pType  = NULL;
+}
+
+static int GoldenLineMatch(VmetaGolden *pGolden, char t, Ipp32u *pSum)
+{
+    if (pGolden->nPos >= pGolden->nNum) {
+        return 0;
+    }
+    if ((t != pGolden->pType[pGolden->nPos]) || IPP_Memcmp(pGolden->pSum[pGolden->nPos], pSum, 8 * sizeof(Ipp32u))) {
+        return 0;
+    }
+    pGolden->nPos++;
+    return 1;
+}
+
+/*0 if the picture matches the next golden entry, -1 on the first mismatch*/
+static int VmetaGoldenCheck(VmetaGolden *pGolden, IppVmetaPicture *pPic)
+{
+    int bMatch;
+
+    if (0 <= pGolden->nMismatch) {
+        return -1;
+    }
+    if (1 == pPic->PicDataInfo.pic_type) {
+        bMatch = GoldenLineMatch(pGolden, 'T', pPic->PicDataInfo.chksum_data[0])
+            && GoldenLineMatch(pGolden, 'B', pPic->PicDataInfo.chksum_data[1]);
+    } else {
+        bMatch = GoldenLineMatch(pGolden, 'F', pPic->PicDataInfo.chksum_data[0]);
+    }
+    if (!bMatch) {
+        pGolden->nMismatch = pGolden->nFrame;
+        return -1;
+    }
+    pGolden->nFrame++;
+    return 0;
+}
+
+static int CompareFrameTime(const void *a, const void *b)
+{
+    Ipp32u x = *(const Ipp32u*)a;
+    Ipp32u y = *(const Ipp32u*)b;
+    return (x > y) - (x < y);
+}
+
+static void FillFrameTimeStat(VmetaDecStat *pStat, Ipp32u *pFrameTimeArray, int nFrameCount)
+{
+    Ipp32u *pSorted = NULL;
+
+    if (0 >= nFrameCount) {
+        return;
+    }
+    IPP_MemMalloc((void**)(&pSorted), 4 * nFrameCount, 4);
+    if (NULL == pSorted) {
+        return;
+    }
+    IPP_Memcpy(pSorted, pFrameTimeArray, 4 * nFrameCount);
+    qsort(pSorted, nFrameCount, 4, CompareFrameTime);
+    pStat->nFrameTime[0] = pSorted[(nFrameCount - 1) * 50 / 100];
+    pStat->nFrameTime[1] = pSorted[(nFrameCount - 1) * 90 / 100];
+    pStat->nFrameTime[2] = pSorted[(nFrameCount - 1) * 99 / 100];
+    pStat->nFrameTime[3] = pSorted[nFrameCount - 1];
+    IPP_MemFree((void**)(&pSorted));
+}
+
 /*
 ***************************************************************************************
 *this function output the checksum value which is used for test.Customer need not use it.
@@ -105,6 +261,64 @@ void Output_checksum(IppVmetaPicture *pPic, IPP_FILE *f)
     }
 }
 
+/*
+* the rows of one output picture are gathered into an iovec and written with writev,
+* adjacent rows (stride equal to width) collapse into one entry.
+*/
+#define VMETA_OUT_IOV_NUM               256
+
+typedef struct _VmetaOutVec {
+    int                 fd;
+    int                 nNum;
+    int                 nErr;
+    struct iovec        iov[VMETA_OUT_IOV_NUM];
+}VmetaOutVec;
+
+static void OutVecFlush(VmetaOutVec *pVec)
+{
+    struct iovec *pIov = pVec->iov;
+    int nNum = pVec->nNum;
+    ssize_t nRet;
+
+    while (nNum > 0 && !pVec->nErr) {
+        nRet = writev(pVec->fd, pIov, nNum);
+        if (0 > nRet) {
+            pVec->nErr = 1;
+            break;
+        }
+        /*skip what was written, a short write resumes in the middle of an entry*/
+        while (nNum > 0 && nRet >= (ssize_t)pIov->iov_len) {
+            nRet -= pIov->iov_len;
+            pIov++;
+            nNum--;
+        }
+        if (nNum > 0) {
+            pIov->iov_base  = (Ipp8u*)pIov->iov_base + nRet;
+            pIov->iov_len  -= nRet;
+        }
+    }
+    pVec->nNum = 0;
+}
+
+static void OutVecAdd(VmetaOutVec *pVec, Ipp8u *p, int nLen)
+{
+    struct iovec *pLast;
+
+    if (pVec->nNum) {
+        pLast = &(pVec->iov[pVec->nNum - 1]);
+        if ((Ipp8u*)pLast->iov_base + pLast->iov_len == p) {
+            pLast->iov_len += nLen;
+            return;
+        }
+    }
+    if (VMETA_OUT_IOV_NUM == pVec->nNum) {
+        OutVecFlush(pVec);
+    }
+    pVec->iov[pVec->nNum].iov_base  = p;
+    pVec->iov[pVec->nNum].iov_len   = nLen;
+    pVec->nNum++;
+}
+
 void OutputPicture_Video(IppVmetaPicture *pPic, IPP_FILE *f, IppVmetaDecInfo *pDecInfo) 
 {
     Ipp8u *p, *pStart;
@@ -113,6 +327,7 @@ void OutputPicture_Video(IppVmetaPicture *pPic, IPP_FILE *f, IppVmetaDecInfo *pD
     int height, width;
     int top, left;
     int bROI = 1;
+    VmetaOutVec Vec;
 
     if (NULL == f){
         return;
@@ -123,6 +338,12 @@ void OutputPicture_Video(IppVmetaPicture *pPic, IPP_FILE *f, IppVmetaDecInfo *pD
         return;
     }
 
+    /*nothing buffered in the stdio stream may follow the rows*/
+    IPP_Fflush(f);
+    Vec.fd      = fileno((FILE*)f);
+    Vec.nNum    = 0;
+    Vec.nErr    = 0;
+
     if (bROI) {
         if (pPic->pic.picFormat == IPP_YCbCr422I) {
             height  = pPic->pic.picROI.height;
@@ -143,7 +364,7 @@ void OutputPicture_Video(IppVmetaPicture *pPic, IPP_FILE *f, IppVmetaDecInfo *pD
             }
             p = pStart + top * stride + left * 2;
             for (i = 0; i < height; i++) {
-                IPP_Fwrite(p, 2, width, f);
+                OutVecAdd(&Vec, p, 2 * width);
                 p += stride;
             }
         } else if (pPic->pic.picFormat == IPP_YCbCr420P) {
@@ -160,7 +381,7 @@ void OutputPicture_Video(IppVmetaPicture *pPic, IPP_FILE *f, IppVmetaDecInfo *pD
 
             p = (Ipp8u*)pPic->pic.ppPicPlane[0] + top * stride + left;
             for (i = 0; i < height; i++) {
-                IPP_Fwrite(p, 1, width, f);
+                OutVecAdd(&Vec, p, width);
                 p += stride;
             }
 
@@ -172,13 +393,13 @@ void OutputPicture_Video(IppVmetaPicture *pPic, IPP_FILE *f, IppVmetaDecInfo *pD
 
             p = (Ipp8u*)pPic->pic.ppPicPlane[1] + top * stride + left;
             for (i = 0; i < height; i++) {
-                IPP_Fwrite(p, 1, width, f);
+                OutVecAdd(&Vec, p, width);
                 p += stride;
             }
             stride   = pPic->pic.picPlaneStep[2];
             p = (Ipp8u*)pPic->pic.ppPicPlane[2] + top * stride + left;
             for (i = 0; i < height; i++) {
-                IPP_Fwrite(p, 1, width, f);
+                OutVecAdd(&Vec, p, width);
                 p += stride;
             }
         }
@@ -199,15 +420,18 @@ void OutputPicture_Video(IppVmetaPicture *pPic, IPP_FILE *f, IppVmetaDecInfo *pD
 
         p = (Ipp8u*)pPic->pic.ppPicPlane[0];
         for (i = 0; i < height; i++) {
-            IPP_Fwrite(p, 2, width, f);
+            OutVecAdd(&Vec, p, 2 * width);
             p += stride;
         }
        
     }
+    OutVecFlush(&Vec);
+    if (Vec.nErr) {
+        IPP_Printf("ID = %d error: fail to write output picture\n", pDecInfo->user_id);
+    }
 }
 
 
-
 int descramble_fake(Ipp32u nSeed0, Ipp32u nSeed1, Ipp8u *pSrc, Ipp8u *pDst, int nSize, int bResume)
 {
     IPP_Memcpy(pDst, pSrc, nSize);
@@ -219,6 +443,721 @@ int scramble_fake(IppVmetaBitstream *pBitStream)
     return 0;
 }
 
+/*
+***************************************************************************************
+* elementary stream framer: the input file is mmap'ed and cut into access units, so
+* that every stream buffer carries exactly one unit without a length file.
+* h.264 annex b, mpeg-1/2 and mpeg-4 are split at start codes, vc-1 rcv by the frame
+* size fields.
+***************************************************************************************/
+typedef struct _VmetaFramer {
+    Ipp8u               *pBase;                     /*mmap'ed input*/
+    int                 nSize;
+    int                 nPos;                       /*start of the next access unit*/
+    int                 nFmt;                       /*IPP_VIDEO_STRM_FMT_xxx*/
+    int                 bSeqDone;                   /*rcv sequence layer has been sent*/
+    Ipp8u               *pUnit;                     /*rest of a unit larger than a stream buffer*/
+    int                 nUnitLeft;
+    Ipp32u              nUnitCount;
+    Ipp32u              nSplitCount;                /*units that needed more than one stream buffer*/
+    long long           nParseTime;                 /*us*/
+}VmetaFramer;
+
+/*offset of the next 00 00 01 at or after nPos, nSize if there is none*/
+static int FindStartCode(const Ipp8u *p, int nPos, int nSize)
+{
+    Ipp32u w;
+    int i;
+
+    while ((nPos + 2 < nSize) && ((unsigned long)(p + nPos) & 3)) {
+        if ((0 == p[nPos]) && (0 == p[nPos + 1]) && (1 == p[nPos + 2])) {
+            return nPos;
+        }
+        nPos++;
+    }
+    /*a start code begins with a zero byte: test four bytes at once and look closer only at words holding one*/
+    while (nPos + 6 <= nSize) {
+        w = *(const Ipp32u*)(p + nPos);
+        if ((w - 0x01010101) & ~w & 0x80808080) {
+            for (i = 0; i < 4; i++) {
+                if ((0 == p[nPos + i]) && (0 == p[nPos + i + 1]) && (1 == p[nPos + i + 2])) {
+                    return nPos + i;
+                }
+            }
+        }
+        nPos += 4;
+    }
+    while (nPos + 2 < nSize) {
+        if ((0 == p[nPos]) && (0 == p[nPos + 1]) && (1 == p[nPos + 2])) {
+            return nPos;
+        }
+        nPos++;
+    }
+    return nSize;
+}
+
+/*
+* 1 if the start code at p opens a new access unit.
+* *pbPic tells whether the current unit already holds picture data.
+*/
+static int IsUnitStart(int nFmt, const Ipp8u *p, int nLeft, int *pbPic)
+{
+    int nCode, bStart;
+
+    if (4 > nLeft) {
+        return 0;
+    }
+    nCode   = p[3];
+    bStart  = *pbPic;
+    if (IPP_VIDEO_STRM_FMT_H264 == nFmt) {
+        nCode &= 0x1f;
+        if ((1 == nCode) || (5 == nCode)) {
+            /*first_mb_in_slice is ue(v), a leading 1 bit means 0*/
+            *pbPic = 1;
+            return bStart && (4 < nLeft) && (p[4] & 0x80);
+        }
+        if (((6 <= nCode) && (9 >= nCode)) || ((14 <= nCode) && (18 >= nCode))) {
+            *pbPic = 0;
+            return bStart;
+        }
+        return 0;
+    } else if (IPP_VIDEO_STRM_FMT_MPG4 == nFmt) {
+        if (0xb6 == nCode) {
+            /*vop*/
+            *pbPic = 1;
+            return bStart;
+        }
+        if ((0xb0 == nCode) || (0xb3 == nCode) || (0xb5 == nCode) || (0x2f >= nCode)) {
+            /*visual object sequence, gov, visual object, vo, vol*/
+            *pbPic = 0;
+            return bStart;
+        }
+        return 0;
+    } else {
+        /*mpeg-1/2*/
+        if (0x00 == nCode) {
+            *pbPic = 1;
+            return bStart;
+        }
+        if ((0xb3 == nCode) || (0xb8 == nCode)) {
+            /*sequence header, gop*/
+            *pbPic = 0;
+            return bStart;
+        }
+        return 0;
+    }
+}
+
+static int VmetaFramerOpen(VmetaFramer *pFr, IPP_FILE *fpin, int nFmt)
+{
+    struct stat st;
+    int fd;
+
+    IPP_Memset(pFr, 0, sizeof(VmetaFramer));
+    if ((IPP_VIDEO_STRM_FMT_H264 != nFmt) && (IPP_VIDEO_STRM_FMT_MPG1 != nFmt) && (IPP_VIDEO_STRM_FMT_MPG2 != nFmt)
+        && (IPP_VIDEO_STRM_FMT_MPG4 != nFmt) && (IPP_VIDEO_STRM_FMT_VC1M != nFmt)) {
+        return -1;
+    }
+    fd = fileno((FILE*)fpin);
+    if ((0 > fstat(fd, &st)) || (0 >= st.st_size)) {
+        return -1;
+    }
+    pFr->pBase = (Ipp8u*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (MAP_FAILED == pFr->pBase) {
+        pFr->pBase = NULL;
+        return -1;
+    }
+    madvise(pFr->pBase, st.st_size, MADV_SEQUENTIAL);
+    pFr->nSize  = (int)st.st_size;
+    pFr->nFmt   = nFmt;
+    return 0;
+}
+
+static void VmetaFramerClose(VmetaFramer *pFr)
+{
+    if (pFr->pBase) {
+        munmap(pFr->pBase, pFr->nSize);
+        pFr->pBase = NULL;
+    }
+}
+
+/*locate the next access unit, return its length, 0 at the end of input*/
+static int VmetaFramerNext(VmetaFramer *pFr, Ipp8u **ppUnit)
+{
+    Ipp8u *p = pFr->pBase;
+    int nStart = pFr->nPos;
+    int nLeft = pFr->nSize - nStart;
+    long long nTick;
+    int nPos, nLen, bPic;
+
+    if (0 >= nLeft) {
+        return 0;
+    }
+    nTick = IPP_TimeGetTickCount();
+    if (IPP_VIDEO_STRM_FMT_VC1M == pFr->nFmt) {
+        if (!pFr->bSeqDone) {
+            /*sequence layer, the same size the length-file-less path reads*/
+            nLen = (8 <= nLeft) ? 36 + ((p[7] << 24) | (p[6] << 16) | (p[5] << 8) | p[4]) - 4 : nLeft;
+            pFr->bSeqDone = 1;
+        } else {
+            /*frame size (24 bits) and key flag, timestamp, frame data*/
+            nLen = (4 <= nLeft) ? ((p[nStart + 2] << 16) | (p[nStart + 1] << 8) | p[nStart]) + 8 : nLeft;
+        }
+        if (nLen > nLeft || 0 >= nLen) {
+            nLen = nLeft;
+        }
+    } else {
+        bPic = 0;
+        nPos = FindStartCode(p, nStart, pFr->nSize);
+        while (nPos < pFr->nSize) {
+            if (IsUnitStart(pFr->nFmt, p + nPos, pFr->nSize - nPos, &bPic)) {
+                break;
+            }
+            nPos = FindStartCode(p, nPos + 3, pFr->nSize);
+        }
+        /*the zero_byte of a 4-byte start code belongs to the next unit*/
+        if ((nPos < pFr->nSize) && (nPos > nStart) && (0 == p[nPos - 1])) {
+            nPos--;
+        }
+        nLen = nPos - nStart;
+    }
+    pFr->nPos += nLen;
+    pFr->nUnitCount++;
+    pFr->nParseTime += IPP_TimeGetTickCount() - nTick;
+    *ppUnit = p + nStart;
+    return nLen;
+}
+
+/*
+***************************************************************************************
+* decode pipeline: a feeder thread reads the input file into stream buffers, the
+* decode thread only drives the hardware, and a writer thread stores the output
+* pictures. The stages are connected by single-producer/single-consumer rings.
+***************************************************************************************/
+#define VMETA_QUEUE_SIZE                32          /*power of 2, not less than PICTURE_BUF_NUM*/
+#define VMETA_QUEUE_POLL_US             500
+
+#define VMETA_FEED_PUSH                 0x1         /*the stream buffer carries data for the codec*/
+#define VMETA_FEED_EOS                  0x2         /*send end of stream after this buffer*/
+
+#define VMETA_BUF_FREE                  0           /*on the free-list*/
+#define VMETA_BUF_APP                   1           /*taken from the free-list, not yet pushed*/
+#define VMETA_BUF_CODEC                 2           /*pushed to the codec*/
+#define VMETA_BUF_WRITER                3           /*queued for the output writer*/
+
+typedef struct _VmetaQueue {
+    volatile Ipp32u     nHead;                      /*written by the producer only*/
+    volatile Ipp32u     nTail;                      /*written by the consumer only*/
+    void                *pItem[VMETA_QUEUE_SIZE];
+    Ipp32u              nPopCount;                  /*consumer side statistics*/
+    Ipp32u              nOccSum;
+    Ipp32u              nOccMax;
+}VmetaQueue;
+
+/*LIFO free-list of buffer indices with the owner of every buffer*/
+typedef struct _VmetaFreeList {
+    const char          *pName;
+    int                 nNum;
+    int                 nTop;
+    int                 nIdx[VMETA_QUEUE_SIZE];
+    int                 nOwner[VMETA_QUEUE_SIZE];   /*VMETA_BUF_xxx*/
+    int                 nMinFree;                   /*low watermark of nTop*/
+    Ipp32u              nGetCount;
+    Ipp32u              nStarve;                    /*times a buffer was needed but the list was empty*/
+    Ipp32u              nOwnerErr;                  /*double push or double return, bumped from the feed and decode threads*/
+}VmetaFreeList;
+
+typedef struct _VmetaDecPipe {
+    VmetaQueue          EmptyStrmQ;                 /*decode -> feeder*/
+    VmetaQueue          FilledStrmQ;                /*feeder -> decode*/
+    VmetaQueue          OutPicQ;                    /*decode -> writer*/
+    VmetaQueue          FreePicQ;                   /*writer -> decode*/
+    volatile int        bFeedDone;
+    volatile int        bExit;
+    int                 nFeedFlag[STREAM_BUF_NUM];  /*VMETA_FEED_xxx, indexed by pUsrData0*/
+    VmetaFreeList       StrmList;                   /*get/put by the feeder*/
+    VmetaFreeList       PicList;                    /*decode thread only*/
+    IppVmetaBitstream   *pStrmGroup;
+
+    /*feeder*/
+    IPP_FILE            *fpin;
+    IPP_FILE            *fplen;
+    VmetaFramer         *pFramer;                   /*NULL: read the file as before*/
+    IppVmetaDecParSet   *pDecParSet;
+    IppVmetaDecParSetEx *pDecParSetEx;
+    int                 nLeftBytes;
+    int                 bReadSeqLayer;
+    int                 nFeedCount;
+    Ipp32u              nFeedWait;                  /*polls spent waiting for an empty stream buffer*/
+
+    /*writer*/
+    IPP_FILE            *fpout;
+    IppVmetaDecInfo     *pDecInfo;
+    DISPLAY_CB          *hDispCB;
+    Ipp32u              nWriteWait;                 /*polls spent waiting for a decoded picture*/
+    long long           nWriteTime;                 /*us spent in OutputPicture_Video*/
+    VmetaGolden         *pGolden;                   /*NULL: no on the fly compare*/
+    volatile int        bMismatch;                  /*set by the writer, decoding stops*/
+    int                 nPicInWriter;               /*decode thread only*/
+}VmetaDecPipe;
+
+static void VmetaQueueInit(VmetaQueue *pQueue)
+{
+    IPP_Memset(pQueue, 0, sizeof(VmetaQueue));
+}
+
+static int VmetaQueuePush(VmetaQueue *pQueue, void *pItem)
+{
+    Ipp32u nHead = pQueue->nHead;
+
+    if (VMETA_QUEUE_SIZE <= nHead - pQueue->nTail) {
+        return -1;
+    }
+    pQueue->pItem[nHead & (VMETA_QUEUE_SIZE - 1)] = pItem;
+    /*publish the item before the new head*/
+    __sync_synchronize();
+    pQueue->nHead = nHead + 1;
+    return 0;
+}
+
+static void *VmetaQueuePop(VmetaQueue *pQueue)
+{
+    Ipp32u nTail = pQueue->nTail;
+    Ipp32u nOcc = pQueue->nHead - nTail;
+    void *pItem;
+
+    if (0 == nOcc) {
+        return NULL;
+    }
+    __sync_synchronize();
+    pItem = pQueue->pItem[nTail & (VMETA_QUEUE_SIZE - 1)];
+    pQueue->nOccSum += nOcc;
+    if (nOcc > pQueue->nOccMax) {
+        pQueue->nOccMax = nOcc;
+    }
+    pQueue->nPopCount++;
+    /*the slot is reusable once the item has been read*/
+    __sync_synchronize();
+    pQueue->nTail = nTail + 1;
+    return pItem;
+}
+
+static void VmetaFreeListInit(VmetaFreeList *pList, const char *pName, int nNum)
+{
+    int i;
+
+    IPP_Memset(pList, 0, sizeof(VmetaFreeList));
+    pList->pName    = pName;
+    pList->nNum     = nNum;
+    /*buffer 0 on top*/
+    for (i = 0; i < nNum; i++) {
+        pList->nIdx[i]  = nNum - 1 - i;
+    }
+    pList->nTop     = nNum;
+    pList->nMinFree = nNum;
+}
+
+/*take the most recently returned buffer, -1 if the list is empty*/
+static int VmetaFreeListGet(VmetaFreeList *pList)
+{
+    int nIdx;
+
+    if (0 == pList->nTop) {
+        return -1;
+    }
+    nIdx = pList->nIdx[--pList->nTop];
+    pList->nOwner[nIdx] = VMETA_BUF_APP;
+    pList->nGetCount++;
+    if (pList->nTop < pList->nMinFree) {
+        pList->nMinFree = pList->nTop;
+    }
+    return nIdx;
+}
+
+/*move a buffer from one owner to another, -1 if nFrom does not own it*/
+static int VmetaBufTransfer(VmetaFreeList *pList, int nIdx, int nFrom, int nTo)
+{
+    if (pList->nOwner[nIdx] != nFrom) {
+        IPP_Printf("error: %s buf %d is owned by %d, expect %d\n", pList->pName, nIdx, pList->nOwner[nIdx], nFrom);
+        __sync_fetch_and_add(&pList->nOwnerErr, 1);
+        return -1;
+    }
+    pList->nOwner[nIdx] = nTo;
+    return 0;
+}
+
+static int VmetaFreeListPut(VmetaFreeList *pList, int nIdx)
+{
+    if (VMETA_BUF_FREE == pList->nOwner[nIdx]) {
+        IPP_Printf("error: %s buf %d is returned twice\n", pList->pName, nIdx);
+        __sync_fetch_and_add(&pList->nOwnerErr, 1);
+        return -1;
+    }
+    pList->nOwner[nIdx] = VMETA_BUF_FREE;
+    pList->nIdx[pList->nTop++] = nIdx;
+    return 0;
+}
+
+static void VmetaFreeListPrint(int nUserId, VmetaFreeList *pList)
+{
+    IPP_Printf("ID = %d [BUF] %-4s: get %u starved %u min free %d of %d owner error %u\n", nUserId, pList->pName,
+        pList->nGetCount, pList->nStarve, pList->nMinFree, pList->nNum, pList->nOwnerErr);
+}
+
+static void VmetaQueuePrint(int nUserId, const char *pName, VmetaQueue *pQueue)
+{
+    IPP_Printf("ID = %d [PIPE] %-9s: pop %u avg occupancy %f max %u\n", nUserId, pName, pQueue->nPopCount,
+        pQueue->nPopCount ? (float)pQueue->nOccSum / pQueue->nPopCount : 0.0f, pQueue->nOccMax);
+}
+
+static int VmetaFeedFramed(VmetaDecPipe *pPipe, IppVmetaBitstream *pBitStream);
+
+/*
+* fill one stream buffer from the input file, return VMETA_FEED_xxx flags.
+* this is the read part of the former IPP_STATUS_NEED_INPUT handling.
+*/
+static int VmetaFeedStrmBuf(VmetaDecPipe *pPipe, IppVmetaBitstream *pBitStream)
+{
+    IppVmetaDecParSet *pDecParSet = pPipe->pDecParSet;
+    IppVmetaDecParSetEx *pDecParSetEx = pPipe->pDecParSetEx;
+    IPP_FILE *fpin = pPipe->fpin;
+    int bLog = (0 == pDecParSetEx->bLessInfo) || (pPipe->nFeedCount <= LESSINFO_MAX_FRAME);
+    Ipp8u pReadBuf[10];
+    Ipp32u nVal;
+    int nFrameLen = 0;
+    int nReadNum;
+    int nFlag = 0;
+
+    if (pPipe->pFramer) {
+        return VmetaFeedFramed(pPipe, pBitStream);
+    }
+
+    pBitStream->nDataLen    = 0;
+    pBitStream->nOffset     = 0;
+    pBitStream->nFlag       = 0; /*default value means neither end of frame nor end of unit*/
+
+    if (pPipe->fplen || (IPP_VIDEO_STRM_FMT_VC1M == pDecParSet->strm_fmt)) {
+        if (pPipe->nLeftBytes) {
+            if (pPipe->nLeftBytes > STREAM_BUF_SIZE) {
+                nFrameLen = STREAM_BUF_SIZE;
+            } else {
+                nFrameLen = pPipe->nLeftBytes;
+            }
+        } else {
+            if (IPP_VIDEO_STRM_FMT_VC1M == pDecParSet->strm_fmt) {
+                /* this offset is not necessary, but with it, maybe avoid internal memory copy*/
+                pBitStream->nOffset += VMETA_COM_PKT_HDR_SIZE;
+                if (pPipe->bReadSeqLayer) {
+                    /*read sequence layer data*/
+                    IPP_Fread(pReadBuf, 1, 4, fpin);
+                    IPP_Fread(pReadBuf, 1, 4, fpin);
+                    IPP_Fseek(fpin, 0, IPP_SEEK_SET);
+                    nVal = (pReadBuf[3] << 24) | (pReadBuf[2] << 16) | (pReadBuf[1] << 8) | (pReadBuf[0]);
+                    nFrameLen               = 36 + (nVal - 4);
+                    pPipe->bReadSeqLayer    = 0;
+                } else {
+                    /*read frame layer data*/
+                    nReadNum = IPP_Fread(pReadBuf, 1, 4, fpin);
+                    if (4 == nReadNum) {
+                        nFrameLen   = (pReadBuf[2] << 16) | (pReadBuf[1] << 8) | (pReadBuf[0]);
+                        /*include framesize and timestamp*/
+                        IPP_Fseek(fpin, -4, IPP_SEEK_CUR);
+                        nFrameLen  += 8; /* the size of timestamp*/
+                    } else {
+                        nFrameLen   = 0;
+                    }
+                }
+                pPipe->nLeftBytes = nFrameLen;
+                if (STREAM_BUF_SIZE < (nFrameLen + pBitStream->nOffset)) {
+                    nFrameLen = STREAM_BUF_SIZE - pBitStream->nOffset;
+                }
+                if (bLog) {
+                    IPP_Printf("ID = %d framelen = %d to read num = %d\n", pPipe->pDecInfo->user_id, pPipe->nLeftBytes, nFrameLen);
+                }
+            } else {
+                IPP_Fscanf(pPipe->fplen, "%d", &nFrameLen);
+                pPipe->nLeftBytes = nFrameLen;
+                if (STREAM_BUF_SIZE < nFrameLen) {
+                    nFrameLen = STREAM_BUF_SIZE;
+                }
+            }
+        }
+
+        nReadNum = IPP_Fread(pBitStream->pBuf + pBitStream->nOffset + pBitStream->nDataLen, 1, nFrameLen, fpin);
+        if (nReadNum) {
+            pBitStream->nDataLen    += nReadNum;
+            pPipe->nLeftBytes       -= nReadNum;
+
+            if (bLog) {
+                IPP_Printf("ID = %d framelen = %d readnum = %d\n", pPipe->pDecInfo->user_id, nFrameLen, nReadNum);
+            }
+
+            if (0 >= pPipe->nLeftBytes) {
+                if (pDecParSetEx->bNoOutputDelay) {
+                    /*for no-output-delay feature, user must attach end-of-frame flag.*/
+                    pBitStream->nFlag  |= IPP_VMETA_STRM_BUF_END_OF_FRAME;
+                } else {
+                    /*if user doesn't need no-output-delay feature, end-of-unit flag is enough. end-of-frame flag is also right.*/
+                    pBitStream->nFlag  |= IPP_VMETA_STRM_BUF_END_OF_UNIT;
+                }
+                pPipe->nLeftBytes   = 0;
+            }
+
+            if (pDecParSetEx->bDrmEnable) {
+                scramble_fake(pBitStream);
+            }
+            nFlag |= VMETA_FEED_PUSH;
+        }
+        if ((nFrameLen != nReadNum) || (0 == nReadNum)) {
+            nFlag |= VMETA_FEED_EOS;
+        }
+    } else {
+        nReadNum = IPP_Fread(pBitStream->pBuf, 1, STREAM_BUF_SIZE, fpin);
+        pBitStream->nDataLen = STREAM_BUF_SIZE;
+        nFlag |= VMETA_FEED_PUSH;
+        if (STREAM_BUF_SIZE != nReadNum) {
+            /*end of file*/
+            IPP_Printf("ID = %d add end of unit flag!\n", pPipe->pDecInfo->user_id);
+            pBitStream->nFlag      |= IPP_VMETA_STRM_BUF_END_OF_UNIT;
+            pBitStream->nDataLen    = nReadNum;
+            nFlag |= VMETA_FEED_EOS;
+        }
+    }
+    pPipe->nFeedCount++;
+    return nFlag;
+}
+
+/*fill one stream buffer with the next access unit of the framer*/
+static int VmetaFeedFramed(VmetaDecPipe *pPipe, IppVmetaBitstream *pBitStream)
+{
+    VmetaFramer *pFr = pPipe->pFramer;
+    int nLen;
+
+    pBitStream->nDataLen    = 0;
+    pBitStream->nOffset     = 0;
+    pBitStream->nFlag       = 0;
+    if (IPP_VIDEO_STRM_FMT_VC1M == pFr->nFmt) {
+        /* this offset is not necessary, but with it, maybe avoid internal memory copy*/
+        pBitStream->nOffset += VMETA_COM_PKT_HDR_SIZE;
+    }
+
+    if (0 == pFr->nUnitLeft) {
+        pFr->nUnitLeft = VmetaFramerNext(pFr, &pFr->pUnit);
+        if (0 == pFr->nUnitLeft) {
+            return VMETA_FEED_EOS;
+        }
+        if (pFr->nUnitLeft > STREAM_BUF_SIZE - (int)pBitStream->nOffset) {
+            pFr->nSplitCount++;
+        }
+    }
+    nLen = pFr->nUnitLeft;
+    if (nLen > STREAM_BUF_SIZE - (int)pBitStream->nOffset) {
+        nLen = STREAM_BUF_SIZE - pBitStream->nOffset;
+    }
+    IPP_Memcpy(pBitStream->pBuf + pBitStream->nOffset, pFr->pUnit, nLen);
+    pBitStream->nDataLen    = nLen;
+    pFr->pUnit             += nLen;
+    pFr->nUnitLeft         -= nLen;
+    if (0 == pFr->nUnitLeft) {
+        if (pPipe->pDecParSetEx->bNoOutputDelay) {
+            pBitStream->nFlag  |= IPP_VMETA_STRM_BUF_END_OF_FRAME;
+        } else {
+            pBitStream->nFlag  |= IPP_VMETA_STRM_BUF_END_OF_UNIT;
+        }
+    }
+    if (pPipe->pDecParSetEx->bDrmEnable) {
+        scramble_fake(pBitStream);
+    }
+    pPipe->nFeedCount++;
+    return VMETA_FEED_PUSH;
+}
+
+static int VmetaFeedThread(void *pParam)
+{
+    VmetaDecPipe *pPipe = (VmetaDecPipe*)pParam;
+    IppVmetaBitstream *pBitStream;
+    int nIdx, nFlag;
+    int bStarved = 0;
+
+    while (!pPipe->bExit) {
+        /*buffers given back by the decode thread go on top of the free-list*/
+        while (NULL != (pBitStream = (IppVmetaBitstream*)VmetaQueuePop(&pPipe->EmptyStrmQ))) {
+            VmetaFreeListPut(&pPipe->StrmList, (int)pBitStream->pUsrData0);
+        }
+        nIdx = VmetaFreeListGet(&pPipe->StrmList);
+        if (0 > nIdx) {
+            if (!bStarved) {
+                pPipe->StrmList.nStarve++;
+                bStarved = 1;
+            }
+            pPipe->nFeedWait++;
+            IPP_Sleep(VMETA_QUEUE_POLL_US);
+            continue;
+        }
+        bStarved = 0;
+        pBitStream = &(pPipe->pStrmGroup[nIdx]);
+        nFlag = VmetaFeedStrmBuf(pPipe, pBitStream);
+        pPipe->nFeedFlag[(int)pBitStream->pUsrData0] = nFlag;
+        VmetaQueuePush(&pPipe->FilledStrmQ, pBitStream);
+        if (nFlag & VMETA_FEED_EOS) {
+            break;
+        }
+    }
+    /*the last buffer is visible before the done flag*/
+    __sync_synchronize();
+    pPipe->bFeedDone = 1;
+    return 0;
+}
+
+static int VmetaWriteThread(void *pParam)
+{
+    VmetaDecPipe *pPipe = (VmetaDecPipe*)pParam;
+    IppVmetaPicture *pPicture;
+    long long nStart;
+
+    while (!pPipe->bExit) {
+        pPicture = (IppVmetaPicture*)VmetaQueuePop(&pPipe->OutPicQ);
+        if (NULL == pPicture) {
+            pPipe->nWriteWait++;
+            IPP_Sleep(VMETA_QUEUE_POLL_US);
+            continue;
+        }
+        if (pPipe->pGolden && (0 > VmetaGoldenCheck(pPipe->pGolden, pPicture))) {
+            pPipe->bMismatch = 1;
+        }
+        nStart = IPP_TimeGetTickCount();
+        OutputPicture_Video(pPicture, pPipe->fpout, pPipe->pDecInfo);
+        pPipe->nWriteTime += IPP_TimeGetTickCount() - nStart;
+        display_frame(pPipe->hDispCB, &pPicture->pic);
+        VmetaQueuePush(&pPipe->FreePicQ, pPicture);
+    }
+    return 0;
+}
+
+/*hand a popped picture to the writer, a picture without data is recycled at once*/
+static int VmetaPipeOutPic(VmetaDecPipe *pPipe, IppVmetaPicture *pPicture)
+{
+    int nIdx = (int)pPicture->pUsrData0;
+
+    if (0 < pPicture->nDataLen) {
+        if (0 == VmetaBufTransfer(&pPipe->PicList, nIdx, VMETA_BUF_CODEC, VMETA_BUF_WRITER)) {
+            VmetaQueuePush(&pPipe->OutPicQ, pPicture);
+            pPipe->nPicInWriter++;
+        }
+        return 0;
+    }
+    if (0 > VmetaFreeListPut(&pPipe->PicList, nIdx)) {
+        return 0;
+    }
+    bFreePicBufFlag[nIdx] = 1;
+    return 1;
+}
+
+/*take back the pictures the writer has finished with, return the number of them*/
+static int VmetaPipeReclaimPic(VmetaDecPipe *pPipe)
+{
+    IppVmetaPicture *pPicture;
+    int nNum = 0;
+
+    while (NULL != (pPicture = (IppVmetaPicture*)VmetaQueuePop(&pPipe->FreePicQ))) {
+        pPipe->nPicInWriter--;
+        if (0 == VmetaFreeListPut(&pPipe->PicList, (int)pPicture->pUsrData0)) {
+            bFreePicBufFlag[(int)pPicture->pUsrData0] = 1;
+            nNum++;
+        }
+    }
+    return nNum;
+}
+
+/*give a stream buffer popped from the codec back to the feeder*/
+static void VmetaPipeReturnStrm(VmetaDecPipe *pPipe, IppVmetaBitstream *pBitStream)
+{
+    if (0 == VmetaBufTransfer(&pPipe->StrmList, (int)pBitStream->pUsrData0, VMETA_BUF_CODEC, VMETA_BUF_APP)) {
+        VmetaQueuePush(&pPipe->EmptyStrmQ, pBitStream);
+    }
+}
+
+/*wait until the writer has stored every picture handed to it*/
+static int VmetaPipeDrainWriter(VmetaDecPipe *pPipe)
+{
+    int nNum = 0;
+
+    while (1) {
+        nNum += VmetaPipeReclaimPic(pPipe);
+        if (0 == pPipe->nPicInWriter) {
+            break;
+        }
+        IPP_Sleep(VMETA_QUEUE_POLL_US);
+    }
+    return nNum;
+}
+
+/*
+* display buffer pool: new buffers are sized for the largest of the recent sequences so
+* that streams switching back and forth between resolutions reuse them in place. A
+* buffer larger than every recent sequence is retired only when it is taken again.
+*/
+#define VMETA_POOL_SEQ_WINDOW           4
+
+typedef struct _VmetaPicPool {
+    int                 nSeqSize[VMETA_POOL_SEQ_WINDOW];   /*dis_buf_size of the recent sequences*/
+    int                 nSeqNum;
+    int                 nAllocSize;                 /*max of nSeqSize*/
+    Ipp32u              nAllocCount;
+    Ipp32u              nGrowCount;
+    Ipp32u              nRetireCount;
+    Ipp32u              nReuseCount;
+    long long           nSeqStart;                  /*tick of the pending sequence change, 0 if none*/
+    Ipp32u              nSeqLatCount;
+    Ipp32u              nSeqLatSum;                 /*us*/
+    Ipp32u              nSeqLatMax;
+}VmetaPicPool;
+
+static void VmetaPicPoolNewSeq(VmetaPicPool *pPool, int nDisBufSize)
+{
+    int i;
+
+    pPool->nSeqSize[pPool->nSeqNum % VMETA_POOL_SEQ_WINDOW] = nDisBufSize;
+    pPool->nSeqNum++;
+    pPool->nAllocSize = 0;
+    for (i = 0; i < VMETA_POOL_SEQ_WINDOW; i++) {
+        if (pPool->nSeqSize[i] > pPool->nAllocSize) {
+            pPool->nAllocSize = pPool->nSeqSize[i];
+        }
+    }
+}
+
+/*first picture of a new sequence is out, account the sequence change latency*/
+static void VmetaPicPoolSeqDone(VmetaPicPool *pPool)
+{
+    Ipp32u nLat;
+
+    if (0 == pPool->nSeqStart) {
+        return;
+    }
+    nLat = (Ipp32u)(IPP_TimeGetTickCount() - pPool->nSeqStart);
+    pPool->nSeqStart = 0;
+    pPool->nSeqLatCount++;
+    pPool->nSeqLatSum += nLat;
+    if (nLat > pPool->nSeqLatMax) {
+        pPool->nSeqLatMax = nLat;
+    }
+}
+
+/*bits per pixel of a display picture in output format nFmt, for the carve-out*/
+static int VmetaPicBits(int nFmt)
+{
+    switch (nFmt) {
+    case IPP_YCbCr420P:
+    case IPP_YCbCr420SP:
+    case IPP_YCrCb420SP:
+        return 12;
+    default:
+        /*4:2:2 interleaved and anything unknown*/
+        return 16;
+    }
+}
+
 int VmetaDecoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IPP_FILE *fplen, IppVmetaDecParSet *pDecParSet, IppVmetaDecParSetEx *pDecParSetEx)
 {
     void *pDecoderState;
@@ -233,10 +1172,8 @@ int VmetaDecoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IPP_FILE
     IppVmetaDecInfo VideoDecInfo;
     IppVmetaPicture *pPicture;
     IppVmetaDecInfo *pDecInfo;
-    int nReadNum;
     int nCurStrmBufIdx;
     int nCurPicBufIdx;
-    int bFreeStrmBufFlag[STREAM_BUF_NUM];
 
     int bStop;
     int nTotalFrames, nSkipFrames;
@@ -266,13 +1203,6 @@ int VmetaDecoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IPP_FILE
 
     int ret;
     IPP_FILE *flen = NULL;
-    int nFrameLen;
-    int nLeftBytes;
-
-    int bReadSeqLayer;
-    Ipp8u pReadBuf[10];
-    vc1m_seq_header Vc1mSeqHdr;
-    Ipp32u nVal;
     Ipp32u nCumulTime, nOldCumulTime;
     Ipp32u nMaxFrameTime, nMinFrameTime, nFrameTime;
     Ipp32u nFrameCount;
@@ -281,8 +1211,33 @@ int VmetaDecoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IPP_FILE
     Ipp32u nVmetaRTLVer;
     IppEnableSwMpeg4DecPar EnableSwMpeg4DecPar;
     IppVmetaInputMode eSwMpeg4InputMode;
+    vmeta_arena *pArena;
+    vmeta_arena_stat ArenaStat;
+    vmeta_carveout *pCarveout;
+    vmeta_carveout_stat CarveoutStat;
+    Ipp32u nResPicSize;
+    VmetaDecPipe Pipe;
+    IppThread hFeedThread, hWriteThread;
+    int perf_idle_index;
+    int nIdleTime;
+    int bIdle, bFeedDone, nFeedFlag;
+    int nStrmStarve, nPicStarve;
+    VmetaPicPool Pool;
+    VmetaFramer Framer;
+    int bFrameIn;
+    VmetaGolden Golden;
+    int bGoldenFail;
 
     pDecoderState   = NULL;
+    hFeedThread     = 0;
+    hWriteThread    = 0;
+    IPP_Memset(&Pipe, 0, sizeof(VmetaDecPipe));
+    IPP_Memset(&Pool, 0, sizeof(VmetaPicPool));
+    IPP_Memset(&Framer, 0, sizeof(VmetaFramer));
+    IPP_Memset(&Golden, 0, sizeof(VmetaGolden));
+    bGoldenFail     = 0;
+    pArena          = NULL;
+    pCarveout       = NULL;
     pFrameTimeArray = NULL;
     for (i = 0; i < STREAM_BUF_NUM; i++) {
         BitStreamGroup[i].pBuf = NULL;
@@ -298,12 +1253,35 @@ int VmetaDecoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IPP_FILE
     IPP_Printf("input buffer number: %d\n", STREAM_BUF_NUM);
     IPP_Printf("input buffer size: %d\n", STREAM_BUF_SIZE);
     IPP_Printf("output buffer number: %d\n", PICTURE_BUF_NUM);
-    if (NULL != fplen) {
+    if ('\0' != g_GoldenFile[0]) {
+        if (0 != VmetaGoldenLoad(&Golden, g_GoldenFile)) {
+            IPP_Printf("error: fail to load golden checksum file %s\n", g_GoldenFile);
+            IPP_Log(log_file_name, "a", "error: fail to load golden checksum file %s\n", g_GoldenFile);
+            VmetaGoldenFree(&Golden);
+            return IPP_FAIL;
+        }
+        IPP_Printf("golden checksum: %d entries from %s\n", Golden.nNum, g_GoldenFile);
+    }
+    if (pDecParSetEx->bFramer) {
+        if (0 == VmetaFramerOpen(&Framer, fpin, pDecParSet->strm_fmt)) {
+            IPP_Printf("access unit framer for format %d, input size %d\n", pDecParSet->strm_fmt, Framer.nSize);
+            if (fplen) {
+                IPP_Printf("framer on, length file is ignored\n");
+            }
+        } else {
+            IPP_Printf("warning: no framer for format %d or input not mappable, read the file as before\n", pDecParSet->strm_fmt);
+            pDecParSetEx->bFramer = 0;
+        }
+    }
+    bFrameIn = (NULL != fplen) || pDecParSetEx->bFramer;
+    if (bFrameIn) {
         IPP_Printf("entire frame mode!\n");
     } else {
         if (IPP_VMETA_INPUT_MODE_PARTIAL_END_OF_FRAME == pDecParSetEx->eInputMode) {
             IPP_Printf("error:to set frame-in mode, but no length file!\n");
             IPP_Log(log_file_name, "a", "error:to set frame-in mode, but no length file\n");
+            VmetaFramerClose(&Framer);
+            VmetaGoldenFree(&Golden);
             return IPP_FAIL;
         }
         IPP_Printf("stream in mode!\n");
@@ -317,6 +1295,23 @@ int VmetaDecoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IPP_FILE
     }
     IPP_Printf("after driver init\n");
 
+    if (pDecParSetEx->nResWidth && pDecParSetEx->nResHeight) {
+        nResPicSize = vdec_os_api_carveout_pic_size(pDecParSetEx->nResWidth, pDecParSetEx->nResHeight,
+            VmetaPicBits(pDecParSet->opt_fmt));
+        pCarveout = vdec_os_api_carveout_reserve(pDecParSetEx->nResWidth, pDecParSetEx->nResHeight,
+            pDecParSetEx->nResNum, nResPicSize);
+        if (NULL == pCarveout) {
+            IPP_Printf("warning: carve-out %dx%d x %d not reserved, use dma alloc\n",
+                pDecParSetEx->nResWidth, pDecParSetEx->nResHeight, pDecParSetEx->nResNum);
+        } else {
+            /*the region is capped, pictures past it are dma allocated*/
+            vdec_os_api_carveout_get_stat(pCarveout, &CarveoutStat);
+            IPP_Printf("reserve carve-out %dx%d x %d (holds %u), size = %u, time = %u (us)\n",
+                pDecParSetEx->nResWidth, pDecParSetEx->nResHeight, pDecParSetEx->nResNum,
+                CarveoutStat.size / ((nResPicSize + 4095) & ~4095), CarveoutStat.size, CarveoutStat.reserve_us);
+        }
+    }
+
     IPP_GetPerfCounter(&codec_perf_index, DEFAULT_TIMINGFUNC_START, DEFAULT_TIMINGFUNC_STOP);
     IPP_ResetPerfCounter(codec_perf_index);
 
@@ -337,6 +1332,9 @@ int VmetaDecoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IPP_FILE
     IPP_GetPerfCounter(&perf_cmd_index, DEFAULT_TIMINGFUNC_START, DEFAULT_TIMINGFUNC_STOP);
     IPP_ResetPerfCounter(perf_cmd_index);
 
+    IPP_GetPerfCounter(&perf_idle_index, DEFAULT_TIMINGFUNC_START, DEFAULT_TIMINGFUNC_STOP);
+    IPP_ResetPerfCounter(perf_idle_index);
+
     
     IPP_GetPerfCounter(&total_perf_index, IPP_TimeGetTickCount, IPP_TimeGetTickCount);
     IPP_ResetPerfCounter(total_perf_index);
@@ -371,7 +1369,6 @@ int VmetaDecoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IPP_FILE
             BitStreamGroup[i].pUsrData3             = NULL;
         }
         BitStreamGroup[i].nFlag                     = 0;
-        bFreeStrmBufFlag[i]                         = 1;
     }
 
     for (i = 0; i < PICTURE_BUF_NUM; i++) {
@@ -398,6 +1395,15 @@ int VmetaDecoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IPP_FILE
         goto fail_cleanup;
     }
 
+    /* codec internal vmalloc of this instance comes from one arena */
+    pArena = vdec_os_api_arena_create(0);
+    if (NULL == pArena) {
+        IPP_Printf("error: no memory\n");
+        IPP_Log(log_file_name, "a", "error: no memory\n");
+        goto fail_cleanup;
+    }
+    vdec_os_api_arena_bind(pArena);
+
     IPP_Printf("before DecoderInitAlloc_Vmeta!\n");
     rtCode = DecoderInitAlloc_Vmeta(pDecParSet, &CBTable, &pDecoderState);
     IPP_Printf("after DecoderInitAlloc_Vmeta!\n");
@@ -450,7 +1456,7 @@ int VmetaDecoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IPP_FILE
     }
 
     if (pDecParSetEx->bDrmEnable) {
-        if (!fplen) {
+        if (!bFrameIn) {
             IPP_Printf("Error: to enable drm, must be frame-in mode\n");
             goto fail_cleanup;
         }
@@ -511,8 +1517,6 @@ int VmetaDecoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IPP_FILE
     nFreeStrmBufNum     = STREAM_BUF_NUM;
     nFreePicBufNum      = PICTURE_BUF_NUM;
     bInitLCD            = 0;
-    nLeftBytes          = 0;
-    bReadSeqLayer       = 1;
 
     nCumulTime          = 0;
     nOldCumulTime       = 0;
@@ -520,9 +1524,45 @@ int VmetaDecoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IPP_FILE
     nMinFrameTime       = 0xffffffff;
     nFrameTime          = 0;
     nFrameCount         = 0;
+    nStrmStarve         = 0;
+    nPicStarve          = 0;
+
+    VmetaQueueInit(&Pipe.EmptyStrmQ);
+    VmetaQueueInit(&Pipe.FilledStrmQ);
+    VmetaQueueInit(&Pipe.OutPicQ);
+    VmetaQueueInit(&Pipe.FreePicQ);
+    Pipe.fpin           = fpin;
+    Pipe.fplen          = fplen;
+    Pipe.pFramer        = pDecParSetEx->bFramer ? &Framer : NULL;
+    Pipe.pGolden        = ('\0' != g_GoldenFile[0]) ? &Golden : NULL;
+    Pipe.pDecParSet     = pDecParSet;
+    Pipe.pDecParSetEx   = pDecParSetEx;
+    Pipe.bReadSeqLayer  = 1;
+    Pipe.fpout          = fpout;
+    Pipe.pDecInfo       = pDecInfo;
+    Pipe.hDispCB        = hDispCB;
+    Pipe.pStrmGroup     = BitStreamGroup;
+    VmetaFreeListInit(&Pipe.StrmList, "strm", STREAM_BUF_NUM);
+    VmetaFreeListInit(&Pipe.PicList, "pic", PICTURE_BUF_NUM);
 
     IPP_StartPerfCounter(total_perf_index);
+    if (0 != IPP_ThreadCreate(&hFeedThread, 0, VmetaFeedThread, &Pipe)
+        || 0 != IPP_ThreadCreate(&hWriteThread, 0, VmetaWriteThread, &Pipe)) {
+        IPP_Printf("error: fail to create decode pipeline threads\n");
+        IPP_Log(log_file_name, "a", "error: fail to create decode pipeline threads\n");
+        goto fail_cleanup;
+    }
     while(!bStop) {
+        if (Pipe.StrmList.nOwnerErr || Pipe.PicList.nOwnerErr) {
+            IPP_Printf("ID = %d error: buffer ownership is broken!\n", pDecInfo->user_id);
+            IPP_Log(log_file_name, "a", "error: buffer ownership is broken!\n");
+            goto fail_cleanup;
+        }
+        if (Pipe.bMismatch) {
+            /*the frame is reported once the output thread is joined, it owns Golden until then*/
+            IPP_Printf("ID = %d golden checksum mismatch, stop decoding\n", pDecInfo->user_id);
+            break;
+        }
         IPP_StartPerfCounter(codec_perf_index);
         IPP_StartPerfCounter(thread_perf_index);
         rtCode = DecodeFrame_Vmeta(pDecInfo, pDecoderState);
@@ -530,202 +1570,70 @@ int VmetaDecoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IPP_FILE
         IPP_StopPerfCounter(codec_perf_index);
 
         if (IPP_STATUS_NEED_INPUT == rtCode) {
-            if (0 >= nFreeStrmBufNum) {
-                /*for multi-instance, input buffer may not be explicitly returned*/
-                if( (0 == pDecParSetEx->bLessInfo) || nTotalFrames<=LESSINFO_MAX_FRAME) {
-                    IPP_Printf("ID = %d nFreeStrmBufNum == 0, try to pop implicitly returned input buffers\n", pDecInfo->user_id);
+            bIdle = 0;
+            while (1) {
+                /*read the done flag first, the feeder sets it after its last buffer*/
+                bFeedDone = Pipe.bFeedDone;
+                __sync_synchronize();
+                pBitStream = (IppVmetaBitstream*)VmetaQueuePop(&Pipe.FilledStrmQ);
+                if ((NULL != pBitStream) || bFeedDone) {
+                    break;
                 }
-                while (1) {
-                    IPP_StartPerfCounter(perf_pop_strm_index);
-                    DecoderPopBuffer_Vmeta(IPP_VMETA_BUF_TYPE_STRM, (void**)&pBitStream, pDecoderState);
-                    IPP_StopPerfCounter(perf_pop_strm_index);
-                    if (NULL == pBitStream) {
-                        break;
-                    }
-                    bFreeStrmBufFlag[(int)pBitStream->pUsrData0] = 1;
-                    nFreeStrmBufNum++;
+                if (0 >= nFreeStrmBufNum) {
+                    /*for multi-instance, input buffer may not be explicitly returned*/
                     if( (0 == pDecParSetEx->bLessInfo) || nTotalFrames<=LESSINFO_MAX_FRAME) {
-                        IPP_Printf("ID = %d pop strm buf finish. strm buf id: %d\n", pDecInfo->user_id, (int)pBitStream->pUsrData0);
+                        IPP_Printf("ID = %d nFreeStrmBufNum == 0, try to pop implicitly returned input buffers\n", pDecInfo->user_id);
                     }
-                }
-            }
-            if( (0 == pDecParSetEx->bLessInfo) || nTotalFrames<=LESSINFO_MAX_FRAME) {
-                IPP_Printf("ID = %d nFreeStrmBufNum = %d\n", pDecInfo->user_id, nFreeStrmBufNum);
-            }
-            nCurStrmBufIdx = 0;
-            while ((0 == bFreeStrmBufFlag[nCurStrmBufIdx]) && (STREAM_BUF_NUM > nCurStrmBufIdx)) {
-                nCurStrmBufIdx++;
-            }
-            if (STREAM_BUF_NUM <= nCurStrmBufIdx) {
-                IPP_Printf("ID = %d error: strm buf is not enough!\n", pDecInfo->user_id);
-                goto fail_cleanup;
-            }
-
-            pBitStream = &(BitStreamGroup[nCurStrmBufIdx]);
-            bFreeStrmBufFlag[nCurStrmBufIdx] = 0;
-            nFreeStrmBufNum--;
-            pBitStream->nDataLen    = 0;
-            pBitStream->nOffset     = 0;
-            pBitStream->nFlag       = 0; /*default value means neither end of frame nor end of unit*/
-
-            if (fplen || (IPP_VIDEO_STRM_FMT_VC1M == pDecParSet->strm_fmt)) {
-                if (nLeftBytes) {
-                    if (nLeftBytes > STREAM_BUF_SIZE) {
-                        nFrameLen = STREAM_BUF_SIZE;
-                    } else {
-                        nFrameLen = nLeftBytes;
-                    }
-                } else {
-                    if (IPP_VIDEO_STRM_FMT_VC1M == pDecParSet->strm_fmt) {
-#if 0
-                        if (bReadSeqLayer) {
-                            /*parse sequence layer data*/
-                            IPP_Memset(&Vc1mSeqHdr, 0, sizeof(vc1m_seq_header));
-                            IPP_Fread(pReadBuf, 1, 4, fpin);
-                            /*num_frames(not need)*/
-                            //Vc1mSeqHdr.num_frames = (pReadBuf[2] << 16) | (pReadBuf[1] << 8) | (pReadBuf[0]);
-                            IPP_Fread(pReadBuf, 1, 4, fpin);
-
-                            nVal = (pReadBuf[3] << 24) | (pReadBuf[2] << 16) | (pReadBuf[1] << 8) | (pReadBuf[0]);
-                            IPP_Fread(pReadBuf, 1, nVal, fpin);
-                            if ((4 != nVal) && (5 != nVal)) {
-                                IPP_Printf("ID = %d exthdr size is not equal to 4 or 5, size = %d\n", pDecInfo->user_id, nVal);
-                                break;
-                            }
-                            /*exthdr(need)*/  
-                            for (i = 0; i < nVal; i++) {
-                                Vc1mSeqHdr.exthdr[i]    = pReadBuf[i];
-                            }
-                            Vc1mSeqHdr.exthdrsize = nVal;
-
-                            IPP_Fread(pReadBuf, 1, 4, fpin);
-                            /*vert_size(need)*/
-                            Vc1mSeqHdr.vert_size    = (pReadBuf[3] << 24) | (pReadBuf[2] << 16) | (pReadBuf[1] << 8) | (pReadBuf[0]);
-                            IPP_Fread(pReadBuf, 1, 4, fpin);
-                            /*horiz_size(need)*/
-                            Vc1mSeqHdr.horiz_size   = (pReadBuf[3] << 24) | (pReadBuf[2] << 16) | (pReadBuf[1] << 8) | (pReadBuf[0]);
-                            IPP_Fread(pReadBuf, 1, 4, fpin);
-                            IPP_Fread(pReadBuf, 1, 4, fpin);
-                            /*level, cbr, res1 and hrd_buffer(not need)*/
-                            //Vc1mSeqHdr.level        = (pReadBuf[0] >> 5) & 0x7;
-                            //Vc1mSeqHdr.cbr          = (pReadBuf[0] >> 4) & 0x1;
-                            //Vc1mSeqHdr.hrd_buffer   = (pReadBuf[3] << 16) | (pReadBuf[2] << 8) | (pReadBuf[1]);
-
-                            IPP_Fread(pReadBuf, 1, 4, fpin);
-                            /*hrd_rate(not need)*/
-                            //Vc1mSeqHdr.hrd_rate     = (pReadBuf[3] << 24) | (pReadBuf[2] << 16) | (pReadBuf[1] << 8) | (pReadBuf[0]);
-                            IPP_Fread(pReadBuf, 1, 4, fpin);
-                            /*frame_rate(not need)*/
-                            //Vc1mSeqHdr.frame_rate   = (pReadBuf[3] << 24) | (pReadBuf[2] << 16) | (pReadBuf[1] << 8) | (pReadBuf[0]);
-
-                            IPP_Printf("ID = %d send set seq info command!\n", pDecInfo->user_id);
-                            IPP_StartPerfCounter(perf_cmd_index);
-                            rtCode = DecodeSendCmd_Vmeta(IPPVC_SET_VC1M_SEQ_INFO, &Vc1mSeqHdr, NULL, pDecoderState);
-                            IPP_StopPerfCounter(perf_cmd_index);
-                            IPP_Printf("ID = %d send set seq info command!, rtCode = %d\n", pDecInfo->user_id, rtCode);
-                            bReadSeqLayer       = 0;
-                        }
-#endif
-
-                        /* this offset is not necessary, but with it, maybe avoid internal memory copy*/
-                        pBitStream->nOffset += VMETA_COM_PKT_HDR_SIZE;
-                        if (bReadSeqLayer) {
-                            /*read sequence layer data*/
-                            IPP_Fread(pReadBuf, 1, 4, fpin);
-                            IPP_Fread(pReadBuf, 1, 4, fpin);
-                            IPP_Fseek(fpin, 0, IPP_SEEK_SET);
-                            nVal = (pReadBuf[3] << 24) | (pReadBuf[2] << 16) | (pReadBuf[1] << 8) | (pReadBuf[0]);
-                            nFrameLen           = 36 + (nVal - 4);
-                            bReadSeqLayer       = 0;
-                        } else {
-                            /*read frame layer data*/
-                            nReadNum = IPP_Fread(pReadBuf, 1, 4, fpin);
-                            if (4 == nReadNum) {
-                                nFrameLen   = (pReadBuf[2] << 16) | (pReadBuf[1] << 8) | (pReadBuf[0]);
-#if 0
-                                /*not include framesize and timestamp*/
-                                nReadNum    = IPP_Fread(pReadBuf, 1, 4, fpin);
-#else
-                                /*include framesize and timestamp*/
-                                IPP_Fseek(fpin, -4, IPP_SEEK_CUR);
-                                nFrameLen  += 8; /* the size of timestamp*/
-#endif
-                                nLeftBytes              = nFrameLen;
-                            } else {
-                                nFrameLen               = 0;
-                            }
-                        }
-                        nLeftBytes = nFrameLen;
-                        if (STREAM_BUF_SIZE < (nFrameLen + pBitStream->nOffset)) {
-                            nFrameLen = STREAM_BUF_SIZE - pBitStream->nOffset;
+                    while (1) {
+                        IPP_StartPerfCounter(perf_pop_strm_index);
+                        DecoderPopBuffer_Vmeta(IPP_VMETA_BUF_TYPE_STRM, (void**)&pBitStream, pDecoderState);
+                        IPP_StopPerfCounter(perf_pop_strm_index);
+                        if (NULL == pBitStream) {
+                            break;
                         }
+                        nFreeStrmBufNum++;
+                        VmetaPipeReturnStrm(&Pipe, pBitStream);
                         if( (0 == pDecParSetEx->bLessInfo) || nTotalFrames<=LESSINFO_MAX_FRAME) {
-                            IPP_Printf("ID = %d framelen = %d to read num = %d\n", pDecInfo->user_id, nLeftBytes, nFrameLen);
+                            IPP_Printf("ID = %d pop strm buf finish. strm buf id: %d\n", pDecInfo->user_id, (int)pBitStream->pUsrData0);
                         }
-                    } else {
-                        IPP_Fscanf(fplen, "%d", &nFrameLen);
-                        nLeftBytes = nFrameLen;
-                        if (STREAM_BUF_SIZE < nFrameLen) {
-                            nFrameLen = STREAM_BUF_SIZE;
-                        }
-                    }
-                }
-
-                nReadNum = IPP_Fread(pBitStream->pBuf + pBitStream->nOffset + pBitStream->nDataLen, 1, nFrameLen, fpin);
-                if (nReadNum) {
-                    pBitStream->nDataLen    += nReadNum;
-                    nLeftBytes              -= nReadNum;
-
-                    if( (0 == pDecParSetEx->bLessInfo) || nTotalFrames<=LESSINFO_MAX_FRAME) {
-                        IPP_Printf("ID = %d framelen = %d readnum = %d\n", pDecInfo->user_id, nFrameLen, nReadNum);
                     }
-
-                    if (0 >= nLeftBytes) {
-                        if (pDecParSetEx->bNoOutputDelay) {
-                            /*for no-output-delay feature, user must attach end-of-frame flag.*/
-                            pBitStream->nFlag  |= IPP_VMETA_STRM_BUF_END_OF_FRAME;
-                        } else {
-                            /*if user doesn't need no-output-delay feature, end-of-unit flag is enough. end-of-frame flag is also right.*/
-                            pBitStream->nFlag  |= IPP_VMETA_STRM_BUF_END_OF_UNIT;
-                        }
-                        nLeftBytes          = 0;
-                    }
-
-                    if (pDecParSetEx->bDrmEnable) {
-                        scramble_fake(pBitStream);
-                    }
-
-                    IPP_StartPerfCounter(perf_push_strm_index);
-                    rtCode = DecoderPushBuffer_Vmeta(IPP_VMETA_BUF_TYPE_STRM, (void*)pBitStream, pDecoderState);
-                    IPP_StopPerfCounter(perf_push_strm_index);
-
-                    if (IPP_STATUS_NOERR != rtCode) {
-                        IPP_Printf("ID = %d push stream buffer error!\n", pDecInfo->user_id);
+                    if (0 >= nFreeStrmBufNum) {
+                        IPP_Printf("ID = %d error: strm buf is not enough!\n", pDecInfo->user_id);
                         goto fail_cleanup;
                     }
-
-                    if( (0 == pDecParSetEx->bLessInfo) || nTotalFrames<=LESSINFO_MAX_FRAME) {
-                        IPP_Printf("ID = %d push strm buf finish. strm buf id: %d\n", pDecInfo->user_id, (int)pBitStream->pUsrData0);
-                    }
-                } else {
-                    bFreeStrmBufFlag[nCurStrmBufIdx] = 1;
-                    nFreeStrmBufNum++;
                 }
-                if ((nFrameLen != nReadNum) || (0 == nReadNum)) {
-                    IPP_Printf("ID = %d send end of stream command!, pre datalen = %d\n", pDecInfo->user_id, nReadNum);
-                    IPP_StartPerfCounter(perf_cmd_index);
-                    DecodeSendCmd_Vmeta(IPPVC_END_OF_STREAM, NULL, NULL, pDecoderState);
-                    IPP_StopPerfCounter(perf_cmd_index);
+                /*the feeder is behind, the hardware waits for input*/
+                if (!bIdle) {
+                    IPP_StartPerfCounter(perf_idle_index);
+                    bIdle = 1;
                 }
-            } else {
-                nReadNum = IPP_Fread(pBitStream->pBuf, 1, STREAM_BUF_SIZE, fpin);
-                pBitStream->nDataLen = STREAM_BUF_SIZE;
-                if (STREAM_BUF_SIZE != nReadNum) {
-                    /*end of file*/
-                    IPP_Printf("ID = %d add end of unit flag!\n", pDecInfo->user_id);
-                    pBitStream->nFlag      |= IPP_VMETA_STRM_BUF_END_OF_UNIT;
-                    pBitStream->nDataLen    = nReadNum;                    
+                IPP_Sleep(VMETA_QUEUE_POLL_US);
+            }
+            if (bIdle) {
+                IPP_StopPerfCounter(perf_idle_index);
+                nStrmStarve++;
+            }
+
+            if (NULL == pBitStream) {
+                /*the feeder has reached the end of input*/
+                IPP_Printf("ID = %d send end of stream command!, pre datalen = 0\n", pDecInfo->user_id);
+                IPP_StartPerfCounter(perf_cmd_index);
+                DecodeSendCmd_Vmeta(IPPVC_END_OF_STREAM, NULL, NULL, pDecoderState);
+                IPP_StopPerfCounter(perf_cmd_index);
+                continue;
+            }
+
+            nCurStrmBufIdx = (int)pBitStream->pUsrData0;
+            nFeedFlag = Pipe.nFeedFlag[nCurStrmBufIdx];
+            if( (0 == pDecParSetEx->bLessInfo) || nTotalFrames<=LESSINFO_MAX_FRAME) {
+                IPP_Printf("ID = %d nFreeStrmBufNum = %d\n", pDecInfo->user_id, nFreeStrmBufNum);
+            }
+            if (nFeedFlag & VMETA_FEED_PUSH) {
+                if (0 > VmetaBufTransfer(&Pipe.StrmList, nCurStrmBufIdx, VMETA_BUF_APP, VMETA_BUF_CODEC)) {
+                    goto fail_cleanup;
                 }
+                nFreeStrmBufNum--;
+
                 IPP_StartPerfCounter(perf_push_strm_index);
                 rtCode = DecoderPushBuffer_Vmeta(IPP_VMETA_BUF_TYPE_STRM, (void*)pBitStream, pDecoderState);
                 IPP_StopPerfCounter(perf_push_strm_index);
@@ -734,18 +1642,22 @@ int VmetaDecoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IPP_FILE
                     goto fail_cleanup;
                 }
                 if( (0 == pDecParSetEx->bLessInfo) || nTotalFrames<=LESSINFO_MAX_FRAME) {
-                    IPP_Printf("ID = %d push strm buf finish. strm buf id: %d datalen=%d\n", pDecInfo->user_id, (int)pBitStream->pUsrData0, pBitStream->nDataLen);
-                }
-                if (STREAM_BUF_SIZE != pBitStream->nDataLen) {
-                    IPP_Printf("ID = %d send end of stream command!, pre datalen = %d\n", pDecInfo->user_id, pBitStream->nDataLen);
-                    IPP_StartPerfCounter(perf_cmd_index);
-                    rtCode = DecodeSendCmd_Vmeta(IPPVC_END_OF_STREAM, NULL, NULL, pDecoderState);
-                    IPP_StopPerfCounter(perf_cmd_index);
-                    IPP_Printf("ID = %d send end of stream command!, rtCode = %d\n", pDecInfo->user_id, rtCode);
+                    IPP_Printf("ID = %d push strm buf finish. strm buf id: %d datalen=%d\n", pDecInfo->user_id, nCurStrmBufIdx, pBitStream->nDataLen);
                 }
+            } else {
+                VmetaQueuePush(&Pipe.EmptyStrmQ, pBitStream);
+            }
+            if (nFeedFlag & VMETA_FEED_EOS) {
+                IPP_Printf("ID = %d send end of stream command!, pre datalen = %d\n", pDecInfo->user_id, pBitStream->nDataLen);
+                IPP_StartPerfCounter(perf_cmd_index);
+                rtCode = DecodeSendCmd_Vmeta(IPPVC_END_OF_STREAM, NULL, NULL, pDecoderState);
+                IPP_StopPerfCounter(perf_cmd_index);
+                IPP_Printf("ID = %d send end of stream command!, rtCode = %d\n", pDecInfo->user_id, rtCode);
             }
         } else if (IPP_STATUS_NEED_OUTPUT_BUF == rtCode) {
+            nFreePicBufNum += VmetaPipeReclaimPic(&Pipe);
             if (0 >= nFreePicBufNum) {
+                Pipe.PicList.nStarve++;
                 /*for multi-instance, output buffer may not be explicitly returned*/
                 if( (0 == pDecParSetEx->bLessInfo) || nTotalFrames<=LESSINFO_MAX_FRAME) {
                     IPP_Printf("ID = %d nFreePicBufNum == 0, try to pop implicitly returned output buffers\n", pDecInfo->user_id);
@@ -757,13 +1669,9 @@ int VmetaDecoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IPP_FILE
                     if (NULL == pPicture) {
                         break;
                     }
-                    bFreePicBufFlag[(int)pPicture->pUsrData0] = 1;
-                    nFreePicBufNum++;
+                    nFreePicBufNum += VmetaPipeOutPic(&Pipe, pPicture);
 
                     if (0 < pPicture->nDataLen) {
-                        OutputPicture_Video(pPicture, fpout, pDecInfo);
-                        display_frame(hDispCB, &pPicture->pic);
-
                         nTotalFrames++;
                         if( (0 == pDecParSetEx->bLessInfo) || nTotalFrames<=LESSINFO_MAX_FRAME) {
                             IPP_Printf("ID = %d IPP_STATUS_FRAME_COMPLETE %d id=%d pic_tye = %d POC = %d %d, coded pic = [%dx%d] roi=[%d %d %d %d] coded_type = %d %d\n", pDecInfo->user_id, 
@@ -782,43 +1690,58 @@ int VmetaDecoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IPP_FILE
                     }
                 }
             }
+            if ((0 >= nFreePicBufNum) && Pipe.nPicInWriter) {
+                /*all display buffers are queued for output, the hardware waits for the writer*/
+                IPP_StartPerfCounter(perf_idle_index);
+                while (0 >= (nFreePicBufNum += VmetaPipeReclaimPic(&Pipe))) {
+                    IPP_Sleep(VMETA_QUEUE_POLL_US);
+                }
+                IPP_StopPerfCounter(perf_idle_index);
+                nPicStarve++;
+            }
             if( (0 == pDecParSetEx->bLessInfo) || nTotalFrames<=LESSINFO_MAX_FRAME) {
                 IPP_Printf("ID = %d nFreePicBufNum = %d\n", pDecInfo->user_id, nFreePicBufNum);
             }
-            nCurPicBufIdx = 0;
-            while ((0 == bFreePicBufFlag[nCurPicBufIdx]) && (PICTURE_BUF_NUM > nCurPicBufIdx)) {
-                nCurPicBufIdx++;
-            }
-            if (PICTURE_BUF_NUM <= nCurPicBufIdx) {
+            nCurPicBufIdx = VmetaFreeListGet(&Pipe.PicList);
+            if (0 > nCurPicBufIdx) {
                 IPP_Printf("ID = %d error: dis pic buf is not enough!\n", pDecInfo->user_id);
                 goto fail_cleanup;
             }
             pPicture = &(PictureGroup[nCurPicBufIdx]);
+            if (Pool.nAllocSize < pDecInfo->seq_info.dis_buf_size) {
+                Pool.nAllocSize = pDecInfo->seq_info.dis_buf_size;
+            }
+            if (pPicture->pBuf) {
+                if (pPicture->nBufSize < pDecInfo->seq_info.dis_buf_size) {
+                    IPP_Printf("ID = %d reallocate display buffer! id = %d presize = %d cursize = %d pool size = %d\n", pDecInfo->user_id, 
+                        nCurPicBufIdx, pPicture->nBufSize, pDecInfo->seq_info.dis_buf_size, Pool.nAllocSize);
+                    Pool.nGrowCount++;
+                    vdec_os_api_dma_free(pPicture->pBuf);
+                    pPicture->pBuf = NULL;
+                } else if (pPicture->nBufSize > Pool.nAllocSize) {
+                    IPP_Printf("ID = %d retire oversized display buffer! id = %d presize = %d pool size = %d\n", pDecInfo->user_id, 
+                        nCurPicBufIdx, pPicture->nBufSize, Pool.nAllocSize);
+                    Pool.nRetireCount++;
+                    vdec_os_api_dma_free(pPicture->pBuf);
+                    pPicture->pBuf = NULL;
+                } else {
+                    Pool.nReuseCount++;
+                }
+            }
             if (NULL == pPicture->pBuf) {
                 pPicture->pBuf = 
-                    (Ipp8u*)vdec_os_api_dma_alloc(pDecInfo->seq_info.dis_buf_size, VMETA_DIS_BUF_ALIGN, &(pPicture->nPhyAddr));
+                    (Ipp8u*)vdec_os_api_carveout_alloc(pCarveout, Pool.nAllocSize, VMETA_DIS_BUF_ALIGN, &(pPicture->nPhyAddr));
                 if (NULL == pPicture->pBuf) {
                      IPP_Printf("ID = %d error: no memory for display!\n", pDecInfo->user_id);
                      IPP_Log(log_file_name, "a", "error: no memory for display!\n");
                      goto fail_cleanup;
                 }
-                IPP_Printf("ID = %d allocate display buffer %d, paddr = %p, vaddr = %p\n",pDecInfo->user_id, nCurPicBufIdx, pPicture->nPhyAddr, pPicture->pBuf);
-                pPicture->nBufSize = pDecInfo->seq_info.dis_buf_size;
-            } else {
-                if (pPicture->nBufSize < pDecInfo->seq_info.dis_buf_size) {
-                    IPP_Printf("ID = %d reallocate display buffer! id = %d presize = %d cursize = %d, ", pDecInfo->user_id, (int)pPicture->pUsrData0, 
-                        pPicture->nBufSize, pDecInfo->seq_info.dis_buf_size);
-                    vdec_os_api_dma_free(pPicture->pBuf);
-                    pPicture->pBuf = NULL;
-                    pPicture->pBuf = (Ipp8u*)vdec_os_api_dma_alloc(pDecInfo->seq_info.dis_buf_size, VMETA_DIS_BUF_ALIGN, &(pPicture->nPhyAddr));
-                    if (NULL == pPicture->pBuf) {
-                        IPP_Printf("\nID = %d error: no memory for display!\n", pDecInfo->user_id);
-                        IPP_Log(log_file_name, "a", "error: no memory for display!\n");
-                        goto fail_cleanup;
-                    }
-                    IPP_Printf("paddr = %p, vaddr = %p\n",pPicture->nPhyAddr, pPicture->pBuf);
-                    pPicture->nBufSize = pDecInfo->seq_info.dis_buf_size;
-                }
+                IPP_Printf("ID = %d allocate display buffer %d, size = %d paddr = %p, vaddr = %p\n",pDecInfo->user_id, nCurPicBufIdx, Pool.nAllocSize, pPicture->nPhyAddr, pPicture->pBuf);
+                pPicture->nBufSize = Pool.nAllocSize;
+                Pool.nAllocCount++;
+            }
+            if (0 > VmetaBufTransfer(&Pipe.PicList, nCurPicBufIdx, VMETA_BUF_APP, VMETA_BUF_CODEC)) {
+                goto fail_cleanup;
             }
             IPP_StartPerfCounter(perf_push_pic_index);
             DecoderPushBuffer_Vmeta(IPP_VMETA_BUF_TYPE_PIC, (void*)pPicture, pDecoderState);
@@ -836,8 +1759,8 @@ int VmetaDecoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IPP_FILE
                 if (NULL == pBitStream) {
                     break;
                 }
-                bFreeStrmBufFlag[(int)pBitStream->pUsrData0] = 1;
                 nFreeStrmBufNum++;
+                VmetaPipeReturnStrm(&Pipe, pBitStream);
                 if( (0 == pDecParSetEx->bLessInfo) || nTotalFrames<=LESSINFO_MAX_FRAME) {
                     IPP_Printf("ID = %d pop strm buf finish. strm buf id: %d\n", pDecInfo->user_id, (int)pBitStream->pUsrData0);
                 }
@@ -850,13 +1773,9 @@ int VmetaDecoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IPP_FILE
                 if (NULL == pPicture) {
                     break;
                 }
-                bFreePicBufFlag[(int)pPicture->pUsrData0] = 1;
-                nFreePicBufNum++;
+                nFreePicBufNum += VmetaPipeOutPic(&Pipe, pPicture);
 
                 if (0 < pPicture->nDataLen) {
-                    OutputPicture_Video(pPicture, fpout, pDecInfo);
-                    display_frame(hDispCB, &pPicture->pic);
-
                     nTotalFrames++;
                     if( (0 == pDecParSetEx->bLessInfo) || nTotalFrames<=LESSINFO_MAX_FRAME) {
                         IPP_Printf("ID = %d IPP_STATUS_FRAME_COMPLETE %d id=%d pic_tye = %d POC = %d %d, coded pic = [%dx%d] roi=[%d %d %d %d] coded_type = %d %d\n", pDecInfo->user_id, 
@@ -891,13 +1810,15 @@ int VmetaDecoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IPP_FILE
                 if (NULL == pBitStream) {
                     break;
                 }
-                bFreeStrmBufFlag[(int)pBitStream->pUsrData0] = 1;
                 nFreeStrmBufNum++;
+                VmetaPipeReturnStrm(&Pipe, pBitStream);
                 if( (0 == pDecParSetEx->bLessInfo) || nTotalFrames<=LESSINFO_MAX_FRAME) {
                     IPP_Printf("ID = %d pop strm buf finish. strm buf id: %d\n", pDecInfo->user_id, (int)pBitStream->pUsrData0);
                 }
             }
 
+            VmetaPicPoolSeqDone(&Pool);
+
             nCumulTime  = (IPP_GetPerfData(codec_perf_index) + 500) / 1000;
             nCumulTime += (IPP_GetPerfData(perf_push_strm_index) + 500) / 1000;
             nCumulTime += (IPP_GetPerfData(perf_pop_strm_index) + 500) / 1000;
@@ -922,6 +1843,10 @@ int VmetaDecoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IPP_FILE
                 nMaxFrameCount = nMaxFrameCount * 2;
             }
         } else if (IPP_STATUS_NEW_VIDEO_SEQ == rtCode) {
+            if (Pool.nSeqNum) {
+                /*measure until the first picture of the new sequence*/
+                Pool.nSeqStart = IPP_TimeGetTickCount();
+            }
             // According to current vmeta hal logic, the following block is acturally not necessary, 
             // all display buffers should have already been popped in the last IPP_STATUS_FRAME_COMPLETE
             while (1) {
@@ -931,13 +1856,9 @@ int VmetaDecoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IPP_FILE
                 if (NULL == pPicture) {
                     break;
                 }
-                bFreePicBufFlag[(int)pPicture->pUsrData0] = 1;
-                nFreePicBufNum++;
+                nFreePicBufNum += VmetaPipeOutPic(&Pipe, pPicture);
                 IPP_Printf("ID = %d pop display buffer id = %d when encounter new sequence!\n", pDecInfo->user_id, (int)pPicture->pUsrData0);
                 if (0 < pPicture->nDataLen) {
-                    OutputPicture_Video(pPicture, fpout, pDecInfo);
-                    display_frame(hDispCB, &pPicture->pic);
-
                     nTotalFrames++;
                     IPP_Printf("ID = %d IPP_STATUS_FRAME_COMPLETE %d id=%d pic_tye = %d POC = %d %d, coded pic = [%dx%d] roi=[%d %d %d %d] coded_type = %d %d\n", pDecInfo->user_id, 
                         nTotalFrames, (int)pPicture->pUsrData0, 
@@ -972,7 +1893,12 @@ int VmetaDecoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IPP_FILE
             IPP_Printf("ID = %d display area: [x = %d, y = %d width = %d height = %d]\n", pDecInfo->user_id, 
                 pDecInfo->seq_info.picROI.x, pDecInfo->seq_info.picROI.y,
                 pDecInfo->seq_info.picROI.width, pDecInfo->seq_info.picROI.height);
+            /*the writer may still show pictures of the old sequence*/
+            IPP_StartPerfCounter(perf_idle_index);
+            nFreePicBufNum += VmetaPipeDrainWriter(&Pipe);
+            IPP_StopPerfCounter(perf_idle_index);
             display_open(hDispCB, pDecInfo->seq_info.max_width, pDecInfo->seq_info.max_height);
+            VmetaPicPoolNewSeq(&Pool, pDecInfo->seq_info.dis_buf_size);
 
             if (IPP_VIDEO_STRM_FMT_JPEG == pDecParSet->strm_fmt) {
                 IppVmetaJPEGDecParSet jpegpar;
@@ -999,8 +1925,8 @@ int VmetaDecoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IPP_FILE
                 if (NULL == pBitStream) {
                     break;
                 }
-                bFreeStrmBufFlag[(int)pBitStream->pUsrData0] = 1;
                 nFreeStrmBufNum++;
+                VmetaPipeReturnStrm(&Pipe, pBitStream);
                 IPP_Printf("ID = %d pop strm buf finish. strm buf id: %d\n", pDecInfo->user_id, (int)pBitStream->pUsrData0);
             }
             while (1) {
@@ -1010,13 +1936,9 @@ int VmetaDecoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IPP_FILE
                 if (NULL == pPicture) {
                     break;
                 }
-                bFreePicBufFlag[(int)pPicture->pUsrData0] = 1;
-                nFreePicBufNum++;
+                nFreePicBufNum += VmetaPipeOutPic(&Pipe, pPicture);
 
                 if (0 < pPicture->nDataLen) {
-                    OutputPicture_Video(pPicture, fpout, pDecInfo);
-                    display_frame(hDispCB, &pPicture->pic);
-
                     nTotalFrames++;
                     IPP_Printf("ID = %d IPP_STATUS_FRAME_COMPLETE %d id=%d pic_tye = %d POC = %d %d, coded pic = [%dx%d] roi=[%d %d %d %d] coded_type = %d %d\n", pDecInfo->user_id, 
                         nTotalFrames, (int)pPicture->pUsrData0, 
@@ -1030,6 +1952,7 @@ int VmetaDecoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IPP_FILE
                     IPP_Printf("ID = %d pop empty picture buffer! id = %d\n", pDecInfo->user_id, (int)pPicture->pUsrData0);
                 }
             }
+            nFreePicBufNum += VmetaPipeDrainWriter(&Pipe);
             break;
         } else {
             IPP_Log(log_file_name, "a", "error: deadly error! %d\n", rtCode);
@@ -1037,12 +1960,38 @@ int VmetaDecoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IPP_FILE
             goto fail_cleanup;
         }
     }
+    Pipe.bExit = 1;
+    IPP_ThreadDestroy(&hFeedThread, 1);
+    IPP_ThreadDestroy(&hWriteThread, 1);
+    hFeedThread     = 0;
+    hWriteThread    = 0;
     IPP_StopPerfCounter(total_perf_index);
 
+    if (g_pDecStat) {
+        vmeta_lock_info LockInfo;
+        if (0 == vdec_os_api_get_lock_info(pDecInfo->user_id, &LockInfo)) {
+            g_pDecStat->nLockWait = LockInfo.wait_ms;
+            g_pDecStat->nLockHold = LockInfo.hold_ms;
+        }
+    }
+
     IPP_Printf("ID = %d before DecoderFree_Vmeta\n", pDecInfo->user_id);
     rtCode = DecoderFree_Vmeta(&pDecoderState);
     IPP_Printf("ID = %d after DecoderFree_Vmeta rtCode = %d\n", pDecInfo->user_id, rtCode);
 
+    vdec_os_api_arena_bind(NULL);
+    vdec_os_api_arena_get_stat(pArena, &ArenaStat);
+    IPP_Printf("ID = %d [MEM] arena: alloc %u free %u reuse %u chunk %u req %u used %u reserved %u (bytes)\n",
+        pDecInfo->user_id, ArenaStat.alloc_count, ArenaStat.free_count, ArenaStat.reuse_count,
+        ArenaStat.chunk_count, ArenaStat.req_bytes, ArenaStat.used_bytes, ArenaStat.reserved_bytes);
+    /*req counts every call, reused blocks included, so compare used with reserved only*/
+    if (ArenaStat.reserved_bytes) {
+        IPP_Printf("ID = %d [MEM] arena: unused tail %f\n", pDecInfo->user_id,
+            (float)(ArenaStat.reserved_bytes - ArenaStat.used_bytes) / ArenaStat.reserved_bytes);
+    }
+    vdec_os_api_arena_destroy(pArena);
+    pArena = NULL;
+
     for (i = 0; i < STREAM_BUF_NUM; i++) {
         if (BitStreamGroup[i].pBuf) {
             vdec_os_api_dma_free(BitStreamGroup[i].pBuf);
@@ -1055,6 +2004,15 @@ int VmetaDecoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IPP_FILE
         }
     }
 
+    if (pCarveout) {
+        vdec_os_api_carveout_get_stat(pCarveout, &CarveoutStat);
+        IPP_Printf("ID = %d [MEM] carve-out: alloc %u fail %u (fallback fail %u) peak %u of %u (bytes)\n",
+            pDecInfo->user_id, CarveoutStat.alloc_count, CarveoutStat.fail_count, CarveoutStat.fallback_fail,
+            CarveoutStat.peak_bytes, CarveoutStat.size);
+        vdec_os_api_carveout_release(pCarveout);
+        pCarveout = NULL;
+    }
+
     nDecTime = IPP_GetPerfData(codec_perf_index);
     IPP_Printf("ID = %d dec time      : %d (ms)\n", pDecInfo->user_id, (nDecTime + 500) / 1000);
     nPushStrmTime = IPP_GetPerfData(perf_push_strm_index);
@@ -1070,6 +2028,31 @@ int VmetaDecoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IPP_FILE
     nCmdTime = IPP_GetPerfData(perf_cmd_index);
     IPP_Printf("ID = %d cmd time      : %d (ms)\n", pDecInfo->user_id, (nCmdTime + 500) / 1000);
 
+    nIdleTime = IPP_GetPerfData(perf_idle_index);
+    IPP_Printf("ID = %d hw idle time  : %d (ms), input starved %d, output starved %d\n", pDecInfo->user_id,
+        (nIdleTime + 500) / 1000, nStrmStarve, nPicStarve);
+    VmetaQueuePrint(pDecInfo->user_id, "strm in", &Pipe.FilledStrmQ);
+    VmetaQueuePrint(pDecInfo->user_id, "strm free", &Pipe.EmptyStrmQ);
+    VmetaQueuePrint(pDecInfo->user_id, "pic out", &Pipe.OutPicQ);
+    VmetaQueuePrint(pDecInfo->user_id, "pic free", &Pipe.FreePicQ);
+    IPP_Printf("ID = %d [PIPE] feeder wait %u writer wait %u (x %d us)\n", pDecInfo->user_id,
+        Pipe.nFeedWait, Pipe.nWriteWait, VMETA_QUEUE_POLL_US);
+    IPP_Printf("ID = %d [PIPE] output write time: %d (ms)\n", pDecInfo->user_id, (int)((Pipe.nWriteTime + 500) / 1000));
+    if (Pipe.pFramer) {
+        IPP_Printf("ID = %d [FRAMER] units %u split %u, parsed %d bytes in %d (us), %f MB/s\n", pDecInfo->user_id,
+            Framer.nUnitCount, Framer.nSplitCount, Framer.nPos, (int)Framer.nParseTime,
+            Framer.nParseTime ? (float)Framer.nPos / Framer.nParseTime : 0.0f);
+    }
+    VmetaFramerClose(&Framer);
+    VmetaFreeListPrint(pDecInfo->user_id, &Pipe.StrmList);
+    VmetaFreeListPrint(pDecInfo->user_id, &Pipe.PicList);
+    IPP_Printf("ID = %d [POOL] sequences %d pool size %d: alloc %u reuse %u grow %u retire %u\n", pDecInfo->user_id,
+        Pool.nSeqNum, Pool.nAllocSize, Pool.nAllocCount, Pool.nReuseCount, Pool.nGrowCount, Pool.nRetireCount);
+    if (Pool.nSeqLatCount) {
+        IPP_Printf("ID = %d [POOL] sequence change latency: avg %u max %u (us) over %u changes\n", pDecInfo->user_id,
+            Pool.nSeqLatSum / Pool.nSeqLatCount, Pool.nSeqLatMax, Pool.nSeqLatCount);
+    }
+
     nTotalTime = nDecTime + nPushStrmTime + nPopStrmTime + nPushPicTime + nPopPicTime + nCmdTime;
     IPP_Printf("ID = %d [PERF] Codec Level: ", pDecInfo->user_id);
     IPP_Printf("Total Frame: %d(Skip Frame: %d), Total Time: %d(ms), FPS: %f\n", 
@@ -1088,6 +2071,28 @@ int VmetaDecoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IPP_FILE
     IPP_Printf("ID = %d [PERF] FrameCompleteEvent = %d MaxFrameDecTime = %d (ms) MinFrameDecTime = %d (ms)\n", 
         pDecInfo->user_id, nFrameCount, nMaxFrameTime, nMinFrameTime);
 
+    if (Pipe.pGolden) {
+        if ((0 > Golden.nMismatch) && (Golden.nPos < Golden.nNum)) {
+            /*the stream ended before the golden list*/
+            Golden.nMismatch = Golden.nFrame;
+        }
+        bGoldenFail = (0 <= Golden.nMismatch);
+        if (bGoldenFail) {
+            IPP_Printf("ID = %d [GOLDEN] FAIL at frame %d (%d of %d entries matched)\n", pDecInfo->user_id,
+                Golden.nMismatch, Golden.nPos, Golden.nNum);
+        } else {
+            IPP_Printf("ID = %d [GOLDEN] PASS %d frames\n", pDecInfo->user_id, Golden.nFrame);
+        }
+        VmetaGoldenFree(&Golden);
+    }
+
+    if (g_pDecStat) {
+        g_pDecStat->nTotalFrames    = nTotalFrames;
+        g_pDecStat->nTotalTime      = nTotalTime;
+        g_pDecStat->nMismatch       = Pipe.pGolden ? Golden.nMismatch : -1;
+        FillFrameTimeStat(g_pDecStat, pFrameTimeArray, nFrameCount);
+    }
+
     if (pFrameTimeArray) {
 #if 0
         IPP_FILE *f;
@@ -1108,6 +2113,7 @@ int VmetaDecoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IPP_FILE
     IPP_FreePerfCounter(perf_push_pic_index);
     IPP_FreePerfCounter(perf_pop_pic_index);
     IPP_FreePerfCounter(perf_cmd_index);
+    IPP_FreePerfCounter(perf_idle_index);
     display_close();
 
     IPP_Printf("ID = %d before driver clean\n", pDecInfo->user_id);
@@ -1116,16 +2122,27 @@ int VmetaDecoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IPP_FILE
 
     IPP_PysicalMemTest();
 
-    return IPP_OK;
+    return bGoldenFail ? IPP_FAIL : IPP_OK;
 
 fail_cleanup:
     IPP_Printf("decoding fail: clean up\n");
 
+    Pipe.bExit = 1;
+    IPP_ThreadDestroy(&hFeedThread, 1);
+    IPP_ThreadDestroy(&hWriteThread, 1);
+    VmetaFramerClose(&Framer);
+    VmetaGoldenFree(&Golden);
+
     IPP_Printf("free codec state\n");
     if (pDecoderState) {
         DecoderFree_Vmeta(&pDecoderState);
     }
 
+    if (pArena) {
+        vdec_os_api_arena_bind(NULL);
+        vdec_os_api_arena_destroy(pArena);
+    }
+
     IPP_Printf("free stream buffer\n");
     for (i = 0; i < STREAM_BUF_NUM; i++) {
         if (BitStreamGroup[i].pBuf) {
@@ -1140,6 +2157,10 @@ fail_cleanup:
         }
     }
 
+    if (pCarveout) {
+        vdec_os_api_carveout_release(pCarveout);
+    }
+
     IPP_Printf("free time array\n");
     if (pFrameTimeArray) {
         IPP_MemFree((void**)(&pFrameTimeArray));
@@ -1291,6 +2312,31 @@ int ParseVmetaDecCmd(char *pCmdLine,
         } else if (0 == IPP_Strcmp(par_name, "norc")) {
             STRNCPY(par_value, p2 + 1, par_value_len);
             pDecParSetEx->bNoResoChange = IPP_Atoi(par_value);
+        } else if (0 == IPP_Strcmp(par_name, "bench")) {
+            /*manifest file, one command line per session*/
+            STRNCPY(g_BenchFile, p2 + 1, par_value_len);
+        } else if (0 == IPP_Strcmp(par_name, "resw")) {
+            STRNCPY(par_value, p2 + 1, par_value_len);
+            pDecParSetEx->nResWidth = IPP_Atoi(par_value);
+        } else if (0 == IPP_Strcmp(par_name, "resh")) {
+            STRNCPY(par_value, p2 + 1, par_value_len);
+            pDecParSetEx->nResHeight = IPP_Atoi(par_value);
+        } else if (0 == IPP_Strcmp(par_name, "resn")) {
+            STRNCPY(par_value, p2 + 1, par_value_len);
+            pDecParSetEx->nResNum = IPP_Atoi(par_value);
+        } else if (0 == IPP_Strcmp(par_name, "golden")) {
+            STRNCPY(g_GoldenFile, p2 + 1, par_value_len);
+        } else if (0 == IPP_Strcmp(par_name, "conf")) {
+            /*conformance directory, streams with a golden file next to them*/
+            STRNCPY(g_ConfDir, p2 + 1, par_value_len);
+        } else if (0 == IPP_Strcmp(par_name, "report")) {
+            STRNCPY(g_ConfReport, p2 + 1, par_value_len);
+        } else if (0 == IPP_Strcmp(par_name, "j")) {
+            STRNCPY(par_value, p2 + 1, par_value_len);
+            g_nConfJobs = IPP_Atoi(par_value);
+        } else if (0 == IPP_Strcmp(par_name, "fr")) {
+            STRNCPY(par_value, p2 + 1, par_value_len);
+            pDecParSetEx->bFramer = IPP_Atoi(par_value);
         } else {
             /*parse other parameters for encoder*/
         }
@@ -1301,6 +2347,351 @@ int ParseVmetaDecCmd(char *pCmdLine,
     return IPP_OK;
 }
 
+/******************************************************************************
+// Name:                VmetaDecBench
+// Description:         Decode the streams listed in a manifest concurrently,
+//                      one forked process per line, and report per-session
+//                      and aggregate throughput
+//
+// Input Arguments:
+//      pManifest   :   Manifest file, each line is a decoder command line
+//                      such as "-i:a.264 -o:a.yuv -fmt:5 -c:1", '#' comments
+// Returns:
+//        [Success]     IPP_OK
+//        [Failure]     IPP_FAIL
+******************************************************************************/
+int CodecTest(int argc, char **argv);
+
+static int VmetaDecBench(char *pManifest)
+{
+    IPP_FILE *fp;
+    char pLine[MAX_BENCH_SESSION][MAX_BENCH_LINE];
+    char *pArgv[2];
+    int pFd[MAX_BENCH_SESSION];
+    pid_t pid[MAX_BENCH_SESSION];
+    VmetaDecStat Stat[MAX_BENCH_SESSION];
+    VmetaDecStat *pStat;
+    int nSession, nLen, i, fd[2];
+    int nFrames, rtFlag;
+    long long nStart, nWall;
+    double fFps, fSum, fSumSq;
+
+    fp = IPP_Fopen(pManifest, "r");
+    if (!fp) {
+        IPP_Printf("Fails to open manifest %s!\n", pManifest);
+        return IPP_FAIL;
+    }
+    nSession = 0;
+    while ((MAX_BENCH_SESSION > nSession) && IPP_Fgets(pLine[nSession], MAX_BENCH_LINE, fp)) {
+        nLen = IPP_Strlen(pLine[nSession]);
+        while ((0 < nLen) && (('\n' == pLine[nSession][nLen - 1]) || ('\r' == pLine[nSession][nLen - 1]))) {
+            pLine[nSession][--nLen] = '\0';
+        }
+        if ((0 == nLen) || ('#' == pLine[nSession][0])) {
+            continue;
+        }
+        nSession++;
+    }
+    IPP_Fclose(fp);
+    if (0 == nSession) {
+        IPP_Printf("manifest %s is empty!\n", pManifest);
+        return IPP_FAIL;
+    }
+
+    IPP_Printf("[BENCH] %d sessions\n", nSession);
+    nStart = IPP_TimeGetTickCount();
+    for (i = 0; i < nSession; i++) {
+        pFd[i] = -1;
+        pid[i] = -1;
+        IPP_Memset(&Stat[i], 0, sizeof(VmetaDecStat));
+        Stat[i].nRet = IPP_FAIL;
+        if (0 != pipe(fd)) {
+            continue;
+        }
+        /*the child flushes stdout, it must not inherit unwritten parent output*/
+        fflush(stdout);
+        pid[i] = fork();
+        if (0 == pid[i]) {
+            VmetaDecStat ChildStat;
+
+            close(fd[0]);
+            IPP_Memset(&ChildStat, 0, sizeof(VmetaDecStat));
+            g_BenchFile[0]  = '\0';
+            g_pDecStat      = &ChildStat;
+            pArgv[0]        = "appvmetadec";
+            pArgv[1]        = pLine[i];
+            ChildStat.nRet  = CodecTest(2, pArgv);
+            if (sizeof(VmetaDecStat) != write(fd[1], &ChildStat, sizeof(VmetaDecStat))) {
+                IPP_Printf("[BENCH] error: session %d fail to report\n", i);
+                fflush(stdout);
+                _exit(1);
+            }
+            close(fd[1]);
+            /*_exit skips stdio, the session log would be lost*/
+            fflush(stdout);
+            _exit(0);
+        }
+        close(fd[1]);
+        if (0 > pid[i]) {
+            close(fd[0]);
+            continue;
+        }
+        pFd[i] = fd[0];
+    }
+
+    for (i = 0; i < nSession; i++) {
+        if (0 <= pFd[i]) {
+            if (sizeof(VmetaDecStat) != read(pFd[i], &Stat[i], sizeof(VmetaDecStat))) {
+                Stat[i].nRet = IPP_FAIL;
+            }
+            close(pFd[i]);
+        }
+        if (0 < pid[i]) {
+            waitpid(pid[i], NULL, 0);
+        }
+    }
+    nWall = IPP_TimeGetTickCount() - nStart;
+
+    rtFlag  = IPP_OK;
+    nFrames = 0;
+    fSum    = 0;
+    fSumSq  = 0;
+    for (i = 0; i < nSession; i++) {
+        pStat = &Stat[i];
+        fFps  = pStat->nTotalTime ? 1000.0 * 1000.0 * pStat->nTotalFrames / pStat->nTotalTime : 0;
+        IPP_Printf("[BENCH] session %d: %s\n", i, pLine[i]);
+        IPP_Printf("[BENCH] session %d: %s frames %d fps %f lock wait %u ms (%f%%) hold %u ms frame time p50 %u p90 %u p99 %u max %u (ms)\n",
+            i, (IPP_OK == pStat->nRet) ? "ok" : "FAIL", pStat->nTotalFrames, fFps,
+            pStat->nLockWait, pStat->nTotalTime ? 100.0 * 1000.0 * pStat->nLockWait / pStat->nTotalTime : 0,
+            pStat->nLockHold, pStat->nFrameTime[0], pStat->nFrameTime[1], pStat->nFrameTime[2], pStat->nFrameTime[3]);
+        if (IPP_OK != pStat->nRet) {
+            rtFlag = IPP_FAIL;
+        }
+        nFrames += pStat->nTotalFrames;
+        fSum    += fFps;
+        fSumSq  += fFps * fFps;
+    }
+    /*Jain's index: 1.0 when every session gets the same frame rate*/
+    IPP_Printf("[BENCH] aggregate: frames %d wall %d (ms) fps %f fairness %f\n",
+        nFrames, (int)((nWall + 500) / 1000), nWall ? 1000.0 * 1000.0 * nFrames / nWall : 0,
+        fSumSq ? fSum * fSum / (nSession * fSumSq) : 0);
+
+    return rtFlag;
+}
+
+/*stream format of a conformance file from its extension, -1 if not a stream*/
+static int ConfStreamFormat(char *pName)
+{
+    static const struct {
+        const char  *pExt;
+        int         nFmt;
+    } FmtTbl[] = {
+        {".264",    IPP_VIDEO_STRM_FMT_H264},
+        {".h264",   IPP_VIDEO_STRM_FMT_H264},
+        {".jsv",    IPP_VIDEO_STRM_FMT_H264},
+        {".avc",    IPP_VIDEO_STRM_FMT_H264},
+        {".26l",    IPP_VIDEO_STRM_FMT_H264},
+        {".m2v",    IPP_VIDEO_STRM_FMT_MPG2},
+        {".mpg",    IPP_VIDEO_STRM_FMT_MPG2},
+        {".m4v",    IPP_VIDEO_STRM_FMT_MPG4},
+        {".cmp",    IPP_VIDEO_STRM_FMT_MPG4},
+        {".263",    IPP_VIDEO_STRM_FMT_H263},
+        {".vc1",    IPP_VIDEO_STRM_FMT_VC1},
+        {".rcv",    IPP_VIDEO_STRM_FMT_VC1M},
+        {".jpg",    IPP_VIDEO_STRM_FMT_JPEG},
+    };
+    char *pExt = strrchr(pName, '.');
+    int i;
+
+    if (NULL == pExt) {
+        return -1;
+    }
+    for (i = 0; i < (int)(sizeof(FmtTbl) / sizeof(FmtTbl[0])); i++) {
+        if (0 == strcasecmp(pExt, FmtTbl[i].pExt)) {
+            return FmtTbl[i].nFmt;
+        }
+    }
+    return -1;
+}
+
+/******************************************************************************
+// Name:                VmetaConfRun
+// Description:         Decode every stream of a conformance directory against
+//                      its golden checksum file (<stream>.chksum, written by
+//                      -c:1), at most nJobs processes at a time, and write one
+//                      CSV line per stream to the report
+//
+// Input Arguments:
+//      pDir        :   Conformance directory
+//      nJobs       :   Maximum number of concurrent decoders
+//      pReport     :   Report file
+// Returns:
+//        [Success]     IPP_OK, every stream matched
+//        [Failure]     IPP_FAIL
+******************************************************************************/
+static int VmetaConfRun(char *pDir, int nJobs, char *pReport)
+{
+    DIR *pDirp;
+    struct dirent *pEnt;
+    char (*pName)[MAX_BENCH_LINE];
+    char pLine[MAX_BENCH_LINE];
+    char pGolden[MAX_BENCH_LINE];
+    char *pArgv[2];
+    int pFmt[MAX_CONF_STREAM];
+    int pFd[MAX_CONF_STREAM];
+    pid_t pid[MAX_CONF_STREAM];
+    VmetaDecStat *pStat;
+    IPP_FILE *fpReport;
+    int nStream, nNext, nRunning, nPass, i, fd[2];
+    int nFmt, nDropped;
+    pid_t nDone;
+    long long nStart, nWall;
+    double fFps;
+
+    if (0 >= nJobs) {
+        nJobs = 1;
+    }
+    pDirp = opendir(pDir);
+    if (NULL == pDirp) {
+        IPP_Printf("Fails to open conformance directory %s!\n", pDir);
+        return IPP_FAIL;
+    }
+    pName = malloc(MAX_CONF_STREAM * sizeof(pName[0]));
+    pStat = malloc(MAX_CONF_STREAM * sizeof(VmetaDecStat));
+    if ((NULL == pName) || (NULL == pStat)) {
+        closedir(pDirp);
+        free(pName);
+        free(pStat);
+        return IPP_FAIL;
+    }
+    nStream = 0;
+    nDropped = 0;
+    while (NULL != (pEnt = readdir(pDirp))) {
+        nFmt = ConfStreamFormat(pEnt->d_name);
+        if (0 > nFmt) {
+            continue;
+        }
+        snprintf(pGolden, sizeof(pGolden), "%s/%s%s", pDir, pEnt->d_name, CONF_GOLDEN_EXT);
+        if (0 != access(pGolden, R_OK)) {
+            IPP_Printf("[CONF] skip %s: no golden checksum\n", pEnt->d_name);
+            continue;
+        }
+        if (MAX_CONF_STREAM <= nStream) {
+            IPP_Printf("[CONF] drop %s: more than %d streams\n", pEnt->d_name, MAX_CONF_STREAM);
+            nDropped++;
+            continue;
+        }
+        pFmt[nStream] = nFmt;
+        snprintf(pName[nStream], MAX_BENCH_LINE, "%s", pEnt->d_name);
+        nStream++;
+    }
+    closedir(pDirp);
+    /*a partial run must not pass as the whole set*/
+    if (0 < nDropped) {
+        IPP_Printf("[CONF] error: %d streams dropped, split the directory\n", nDropped);
+        free(pName);
+        free(pStat);
+        return IPP_FAIL;
+    }
+
+    IPP_Printf("[CONF] %d streams, %d jobs\n", nStream, nJobs);
+    nStart      = IPP_TimeGetTickCount();
+    nNext       = 0;
+    nRunning    = 0;
+    while ((nNext < nStream) || (0 < nRunning)) {
+        while ((nNext < nStream) && (nRunning < nJobs)) {
+            i           = nNext++;
+            pFd[i]      = -1;
+            pid[i]      = -1;
+            IPP_Memset(&pStat[i], 0, sizeof(VmetaDecStat));
+            pStat[i].nRet       = IPP_FAIL;
+            pStat[i].nMismatch  = -1;
+            if (0 != pipe(fd)) {
+                continue;
+            }
+            /*the child flushes stdout, it must not inherit unwritten parent output*/
+            fflush(stdout);
+            pid[i] = fork();
+            if (0 == pid[i]) {
+                VmetaDecStat ChildStat;
+
+                close(fd[0]);
+                IPP_Memset(&ChildStat, 0, sizeof(VmetaDecStat));
+                ChildStat.nMismatch = -1;
+                g_ConfDir[0]    = '\0';
+                g_pDecStat      = &ChildStat;
+                snprintf(pLine, sizeof(pLine), "-i:%s/%s -fmt:%d -golden:%s/%s%s -lessinfo:1",
+                    pDir, pName[i], pFmt[i], pDir, pName[i], CONF_GOLDEN_EXT);
+                pArgv[0]        = "appvmetadec";
+                pArgv[1]        = pLine;
+                ChildStat.nRet  = CodecTest(2, pArgv);
+                if (sizeof(VmetaDecStat) != write(fd[1], &ChildStat, sizeof(VmetaDecStat))) {
+                    IPP_Printf("[CONF] error: %s fail to report\n", pName[i]);
+                    fflush(stdout);
+                    _exit(1);
+                }
+                close(fd[1]);
+                /*_exit skips stdio, the stream log would be lost*/
+                fflush(stdout);
+                _exit(0);
+            }
+            close(fd[1]);
+            if (0 > pid[i]) {
+                close(fd[0]);
+                continue;
+            }
+            pFd[i] = fd[0];
+            nRunning++;
+        }
+        if (0 == nRunning) {
+            continue;
+        }
+        nDone = waitpid(-1, NULL, 0);
+        if (0 > nDone) {
+            break;
+        }
+        for (i = 0; i < nNext; i++) {
+            if (pid[i] == nDone) {
+                if (sizeof(VmetaDecStat) != read(pFd[i], &pStat[i], sizeof(VmetaDecStat))) {
+                    pStat[i].nRet = IPP_FAIL;
+                }
+                close(pFd[i]);
+                pFd[i] = -1;
+                nRunning--;
+                break;
+            }
+        }
+    }
+    nWall = IPP_TimeGetTickCount() - nStart;
+
+    fpReport = IPP_Fopen(pReport, "w");
+    if (fpReport) {
+        IPP_Fprintf(fpReport, "stream,format,result,frames,fps,first_mismatch\n");
+    }
+    nPass = 0;
+    for (i = 0; i < nStream; i++) {
+        fFps = pStat[i].nTotalTime ? 1000.0 * 1000.0 * pStat[i].nTotalFrames / pStat[i].nTotalTime : 0;
+        if (IPP_OK == pStat[i].nRet) {
+            nPass++;
+        }
+        IPP_Printf("[CONF] %s: %s frames %d fps %f mismatch %d\n", pName[i],
+            (IPP_OK == pStat[i].nRet) ? "PASS" : "FAIL", pStat[i].nTotalFrames, fFps, pStat[i].nMismatch);
+        if (fpReport) {
+            IPP_Fprintf(fpReport, "%s,%d,%s,%d,%.2f,%d\n", pName[i], pFmt[i],
+                (IPP_OK == pStat[i].nRet) ? "PASS" : "FAIL", pStat[i].nTotalFrames, fFps, pStat[i].nMismatch);
+        }
+    }
+    if (fpReport) {
+        IPP_Fclose(fpReport);
+    }
+    IPP_Printf("[CONF] %d of %d streams passed, wall %d (ms), report %s\n", nPass, nStream,
+        (int)((nWall + 500) / 1000), pReport);
+
+    free(pName);
+    free(pStat);
+    return (nPass == nStream) ? IPP_OK : IPP_FAIL;
+}
+
 /*Interface for IPP sample code template*/
 int CodecTest(int argc, char **argv)
 {
@@ -1335,11 +2726,20 @@ int CodecTest(int argc, char **argv)
     DecParSetEx.bDeblocking     = 0;
     DecParSetEx.bDisableFewerDpb= 0;
     DecParSetEx.bLessInfo       = 0;
+    DecParSetEx.nResWidth       = 0;
+    DecParSetEx.nResHeight      = 0;
+    DecParSetEx.nResNum         = PICTURE_BUF_NUM;
+    DecParSetEx.bFramer         = 0;
 
     if (2 > argc) {
         IPP_Printf("Usage: appVmetaDec.exe \"-i:input.cmp -o:output.yuv -l:dec.log -fmt:xx -c:xx\"\n");
         IPP_Printf("       fmt:1(mpeg2), 2(mpeg4), 4(h263), 5(h264), 6(vc-1 ap), 7(jpeg), 8(mjpeg), 10(vc-1 mp&sp)\n");
         IPP_Printf("       c:0(output yuv), 1(output checksum)\n");
+        IPP_Printf("       resw/resh/resn: reserve resn display buffers of resw x resh up front\n");
+        IPP_Printf("       fr:1 feed one access unit per buffer without length file (fmt 1, 2, 5, 10)\n");
+        IPP_Printf("       bench:manifest.txt decode every command line of the manifest concurrently\n");
+        IPP_Printf("       golden:x.chksum compare with a -c:1 checksum list while decoding, stop at the first mismatch\n");
+        IPP_Printf("       conf:dir [-j:n] [-report:file] check every stream of dir against <stream>%s\n", CONF_GOLDEN_EXT);
         return IPP_FAIL;
     } else if (2 == argc){
         /*for validation*/
@@ -1350,6 +2750,12 @@ int CodecTest(int argc, char **argv)
             IPP_Printf("Usage: appVmetaDec.exe \"-i:input.cmp -o:output.yuv -l:dec.log -fmt:xx -c:xx!\"\n", argv[1]);
             return IPP_FAIL;
         }
+        if ('\0' != g_BenchFile[0]) {
+            return VmetaDecBench(g_BenchFile);
+        }
+        if ('\0' != g_ConfDir[0]) {
+            return VmetaConfRun(g_ConfDir, g_nConfJobs, g_ConfReport);
+        }
     } else {
         /*for internal debug*/
         IPP_Strcpy(input_file_name, argv[1]);
@@ -32,12 +32,23 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 /*vmeta os api*/
 #include "vdec_os_api.h"
 
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #define ALIGN16(x)                      ((x + 0xf) & (~0xf))
 #define STREAM_BUF_SIZE                 (2047 * 1024) /*must be multiple of 1024*/
 #define STREAM_BUF_NUM                  3
 #define PICTURE_BUF_NUM                 2
 #define LESSINFO_MAX_FRAME              10
 int bLessInfo=0;
+int bMmapLoader=0;                                  /*-mmap:1, mapped input loaded by a prefetch thread*/
+char g_FarmList[2048]   = {'\0'};                   /*-farm:jobs.txt, encode every job of the list*/
+char g_FarmCsv[2048]    = {'\0'};                   /*-csv:farm.csv, per job results*/
+int g_FarmWorkers       = 1;                        /*-jobs:K, concurrent encoder instances*/
+int g_FarmVerify        = 0;                        /*-verify:1, check restarted instances against fresh ones*/
 
 //#define IPP_Printf 
 
@@ -102,6 +113,187 @@ int LoadYUVData(Ipp8u *pPicBuf, IPP_FILE *infile, int inputYUVmode, int width, i
 	return IPP_OK;
 }
 
+/*
+***************************************************************************************
+* mapped input: the raw YUV file is mapped once and a prefetch thread copies frame n+1
+* into a free picture buffer while the encoder works on frame n. Planes whose source
+* and destination strides agree are copied with one memcpy, otherwise row by row.
+***************************************************************************************/
+#define YUV_QUEUE_SIZE                  4           /*power of 2, not less than PICTURE_BUF_NUM*/
+#define YUV_QUEUE_POLL_US               500
+#define YUV_PREFETCH_EOS                ((void*)-1) /*no more frames after this item*/
+
+typedef struct _YuvQueue {
+    volatile Ipp32u     nHead;                      /*written by the producer only*/
+    volatile Ipp32u     nTail;                      /*written by the consumer only*/
+    void                *pItem[YUV_QUEUE_SIZE];
+}YuvQueue;
+
+typedef struct _YuvPrefetch {
+    Ipp8u               *pBase;                     /*mapped input file*/
+    long                nSize;
+    long                nFrameBytes;                /*packed size of one raw frame*/
+    int                 nFrames;
+    int                 nNext;                      /*next frame to load*/
+    int                 eYUVFmt;
+    int                 nWidth;
+    int                 nHeight;
+    YuvQueue            FreeQ;                      /*encoder -> prefetch, free picture buffers*/
+    YuvQueue            ReadyQ;                     /*prefetch -> encoder, loaded pictures*/
+    volatile int        bExit;
+    IppThread           hThread;
+    int                 bThread;
+    long long           nLoadTime;                  /*us spent copying on the prefetch thread*/
+    Ipp32u              nLoadWait;                  /*polls the prefetch thread found no free buffer*/
+}YuvPrefetch;
+
+static int YuvQueuePush(YuvQueue *pQueue, void *pItem)
+{
+    Ipp32u nHead = pQueue->nHead;
+
+    if (YUV_QUEUE_SIZE <= nHead - pQueue->nTail) {
+        return -1;
+    }
+    pQueue->pItem[nHead & (YUV_QUEUE_SIZE - 1)] = pItem;
+    /*publish the item before the new head*/
+    __sync_synchronize();
+    pQueue->nHead = nHead + 1;
+    return 0;
+}
+
+static void *YuvQueuePop(YuvQueue *pQueue)
+{
+    Ipp32u nTail = pQueue->nTail;
+    void *pItem;
+
+    if (pQueue->nHead == nTail) {
+        return NULL;
+    }
+    __sync_synchronize();
+    pItem = pQueue->pItem[nTail & (YUV_QUEUE_SIZE - 1)];
+    __sync_synchronize();
+    pQueue->nTail = nTail + 1;
+    return pItem;
+}
+
+/*copy nRows rows of nWidth bytes, as one block when the strides agree*/
+static void CopyPlane(Ipp8u *pDst, int nDstStride, Ipp8u *pSrc, int nWidth, int nRows)
+{
+    int j;
+
+    if (nDstStride == nWidth) {
+        IPP_Memcpy(pDst, pSrc, nWidth * nRows);
+        return;
+    }
+    for (j = 0; j < nRows; j++) {
+        IPP_Memcpy(pDst, pSrc, nWidth);
+        pDst += nDstStride;
+        pSrc += nWidth;
+    }
+}
+
+/*same layout as LoadYUVData, from a mapped frame*/
+int LoadYUVDataMapped(Ipp8u *pPicBuf, Ipp8u *pSrc, int inputYUVmode, int width, int height)
+{
+    int     nStride = ALIGN16(width);
+    int     nSliceHeight = ALIGN16(height);
+    Ipp8u   *pChroma = pPicBuf + nStride * nSliceHeight;
+
+    if ((pPicBuf == NULL) || (pSrc == NULL)) {
+        return IPP_FAIL;
+    }
+
+    if (IPP_YCbCr420P == inputYUVmode) {
+        CopyPlane(pPicBuf, nStride, pSrc, width, height);
+        pSrc += width * height;
+        CopyPlane(pChroma, nStride / 2, pSrc, width / 2, height / 2);
+        pSrc += (width / 2) * (height / 2);
+        CopyPlane(pChroma + nStride * nSliceHeight / 4, nStride / 2, pSrc, width / 2, height / 2);
+    } else if ((IPP_YCbCr420SP == inputYUVmode) || (IPP_YCrCb420SP == inputYUVmode)) {
+        CopyPlane(pPicBuf, nStride, pSrc, width, height);
+        pSrc += width * height;
+        CopyPlane(pChroma, nStride, pSrc, width, height / 2);
+    } else if ((IPP_YCbCr422I == inputYUVmode) || (IPP_YCbYCr422I == inputYUVmode)) {
+        CopyPlane(pPicBuf, nStride * 2, pSrc, width * 2, height);
+    } else {
+        return IPP_FAIL;
+    }
+
+    return IPP_OK;
+}
+
+static int YuvPrefetchThread(void *pParam)
+{
+    YuvPrefetch *pPre = (YuvPrefetch*)pParam;
+    IppVmetaPicture *pPicture;
+    long long nStart;
+
+    while (!pPre->bExit) {
+        pPicture = (IppVmetaPicture*)YuvQueuePop(&pPre->FreeQ);
+        if (NULL == pPicture) {
+            pPre->nLoadWait++;
+            IPP_Sleep(YUV_QUEUE_POLL_US);
+            continue;
+        }
+        if (pPre->nNext >= pPre->nFrames) {
+            /*the ready queue holds at most PICTURE_BUF_NUM items, there is always room*/
+            YuvQueuePush(&pPre->ReadyQ, YUV_PREFETCH_EOS);
+            break;
+        }
+        nStart = IPP_TimeGetTickCount();
+        LoadYUVDataMapped(pPicture->pBuf, pPre->pBase + pPre->nFrameBytes * pPre->nNext,
+            pPre->eYUVFmt, pPre->nWidth, pPre->nHeight);
+        /*warm the page cache for the frame after this one*/
+        if (pPre->nNext + 1 < pPre->nFrames) {
+            madvise(pPre->pBase + ((pPre->nFrameBytes * (pPre->nNext + 1)) & ~(long)(getpagesize() - 1)),
+                pPre->nFrameBytes + getpagesize(), MADV_WILLNEED);
+        }
+        pPre->nLoadTime += IPP_TimeGetTickCount() - nStart;
+        pPre->nNext++;
+        YuvQueuePush(&pPre->ReadyQ, pPicture);
+    }
+    return 0;
+}
+
+/*map the input file, IPP_FAIL if it cannot be mapped (pipe, empty file...)*/
+static int YuvPrefetchOpen(YuvPrefetch *pPre, IPP_FILE *fpin, IppVmetaEncParSet *pEncParSet, int nFrameBytes)
+{
+    struct stat st;
+    int fd;
+
+    IPP_Memset(pPre, 0, sizeof(YuvPrefetch));
+    fd = fileno((FILE*)fpin);
+    if ((0 > fd) || (0 != fstat(fd, &st)) || (nFrameBytes > st.st_size) || (0 >= nFrameBytes)) {
+        return IPP_FAIL;
+    }
+    pPre->pBase = (Ipp8u*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (MAP_FAILED == (void*)pPre->pBase) {
+        pPre->pBase = NULL;
+        return IPP_FAIL;
+    }
+    madvise(pPre->pBase, st.st_size, MADV_SEQUENTIAL);
+    pPre->nSize         = st.st_size;
+    pPre->nFrameBytes   = nFrameBytes;
+    pPre->nFrames       = st.st_size / nFrameBytes;
+    pPre->eYUVFmt       = pEncParSet->eInputYUVFmt;
+    pPre->nWidth        = pEncParSet->nWidth;
+    pPre->nHeight       = pEncParSet->nHeight;
+    return IPP_OK;
+}
+
+static void YuvPrefetchClose(YuvPrefetch *pPre)
+{
+    pPre->bExit = 1;
+    if (pPre->bThread) {
+        IPP_ThreadDestroy(&pPre->hThread, 1);
+        pPre->bThread = 0;
+    }
+    if (pPre->pBase) {
+        munmap(pPre->pBase, pPre->nSize);
+        pPre->pBase = NULL;
+    }
+}
+
 int VmetaEncoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IppVmetaEncParSet *pEncParSet)
 {
     void *pEncoderState;
@@ -159,6 +351,12 @@ int VmetaEncoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IppVmetaE
     int ret;
     Ipp32u nVmetaRTLVer;
 
+    YuvPrefetch                 Prefetch;
+    YuvPrefetch                 *pPrefetch = NULL;  /*NULL: LoadYUVData with IPP_Fread*/
+    int                         perf_load_index;
+    int                         nLoadTime;
+    Ipp32u                      nInputWait;
+
 
     pEncoderState   = NULL;
     pFrameTimeArray = NULL;
@@ -206,6 +404,10 @@ int VmetaEncoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IppVmetaE
     IPP_GetPerfCounter(&thread_perf_index, IPP_TimeGetThreadTime, IPP_TimeGetThreadTime);
     IPP_ResetPerfCounter(thread_perf_index);
 
+    /*input time: fread + copy in sync mode, waiting for the prefetch thread otherwise*/
+    IPP_GetPerfCounter(&perf_load_index, IPP_TimeGetTickCount, IPP_TimeGetTickCount);
+    IPP_ResetPerfCounter(perf_load_index);
+
     CBTable.fMemMalloc  = IPP_MemMalloc;
     CBTable.fMemFree    = IPP_MemFree;
 
@@ -262,6 +464,17 @@ int VmetaEncoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IppVmetaE
     }
     nFrameSize = nPicBufSize;
 
+    if (bMmapLoader) {
+        if (IPP_OK == YuvPrefetchOpen(&Prefetch, fpin, pEncParSet,
+                nDataSizeYUV ? nDataSizeYUV : nDataSizeY + nDataSizeUV + nDataSizeU + nDataSizeV)) {
+            pPrefetch = &Prefetch;
+            IPP_Printf("mapped input: %d frames of %ld bytes\n", Prefetch.nFrames, Prefetch.nFrameBytes);
+        } else {
+            IPP_Printf("input cannot be mapped, use fread loader\n");
+        }
+    }
+    nInputWait = 0;
+
     IPP_Printf("pic buffer size  : %d\n", nPicBufSize);
     IPP_Printf("pic buffer number: %d\n", PICTURE_BUF_NUM);
     for (i = 0; i < PICTURE_BUF_NUM; i++) {
@@ -387,7 +600,46 @@ int VmetaEncoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IppVmetaE
             }
             pPicture = &(PictureGroup[nCurPicBufIdx]);
 
-            if ((NULL != pPicture->pBuf) && (pPicture->nBufSize < pEncInfo->dis_buf_size)) {
+            if (pPrefetch && !pPrefetch->bThread) {
+                /*dis_buf_size is known from the first request on, size every buffer before the prefetch starts*/
+                for (i = 0; i < PICTURE_BUF_NUM; i++) {
+                    if (PictureGroup[i].nBufSize < pEncInfo->dis_buf_size) {
+                        /*not every entry is pre-allocated*/
+                        if (PictureGroup[i].pBuf) {
+                            vdec_os_api_dma_free(PictureGroup[i].pBuf);
+                        }
+                        PictureGroup[i].nBufSize = 0;
+                        PictureGroup[i].pBuf    = (Ipp8u*)vdec_os_api_dma_alloc(pEncInfo->dis_buf_size, VMETA_DIS_BUF_ALIGN, &(PictureGroup[i].nPhyAddr));
+                        if (NULL == PictureGroup[i].pBuf) {
+                            IPP_Printf("ID = %d error: no memory!\n", pEncInfo->user_id);
+                            goto fail_cleanup;
+                        }
+                        PictureGroup[i].nBufSize = pEncInfo->dis_buf_size;
+                    }
+                    YuvQueuePush(&pPrefetch->FreeQ, &PictureGroup[i]);
+                }
+                if (0 != IPP_ThreadCreate(&pPrefetch->hThread, 0, YuvPrefetchThread, pPrefetch)) {
+                    IPP_Printf("ID = %d error: fail to create prefetch thread!\n", pEncInfo->user_id);
+                    goto fail_cleanup;
+                }
+                pPrefetch->bThread = 1;
+            }
+
+            if (pPrefetch && !bEOS) {
+                /*take the next loaded picture, whichever buffer it is in*/
+                IPP_StartPerfCounter(perf_load_index);
+                while (NULL == (pPicture = (IppVmetaPicture*)YuvQueuePop(&pPrefetch->ReadyQ))) {
+                    nInputWait++;
+                    IPP_Sleep(YUV_QUEUE_POLL_US);
+                }
+                IPP_StopPerfCounter(perf_load_index);
+                if (YUV_PREFETCH_EOS == (void*)pPicture) {
+                    pPicture    = NULL;
+                    bEOS        = 1;
+                } else {
+                    nCurPicBufIdx = (int)pPicture->pUsrData0;
+                }
+            } else if ((NULL != pPicture->pBuf) && (pPicture->nBufSize < pEncInfo->dis_buf_size)) {
                 if (!bLessInfo || nTotalFrames<=LESSINFO_MAX_FRAME) {
                     IPP_Printf("ID = %d pre-allocated picture is smaller than needed, pre = %d needed = %d\n", pEncInfo->user_id, 
                         pPicture->nBufSize, pEncInfo->dis_buf_size);
@@ -398,18 +650,24 @@ int VmetaEncoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IppVmetaE
                 pPicture->nBufSize  = 0;
             }
 
-            if (NULL == pPicture->pBuf) {
-                pPicture->pBuf                      = (Ipp8u*)vdec_os_api_dma_alloc(pEncInfo->dis_buf_size, VMETA_DIS_BUF_ALIGN, &(pPicture->nPhyAddr));
+            if (pPrefetch) {
+                /*loaded by the prefetch thread*/
+            } else {
                 if (NULL == pPicture->pBuf) {
-                    IPP_Printf("ID = %d error: no memory!\n", pEncInfo->user_id);
-                    goto fail_cleanup;
+                    pPicture->pBuf                      = (Ipp8u*)vdec_os_api_dma_alloc(pEncInfo->dis_buf_size, VMETA_DIS_BUF_ALIGN, &(pPicture->nPhyAddr));
+                    if (NULL == pPicture->pBuf) {
+                        IPP_Printf("ID = %d error: no memory!\n", pEncInfo->user_id);
+                        goto fail_cleanup;
+                    }
+                    pPicture->nBufSize                  = pEncInfo->dis_buf_size;
                 }
-                pPicture->nBufSize                  = pEncInfo->dis_buf_size;
-            }
 
-            ret = LoadYUVData(pPicture->pBuf, fpin, pEncParSet->eInputYUVFmt, pEncParSet->nWidth, pEncParSet->nHeight);
-            if (ret != IPP_OK) {
-                bEOS = 1;
+                IPP_StartPerfCounter(perf_load_index);
+                ret = LoadYUVData(pPicture->pBuf, fpin, pEncParSet->eInputYUVFmt, pEncParSet->nWidth, pEncParSet->nHeight);
+                IPP_StopPerfCounter(perf_load_index);
+                if (ret != IPP_OK) {
+                    bEOS = 1;
+                }
             }
 
             if (bEOS) {
@@ -440,6 +698,9 @@ int VmetaEncoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IppVmetaE
                     break;
                 }
                 bFreePicBufFlag[(int)pPicture->pUsrData0] = 1;
+                if (pPrefetch) {
+                    YuvQueuePush(&pPrefetch->FreeQ, pPicture);
+                }
                 if (!bLessInfo || nTotalFrames<=LESSINFO_MAX_FRAME) {
                     IPP_Printf("ID = %d pop pic buf finish. pic buf id: %d\n", pEncInfo->user_id, (int)pPicture->pUsrData0);
                 }
@@ -520,6 +781,9 @@ int VmetaEncoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IppVmetaE
                     break;
                 }
                 bFreePicBufFlag[(int)pPicture->pUsrData0] = 1;
+                if (pPrefetch) {
+                    YuvQueuePush(&pPrefetch->FreeQ, pPicture);
+                }
                 if (!bLessInfo || nTotalFrames<=LESSINFO_MAX_FRAME) {
                     IPP_Printf("ID = %d pop pic buf finish. pic buf id: %d\n", pEncInfo->user_id, (int)pPicture->pUsrData0);
                 }
@@ -577,6 +841,9 @@ int VmetaEncoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IppVmetaE
                     break;
                 }
                 bFreePicBufFlag[(int)pPicture->pUsrData0] = 1;
+                if (pPrefetch) {
+                    YuvQueuePush(&pPrefetch->FreeQ, pPicture);
+                }
                 if (!bLessInfo || nTotalFrames<=LESSINFO_MAX_FRAME) {
                     IPP_Printf("ID = %d pop pic buf finish. pic buf id: %d\n", pEncInfo->user_id, (int)pPicture->pUsrData0);
                 }
@@ -621,6 +888,10 @@ int VmetaEncoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IppVmetaE
         }
     }
     IPP_StopPerfCounter(total_perf_index);
+    if (pPrefetch) {
+        /*stop the prefetch thread before its picture buffers go away*/
+        YuvPrefetchClose(pPrefetch);
+    }
 
     IPP_Printf("ID = %d before EncoderFree_Vmeta\n", pEncInfo->user_id);
     rtCode = EncoderFree_Vmeta(&pEncoderState);
@@ -661,6 +932,14 @@ int VmetaEncoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IppVmetaE
     IPP_Printf("ID = %d Total Frame: %d, Total Time: %d(ms), FPS: %f\n", pEncInfo->user_id, 
         nTotalFrames, (nTotalTime + 500) / 1000, (float)(1000.0 * 1000.0 * nTotalFrames / nTotalTime));
 
+    nLoadTime = IPP_GetPerfData(perf_load_index);
+    if (pPrefetch) {
+        IPP_Printf("ID = %d [PERF] Input: mmap + prefetch, copy time %d (ms) on prefetch thread, encoder waited %d (ms) in %u polls, prefetch idle polls %u\n",
+            pEncInfo->user_id, (int)((pPrefetch->nLoadTime + 500) / 1000), (nLoadTime + 500) / 1000, nInputWait, pPrefetch->nLoadWait);
+    } else {
+        IPP_Printf("ID = %d [PERF] Input: fread, load time %d (ms)\n", pEncInfo->user_id, (nLoadTime + 500) / 1000);
+    }
+
     g_Tot_Time[IPP_VIDEO_INDEX]     = IPP_GetPerfData(codec_perf_index);
     g_Tot_CPUTime[IPP_VIDEO_INDEX]  = IPP_GetPerfData(thread_perf_index);
     g_Frame_Num[IPP_VIDEO_INDEX]    = nTotalFrames;
@@ -691,6 +970,7 @@ int VmetaEncoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IppVmetaE
     IPP_FreePerfCounter(perf_push_pic_index);
     IPP_FreePerfCounter(perf_pop_pic_index);
     IPP_FreePerfCounter(perf_cmd_index);
+    IPP_FreePerfCounter(perf_load_index);
 
     IPP_Printf("ID = %d before driver clean\n", pEncInfo->user_id);
     vdec_os_driver_clean();
@@ -703,6 +983,10 @@ int VmetaEncoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, IppVmetaE
 fail_cleanup:
     IPP_Printf("encoding fail: clean up\n");
 
+    if (pPrefetch) {
+        YuvPrefetchClose(pPrefetch);
+    }
+
     IPP_Printf("free codec state\n");
     if (pEncoderState) {
         EncoderFree_Vmeta(&pEncoderState);
@@ -736,6 +1020,485 @@ fail_cleanup:
     return IPP_FAIL;
 }
 
+/*
+encode farm: a job list is shared by K worker threads, each of them owning one encoder
+instance with its stream and picture buffers. A worker prefers the next job with the
+configuration its instance was created with and restarts the instance for it with
+IPPVC_RECONFIG; the instance is only freed and allocated again when the configuration
+differs or the restart is refused.
+With -verify:1 the first job a restarted instance encodes is encoded again by a fresh
+instance and the two streams are compared; only a match counts as a reuse. On a mismatch
+the job is redone by the fresh instance and every later job gets a new instance. These
+extra encodes are not farm work: they are timed apart from the jobs and reported on
+their own, but they still share the wall time and the hardware, so leave verification
+off for benchmark runs.
+*/
+#define FARM_MAX_JOB                    256
+#define FARM_MAX_WORKER                 8
+#define FARM_CHECK_INIT                 2166136261u /*FNV-1a offset basis*/
+
+typedef struct _FarmJob {
+    char                InFile[2048];
+    char                OutFile[2048];
+    IppVmetaEncParSet   EncParSet;
+    int                 bClaimed;
+    /*result*/
+    int                 rtFlag;
+    int                 nWorker;
+    int                 bReused;
+    int                 nFrames;
+    int                 nBytes;
+    Ipp32u              nCheck;                     /*FNV-1a of the output stream*/
+    long long           nWallTime;                  /*us, from open to end of stream*/
+    long long           nCodecTime;                 /*us spent in EncodeFrame_Vmeta*/
+    Ipp32u              nHoldMs;                    /*hw lock held for this job*/
+    Ipp32u              nWaitMs;                    /*hw lock waited for by this job*/
+}FarmJob;
+
+typedef struct _FarmWorker {
+    int                 nId;
+    struct _FarmCtx     *pFarm;
+    IppThread           hThread;
+    void                *pEncoderState;
+    IppVmetaEncParSet   EncParSet;                  /*the configuration pEncoderState runs with*/
+    int                 user_id;
+    IppVmetaBitstream   BitStreamGroup[STREAM_BUF_NUM];
+    IppVmetaPicture     PictureGroup[PICTURE_BUF_NUM];
+    int                 bFreeStrmBufFlag[STREAM_BUF_NUM];
+    int                 bFreePicBufFlag[PICTURE_BUF_NUM];
+    int                 nInitNum;
+    int                 nReuseNum;
+    int                 bReuseChecked;              /*a restart of this instance matched a fresh encode*/
+    long long           nVerifyTime;                /*us spent in verification encodes and discarded jobs*/
+    Ipp32u              nVerifyHoldMs;              /*hw lock held by them*/
+}FarmWorker;
+
+typedef struct _FarmCtx {
+    FarmJob             *pJobs;
+    int                 nJobs;
+    FarmWorker          Worker[FARM_MAX_WORKER];
+    int                 nWorkers;
+    int                 bVerify;                    /*check the first job of a restarted instance*/
+    int                 bNoReuse;                   /*a restarted instance encoded differently, always reopen*/
+}FarmCtx;
+
+static int FarmSameConfig(IppVmetaEncParSet *pA, IppVmetaEncParSet *pB)
+{
+    return (pA->eInputYUVFmt == pB->eInputYUVFmt) && (pA->eOutputStrmFmt == pB->eOutputStrmFmt)
+        && (pA->nWidth == pB->nWidth) && (pA->nHeight == pB->nHeight)
+        && (pA->nPBetweenI == pB->nPBetweenI) && (pA->nBFrameNum == pB->nBFrameNum)
+        && (pA->bRCEnable == pB->bRCEnable) && (pA->nRCType == pB->nRCType) && (pA->nQP == pB->nQP)
+        && (pA->nRCBitRate == pB->nRCBitRate) && (pA->nMaxBitRate == pB->nMaxBitRate)
+        && (pA->nFrameRateNum == pB->nFrameRateNum);
+}
+
+/*next unclaimed job, one matching the worker's instance first*/
+static FarmJob *FarmClaimJob(FarmWorker *pWorker)
+{
+    FarmCtx *pFarm = pWorker->pFarm;
+    FarmJob *pJob;
+    int i;
+
+    if (pWorker->pEncoderState) {
+        for (i = 0; i < pFarm->nJobs; i++) {
+            pJob = &pFarm->pJobs[i];
+            if (!pJob->bClaimed && FarmSameConfig(&pJob->EncParSet, &pWorker->EncParSet)
+                && __sync_bool_compare_and_swap(&pJob->bClaimed, 0, 1)) {
+                return pJob;
+            }
+        }
+    }
+    for (i = 0; i < pFarm->nJobs; i++) {
+        pJob = &pFarm->pJobs[i];
+        if (!pJob->bClaimed && __sync_bool_compare_and_swap(&pJob->bClaimed, 0, 1)) {
+            return pJob;
+        }
+    }
+    return NULL;
+}
+
+static void FarmFreeEncoder(FarmWorker *pWorker)
+{
+    int i;
+
+    if (pWorker->pEncoderState) {
+        EncoderFree_Vmeta(&pWorker->pEncoderState);
+        pWorker->pEncoderState = NULL;
+    }
+    pWorker->user_id = -1;
+    pWorker->bReuseChecked = 0;
+    for (i = 0; i < STREAM_BUF_NUM; i++) {
+        pWorker->bFreeStrmBufFlag[i] = 1;
+    }
+    for (i = 0; i < PICTURE_BUF_NUM; i++) {
+        pWorker->bFreePicBufFlag[i] = 1;
+    }
+}
+
+static void FarmPopPic(FarmWorker *pWorker)
+{
+    IppVmetaPicture *pPicture;
+
+    while (1) {
+        EncoderPopBuffer_Vmeta(IPP_VMETA_BUF_TYPE_PIC, (void**)&pPicture, pWorker->pEncoderState);
+        if (NULL == pPicture) {
+            break;
+        }
+        pWorker->bFreePicBufFlag[(int)pPicture->pUsrData0] = 1;
+    }
+}
+
+static Ipp32u FarmCheck(Ipp32u nCheck, Ipp8u *p, int nLen)
+{
+    while (0 < nLen--) {
+        nCheck = (nCheck ^ *p++) * 16777619u;
+    }
+    return nCheck;
+}
+
+static void FarmPopStrm(FarmWorker *pWorker, FarmJob *pJob, IPP_FILE *fpout)
+{
+    IppVmetaBitstream *pBitStream;
+
+    while (1) {
+        EncoderPopBuffer_Vmeta(IPP_VMETA_BUF_TYPE_STRM, (void**)&pBitStream, pWorker->pEncoderState);
+        if (NULL == pBitStream) {
+            break;
+        }
+        pWorker->bFreeStrmBufFlag[(int)pBitStream->pUsrData0] = 1;
+        if (fpout) {
+            IPP_Fwrite(pBitStream->pBuf + pBitStream->nOffset, 1, pBitStream->nDataLen, fpout);
+        }
+        pJob->nBytes += pBitStream->nDataLen;
+        pJob->nCheck = FarmCheck(pJob->nCheck, pBitStream->pBuf + pBitStream->nOffset, pBitStream->nDataLen);
+    }
+}
+
+/*restart the worker's instance for pJob, or create one*/
+static int FarmPrepareEncoder(FarmWorker *pWorker, FarmJob *pJob)
+{
+    MiscGeneralCallbackTable CBTable;
+    IppCodecStatus rtCode;
+    int nOptHdrs;
+
+    if (pWorker->pEncoderState) {
+        if (!pWorker->pFarm->bNoReuse && FarmSameConfig(&pJob->EncParSet, &pWorker->EncParSet)) {
+            rtCode = EncodeSendCmd_Vmeta(IPPVC_RECONFIG, &pWorker->EncParSet, NULL, pWorker->pEncoderState);
+            if (IPP_STATUS_NOERR == rtCode) {
+                /*with verification, counted once the restart is known to encode like a fresh instance*/
+                pJob->bReused = 1;
+                if (pWorker->bReuseChecked || !pWorker->pFarm->bVerify) {
+                    pWorker->nReuseNum++;
+                }
+            } else {
+                IPP_Printf("[FARM] worker %d: instance restart refused (%d), allocate a new one\n", pWorker->nId, rtCode);
+                FarmFreeEncoder(pWorker);
+            }
+        } else {
+            FarmFreeEncoder(pWorker);
+        }
+    }
+
+    if (NULL == pWorker->pEncoderState) {
+        pWorker->EncParSet  = pJob->EncParSet;
+        CBTable.fMemMalloc  = IPP_MemMalloc;
+        CBTable.fMemFree    = IPP_MemFree;
+        rtCode = EncoderInitAlloc_Vmeta(&pWorker->EncParSet, &CBTable, &pWorker->pEncoderState);
+        if (IPP_STATUS_NOERR != rtCode) {
+            IPP_Printf("[FARM] worker %d: encoder init fail, error code %d!\n", pWorker->nId, rtCode);
+            EncoderFree_Vmeta(&pWorker->pEncoderState);
+            pWorker->pEncoderState = NULL;
+            return IPP_FAIL;
+        }
+        pWorker->nInitNum++;
+    }
+
+    /*every job is a stream of its own*/
+    nOptHdrs = 1;
+    EncodeSendCmd_Vmeta(IPPVC_OUTPUT_SPS_AND_PPS, &nOptHdrs, NULL, pWorker->pEncoderState);
+    return IPP_OK;
+}
+
+static int FarmEncodeJob(FarmWorker *pWorker, FarmJob *pJob)
+{
+    IppVmetaEncParSet *pEncParSet = &pJob->EncParSet;
+    IppVmetaEncInfo VideoEncInfo;
+    IppVmetaEncInfo *pEncInfo = &VideoEncInfo;
+    IppVmetaPicture *pPicture;
+    IppCodecStatus rtCode;
+    IPP_FILE *fpin, *fpout = NULL;
+    vmeta_lock_info LockStart, LockEnd;
+    long long nStart, nTick;
+    int i, bEOS = 0;
+
+    pJob->nWorker   = pWorker->nId;
+    pJob->bReused   = 0;
+    pJob->nFrames   = 0;
+    pJob->nBytes    = 0;
+    pJob->nCheck    = FARM_CHECK_INIT;
+    pJob->nCodecTime= 0;
+    pJob->nWallTime = 0;
+    pJob->nHoldMs   = 0;
+    pJob->nWaitMs   = 0;
+    nStart          = IPP_TimeGetTickCount();
+
+    fpin = IPP_Fopen(pJob->InFile, "rb");
+    if (NULL == fpin) {
+        IPP_Printf("[FARM] worker %d: fails to open file %s\n", pWorker->nId, pJob->InFile);
+        return IPP_FAIL;
+    }
+    if (0 != IPP_Strcmp(pJob->OutFile, "\0")) {
+        fpout = IPP_Fopen(pJob->OutFile, "wb");
+        if (NULL == fpout) {
+            IPP_Printf("[FARM] worker %d: fails to open file %s\n", pWorker->nId, pJob->OutFile);
+            IPP_Fclose(fpin);
+            return IPP_FAIL;
+        }
+    }
+
+    if (IPP_OK != FarmPrepareEncoder(pWorker, pJob)) {
+        goto fail;
+    }
+    /*a new user id starts with cleared lock statistics*/
+    IPP_Memset(&LockStart, 0, sizeof(vmeta_lock_info));
+    if (pJob->bReused && (0 <= pWorker->user_id)) {
+        vdec_os_api_get_lock_info(pWorker->user_id, &LockStart);
+    }
+
+    while (1) {
+        nTick   = IPP_TimeGetTickCount();
+        rtCode  = EncodeFrame_Vmeta(pEncInfo, pWorker->pEncoderState);
+        pJob->nCodecTime += IPP_TimeGetTickCount() - nTick;
+
+        if (IPP_STATUS_NEED_OUTPUT_BUF == rtCode) {
+            for (i = 0; i < STREAM_BUF_NUM; i++) {
+                if (pWorker->bFreeStrmBufFlag[i]) {
+                    break;
+                }
+            }
+            if (STREAM_BUF_NUM <= i) {
+                IPP_Printf("[FARM] worker %d: strm buf is not enough!\n", pWorker->nId);
+                goto fail;
+            }
+            pWorker->bFreeStrmBufFlag[i] = 0;
+            rtCode = EncoderPushBuffer_Vmeta(IPP_VMETA_BUF_TYPE_STRM, (void*)&pWorker->BitStreamGroup[i], pWorker->pEncoderState);
+            if (IPP_STATUS_NOERR != rtCode) {
+                IPP_Printf("[FARM] worker %d: push stream buffer error!\n", pWorker->nId);
+                goto fail;
+            }
+        } else if (IPP_STATUS_NEED_INPUT == rtCode) {
+            if (bEOS) {
+                EncodeSendCmd_Vmeta(IPPVC_END_OF_STREAM, NULL, NULL, pWorker->pEncoderState);
+                continue;
+            }
+            for (i = 0; i < PICTURE_BUF_NUM; i++) {
+                if (pWorker->bFreePicBufFlag[i]) {
+                    break;
+                }
+            }
+            if (PICTURE_BUF_NUM <= i) {
+                IPP_Printf("[FARM] worker %d: pic buf is not enough!\n", pWorker->nId);
+                goto fail;
+            }
+            pPicture = &pWorker->PictureGroup[i];
+            /*picture buffers stay with the worker, grow them when a job needs more*/
+            if (pPicture->nBufSize < pEncInfo->dis_buf_size) {
+                if (pPicture->pBuf) {
+                    vdec_os_api_dma_free(pPicture->pBuf);
+                }
+                pPicture->pBuf = (Ipp8u*)vdec_os_api_dma_alloc(pEncInfo->dis_buf_size, VMETA_DIS_BUF_ALIGN, &(pPicture->nPhyAddr));
+                if (NULL == pPicture->pBuf) {
+                    pPicture->nBufSize = 0;
+                    IPP_Printf("[FARM] worker %d: no memory!\n", pWorker->nId);
+                    goto fail;
+                }
+                pPicture->nBufSize = pEncInfo->dis_buf_size;
+            }
+            if (IPP_OK != LoadYUVData(pPicture->pBuf, fpin, pEncParSet->eInputYUVFmt, pEncParSet->nWidth, pEncParSet->nHeight)) {
+                bEOS = 1;
+                EncodeSendCmd_Vmeta(IPPVC_END_OF_STREAM, NULL, NULL, pWorker->pEncoderState);
+            } else {
+                pPicture->nDataLen = pEncInfo->dis_buf_size;
+                pWorker->bFreePicBufFlag[i] = 0;
+                EncoderPushBuffer_Vmeta(IPP_VMETA_BUF_TYPE_PIC, (void*)pPicture, pWorker->pEncoderState);
+                pJob->nFrames++;
+            }
+        } else if (IPP_STATUS_END_OF_PICTURE == rtCode) {
+            FarmPopPic(pWorker);
+            FarmPopStrm(pWorker, pJob, fpout);
+        } else if (IPP_STATUS_RETURN_INPUT_BUF == rtCode) {
+            FarmPopPic(pWorker);
+        } else if (IPP_STATUS_OUTPUT_DATA == rtCode) {
+            FarmPopStrm(pWorker, pJob, fpout);
+        } else if (IPP_STATUS_END_OF_STREAM == rtCode) {
+            FarmPopPic(pWorker);
+            FarmPopStrm(pWorker, pJob, fpout);
+            break;
+        } else {
+            IPP_Printf("[FARM] worker %d: deadly error! %d\n", pWorker->nId, rtCode);
+            goto fail;
+        }
+    }
+    pJob->nWallTime     = IPP_TimeGetTickCount() - nStart;
+    pWorker->user_id    = pEncInfo->user_id;
+
+    if (0 == vdec_os_api_get_lock_info(pWorker->user_id, &LockEnd)) {
+        pJob->nHoldMs   = LockEnd.hold_ms - LockStart.hold_ms;
+        pJob->nWaitMs   = LockEnd.wait_ms - LockStart.wait_ms;
+    }
+
+    IPP_Fclose(fpin);
+    if (fpout) {
+        IPP_Fclose(fpout);
+    }
+    pJob->rtFlag = IPP_OK;
+    return IPP_OK;
+
+fail:
+    pJob->nWallTime = IPP_TimeGetTickCount() - nStart;
+    /*the instance is in an unknown state, do not hand it to the next job*/
+    FarmFreeEncoder(pWorker);
+    IPP_Fclose(fpin);
+    if (fpout) {
+        IPP_Fclose(fpout);
+    }
+    pJob->rtFlag = IPP_FAIL;
+    return IPP_FAIL;
+}
+
+/*encode pJob again with a fresh instance and compare, 1 if the restarted instance can be trusted*/
+static int FarmCheckReuse(FarmWorker *pWorker, FarmJob *pJob)
+{
+    FarmJob Fresh = *pJob;
+    int ret;
+
+    Fresh.OutFile[0] = '\0';
+    FarmFreeEncoder(pWorker);
+    ret = FarmEncodeJob(pWorker, &Fresh);
+    pWorker->nVerifyTime    += Fresh.nWallTime;
+    pWorker->nVerifyHoldMs  += Fresh.nHoldMs;
+    if (IPP_OK != ret) {
+        IPP_Printf("[FARM] worker %d: fresh encode of %s failed, restart not verified\n", pWorker->nId, pJob->InFile);
+        return 0;
+    }
+    if ((Fresh.nBytes != pJob->nBytes) || (Fresh.nCheck != pJob->nCheck)) {
+        IPP_Printf("[FARM] worker %d: restarted instance differs from a fresh one on %s (%d/%d bytes), stop reusing\n",
+            pWorker->nId, pJob->InFile, pJob->nBytes, Fresh.nBytes);
+        __sync_fetch_and_or(&pWorker->pFarm->bNoReuse, 1);
+        return 0;
+    }
+    IPP_Printf("[FARM] worker %d: restarted instance matches a fresh one on %s\n", pWorker->nId, pJob->InFile);
+    pWorker->bReuseChecked = 1;
+    return 1;
+}
+
+static int FarmWorkerThread(void *pParam)
+{
+    FarmWorker *pWorker = (FarmWorker*)pParam;
+    FarmJob *pJob;
+    int i;
+
+    while (NULL != (pJob = FarmClaimJob(pWorker))) {
+        IPP_Printf("[FARM] worker %d: start %s %dx%d\n", pWorker->nId, pJob->InFile,
+            pJob->EncParSet.nWidth, pJob->EncParSet.nHeight);
+        FarmEncodeJob(pWorker, pJob);
+        if (pWorker->pFarm->bVerify && (IPP_OK == pJob->rtFlag) && pJob->bReused && !pWorker->bReuseChecked) {
+            if (FarmCheckReuse(pWorker, pJob)) {
+                pWorker->nReuseNum++;
+            } else if (pWorker->pFarm->bNoReuse) {
+                /*the output of the restarted instance is suspect, redo the job and count only the redo*/
+                pWorker->nVerifyTime    += pJob->nWallTime;
+                pWorker->nVerifyHoldMs  += pJob->nHoldMs;
+                FarmEncodeJob(pWorker, pJob);
+            }
+        }
+        IPP_Printf("[FARM] worker %d: %s %s, %d frames\n", pWorker->nId, pJob->InFile,
+            (IPP_OK == pJob->rtFlag) ? "done" : "failed", pJob->nFrames);
+    }
+
+    FarmFreeEncoder(pWorker);
+    for (i = 0; i < PICTURE_BUF_NUM; i++) {
+        if (pWorker->PictureGroup[i].pBuf) {
+            vdec_os_api_dma_free(pWorker->PictureGroup[i].pBuf);
+            pWorker->PictureGroup[i].pBuf = NULL;
+        }
+    }
+    return 0;
+}
+
+static int FarmWorkerOpen(FarmWorker *pWorker, FarmCtx *pFarm, int nId)
+{
+    int i;
+
+    IPP_Memset(pWorker, 0, sizeof(FarmWorker));
+    pWorker->nId    = nId;
+    pWorker->pFarm  = pFarm;
+    pWorker->user_id= -1;
+    for (i = 0; i < STREAM_BUF_NUM; i++) {
+        pWorker->BitStreamGroup[i].pBuf = (Ipp8u*)vdec_os_api_dma_alloc(STREAM_BUF_SIZE, VMETA_STRM_BUF_ALIGN, &(pWorker->BitStreamGroup[i].nPhyAddr));
+        if (NULL == pWorker->BitStreamGroup[i].pBuf) {
+            return IPP_FAIL;
+        }
+        pWorker->BitStreamGroup[i].nBufSize     = STREAM_BUF_SIZE;
+        pWorker->BitStreamGroup[i].pUsrData0    = (void*)i;
+        pWorker->bFreeStrmBufFlag[i]            = 1;
+    }
+    for (i = 0; i < PICTURE_BUF_NUM; i++) {
+        pWorker->PictureGroup[i].pUsrData0      = (void*)i;
+        pWorker->bFreePicBufFlag[i]             = 1;
+    }
+    return IPP_OK;
+}
+
+static void FarmWorkerClose(FarmWorker *pWorker)
+{
+    int i;
+
+    for (i = 0; i < STREAM_BUF_NUM; i++) {
+        if (pWorker->BitStreamGroup[i].pBuf) {
+            vdec_os_api_dma_free(pWorker->BitStreamGroup[i].pBuf);
+            pWorker->BitStreamGroup[i].pBuf = NULL;
+        }
+    }
+}
+
+/*one line per job for capacity planning*/
+static void FarmWriteCsv(FarmCtx *pFarm, char *pCsvFile)
+{
+    IPP_FILE *fp;
+    FarmJob *pJob;
+    float fFps, fKbps, fTargetKbps, fFrameRate;
+    int i;
+
+    fp = IPP_Fopen(pCsvFile, "w");
+    if (NULL == fp) {
+        IPP_Printf("[FARM] fails to open file %s\n", pCsvFile);
+        return;
+    }
+    IPP_Fprintf(fp, "job,input,worker,instance,width,height,frames,result,wall_ms,codec_ms,fps,"
+        "target_kbps,actual_kbps,bitrate_err_pct,hw_hold_ms,hw_wait_ms,hw_occupancy_pct\n");
+    for (i = 0; i < pFarm->nJobs; i++) {
+        pJob        = &pFarm->pJobs[i];
+        fFrameRate  = pJob->EncParSet.nFrameRateNum ? (float)pJob->EncParSet.nFrameRateNum : 30.0f;
+        fFps        = pJob->nWallTime ? (float)(1000.0 * 1000.0 * pJob->nFrames / pJob->nWallTime) : 0;
+        fKbps       = pJob->nFrames ? (float)pJob->nBytes * 8 * fFrameRate / pJob->nFrames / 1000 : 0;
+        fTargetKbps = pJob->EncParSet.bRCEnable ? (float)pJob->EncParSet.nRCBitRate / 1000 : 0;
+        IPP_Fprintf(fp, "%d,%s,%d,%s,%d,%d,%d,%s,%d,%d,%.2f,", i, pJob->InFile, pJob->nWorker,
+            pJob->bReused ? "reused" : "new", pJob->EncParSet.nWidth, pJob->EncParSet.nHeight, pJob->nFrames,
+            (IPP_OK == pJob->rtFlag) ? "ok" : "fail", (int)((pJob->nWallTime + 500) / 1000),
+            (int)((pJob->nCodecTime + 500) / 1000), fFps);
+        if (fTargetKbps > 0) {
+            IPP_Fprintf(fp, "%.1f,%.1f,%.2f,", fTargetKbps, fKbps, (fKbps - fTargetKbps) * 100 / fTargetKbps);
+        } else {
+            /*constant QP, there is no target to compare with*/
+            IPP_Fprintf(fp, ",%.1f,,", fKbps);
+        }
+        IPP_Fprintf(fp, "%u,%u,%.1f\n", pJob->nHoldMs, pJob->nWaitMs,
+            pJob->nWallTime ? (float)(pJob->nHoldMs * 100000.0 / pJob->nWallTime) : 0);
+    }
+    IPP_Fclose(fp);
+}
+
 
 #define VMETA_ENC_PARA_NUM 13
 
@@ -1020,6 +1783,19 @@ int ParseVmetaEncCmd(char *pCmdLine,
         } else if (0 == IPP_Strcmp(par_name, "lessinfo")) {
             STRNCPY(par_value, p2 + 1, par_value_len);
             bLessInfo = IPP_Atoi(par_value);
+        } else if (0 == IPP_Strcmp(par_name, "mmap")) {
+            STRNCPY(par_value, p2 + 1, par_value_len);
+            bMmapLoader = IPP_Atoi(par_value);
+        } else if (0 == IPP_Strcmp(par_name, "farm")) {
+            STRNCPY(g_FarmList, p2 + 1, par_value_len);
+        } else if (0 == IPP_Strcmp(par_name, "csv")) {
+            STRNCPY(g_FarmCsv, p2 + 1, par_value_len);
+        } else if (0 == IPP_Strcmp(par_name, "jobs")) {
+            STRNCPY(par_value, p2 + 1, par_value_len);
+            g_FarmWorkers = IPP_Atoi(par_value);
+        } else if (0 == IPP_Strcmp(par_name, "verify")) {
+            STRNCPY(par_value, p2 + 1, par_value_len);
+            g_FarmVerify = IPP_Atoi(par_value);
         } else if ((0 == IPP_Strcmp(par_name, "p")) || (0 == IPP_Strcmp(par_name, "P"))) {
             /*par file*/
             /*parse par file to fill pParSet*/
@@ -1058,6 +1834,137 @@ int ParseVmetaEncCmd(char *pCmdLine,
     return IPP_OK;
 }
 
+/******************************************************************************
+// Name:                VmetaEncFarm
+// Description:         Encode every job of a job list with nWorkers concurrent
+//                      encoder instances
+//
+// Input Arguments:
+//      pListFile   :   Job list, one command line per job, e.g.
+//                      -i:a.yuv -o:a.264 -nWidth:1280 -nHeight:720 -bRCEnable:1 -nRCBitRate:2000000
+//                      each job starts from the defaults and VmetaEncConfig.cfg
+//      nWorkers    :   Number of concurrent encoder instances
+//      bVerify     :   Check restarted instances against fresh ones, off for benchmark runs
+//      pCsvFile    :   Per job results, may be empty
+// Returns:
+//        [Success]     IPP_OK, every job encoded
+//        [Failure]     IPP_FAIL
+******************************************************************************/
+int VmetaEncFarm(char *pListFile, int nWorkers, int bVerify, char *pCsvFile)
+{
+    FarmCtx Farm;
+    IPP_FILE *fpList;
+    FarmJob *pJob;
+    char line[2048];
+    char log_file_name[2048]    = {'\0'};
+    char rec_file_name[2048]    = {'\0'};
+    long long nStart, nWallTime, nVerifyTime = 0;
+    Ipp32u nHoldMs = 0, nVerifyHoldMs = 0;
+    int nFrames = 0, nFailed = 0, nReuse = 0, nInit = 0;
+    int i, len, ret;
+
+    IPP_Memset(&Farm, 0, sizeof(FarmCtx));
+    Farm.bVerify = bVerify;
+    if (nWorkers < 1) {
+        nWorkers = 1;
+    } else if (nWorkers > FARM_MAX_WORKER) {
+        nWorkers = FARM_MAX_WORKER;
+    }
+
+    fpList = IPP_Fopen(pListFile, "r");
+    if (NULL == fpList) {
+        IPP_Printf("[FARM] fails to open job list %s\n", pListFile);
+        return IPP_FAIL;
+    }
+    IPP_MemMalloc((void**)&Farm.pJobs, sizeof(FarmJob) * FARM_MAX_JOB, 4);
+    if (NULL == Farm.pJobs) {
+        IPP_Fclose(fpList);
+        return IPP_FAIL;
+    }
+    IPP_Memset(Farm.pJobs, 0, sizeof(FarmJob) * FARM_MAX_JOB);
+    while ((Farm.nJobs < FARM_MAX_JOB) && (NULL != IPP_Fgets(line, sizeof(line), fpList))) {
+        len = IPP_Strlen(line);
+        while ((0 < len) && (('\n' == line[len - 1]) || ('\r' == line[len - 1]) || (' ' == line[len - 1]))) {
+            line[--len] = '\0';
+        }
+        if ((0 == len) || ('#' == line[0])) {
+            continue;
+        }
+        pJob = &Farm.pJobs[Farm.nJobs];
+        if (IPP_OK != ParseVmetaEncCmd(line, pJob->InFile, pJob->OutFile, log_file_name, rec_file_name, &g_VmetaEncParSet)
+            || (0 == IPP_Strcmp(pJob->InFile, "\0"))) {
+            IPP_Printf("[FARM] wrong job line: %s\n", line);
+            IPP_Fclose(fpList);
+            IPP_MemFree((void**)&Farm.pJobs);
+            return IPP_FAIL;
+        }
+        pJob->EncParSet = g_VmetaEncParSet;
+        /*the workers share the hardware*/
+        pJob->EncParSet.bMultiIns   = 1;
+        pJob->EncParSet.bFirstUser  = 0;
+        Farm.nJobs++;
+    }
+    IPP_Fclose(fpList);
+    IPP_Printf("[FARM] %d jobs, %d workers\n", Farm.nJobs, nWorkers);
+
+    ret = vdec_os_driver_init();
+    if (0 > ret) {
+        IPP_Printf("error: driver init fail! ret = %d\n", ret);
+        IPP_MemFree((void**)&Farm.pJobs);
+        return IPP_FAIL;
+    }
+
+    nStart = IPP_TimeGetTickCount();
+    for (i = 0; i < nWorkers; i++) {
+        if (IPP_OK != FarmWorkerOpen(&Farm.Worker[i], &Farm, i)) {
+            IPP_Printf("[FARM] worker %d: no memory!\n", i);
+            FarmWorkerClose(&Farm.Worker[i]);
+            break;
+        }
+        if (0 != IPP_ThreadCreate(&Farm.Worker[i].hThread, 0, FarmWorkerThread, &Farm.Worker[i])) {
+            IPP_Printf("[FARM] worker %d: fail to create thread!\n", i);
+            FarmWorkerClose(&Farm.Worker[i]);
+            break;
+        }
+    }
+    Farm.nWorkers = i;
+    for (i = 0; i < Farm.nWorkers; i++) {
+        IPP_ThreadDestroy(&Farm.Worker[i].hThread, 1);
+        FarmWorkerClose(&Farm.Worker[i]);
+        nReuse  += Farm.Worker[i].nReuseNum;
+        nInit   += Farm.Worker[i].nInitNum;
+        nVerifyTime     += Farm.Worker[i].nVerifyTime;
+        nVerifyHoldMs   += Farm.Worker[i].nVerifyHoldMs;
+    }
+    nWallTime = IPP_TimeGetTickCount() - nStart;
+    vdec_os_driver_clean();
+
+    for (i = 0; i < Farm.nJobs; i++) {
+        pJob = &Farm.pJobs[i];
+        if ((IPP_OK != pJob->rtFlag) || !pJob->bClaimed) {
+            nFailed++;
+        }
+        nFrames += pJob->nFrames;
+        nHoldMs += pJob->nHoldMs;
+    }
+    IPP_Printf("[FARM] %d jobs (%d failed) %d frames in %d (ms), FPS: %f\n", Farm.nJobs, nFailed, nFrames,
+        (int)((nWallTime + 500) / 1000), nWallTime ? (float)(1000.0 * 1000.0 * nFrames / nWallTime) : 0);
+    IPP_Printf("[FARM] encoder instances created %d reused %d, hw held %u (ms) %.1f%% of wall time\n",
+        nInit, nReuse, nHoldMs, nWallTime ? (float)(nHoldMs * 100000.0 / nWallTime) : 0);
+    if (bVerify) {
+        /*not in the job totals above, but the wall time includes it*/
+        IPP_Printf("[FARM] reuse verification %d (ms), hw held %u (ms), wall time is not a capacity figure\n",
+            (int)((nVerifyTime + 500) / 1000), nVerifyHoldMs);
+    }
+
+    if (0 != IPP_Strcmp(pCsvFile, "\0")) {
+        FarmWriteCsv(&Farm, pCsvFile);
+    }
+    IPP_MemFree((void**)&Farm.pJobs);
+    IPP_PysicalMemTest();
+    return nFailed ? IPP_FAIL : IPP_OK;
+}
+
 /*Interface for IPP sample code template*/
 int CodecTest(int argc, char **argv)
 {
@@ -1071,7 +1978,8 @@ int CodecTest(int argc, char **argv)
 
     IPP_Printf("enter CodecTest**********************************\n");
     if (2 > argc) {
-        IPP_Printf("Usage: ./appVmetaEnc.exe -i:input.cmp -o:output.yuv -l:enc.log -p:xxx.cfg -lessinfo:0/1!\n");
+        IPP_Printf("Usage: ./appVmetaEnc.exe -i:input.cmp -o:output.yuv -l:enc.log -p:xxx.cfg -lessinfo:0/1 -mmap:0/1!\n");
+        IPP_Printf("       ./appVmetaEnc.exe \"-farm:jobs.txt -jobs:K -csv:farm.csv -verify:0/1\" encode a job list with K instances\n");
         return IPP_FAIL;
     } else if (2 == argc){
         /*for validation*/
@@ -1088,6 +1996,12 @@ int CodecTest(int argc, char **argv)
         IPP_Strcpy(output_file_name, argv[2]);   
     }
 
+    if (0 != IPP_Strcmp(g_FarmList, "\0")) {
+        rtFlag = VmetaEncFarm(g_FarmList, g_FarmWorkers, g_FarmVerify, g_FarmCsv);
+        IPP_Log(log_file_name, "a", (IPP_OK == rtFlag) ? "farm: every job is OK!\n" : "farm: some jobs fail!\n");
+        return rtFlag;
+    }
+
     IPP_Printf("input: %s\n", input_file_name);
     IPP_Printf("output: %s\n", output_file_name);
     if (0 == IPP_Strcmp(input_file_name, "\0")) {
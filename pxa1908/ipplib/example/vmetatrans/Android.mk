@@ -0,0 +1,22 @@
+# Copyright 2006 The Android Open Source Project
+
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_C_INCLUDES += \
+	$(LOCAL_PATH) \
+	$(LOCAL_PATH)/../../include
+
+LOCAL_CFLAGS += -D_IPP_LINUX -D_VMETA_VER=18
+
+LOCAL_SRC_FILES:= \
+	../main/src/main.c \
+	src/appvmetatrans.c \
+
+LOCAL_SHARED_LIBRARIES := libcodecvmetadec libcodecvmetaenc libvmetahal libmiscgen libvmeta
+LOCAL_STATIC_LIBRARIES := libippcam
+
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE:= appvmetatrans
+
+include $(BUILD_EXECUTABLE)
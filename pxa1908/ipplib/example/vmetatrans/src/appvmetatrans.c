@@ -0,0 +1,1152 @@
+/*****************************************************************************************
+Copyright (c) 2009, Marvell International Ltd.
+All Rights Reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+* Neither the name of the Marvell nor the
+names of its contributors may be used to endorse or promote products
+derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY MARVELL ''AS IS'' AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL MARVELL BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************************/
+
+/*
+***************************************************************************************
+* vmeta transcoder: one decoder and one encoder instance driven from the same thread.
+* Decoded pictures are pushed to the encoder by physical address when their layout is
+* what the encoder expects (422I, no crop offset, 16-aligned stride); otherwise, or when
+* resize/csc is requested, they are converted with ippIP into an encoder owned buffer.
+* The two instances are stepped in turn, so the hardware lock taken by the codec for
+* every frame alternates between them.
+***************************************************************************************/
+
+#include "codecVC.h"
+#include "misc.h"
+#include "ippLV.h"
+#include "ippIP.h"
+
+/*vmeta os api*/
+#include "vdec_os_api.h"
+
+#define ALIGN16(x)                      ((x + 0xf) & (~0xf))
+#define STREAM_BUF_SIZE                 (2047 * 1024) /*must be multiple of 1024*/
+#define DEC_STRM_BUF_NUM                4
+#define ENC_STRM_BUF_NUM                3
+#define DEC_PIC_BUF_NUM                 20
+#define ENC_PIC_BUF_NUM                 2
+#define LESSINFO_MAX_FRAME              10
+#define TRANS_STAGE_POLL_US             1000        /*poll interval while every stage picture is with the encoder*/
+#define TRANS_STAGE_WAIT_US             2000000     /*give up if none comes back for this long*/
+#define TRANS_FEED_WAIT                 1           /*TransEncFeed: no free stage picture yet*/
+
+/*owner of a decoder picture*/
+#define TRANS_PIC_FREE                  0
+#define TRANS_PIC_DEC                   1           /*pushed to the decoder*/
+#define TRANS_PIC_READY                 2           /*decoded, waiting for the encoder*/
+#define TRANS_PIC_ENC                   3           /*pushed to the encoder without a copy*/
+
+/*pUsrData1 of a picture tells which group it belongs to*/
+#define TRANS_GROUP_DEC                 ((void*)0)
+#define TRANS_GROUP_STAGE               ((void*)1)
+
+typedef struct _VmetaTransPar {
+    IppVmetaDecParSet   DecParSet;
+    IppVmetaEncParSet   EncParSet;
+    int                 nOutWidth;                  /*0: keep the decoded size*/
+    int                 nOutHeight;
+    int                 bCsc;                       /*1: feed the encoder 420P*/
+    int                 bLessInfo;
+}VmetaTransPar;
+
+typedef struct _TransDmaStat {
+    Ipp32u              nCur;                       /*bytes allocated by the transcoder*/
+    Ipp32u              nPeak;
+    Ipp32u              nStrm;                      /*stream buffers*/
+    Ipp32u              nDecPic;                    /*decoder pictures, peak*/
+    Ipp32u              nStage;                     /*encoder input copies*/
+}TransDmaStat;
+
+typedef struct _VmetaTransCtx {
+    VmetaTransPar       *pPar;
+    IPP_FILE            *fpin;
+    IPP_FILE            *fpout;
+    char                *log_file_name;
+
+    /*decoder*/
+    void                *pDecoderState;
+    IppVmetaDecInfo     DecInfo;
+    IppVmetaBitstream   DecStrm[DEC_STRM_BUF_NUM];
+    int                 bDecStrmFree[DEC_STRM_BUF_NUM];
+    IppVmetaPicture     DecPic[DEC_PIC_BUF_NUM];
+    int                 nDecPicState[DEC_PIC_BUF_NUM];  /*TRANS_PIC_xxx*/
+    Ipp32u              nDecPicSize;                /*size of a decoder picture for the current sequence*/
+    int                 bDecWaitPic;                /*decoder asked for a picture while all were busy*/
+    int                 bDecEos;                    /*end of stream command sent*/
+    int                 bDecDone;
+
+    /*decoded pictures in display order, waiting for the encoder*/
+    IppVmetaPicture     *pReady[DEC_PIC_BUF_NUM];
+    int                 nReadyHead;
+    int                 nReadyNum;
+
+    /*encoder*/
+    void                *pEncoderState;
+    IppVmetaEncInfo     EncInfo;
+    IppVmetaBitstream   EncStrm[ENC_STRM_BUF_NUM];
+    int                 bEncStrmFree[ENC_STRM_BUF_NUM];
+    IppVmetaPicture     StagePic[ENC_PIC_BUF_NUM];
+    int                 bStagePicFree[ENC_PIC_BUF_NUM];
+    Ipp32u              nStageSize;
+    int                 nEncWidth;
+    int                 nEncHeight;
+    int                 bEncWaitInput;
+    int                 bEncEos;
+    int                 bEncDone;
+
+    /*420P copy of the source for the resizer*/
+    Ipp8u               *pTmp;
+    int                 nTmpSize;
+
+    /*statistics*/
+    int                 nDecFrames;
+    int                 nSkipFrames;
+    int                 nFedFrames;
+    int                 nEncFrames;
+    int                 nZeroCopy;
+    int                 nCopied;
+    int                 nTotalBytes;
+    Ipp32u              nDecWaitPic;                /*times the decoder waited for the encoder*/
+    Ipp32u              nStageWait;                 /*polls for a stage picture the encoder still held*/
+    Ipp32u              nStageWaitUs;               /*current wait for a stage picture*/
+    TransDmaStat        Dma;
+    int                 dec_perf_index;
+    int                 enc_perf_index;
+    int                 conv_perf_index;
+}VmetaTransCtx;
+
+static void *TransDmaAlloc(TransDmaStat *pStat, Ipp32u nSize, Ipp32u nAlign, Ipp32u *pPhyAddr)
+{
+    void *p = vdec_os_api_dma_alloc(nSize, nAlign, pPhyAddr);
+
+    if (p) {
+        pStat->nCur += nSize;
+        if (pStat->nCur > pStat->nPeak) {
+            pStat->nPeak = pStat->nCur;
+        }
+    }
+    return p;
+}
+
+static void TransDmaFree(TransDmaStat *pStat, void *p, Ipp32u nSize)
+{
+    if (p) {
+        vdec_os_api_dma_free(p);
+        pStat->nCur -= nSize;
+    }
+}
+
+static int TransPrint(VmetaTransCtx *pCtx)
+{
+    return (!pCtx->pPar->bLessInfo || pCtx->nDecFrames <= LESSINFO_MAX_FRAME);
+}
+
+/******************************************************************************
+// decoder side
+******************************************************************************/
+static void TransDecPopStrm(VmetaTransCtx *pCtx)
+{
+    IppVmetaBitstream *pBitStream;
+
+    while (1) {
+        DecoderPopBuffer_Vmeta(IPP_VMETA_BUF_TYPE_STRM, (void**)&pBitStream, pCtx->pDecoderState);
+        if (NULL == pBitStream) {
+            break;
+        }
+        pCtx->bDecStrmFree[(int)pBitStream->pUsrData0] = 1;
+    }
+}
+
+/*decoded pictures go to the ready list in output order, empty ones straight back*/
+static void TransDecPopPic(VmetaTransCtx *pCtx)
+{
+    IppVmetaPicture *pPicture;
+    int nIdx;
+
+    while (1) {
+        DecoderPopBuffer_Vmeta(IPP_VMETA_BUF_TYPE_PIC, (void**)&pPicture, pCtx->pDecoderState);
+        if (NULL == pPicture) {
+            break;
+        }
+        nIdx = (int)pPicture->pUsrData0;
+        if (0 < pPicture->nDataLen) {
+            pCtx->nDecPicState[nIdx] = TRANS_PIC_READY;
+            pCtx->pReady[(pCtx->nReadyHead + pCtx->nReadyNum) % DEC_PIC_BUF_NUM] = pPicture;
+            pCtx->nReadyNum++;
+            pCtx->nDecFrames++;
+            if (TransPrint(pCtx)) {
+                IPP_Printf("ID = %d decoded frame %d id=%d roi=[%d %d %d %d] stride=%d\n", pCtx->DecInfo.user_id,
+                    pCtx->nDecFrames, nIdx, pPicture->pic.picROI.x, pPicture->pic.picROI.y,
+                    pPicture->pic.picROI.width, pPicture->pic.picROI.height, pPicture->pic.picPlaneStep[0]);
+            }
+        } else {
+            pCtx->nDecPicState[nIdx] = TRANS_PIC_FREE;
+            if (pPicture->PicDataInfo.is_skipped) {
+                pCtx->nSkipFrames++;
+            }
+        }
+    }
+}
+
+static int TransDecFeedStrm(VmetaTransCtx *pCtx)
+{
+    IppVmetaBitstream *pBitStream = NULL;
+    IppCodecStatus rtCode;
+    int i, nReadNum;
+
+    for (i = 0; i < DEC_STRM_BUF_NUM; i++) {
+        if (pCtx->bDecStrmFree[i]) {
+            pBitStream = &pCtx->DecStrm[i];
+            break;
+        }
+    }
+    if (NULL == pBitStream) {
+        /*for multi-instance, input buffer may not be explicitly returned*/
+        TransDecPopStrm(pCtx);
+        for (i = 0; i < DEC_STRM_BUF_NUM; i++) {
+            if (pCtx->bDecStrmFree[i]) {
+                pBitStream = &pCtx->DecStrm[i];
+                break;
+            }
+        }
+        if (NULL == pBitStream) {
+            IPP_Printf("ID = %d error: strm buf is not enough!\n", pCtx->DecInfo.user_id);
+            return IPP_FAIL;
+        }
+    }
+
+    pCtx->bDecStrmFree[i]   = 0;
+    pBitStream->nOffset     = 0;
+    pBitStream->nFlag       = 0;
+    nReadNum = IPP_Fread(pBitStream->pBuf, 1, STREAM_BUF_SIZE, pCtx->fpin);
+    pBitStream->nDataLen    = nReadNum;
+    if (STREAM_BUF_SIZE != nReadNum) {
+        pBitStream->nFlag  |= IPP_VMETA_STRM_BUF_END_OF_UNIT;
+    }
+    rtCode = DecoderPushBuffer_Vmeta(IPP_VMETA_BUF_TYPE_STRM, (void*)pBitStream, pCtx->pDecoderState);
+    if (IPP_STATUS_NOERR != rtCode) {
+        IPP_Printf("ID = %d push stream buffer error!\n", pCtx->DecInfo.user_id);
+        return IPP_FAIL;
+    }
+    if (STREAM_BUF_SIZE != nReadNum) {
+        IPP_Printf("ID = %d send end of stream command to decoder\n", pCtx->DecInfo.user_id);
+        DecodeSendCmd_Vmeta(IPPVC_END_OF_STREAM, NULL, NULL, pCtx->pDecoderState);
+        pCtx->bDecEos = 1;
+    }
+    return IPP_OK;
+}
+
+/*pictures grow with the sequence, keep the largest total they reached*/
+static void TransDecPicPeak(VmetaTransCtx *pCtx)
+{
+    Ipp32u nSum = 0;
+    int i;
+
+    for (i = 0; i < DEC_PIC_BUF_NUM; i++) {
+        nSum += pCtx->DecPic[i].nBufSize;
+    }
+    if (nSum > pCtx->Dma.nDecPic) {
+        pCtx->Dma.nDecPic = nSum;
+    }
+}
+
+/*push a free picture to the decoder, 0 if every picture is busy*/
+static int TransDecPushPic(VmetaTransCtx *pCtx)
+{
+    IppVmetaPicture *pPicture;
+    int i;
+
+    for (i = 0; i < DEC_PIC_BUF_NUM; i++) {
+        if (TRANS_PIC_FREE == pCtx->nDecPicState[i]) {
+            break;
+        }
+    }
+    if (DEC_PIC_BUF_NUM <= i) {
+        return 0;
+    }
+
+    pPicture = &pCtx->DecPic[i];
+    if (pPicture->nBufSize < pCtx->nDecPicSize) {
+        TransDmaFree(&pCtx->Dma, pPicture->pBuf, pPicture->nBufSize);
+        pPicture->nBufSize  = 0;
+        pPicture->pBuf      = (Ipp8u*)TransDmaAlloc(&pCtx->Dma, pCtx->nDecPicSize, VMETA_DIS_BUF_ALIGN, &(pPicture->nPhyAddr));
+        if (NULL == pPicture->pBuf) {
+            IPP_Printf("ID = %d error: no memory for display!\n", pCtx->DecInfo.user_id);
+            return -1;
+        }
+        pPicture->nBufSize  = pCtx->nDecPicSize;
+        TransDecPicPeak(pCtx);
+    }
+    pCtx->nDecPicState[i] = TRANS_PIC_DEC;
+    DecoderPushBuffer_Vmeta(IPP_VMETA_BUF_TYPE_PIC, (void*)pPicture, pCtx->pDecoderState);
+    return 1;
+}
+
+static int TransDecStep(VmetaTransCtx *pCtx)
+{
+    IppVmetaDecInfo *pDecInfo = &pCtx->DecInfo;
+    IppCodecStatus rtCode;
+    int ret;
+
+    IPP_StartPerfCounter(pCtx->dec_perf_index);
+    rtCode = DecodeFrame_Vmeta(pDecInfo, pCtx->pDecoderState);
+    IPP_StopPerfCounter(pCtx->dec_perf_index);
+
+    if (IPP_STATUS_NEED_INPUT == rtCode) {
+        return TransDecFeedStrm(pCtx);
+    } else if (IPP_STATUS_NEED_OUTPUT_BUF == rtCode) {
+        ret = TransDecPushPic(pCtx);
+        if (0 == ret) {
+            /*for multi-instance, output buffer may not be explicitly returned*/
+            TransDecPopPic(pCtx);
+            ret = TransDecPushPic(pCtx);
+        }
+        if (0 > ret) {
+            return IPP_FAIL;
+        }
+        if (0 == ret) {
+            /*every picture is queued for or held by the encoder*/
+            pCtx->bDecWaitPic = 1;
+            pCtx->nDecWaitPic++;
+        }
+    } else if (IPP_STATUS_RETURN_INPUT_BUF == rtCode) {
+        TransDecPopStrm(pCtx);
+    } else if (IPP_STATUS_FRAME_COMPLETE == rtCode) {
+        TransDecPopPic(pCtx);
+        TransDecPopStrm(pCtx);
+    } else if (IPP_STATUS_NEW_VIDEO_SEQ == rtCode) {
+        TransDecPopPic(pCtx);
+        IPP_Printf("ID = %d IPP_STATUS_NEW_VIDEO_SEQ %d*%d display area: [x = %d, y = %d width = %d height = %d] dis_buf_size %d stride %d\n",
+            pDecInfo->user_id, pDecInfo->seq_info.max_width, pDecInfo->seq_info.max_height,
+            pDecInfo->seq_info.picROI.x, pDecInfo->seq_info.picROI.y,
+            pDecInfo->seq_info.picROI.width, pDecInfo->seq_info.picROI.height,
+            pDecInfo->seq_info.dis_buf_size, pDecInfo->seq_info.dis_stride);
+        pCtx->nDecPicSize = pDecInfo->seq_info.dis_buf_size;
+        if (!pCtx->pPar->bCsc && !pCtx->pPar->nOutWidth) {
+            /*big enough to serve as encoder input as well*/
+            Ipp32u nEncSize = ALIGN16(pDecInfo->seq_info.picROI.width) * ALIGN16(pDecInfo->seq_info.picROI.height) * 2;
+            if (pCtx->EncInfo.dis_buf_size > nEncSize) {
+                nEncSize = pCtx->EncInfo.dis_buf_size;
+            }
+            if (nEncSize > pCtx->nDecPicSize) {
+                pCtx->nDecPicSize = nEncSize;
+            }
+        }
+    } else if (IPP_STATUS_END_OF_STREAM == rtCode) {
+        IPP_Printf("ID = %d decoder IPP_STATUS_END_OF_STREAM\n", pDecInfo->user_id);
+        TransDecPopStrm(pCtx);
+        TransDecPopPic(pCtx);
+        pCtx->bDecDone = 1;
+    } else {
+        IPP_Log(pCtx->log_file_name, "a", "error: decoder deadly error! %d\n", rtCode);
+        IPP_Printf("ID = %d error: decoder deadly error! %d\n", pDecInfo->user_id, rtCode);
+        return IPP_FAIL;
+    }
+    return IPP_OK;
+}
+
+/******************************************************************************
+// encoder side
+******************************************************************************/
+static int TransEncInit(VmetaTransCtx *pCtx, IppVmetaPicture *pFirst)
+{
+    VmetaTransPar *pPar = pCtx->pPar;
+    IppVmetaEncParSet *pEncParSet = &pPar->EncParSet;
+    MiscGeneralCallbackTable CBTable;
+    IppCodecStatus rtCode;
+    double fFrameRate;
+    int nOptHdrs, i;
+
+    if (pPar->nOutWidth) {
+        pCtx->nEncWidth     = pPar->nOutWidth;
+        pCtx->nEncHeight    = pPar->nOutHeight;
+    } else {
+        pCtx->nEncWidth     = pFirst->pic.picROI.width;
+        pCtx->nEncHeight    = pFirst->pic.picROI.height;
+    }
+    pEncParSet->nWidth          = pCtx->nEncWidth;
+    pEncParSet->nHeight         = pCtx->nEncHeight;
+    pEncParSet->bMultiIns       = 1;
+    pEncParSet->bFirstUser      = 0;
+    if (pPar->bCsc || pPar->nOutWidth) {
+        pEncParSet->eInputYUVFmt    = IPP_YCbCr420P;
+        pCtx->nStageSize            = ALIGN16(pCtx->nEncWidth) * ALIGN16(pCtx->nEncHeight) * 3 / 2;
+    } else {
+        pEncParSet->eInputYUVFmt    = IPP_YCbCr422I;
+        pCtx->nStageSize            = ALIGN16(pCtx->nEncWidth) * ALIGN16(pCtx->nEncHeight) * 2;
+    }
+    if ((0 == pEncParSet->nFrameRateNum) && pCtx->DecInfo.seq_info.frame_rate_den) {
+        /*the encoder takes whole frames per second, round 30000/1001 to 30 rather than truncate it to 29*/
+        fFrameRate                  = (double)pCtx->DecInfo.seq_info.frame_rate_num / pCtx->DecInfo.seq_info.frame_rate_den;
+        pEncParSet->nFrameRateNum   = (int)(fFrameRate + 0.5);
+        IPP_Printf("encoder: decoded frame rate %u/%u (%.3f), encoding at %d\n", pCtx->DecInfo.seq_info.frame_rate_num,
+            pCtx->DecInfo.seq_info.frame_rate_den, fFrameRate, pEncParSet->nFrameRateNum);
+    }
+    if (0 == pEncParSet->nFrameRateNum) {
+        pEncParSet->nFrameRateNum   = 30;
+    }
+    IPP_Printf("encoder: %d*%d input format %d output format %d\n", pCtx->nEncWidth, pCtx->nEncHeight,
+        pEncParSet->eInputYUVFmt, pEncParSet->eOutputStrmFmt);
+
+    /*the buffers a decoded picture is copied or converted into when it cannot be pushed as is*/
+    for (i = 0; i < ENC_PIC_BUF_NUM; i++) {
+        pCtx->StagePic[i].pBuf = (Ipp8u*)TransDmaAlloc(&pCtx->Dma, pCtx->nStageSize, VMETA_DIS_BUF_ALIGN, &(pCtx->StagePic[i].nPhyAddr));
+        if (NULL == pCtx->StagePic[i].pBuf) {
+            IPP_Printf("error: no memory!\n");
+            return IPP_FAIL;
+        }
+        pCtx->StagePic[i].nBufSize  = pCtx->nStageSize;
+        pCtx->Dma.nStage           += pCtx->nStageSize;
+    }
+
+    CBTable.fMemMalloc  = IPP_MemMalloc;
+    CBTable.fMemFree    = IPP_MemFree;
+    rtCode = EncoderInitAlloc_Vmeta(pEncParSet, &CBTable, &pCtx->pEncoderState);
+    if (IPP_STATUS_NOERR != rtCode) {
+        EncoderFree_Vmeta(&pCtx->pEncoderState);
+        pCtx->pEncoderState = NULL;
+        IPP_Log(pCtx->log_file_name, "a", "error: encoder init fail, error code %d!\n", rtCode);
+        IPP_Printf("error: encoder init fail, error code %d!\n", rtCode);
+        return IPP_FAIL;
+    }
+    nOptHdrs = 1;
+    EncodeSendCmd_Vmeta(IPPVC_OUTPUT_SPS_AND_PPS, &nOptHdrs, NULL, pCtx->pEncoderState);
+    return IPP_OK;
+}
+
+static void TransEncPopPic(VmetaTransCtx *pCtx)
+{
+    IppVmetaPicture *pPicture;
+
+    while (1) {
+        EncoderPopBuffer_Vmeta(IPP_VMETA_BUF_TYPE_PIC, (void**)&pPicture, pCtx->pEncoderState);
+        if (NULL == pPicture) {
+            break;
+        }
+        if (TRANS_GROUP_DEC == pPicture->pUsrData1) {
+            pCtx->nDecPicState[(int)pPicture->pUsrData0] = TRANS_PIC_FREE;
+        } else {
+            pCtx->bStagePicFree[(int)pPicture->pUsrData0] = 1;
+        }
+    }
+}
+
+static void TransEncPopStrm(VmetaTransCtx *pCtx)
+{
+    IppVmetaBitstream *pBitStream;
+
+    while (1) {
+        EncoderPopBuffer_Vmeta(IPP_VMETA_BUF_TYPE_STRM, (void**)&pBitStream, pCtx->pEncoderState);
+        if (NULL == pBitStream) {
+            break;
+        }
+        pCtx->bEncStrmFree[(int)pBitStream->pUsrData0] = 1;
+        if (pCtx->fpout) {
+            IPP_Fwrite(pBitStream->pBuf + pBitStream->nOffset, 1, pBitStream->nDataLen, pCtx->fpout);
+        }
+        if (pBitStream->nFlag & IPP_VMETA_STRM_BUF_END_OF_FRAME) {
+            pCtx->nEncFrames++;
+        }
+        pCtx->nTotalBytes += pBitStream->nDataLen;
+    }
+}
+
+/*a decoded picture can be encoded in place when it is laid out as an encoder input picture*/
+static int TransCanPushDirect(VmetaTransCtx *pCtx, IppVmetaPicture *pPic)
+{
+    return (IPP_YCbCr422I == pCtx->pPar->EncParSet.eInputYUVFmt)
+        && (IPP_YCbCr422I == pPic->pic.picFormat)
+        && (0 == pPic->pic.picROI.x) && (0 == pPic->pic.picROI.y)
+        && (pCtx->nEncWidth == pPic->pic.picROI.width) && (pCtx->nEncHeight == pPic->pic.picROI.height)
+        && (ALIGN16(pCtx->nEncWidth) * 2 == pPic->pic.picPlaneStep[0])
+        && ((Ipp8u*)pPic->pic.ppPicPlane[0] == pPic->pBuf)
+        && (pPic->nBufSize >= pCtx->EncInfo.dis_buf_size);
+}
+
+/*copy the display area of pSrc into pDst in the encoder input layout, resizing and converting on the way*/
+static int TransConvert(VmetaTransCtx *pCtx, IppVmetaPicture *pSrc, IppVmetaPicture *pDst)
+{
+    int nWidth      = pSrc->pic.picROI.width;
+    int nHeight     = pSrc->pic.picROI.height;
+    int nSrcStep    = pSrc->pic.picPlaneStep[0];
+    Ipp8u *pIn      = (Ipp8u*)pSrc->pic.ppPicPlane[0] + pSrc->pic.picROI.y * nSrcStep + pSrc->pic.picROI.x * 2;
+    int nStride     = ALIGN16(pCtx->nEncWidth);
+    int nSliceHeight= ALIGN16(pCtx->nEncHeight);
+    Ipp8u *pDstPlane[3], *pTmpPlane[3];
+    int nDstStep[3], nTmpStep[3];
+    IppiSize SrcSize, DstSize;
+    IppStatus ret;
+    int j;
+
+    if (IPP_YCbCr422I != pSrc->pic.picFormat) {
+        IPP_Printf("error: decoder output format %d is not supported\n", pSrc->pic.picFormat);
+        return IPP_FAIL;
+    }
+    if (!pCtx->pPar->nOutWidth && ((nWidth != pCtx->nEncWidth) || (nHeight != pCtx->nEncHeight))) {
+        IPP_Printf("error: resolution changed to %d*%d, set -ow/-oh to resize to the encoder size\n", nWidth, nHeight);
+        return IPP_FAIL;
+    }
+
+    if (IPP_YCbCr422I == pCtx->pPar->EncParSet.eInputYUVFmt) {
+        for (j = 0; j < nHeight; j++) {
+            IPP_Memcpy(pDst->pBuf + j * nStride * 2, pIn + j * nSrcStep, nWidth * 2);
+        }
+        return IPP_OK;
+    }
+
+    pDstPlane[0]    = pDst->pBuf;
+    pDstPlane[1]    = pDst->pBuf + nStride * nSliceHeight;
+    pDstPlane[2]    = pDstPlane[1] + nStride * nSliceHeight / 4;
+    nDstStep[0]     = nStride;
+    nDstStep[1]     = nStride / 2;
+    nDstStep[2]     = nStride / 2;
+    SrcSize.width   = nWidth;
+    SrcSize.height  = nHeight;
+
+    if ((nWidth == pCtx->nEncWidth) && (nHeight == pCtx->nEncHeight)) {
+        ret = ippiYCbCr422ToYCbCr420Rotate_8u_C2P3R(pIn, nSrcStep, pDstPlane, nDstStep, SrcSize, ippCameraRotateDisable);
+        return (ippStsNoErr == ret) ? IPP_OK : IPP_FAIL;
+    }
+
+    /*422I -> 420P at the source size, then resize the planes*/
+    if (pCtx->nTmpSize < ALIGN16(nWidth) * ALIGN16(nHeight) * 3 / 2) {
+        if (pCtx->pTmp) {
+            IPP_MemFree((void**)&pCtx->pTmp);
+        }
+        pCtx->nTmpSize = ALIGN16(nWidth) * ALIGN16(nHeight) * 3 / 2;
+        IPP_MemMalloc((void**)&pCtx->pTmp, pCtx->nTmpSize, 8);
+        if (NULL == pCtx->pTmp) {
+            pCtx->nTmpSize = 0;
+            return IPP_FAIL;
+        }
+    }
+    pTmpPlane[0]    = pCtx->pTmp;
+    pTmpPlane[1]    = pCtx->pTmp + ALIGN16(nWidth) * ALIGN16(nHeight);
+    pTmpPlane[2]    = pTmpPlane[1] + ALIGN16(nWidth) * ALIGN16(nHeight) / 4;
+    nTmpStep[0]     = ALIGN16(nWidth);
+    nTmpStep[1]     = ALIGN16(nWidth) / 2;
+    nTmpStep[2]     = ALIGN16(nWidth) / 2;
+    ret = ippiYCbCr422ToYCbCr420Rotate_8u_C2P3R(pIn, nSrcStep, pTmpPlane, nTmpStep, SrcSize, ippCameraRotateDisable);
+    if (ippStsNoErr != ret) {
+        return IPP_FAIL;
+    }
+    DstSize.width   = pCtx->nEncWidth;
+    DstSize.height  = pCtx->nEncHeight;
+    ret = ippiYCbCr420RszRot_8u_P3R((const Ipp8u**)pTmpPlane, nTmpStep, SrcSize, pDstPlane, nDstStep, DstSize,
+        ippCameraInterpBilinear, ippCameraRotateDisable,
+        ((nWidth - 1) << 16) / (pCtx->nEncWidth - 1), ((nHeight - 1) << 16) / (pCtx->nEncHeight - 1));
+    return (ippStsNoErr == ret) ? IPP_OK : IPP_FAIL;
+}
+
+/*
+hand the oldest decoded picture to the encoder. TRANS_FEED_WAIT if it needs a copy
+and the encoder still holds every stage picture; the picture stays ready then.
+*/
+static int TransEncFeed(VmetaTransCtx *pCtx)
+{
+    IppVmetaPicture *pPicture = pCtx->pReady[pCtx->nReadyHead];
+    IppVmetaPicture *pStage = NULL;
+    int nIdx = (int)pPicture->pUsrData0;
+    int i, ret;
+
+    if (TransCanPushDirect(pCtx, pPicture)) {
+        pCtx->nReadyHead = (pCtx->nReadyHead + 1) % DEC_PIC_BUF_NUM;
+        pCtx->nReadyNum--;
+        pCtx->nDecPicState[nIdx] = TRANS_PIC_ENC;
+        pPicture->nDataLen = pCtx->nStageSize;
+        EncoderPushBuffer_Vmeta(IPP_VMETA_BUF_TYPE_PIC, (void*)pPicture, pCtx->pEncoderState);
+        pCtx->nZeroCopy++;
+        pCtx->nFedFrames++;
+        return IPP_OK;
+    }
+
+    TransEncPopPic(pCtx);
+    for (i = 0; i < ENC_PIC_BUF_NUM; i++) {
+        if (pCtx->bStagePicFree[i]) {
+            pStage = &pCtx->StagePic[i];
+            break;
+        }
+    }
+    if (NULL == pStage) {
+        return TRANS_FEED_WAIT;
+    }
+    pCtx->nReadyHead = (pCtx->nReadyHead + 1) % DEC_PIC_BUF_NUM;
+    pCtx->nReadyNum--;
+    IPP_StartPerfCounter(pCtx->conv_perf_index);
+    ret = TransConvert(pCtx, pPicture, pStage);
+    IPP_StopPerfCounter(pCtx->conv_perf_index);
+    /*the decoder can have its picture back right away*/
+    pCtx->nDecPicState[nIdx] = TRANS_PIC_FREE;
+    if (IPP_OK != ret) {
+        IPP_Printf("ID = %d error: fail to convert picture %d\n", pCtx->EncInfo.user_id, pCtx->nFedFrames);
+        return IPP_FAIL;
+    }
+    pCtx->bStagePicFree[i]  = 0;
+    pStage->nDataLen        = pCtx->nStageSize;
+    EncoderPushBuffer_Vmeta(IPP_VMETA_BUF_TYPE_PIC, (void*)pStage, pCtx->pEncoderState);
+    pCtx->nCopied++;
+    pCtx->nFedFrames++;
+    return IPP_OK;
+}
+
+static int TransEncStep(VmetaTransCtx *pCtx)
+{
+    IppVmetaEncInfo *pEncInfo = &pCtx->EncInfo;
+    IppCodecStatus rtCode;
+    int i;
+
+    IPP_StartPerfCounter(pCtx->enc_perf_index);
+    rtCode = EncodeFrame_Vmeta(pEncInfo, pCtx->pEncoderState);
+    IPP_StopPerfCounter(pCtx->enc_perf_index);
+
+    if (IPP_STATUS_NEED_OUTPUT_BUF == rtCode) {
+        for (i = 0; i < ENC_STRM_BUF_NUM; i++) {
+            if (pCtx->bEncStrmFree[i]) {
+                break;
+            }
+        }
+        if (ENC_STRM_BUF_NUM <= i) {
+            IPP_Printf("ID = %d error: encoder strm buf is not enough!\n", pEncInfo->user_id);
+            return IPP_FAIL;
+        }
+        pCtx->bEncStrmFree[i] = 0;
+        rtCode = EncoderPushBuffer_Vmeta(IPP_VMETA_BUF_TYPE_STRM, (void*)&pCtx->EncStrm[i], pCtx->pEncoderState);
+        if (IPP_STATUS_NOERR != rtCode) {
+            IPP_Printf("ID = %d push stream buffer error!\n", pEncInfo->user_id);
+            return IPP_FAIL;
+        }
+    } else if (IPP_STATUS_NEED_INPUT == rtCode) {
+        /*fed by the scheduler once a decoded picture is ready*/
+        pCtx->bEncWaitInput = 1;
+    } else if (IPP_STATUS_END_OF_PICTURE == rtCode) {
+        TransEncPopPic(pCtx);
+        TransEncPopStrm(pCtx);
+    } else if (IPP_STATUS_RETURN_INPUT_BUF == rtCode) {
+        TransEncPopPic(pCtx);
+    } else if (IPP_STATUS_OUTPUT_DATA == rtCode) {
+        TransEncPopStrm(pCtx);
+    } else if (IPP_STATUS_END_OF_STREAM == rtCode) {
+        IPP_Printf("ID = %d encoder IPP_STATUS_END_OF_STREAM\n", pEncInfo->user_id);
+        TransEncPopPic(pCtx);
+        TransEncPopStrm(pCtx);
+        pCtx->bEncDone = 1;
+    } else {
+        IPP_Log(pCtx->log_file_name, "a", "error: encoder deadly error! %d\n", rtCode);
+        IPP_Printf("ID = %d error: encoder deadly error! %d\n", pEncInfo->user_id, rtCode);
+        return IPP_FAIL;
+    }
+    return IPP_OK;
+}
+
+static void TransPrintLock(const char *pName, int user_id)
+{
+    vmeta_lock_info LockInfo;
+
+    if (0 == vdec_os_api_get_lock_info(user_id, &LockInfo)) {
+        IPP_Printf("[PERF] %s hw: user id %d locks %u hold %u (ms) wait %u (ms) timeouts %u\n", pName, user_id,
+            LockInfo.lock_count, LockInfo.hold_ms, LockInfo.wait_ms, LockInfo.timeout_count);
+    }
+}
+
+static void TransFreeBuffers(VmetaTransCtx *pCtx)
+{
+    int i;
+
+    for (i = 0; i < DEC_STRM_BUF_NUM; i++) {
+        TransDmaFree(&pCtx->Dma, pCtx->DecStrm[i].pBuf, STREAM_BUF_SIZE);
+        pCtx->DecStrm[i].pBuf = NULL;
+    }
+    for (i = 0; i < ENC_STRM_BUF_NUM; i++) {
+        TransDmaFree(&pCtx->Dma, pCtx->EncStrm[i].pBuf, STREAM_BUF_SIZE);
+        pCtx->EncStrm[i].pBuf = NULL;
+    }
+    for (i = 0; i < DEC_PIC_BUF_NUM; i++) {
+        TransDmaFree(&pCtx->Dma, pCtx->DecPic[i].pBuf, pCtx->DecPic[i].nBufSize);
+        pCtx->DecPic[i].pBuf = NULL;
+    }
+    for (i = 0; i < ENC_PIC_BUF_NUM; i++) {
+        TransDmaFree(&pCtx->Dma, pCtx->StagePic[i].pBuf, pCtx->StagePic[i].nBufSize);
+        pCtx->StagePic[i].pBuf = NULL;
+    }
+    if (pCtx->pTmp) {
+        IPP_MemFree((void**)&pCtx->pTmp);
+    }
+}
+
+/******************************************************************************
+// Name:                VmetaTranscoder
+// Description:         Decode fpin and encode the decoded pictures into fpout
+//
+// Input Arguments:
+//      fpin        :   Input elementary stream
+//      fpout       :   Output elementary stream, may be NULL
+//      log_file_name:  Log file
+//      pPar        :   Decoder, encoder and conversion parameters
+// Returns:
+//        [Success]     IPP_OK
+//        [Failure]     IPP_FAIL
+******************************************************************************/
+int VmetaTranscoder(IPP_FILE *fpin, IPP_FILE *fpout, char *log_file_name, VmetaTransPar *pPar)
+{
+    VmetaTransCtx Ctx;
+    VmetaTransCtx *pCtx = &Ctx;
+    MiscGeneralCallbackTable CBTable;
+    IppCodecStatus rtCode;
+    int total_perf_index;
+    int nTotalTime, nDecTime, nEncTime, nConvTime;
+    int i, ret, bProgress;
+    int nDecUserId = -1, nEncUserId = -1;
+
+    IPP_Memset(pCtx, 0, sizeof(VmetaTransCtx));
+    pCtx->pPar          = pPar;
+    pCtx->fpin          = fpin;
+    pCtx->fpout         = fpout;
+    pCtx->log_file_name = log_file_name;
+
+    IPP_Printf("start transcoding********************************\n");
+    ret = vdec_os_driver_init();
+    if (0 > ret) {
+        IPP_Printf("error: driver init fail! ret = %d\n", ret);
+        IPP_Log(log_file_name, "a", "error: driver init fail!\n");
+        return IPP_FAIL;
+    }
+
+    IPP_GetPerfCounter(&pCtx->dec_perf_index, DEFAULT_TIMINGFUNC_START, DEFAULT_TIMINGFUNC_STOP);
+    IPP_ResetPerfCounter(pCtx->dec_perf_index);
+    IPP_GetPerfCounter(&pCtx->enc_perf_index, DEFAULT_TIMINGFUNC_START, DEFAULT_TIMINGFUNC_STOP);
+    IPP_ResetPerfCounter(pCtx->enc_perf_index);
+    IPP_GetPerfCounter(&pCtx->conv_perf_index, DEFAULT_TIMINGFUNC_START, DEFAULT_TIMINGFUNC_STOP);
+    IPP_ResetPerfCounter(pCtx->conv_perf_index);
+    IPP_GetPerfCounter(&total_perf_index, IPP_TimeGetTickCount, IPP_TimeGetTickCount);
+    IPP_ResetPerfCounter(total_perf_index);
+
+    for (i = 0; i < DEC_STRM_BUF_NUM; i++) {
+        pCtx->DecStrm[i].pBuf = (Ipp8u*)TransDmaAlloc(&pCtx->Dma, STREAM_BUF_SIZE, VMETA_STRM_BUF_ALIGN, &(pCtx->DecStrm[i].nPhyAddr));
+        if (NULL == pCtx->DecStrm[i].pBuf) {
+            IPP_Printf("error: no memory!\n");
+            goto fail_cleanup;
+        }
+        pCtx->DecStrm[i].nBufSize   = STREAM_BUF_SIZE;
+        pCtx->DecStrm[i].pUsrData0  = (void*)i;
+        pCtx->bDecStrmFree[i]       = 1;
+        pCtx->Dma.nStrm            += STREAM_BUF_SIZE;
+    }
+    for (i = 0; i < ENC_STRM_BUF_NUM; i++) {
+        pCtx->EncStrm[i].pBuf = (Ipp8u*)TransDmaAlloc(&pCtx->Dma, STREAM_BUF_SIZE, VMETA_STRM_BUF_ALIGN, &(pCtx->EncStrm[i].nPhyAddr));
+        if (NULL == pCtx->EncStrm[i].pBuf) {
+            IPP_Printf("error: no memory!\n");
+            goto fail_cleanup;
+        }
+        pCtx->EncStrm[i].nBufSize   = STREAM_BUF_SIZE;
+        pCtx->EncStrm[i].pUsrData0  = (void*)i;
+        pCtx->bEncStrmFree[i]       = 1;
+        pCtx->Dma.nStrm            += STREAM_BUF_SIZE;
+    }
+    for (i = 0; i < DEC_PIC_BUF_NUM; i++) {
+        pCtx->DecPic[i].pUsrData0   = (void*)i;
+        pCtx->DecPic[i].pUsrData1   = TRANS_GROUP_DEC;
+        pCtx->nDecPicState[i]       = TRANS_PIC_FREE;
+    }
+    for (i = 0; i < ENC_PIC_BUF_NUM; i++) {
+        pCtx->StagePic[i].pUsrData0 = (void*)i;
+        pCtx->StagePic[i].pUsrData1 = TRANS_GROUP_STAGE;
+        pCtx->bStagePicFree[i]      = 1;
+    }
+
+    CBTable.fMemMalloc  = IPP_MemMalloc;
+    CBTable.fMemFree    = IPP_MemFree;
+    CBTable.fMemCalloc  = IPP_MemCalloc;
+    pPar->DecParSet.bMultiIns   = 1;
+    pPar->DecParSet.bFirstUser  = 0;
+    rtCode = DecoderInitAlloc_Vmeta(&pPar->DecParSet, &CBTable, &pCtx->pDecoderState);
+    if (IPP_STATUS_NOERR != rtCode) {
+        pCtx->pDecoderState = NULL;
+        IPP_Printf("error: decoder init fail, error code %d!\n", rtCode);
+        IPP_Log(log_file_name, "a", "error: decoder init fail, error code %d!\n", rtCode);
+        goto fail_cleanup;
+    }
+
+    /*
+    one decoder step and one encoder step per round: each codec takes the hardware lock for
+    the frame it works on and gives it back when the frame is done, so the lock alternates.
+    A stage that waits for the other one (decoder out of pictures, encoder out of input) is
+    skipped until the other stage has made room.
+    */
+    IPP_StartPerfCounter(total_perf_index);
+    while (!pCtx->bEncDone) {
+        bProgress = 0;
+
+        if (!pCtx->bDecDone) {
+            if (pCtx->bDecWaitPic) {
+                ret = TransDecPushPic(pCtx);
+                if (0 > ret) {
+                    goto fail_cleanup;
+                }
+                if (ret) {
+                    pCtx->bDecWaitPic = 0;
+                    bProgress = 1;
+                }
+            } else {
+                if (IPP_OK != TransDecStep(pCtx)) {
+                    goto fail_cleanup;
+                }
+                bProgress = 1;
+            }
+        }
+
+        if (NULL == pCtx->pEncoderState) {
+            if (pCtx->nReadyNum) {
+                if (IPP_OK != TransEncInit(pCtx, pCtx->pReady[pCtx->nReadyHead])) {
+                    goto fail_cleanup;
+                }
+            } else if (pCtx->bDecDone) {
+                IPP_Printf("error: no picture decoded\n");
+                goto fail_cleanup;
+            }
+        } else if (pCtx->bEncWaitInput) {
+            if (pCtx->nReadyNum) {
+                ret = TransEncFeed(pCtx);
+                if (TRANS_FEED_WAIT == ret) {
+                    /*block until the encoder gives a stage picture back, it does so from EncodeFrame_Vmeta*/
+                    if (TRANS_STAGE_WAIT_US <= pCtx->nStageWaitUs) {
+                        IPP_Printf("ID = %d error: encoder kept all %d stage pictures for %d ms\n", pCtx->EncInfo.user_id,
+                            ENC_PIC_BUF_NUM, TRANS_STAGE_WAIT_US / 1000);
+                        goto fail_cleanup;
+                    }
+                    pCtx->nStageWait++;
+                    pCtx->nStageWaitUs += TRANS_STAGE_POLL_US;
+                    IPP_Sleep(TRANS_STAGE_POLL_US);
+                    pCtx->bEncWaitInput = 0;
+                    bProgress = 1;
+                } else if (IPP_OK != ret) {
+                    goto fail_cleanup;
+                } else {
+                    pCtx->nStageWaitUs  = 0;
+                    pCtx->bEncWaitInput = 0;
+                    bProgress = 1;
+                }
+            } else if (pCtx->bDecDone && !pCtx->bEncEos) {
+                IPP_Printf("ID = %d send end of stream command to encoder\n", pCtx->EncInfo.user_id);
+                EncodeSendCmd_Vmeta(IPPVC_END_OF_STREAM, NULL, NULL, pCtx->pEncoderState);
+                pCtx->bEncEos       = 1;
+                pCtx->bEncWaitInput = 0;
+                bProgress = 1;
+            }
+        } else {
+            if (IPP_OK != TransEncStep(pCtx)) {
+                goto fail_cleanup;
+            }
+            bProgress = 1;
+        }
+
+        if (!bProgress) {
+            IPP_Printf("error: transcoder stalled, decoder waits for a picture and encoder for input\n");
+            goto fail_cleanup;
+        }
+    }
+    IPP_StopPerfCounter(total_perf_index);
+
+    /*lock statistics are kept per user id, read them before the ids are released*/
+    nDecUserId = pCtx->DecInfo.user_id;
+    nEncUserId = pCtx->EncInfo.user_id;
+    TransPrintLock("decoder", nDecUserId);
+    TransPrintLock("encoder", nEncUserId);
+
+    EncoderFree_Vmeta(&pCtx->pEncoderState);
+    DecoderFree_Vmeta(&pCtx->pDecoderState);
+    TransFreeBuffers(pCtx);
+
+    nTotalTime  = IPP_GetPerfData(total_perf_index);
+    nDecTime    = IPP_GetPerfData(pCtx->dec_perf_index);
+    nEncTime    = IPP_GetPerfData(pCtx->enc_perf_index);
+    nConvTime   = IPP_GetPerfData(pCtx->conv_perf_index);
+    IPP_Printf("[PERF] decoded %d (skip %d) fed %d encoded %d frames, zero-copy %d copied %d, decoder waited for encoder %u times\n",
+        pCtx->nDecFrames, pCtx->nSkipFrames, pCtx->nFedFrames, pCtx->nEncFrames, pCtx->nZeroCopy, pCtx->nCopied, pCtx->nDecWaitPic);
+    IPP_Printf("[PERF] waited %u times for the encoder to return a stage picture\n", pCtx->nStageWait);
+    IPP_Printf("[PERF] decode call time %d (ms) encode call time %d (ms) convert time %d (ms)\n",
+        (nDecTime + 500) / 1000, (nEncTime + 500) / 1000, (nConvTime + 500) / 1000);
+    IPP_Printf("[PERF] Transcode: Total Frame: %d, Total Time: %d(ms), FPS: %f\n", pCtx->nEncFrames,
+        (nTotalTime + 500) / 1000, nTotalTime ? (float)(1000.0 * 1000.0 * pCtx->nEncFrames / nTotalTime) : 0);
+    IPP_Printf("[MEM] dma peak %u (kB): stream %u decoder pictures %u encoder input %u\n", pCtx->Dma.nPeak / 1024,
+        pCtx->Dma.nStrm / 1024, pCtx->Dma.nDecPic / 1024, pCtx->Dma.nStage / 1024);
+    IPP_Printf("Stream Size     = %.2f(kB)\n", (float)pCtx->nTotalBytes / 1024);
+
+    g_Tot_Time[IPP_VIDEO_INDEX]     = nTotalTime;
+    g_Frame_Num[IPP_VIDEO_INDEX]    = pCtx->nEncFrames;
+
+    IPP_FreePerfCounter(pCtx->dec_perf_index);
+    IPP_FreePerfCounter(pCtx->enc_perf_index);
+    IPP_FreePerfCounter(pCtx->conv_perf_index);
+    IPP_FreePerfCounter(total_perf_index);
+
+    vdec_os_driver_clean();
+    IPP_PysicalMemTest();
+    return IPP_OK;
+
+fail_cleanup:
+    IPP_Printf("transcoding fail: clean up\n");
+    if (pCtx->pEncoderState) {
+        EncoderFree_Vmeta(&pCtx->pEncoderState);
+    }
+    if (pCtx->pDecoderState) {
+        DecoderFree_Vmeta(&pCtx->pDecoderState);
+    }
+    TransFreeBuffers(pCtx);
+    IPP_FreePerfCounter(pCtx->dec_perf_index);
+    IPP_FreePerfCounter(pCtx->enc_perf_index);
+    IPP_FreePerfCounter(pCtx->conv_perf_index);
+    IPP_FreePerfCounter(total_perf_index);
+    vdec_os_driver_clean();
+    IPP_PysicalMemTest();
+    return IPP_FAIL;
+}
+
+#define VMETA_TRANS_PARA_NUM 8
+
+typedef struct {
+    char *name;
+    void *p;
+} ParaTable;
+
+static VmetaTransPar g_VmetaTransPar;
+
+/*encoder parameters that may be given on the command line, same names as VmetaEncConfig.cfg*/
+static ParaTable Map[VMETA_TRANS_PARA_NUM]={
+    {"nPBetweenI",              &g_VmetaTransPar.EncParSet.nPBetweenI       },
+    {"nBFrameNum",              &g_VmetaTransPar.EncParSet.nBFrameNum       },
+    {"bRCEnable",               &g_VmetaTransPar.EncParSet.bRCEnable        },
+    {"nRCType",                 &g_VmetaTransPar.EncParSet.nRCType          },
+    {"nQP",                     &g_VmetaTransPar.EncParSet.nQP              },
+    {"nRCBitRate",              &g_VmetaTransPar.EncParSet.nRCBitRate       },
+    {"nMaxBitRate",             &g_VmetaTransPar.EncParSet.nMaxBitRate      },
+    {"nFrameRateNum",           &g_VmetaTransPar.EncParSet.nFrameRateNum    },
+};
+
+void InitVmetaTransPara(VmetaTransPar *pPar)
+{
+    IPP_Memset(pPar, 0, sizeof(VmetaTransPar));
+    pPar->DecParSet.no_reordering       = 0;
+    pPar->DecParSet.opt_fmt             = IPP_YCbCr422I;
+    pPar->DecParSet.strm_fmt            = IPP_VIDEO_STRM_FMT_H264;
+    pPar->DecParSet.pp_hscale           = 1;
+    pPar->DecParSet.pp_vscale           = 1;
+
+    pPar->EncParSet.eOutputStrmFmt      = IPP_VIDEO_STRM_FMT_H264;
+    pPar->EncParSet.nPBetweenI          = 29;
+    pPar->EncParSet.nBFrameNum          = 0;
+    pPar->EncParSet.bRCEnable           = 0;
+    pPar->EncParSet.nRCType             = 0;
+    pPar->EncParSet.nQP                 = 30;
+    pPar->EncParSet.nRCBitRate          = 2000000;
+    pPar->EncParSet.nMaxBitRate         = 0;
+    pPar->EncParSet.nFrameRateNum       = 0;        /*0: from the decoded sequence*/
+}
+
+/******************************************************************************
+// Name:                ParseVmetaTransCmd
+// Description:         Parse the user command
+//
+// Input Arguments:
+//      pCmdLine    :   Pointer to the input command line
+//
+// Output Arguments:
+//      pSrcFileName:   Pointer to src file name
+//      pDstFileName:   Pointer to dst file name
+//      pLogFileName:   Pointer to log file name
+//      pPar        :   Pointer to transcoder parameter set
+// Returns:
+//        [Success]     IPP_OK
+//        [Failure]     IPP_FAIL
+******************************************************************************/
+int ParseVmetaTransCmd(char *pCmdLine,
+                    char *pSrcFileName,
+                    char *pDstFileName,
+                    char *pLogFileName,
+                    VmetaTransPar *pPar)
+{
+#define MAX_PAR_NAME_LEN    1024
+#define MAX_PAR_VALUE_LEN   2048
+#define STRNCPY(dst, src, len) \
+{\
+    IPP_Strncpy((dst), (src), (len));\
+    (dst)[(len)] = '\0';\
+}
+    char *pCur, *pEnd;
+    char par_name[MAX_PAR_NAME_LEN];
+    char par_value[MAX_PAR_VALUE_LEN];
+    int  par_name_len;
+    int  par_value_len;
+    char *p1, *p2, *p3;
+    int i;
+
+    InitVmetaTransPara(pPar);
+
+    pCur = pCmdLine;
+    pEnd = pCmdLine + IPP_Strlen(pCmdLine);
+
+    while((p1 = IPP_Strstr(pCur, "-"))){
+        p2 = IPP_Strstr(p1, ":");
+        if (NULL == p2) {
+            return IPP_FAIL;
+        }
+        p3 = IPP_Strstr(p2, " "); /*one space*/
+        if (NULL == p3) {
+            p3 = pEnd;
+        }
+
+        par_name_len    = p2 - p1 - 1;
+        par_value_len   = p3 - p2 - 1;
+
+        if ((0 >= par_name_len)  || (MAX_PAR_NAME_LEN <= par_name_len) ||
+            (0 >= par_value_len) || (MAX_PAR_VALUE_LEN <= par_value_len)) {
+            return IPP_FAIL;
+        }
+
+        STRNCPY(par_name, p1 + 1, par_name_len);
+        STRNCPY(par_value, p2 + 1, par_value_len);
+        if ((0 == IPP_Strcmp(par_name, "i")) || (0 == IPP_Strcmp(par_name, "I"))) {
+            /*input file*/
+            STRNCPY(pSrcFileName, p2 + 1, par_value_len);
+        } else if ((0 == IPP_Strcmp(par_name, "o")) || (0 == IPP_Strcmp(par_name, "O"))) {
+            /*output file*/
+            STRNCPY(pDstFileName, p2 + 1, par_value_len);
+        } else if ((0 == IPP_Strcmp(par_name, "l")) || (0 == IPP_Strcmp(par_name, "L"))) {
+            /*log file*/
+            STRNCPY(pLogFileName, p2 + 1, par_value_len);
+        } else if (0 == IPP_Strcmp(par_name, "fmt")) {
+            pPar->DecParSet.strm_fmt = IPP_Atoi(par_value);
+        } else if (0 == IPP_Strcmp(par_name, "ofmt")) {
+            pPar->EncParSet.eOutputStrmFmt = IPP_Atoi(par_value);
+        } else if (0 == IPP_Strcmp(par_name, "ow")) {
+            pPar->nOutWidth = IPP_Atoi(par_value);
+        } else if (0 == IPP_Strcmp(par_name, "oh")) {
+            pPar->nOutHeight = IPP_Atoi(par_value);
+        } else if (0 == IPP_Strcmp(par_name, "csc")) {
+            pPar->bCsc = IPP_Atoi(par_value);
+        } else if (0 == IPP_Strcmp(par_name, "lessinfo")) {
+            pPar->bLessInfo = IPP_Atoi(par_value);
+        } else {
+            for (i = 0; i < VMETA_TRANS_PARA_NUM; i++) {
+                if (0 == IPP_Strcmp(par_name, Map[i].name)) {
+                    *(int*)Map[i].p = IPP_Atoi(par_value);
+                    break;
+                }
+            }
+            if (VMETA_TRANS_PARA_NUM <= i) {
+                return IPP_FAIL;
+            }
+        }
+
+        pCur = p3;
+    }
+
+    if ((0 < pPar->nOutWidth) != (0 < pPar->nOutHeight)) {
+        IPP_Printf("-ow and -oh must be given together\n");
+        return IPP_FAIL;
+    }
+    if ((1 == pPar->nOutWidth) || (1 == pPar->nOutHeight)) {
+        return IPP_FAIL;
+    }
+    return IPP_OK;
+}
+
+/*Interface for IPP sample code template*/
+int CodecTest(int argc, char **argv)
+{
+    IPP_FILE *fpin = NULL, *fpout = NULL;
+    char input_file_name[2048]  = {'\0'};
+    char output_file_name[2048] = {'\0'};
+    char log_file_name[2048]    = {'\0'};
+    int rtFlag;
+    Ipp8u libversion[256]         = {'\0'};
+
+    if (2 != argc) {
+        IPP_Printf("Usage: appVmetaTrans.exe \"-i:input.264 -o:output.264 -l:trans.log -fmt:xx -ofmt:xx\"\n");
+        IPP_Printf("       fmt:1(mpeg2), 2(mpeg4), 4(h263), 5(h264), 6(vc-1 ap) input stream format\n");
+        IPP_Printf("       ofmt:2(mpeg4), 4(h263), 5(h264) output stream format\n");
+        IPP_Printf("       ow:w oh:h resize to w*h before encoding\n");
+        IPP_Printf("       csc:1 encode from 420P instead of pushing decoded 422I pictures\n");
+        IPP_Printf("       nQP, bRCEnable, nRCType, nRCBitRate, nMaxBitRate, nFrameRateNum, nPBetweenI, nBFrameNum: encoder parameters\n");
+        return IPP_FAIL;
+    }
+
+    IPP_Printf("Input command line: %s\n", argv[1]);
+    if (IPP_OK != ParseVmetaTransCmd(argv[1], input_file_name, output_file_name, log_file_name, &g_VmetaTransPar)) {
+        IPP_Log(log_file_name, "w",
+            "command line is wrong! %s\nUsage: appVmetaTrans.exe \"-i:input.264 -o:output.264 -l:trans.log -fmt:xx -ofmt:xx\"\n", argv[1]);
+        IPP_Printf("command line is wrong! %s\n", argv[1]);
+        return IPP_FAIL;
+    }
+
+    IPP_Printf("input: %s\n", input_file_name);
+    IPP_Printf("output: %s\n", output_file_name);
+    if (0 == IPP_Strcmp(input_file_name, "\0")) {
+        IPP_Log(log_file_name, "a", "input file name is null!\n");
+        return IPP_FAIL;
+    }
+    fpin = IPP_Fopen(input_file_name, "rb");
+    if (!fpin) {
+        IPP_Printf("Fails to open file %s!\n", input_file_name);
+        IPP_Log(log_file_name, "a", "Fails to open file %s!\n", input_file_name);
+        return IPP_FAIL;
+    }
+
+    if (0 == IPP_Strcmp(output_file_name, "\0")) {
+        IPP_Printf("output file name is null!\n");
+    } else {
+        fpout = IPP_Fopen(output_file_name, "wb");
+        if (!fpout) {
+            IPP_Printf("Fails to open file %s\n", output_file_name);
+            IPP_Log(log_file_name, "a", "Fails to open file %s\n", output_file_name);
+            IPP_Fclose(fpin);
+            return IPP_FAIL;
+        }
+    }
+
+    GetLibVersion_VmetaDEC(libversion, sizeof(libversion));
+    IPP_Printf("decoder lib version: %s\n", libversion);
+    GetLibVersion_VmetaENC(libversion, sizeof(libversion));
+    IPP_Printf("encoder lib version: %s\n", libversion);
+    IPP_Log(log_file_name, "a", "command line: %s\n", argv[1]);
+    IPP_Log(log_file_name, "a", "begin to transcode\n");
+    rtFlag = VmetaTranscoder(fpin, fpout, log_file_name, &g_VmetaTransPar);
+    if (IPP_OK == rtFlag) {
+        IPP_Log(log_file_name, "a", "everything is OK!\n");
+    } else {
+        IPP_Log(log_file_name, "a", "transcoding fail!\n");
+    }
+
+    IPP_Fclose(fpin);
+    if (fpout) {
+        IPP_Fclose(fpout);
+    }
+
+    IPP_Printf("exit!\n");
+    return rtFlag;
+}
+
+/* EOF */
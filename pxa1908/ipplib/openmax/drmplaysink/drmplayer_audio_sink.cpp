@@ -76,6 +76,19 @@ extern "C" int64_t drmplayer_audiosink_getLatencyUs(void *Handle){
     }
     return 0;
 }
+// Audio consumed by the mixer since the track started, not media time: before
+// passing it to drmplayer_videorender_setClockRef the caller adds the media
+// time of the first sample it wrote (the start or seek position) and subtracts
+// the output latency still ahead of the speaker.
+extern "C" int64_t drmplayer_audiosink_getPositionUs(void *Handle){
+    DrmPlayerAudioSink *hDrmPlayerAudioSink = (DrmPlayerAudioSink *)Handle;
+    uint32_t position = 0;
+
+    if (hDrmPlayerAudioSink == NULL || hDrmPlayerAudioSink->hAudioTrack->getPosition(&position) != NO_ERROR){
+        return -1;
+    }
+    return (int64_t)position * 1000000 / hDrmPlayerAudioSink->hAudioTrack->getSampleRate();
+}
 extern "C" void drmplayer_audiosink_deinit(void *Handle){
     DrmPlayerAudioSink *hDrmPlayerAudioSink = (DrmPlayerAudioSink *)Handle;
 
@@ -0,0 +1,158 @@
+#ifndef DRMPLAYER_BUFFER_TABLE_H
+#define DRMPLAYER_BUFFER_TABLE_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Ownership of the graphics buffers dequeued from the native window.
+// Buffers are looked up by their native handle through an open addressed
+// hash, and every state keeps its buffers on an intrusive list, so both
+// "which entry is this handle" and "give me a buffer in state X" are O(1).
+// Changes need the owner's lock, but the per-state counts are updated
+// atomically and count() may be called without it.
+
+enum GraphicBufferStatus {
+    OWNED_BY_RENDER,
+    OWNED_BY_NATIVE_WINDOW,
+    WAIT_FOR_PROVIDE,       // Graphics buffer have been dequeued, wait for provide to OMX
+    GRAPHIC_BUFFER_STATUS_NUM,
+};
+
+#define DRM_BUFFER_TABLE_MAX    64      // native windows hand out far fewer
+#define DRM_BUFFER_HASH_SIZE    128     // power of 2, at least twice DRM_BUFFER_TABLE_MAX
+#define DRM_BUFFER_NONE         (-1)
+
+struct DrmBufferEntry {
+    const void *mHandle;    // buffer_handle_t of the graphics buffer, the key
+    void *mHeader;          // OMX buffer header wrapping this buffer, NULL until bound
+    int mStatus;
+    int mPrev;
+    int mNext;
+};
+
+struct DrmBufferTable {
+    DrmBufferTable() {
+        clear();
+    }
+
+    void clear() {
+        mCount = 0;
+        memset(mSlot, 0xff, sizeof(mSlot));
+        for (int s = 0; s < GRAPHIC_BUFFER_STATUS_NUM; s++) {
+            mHead[s] = mTail[s] = DRM_BUFFER_NONE;
+            __sync_lock_test_and_set(&mNum[s], 0);
+        }
+    }
+
+    static uint32_t hash(const void *handle) {
+        // handles are heap pointers: drop the alignment bits, then mix
+        return ((uint32_t)((uintptr_t)handle >> 3) * 2654435761u) >> 16;
+    }
+
+    // Entry index of handle, DRM_BUFFER_NONE if it is not tracked.
+    int find(const void *handle) const {
+        uint32_t h = hash(handle);
+        for (int n = 0; n < DRM_BUFFER_HASH_SIZE; n++, h++) {
+            int idx = mSlot[h & (DRM_BUFFER_HASH_SIZE - 1)];
+            if (idx == DRM_BUFFER_NONE) {
+                return DRM_BUFFER_NONE;
+            }
+            if (mEntry[idx].mHandle == handle) {
+                return idx;
+            }
+        }
+        return DRM_BUFFER_NONE;
+    }
+
+    // Track a new buffer, entries are numbered in the order they are added.
+    int add(const void *handle, int status) {
+        if (mCount >= DRM_BUFFER_TABLE_MAX || find(handle) != DRM_BUFFER_NONE) {
+            return DRM_BUFFER_NONE;
+        }
+        uint32_t h = hash(handle);
+        while (mSlot[h & (DRM_BUFFER_HASH_SIZE - 1)] != DRM_BUFFER_NONE) {
+            h++;
+        }
+        int idx = mCount++;
+        mSlot[h & (DRM_BUFFER_HASH_SIZE - 1)] = idx;
+        mEntry[idx].mHandle = handle;
+        mEntry[idx].mHeader = NULL;
+        mEntry[idx].mStatus = status;
+        link(idx);
+        return idx;
+    }
+
+    void setStatus(int idx, int status) {
+        if (mEntry[idx].mStatus == status) {
+            return;
+        }
+        unlink(idx);
+        mEntry[idx].mStatus = status;
+        link(idx);
+    }
+
+    // Oldest buffer that entered status, DRM_BUFFER_NONE if there is none.
+    int first(int status) const {
+        return mHead[status];
+    }
+
+    int next(int idx) const {
+        return mEntry[idx].mNext;
+    }
+
+    int status(int idx) const {
+        return mEntry[idx].mStatus;
+    }
+
+    // Number of buffers in status. Lock-free; read together the counts may
+    // be one transition apart.
+    int count(int status) const {
+        return __sync_fetch_and_add(const_cast<int *>(&mNum[status]), 0);
+    }
+
+    void *header(int idx) const {
+        return mEntry[idx].mHeader;
+    }
+
+    void setHeader(int idx, void *pHeader) {
+        mEntry[idx].mHeader = pHeader;
+    }
+
+private:
+    void link(int idx) {
+        int s = mEntry[idx].mStatus;
+        mEntry[idx].mPrev = mTail[s];
+        mEntry[idx].mNext = DRM_BUFFER_NONE;
+        if (mTail[s] != DRM_BUFFER_NONE) {
+            mEntry[mTail[s]].mNext = idx;
+        } else {
+            mHead[s] = idx;
+        }
+        mTail[s] = idx;
+        __sync_fetch_and_add(&mNum[s], 1);
+    }
+
+    void unlink(int idx) {
+        int s = mEntry[idx].mStatus;
+        if (mEntry[idx].mPrev != DRM_BUFFER_NONE) {
+            mEntry[mEntry[idx].mPrev].mNext = mEntry[idx].mNext;
+        } else {
+            mHead[s] = mEntry[idx].mNext;
+        }
+        if (mEntry[idx].mNext != DRM_BUFFER_NONE) {
+            mEntry[mEntry[idx].mNext].mPrev = mEntry[idx].mPrev;
+        } else {
+            mTail[s] = mEntry[idx].mPrev;
+        }
+        __sync_fetch_and_sub(&mNum[s], 1);
+    }
+
+    DrmBufferEntry mEntry[DRM_BUFFER_TABLE_MAX];
+    int mCount;
+    int16_t mSlot[DRM_BUFFER_HASH_SIZE];    // entry index, DRM_BUFFER_NONE if empty
+    int mHead[GRAPHIC_BUFFER_STATUS_NUM];
+    int mTail[GRAPHIC_BUFFER_STATUS_NUM];
+    int mNum[GRAPHIC_BUFFER_STATUS_NUM];
+};
+
+#endif
@@ -0,0 +1,236 @@
+#ifndef DRMPLAYER_RENDER_PACER_H
+#define DRMPLAYER_RENDER_PACER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+// Presentation pacing for the DRM video renderer.
+// Decoded frames wait in a short queue and a pacing thread hands each one to
+// the native window when the reference clock reaches its PTS. The reference
+// maps media time to CLOCK_MONOTONIC: the player sets it from the audio
+// position when audio is the master, otherwise the first frame after start or
+// flush anchors it to the system clock, and so does a frame whose PTS is more
+// than DRM_PACER_MAX_LEAD_US away from the clock either way. Frames later
+// than mLateDropUs are dropped instead of shown, except on the system clock
+// when no newer frame is queued: the clock then slips to the late frame, so a
+// decoder that falls behind for good loses smoothness, not every frame.
+
+#define DRM_PACER_QUEUE_MAX         8
+#define DRM_PACER_QUEUE_DEFAULT     2
+#define DRM_PACER_LATE_DROP_US      40000       // a bit over one frame at 30fps
+#define DRM_PACER_MAX_LEAD_US       1000000     // further off than this: PTS jumped, re-anchor
+#define DRM_PACER_MAX_WAIT_US       100000      // recheck the clock at least this often
+
+struct DrmPacerFrame {
+    void *mBuf;
+    int64_t mPtsUs;
+};
+
+struct DrmRenderPacer {
+    // bDrop: the frame is late, give the buffer back instead of showing it
+    typedef void (*ReleaseFunc)(void *pCtx, void *pBuf, bool bDrop);
+    // The system clock reference was restarted on a PTS jump. Called with the
+    // pacer lock held.
+    typedef void (*ReanchorFunc)(void *pCtx);
+
+    DrmRenderPacer(ReleaseFunc fRelease, ReanchorFunc fReanchor, void *pCtx, int nQueue, int64_t lateDropUs)
+        : mRelease(fRelease), mReanchor(fReanchor), mCtx(pCtx), mLateDropUs(lateDropUs),
+          mRead(0), mCount(0), mStarted(false), mExit(false), mBusy(false),
+          mHasRef(false), mAudioRef(false), mRefMediaUs(0), mRefMonoUs(0) {
+        mQueueSize = (nQueue < 1) ? 1 : (nQueue > DRM_PACER_QUEUE_MAX ? DRM_PACER_QUEUE_MAX : nQueue);
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);   // waitUs deadlines
+        pthread_mutex_init(&mLock, NULL);
+        pthread_cond_init(&mCond, &attr);
+        pthread_condattr_destroy(&attr);
+    }
+
+    ~DrmRenderPacer() {
+        stop();
+        pthread_cond_destroy(&mCond);
+        pthread_mutex_destroy(&mLock);
+    }
+
+    static int64_t nowUs() {
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return (int64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+    }
+
+    int start() {
+        mExit = false;
+        if (pthread_create(&mThread, NULL, threadEntry, this) != 0) {
+            return -1;
+        }
+        mStarted = true;
+        return 0;
+    }
+
+    // Frames still queued are released right away before the thread exits.
+    void stop() {
+        if (!mStarted) {
+            return;
+        }
+        pthread_mutex_lock(&mLock);
+        mExit = true;
+        pthread_cond_broadcast(&mCond);
+        pthread_mutex_unlock(&mLock);
+        pthread_join(mThread, NULL);
+        mStarted = false;
+    }
+
+    // Media time mediaUs is presented at monotonic time monoUs (audio master).
+    void setClockRef(int64_t mediaUs, int64_t monoUs) {
+        pthread_mutex_lock(&mLock);
+        mRefMediaUs = mediaUs;
+        mRefMonoUs = monoUs;
+        mHasRef = true;
+        mAudioRef = true;
+        pthread_cond_broadcast(&mCond);
+        pthread_mutex_unlock(&mLock);
+    }
+
+    // Blocks while the queue is full. Returns false if the pacer is stopping,
+    // the caller then still owns pBuf.
+    bool push(void *pBuf, int64_t ptsUs) {
+        pthread_mutex_lock(&mLock);
+        while (mCount >= mQueueSize && !mExit) {
+            pthread_cond_wait(&mCond, &mLock);
+        }
+        if (mExit) {
+            pthread_mutex_unlock(&mLock);
+            return false;
+        }
+        DrmPacerFrame *pFrame = &mQueue[(mRead + mCount) % DRM_PACER_QUEUE_MAX];
+        pFrame->mBuf = pBuf;
+        pFrame->mPtsUs = ptsUs;
+        mCount++;
+        pthread_cond_broadcast(&mCond);
+        pthread_mutex_unlock(&mLock);
+        return true;
+    }
+
+    // Forget the queued frames without releasing them (seek, reconfig): their
+    // buffers stay with the renderer. Waits for a release in progress, and the
+    // next frame anchors the clock again unless the player sets a reference.
+    int flush() {
+        pthread_mutex_lock(&mLock);
+        while (mBusy) {
+            pthread_cond_wait(&mCond, &mLock);
+        }
+        int n = mCount;
+        mCount = 0;
+        mHasRef = false;
+        mAudioRef = false;
+        pthread_cond_broadcast(&mCond);
+        pthread_mutex_unlock(&mLock);
+        return n;
+    }
+
+    int queued() {
+        pthread_mutex_lock(&mLock);
+        int n = mCount;
+        pthread_mutex_unlock(&mLock);
+        return n;
+    }
+
+private:
+    static void *threadEntry(void *pParam) {
+        ((DrmRenderPacer *)pParam)->threadLoop();
+        return NULL;
+    }
+
+    void waitUs(int64_t us) {
+        struct timespec t;
+        if (us > DRM_PACER_MAX_WAIT_US) {
+            us = DRM_PACER_MAX_WAIT_US;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        t.tv_nsec += (long)(us % 1000000) * 1000;
+        t.tv_sec += us / 1000000 + t.tv_nsec / 1000000000;
+        t.tv_nsec %= 1000000000;
+        pthread_cond_timedwait(&mCond, &mLock, &t);
+    }
+
+    void threadLoop() {
+        pthread_mutex_lock(&mLock);
+        while (1) {
+            if (mCount == 0) {
+                if (mExit) {
+                    break;
+                }
+                pthread_cond_wait(&mCond, &mLock);
+                continue;
+            }
+
+            DrmPacerFrame frame = mQueue[mRead];
+            int64_t now = nowUs();
+            if (!mHasRef) {
+                mRefMediaUs = frame.mPtsUs;
+                mRefMonoUs = now;
+                mHasRef = true;
+            }
+            int64_t due = mRefMonoUs + (frame.mPtsUs - mRefMediaUs);
+            if (!mAudioRef && llabs(due - now) > DRM_PACER_MAX_LEAD_US) {
+                // PTS discontinuity against the system clock, restart from this frame.
+                // Backwards too, or every frame after the jump would be dropped as late.
+                mRefMediaUs = frame.mPtsUs;
+                mRefMonoUs = now;
+                due = now;
+                if (mReanchor) {
+                    mReanchor(mCtx);
+                }
+            }
+            if (due > now && !mExit) {
+                waitUs(due - now);
+                continue;   // queue, reference or exit may have changed
+            }
+
+            bool bDrop = (now - due > mLateDropUs);
+            if (bDrop && !mAudioRef && mCount == 1) {
+                mRefMediaUs = frame.mPtsUs;
+                mRefMonoUs = now;
+                bDrop = false;
+            }
+            mRead = (mRead + 1) % DRM_PACER_QUEUE_MAX;
+            mCount--;
+            mBusy = true;
+            pthread_cond_broadcast(&mCond);
+            pthread_mutex_unlock(&mLock);
+
+            mRelease(mCtx, frame.mBuf, bDrop);
+
+            pthread_mutex_lock(&mLock);
+            mBusy = false;
+            pthread_cond_broadcast(&mCond);
+        }
+        pthread_mutex_unlock(&mLock);
+    }
+
+    ReleaseFunc mRelease;
+    ReanchorFunc mReanchor;
+    void *mCtx;
+    int64_t mLateDropUs;
+    int mQueueSize;
+
+    pthread_t mThread;
+    pthread_mutex_t mLock;
+    pthread_cond_t mCond;
+    DrmPacerFrame mQueue[DRM_PACER_QUEUE_MAX];
+    int mRead;
+    int mCount;
+    bool mStarted;
+    bool mExit;
+    bool mBusy;             // a frame is being released outside the lock
+
+    bool mHasRef;
+    bool mAudioRef;
+    int64_t mRefMediaUs;
+    int64_t mRefMonoUs;
+};
+
+#endif
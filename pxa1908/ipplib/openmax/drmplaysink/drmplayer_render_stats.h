@@ -0,0 +1,88 @@
+#ifndef DRMPLAYER_RENDER_STATS_H
+#define DRMPLAYER_RENDER_STATS_H
+
+#include <stdint.h>
+#include <string.h>
+#include "OMX_Core.h"
+#include "IppOmxDrmPlayerExt.h"
+
+// Per-renderer counters behind drmplayer_videorender_getStats(). Updates are
+// single atomic operations so the render and pacing threads never block on
+// them, and collection stays on in release builds. A snapshot is taken field
+// by field without a lock, so fields may be a frame apart from each other.
+
+struct DrmRenderStats {
+    DrmRenderStats() {
+        memset(&mStats, 0, sizeof(mStats));
+        mLastRenderUs = 0;
+    }
+
+    static int bin(int64_t us) {
+        int b = 0;
+        for (uint64_t n = (us > 0 ? (uint64_t)us : 0) >> 7; n && b < DRM_RENDER_STATS_HIST_BINS - 1; n >>= 1) {
+            b++;
+        }
+        return b;
+    }
+
+    static void updateMax(OMX_U32 *pMax, OMX_U32 v) {
+        OMX_U32 old = *pMax;
+        while (v > old && !__sync_bool_compare_and_swap(pMax, old, v)) {
+            old = *pMax;
+        }
+    }
+
+    static void record(OMX_U32 *pHist, OMX_U32 *pMax, OMX_U64 *pTot, int64_t us) {
+        if (us < 0) {
+            us = 0;
+        }
+        __sync_fetch_and_add(&pHist[bin(us)], 1);
+        __sync_fetch_and_add(pTot, (OMX_U64)us);
+        updateMax(pMax, (OMX_U32)us);
+    }
+
+    // Called from whichever thread queues buffers.
+    void onQueued(int64_t latencyUs, int64_t nowUs) {
+        record(mStats.nQueueLatencyHist, &mStats.nQueueLatencyMaxUs, &mStats.nQueueLatencyTotUs, latencyUs);
+        __sync_fetch_and_add(&mStats.nFramesRendered, 1);
+        int64_t lastUs = __sync_lock_test_and_set(&mLastRenderUs, nowUs);
+        if (lastUs) {
+            __sync_fetch_and_add(&mStats.nRenderIntervalTotUs, (OMX_U64)(nowUs - lastUs));
+            __sync_fetch_and_add(&mStats.nRenderIntervals, 1);
+        }
+    }
+
+    void onDequeued(int64_t latencyUs) {
+        record(mStats.nDequeueLatencyHist, &mStats.nDequeueLatencyMaxUs, &mStats.nDequeueLatencyTotUs, latencyUs);
+    }
+
+    void onDropped()        { __sync_fetch_and_add(&mStats.nFramesDropped, 1); }
+    void onReanchored()     { __sync_fetch_and_add(&mStats.nClockReanchored, 1); }
+    // Frames entering (n > 0) and leaving (n < 0) the pacing queue.
+    void onPending(int n)   { __sync_fetch_and_add(&mStats.nFramesPending, (OMX_U32)n); }
+    void onQueueError()     { __sync_fetch_and_add(&mStats.nQueueErrors, 1); }
+    void onDequeueError()   { __sync_fetch_and_add(&mStats.nDequeueErrors, 1); }
+
+    // Seek or reconfig: the next frame does not close a render interval.
+    void breakInterval() {
+        __sync_lock_test_and_set(&mLastRenderUs, 0);
+    }
+
+    // Counters only; the caller fills in buffer ownership.
+    void snapshot(DRM_RENDER_STATS *pOut) {
+        OMX_U32 *pSrc = (OMX_U32 *)&mStats;
+        OMX_U32 *pDst = (OMX_U32 *)pOut;
+        for (size_t i = 0; i < sizeof(mStats) / sizeof(OMX_U32); i++) {
+            pDst[i] = __sync_fetch_and_add(&pSrc[i], 0);
+        }
+        pOut->nQueueLatencyTotUs = __sync_fetch_and_add(&mStats.nQueueLatencyTotUs, 0);
+        pOut->nDequeueLatencyTotUs = __sync_fetch_and_add(&mStats.nDequeueLatencyTotUs, 0);
+        pOut->nRenderIntervalTotUs = __sync_fetch_and_add(&mStats.nRenderIntervalTotUs, 0);
+    }
+
+private:
+    DRM_RENDER_STATS mStats;
+    int64_t mLastRenderUs;      // queueing thread, reset on seek from the control thread
+};
+
+#endif
@@ -10,6 +10,7 @@
 #include <utils/List.h>
 #include <utils/Vector.h>
 #include <utils/RefBase.h>
+#include <utils/threads.h>
 #include "AwesomePlayer.h"
 #include "OMX_IVCommon.h"
 #include "IppOmxDrmPlayerExt.h"
@@ -31,25 +32,12 @@
 #include <utils/Log.h>
 #include <utils/Errors.h>
 #include <cutils/properties.h>
+#include "drmplayer_buffer_table.h"
+#include "drmplayer_render_pacer.h"
+#include "drmplayer_render_stats.h"
 
-//#define PERF
 //#define DUMP
 
-#ifdef PERF
-// used to record render frame interval
-struct timespec t_start_base;
-struct timespec t_stop_base;
-long render_interval = 0;
-long time_tot_base = 0;
-
-int32_t oldDisplayWidth = 0;
-int32_t oldDisplayHeight = 0;
-int32_t frameCount = 0;
-
-#define GET_TIME_INTERVAL_USEC(A, B) (((((B).tv_sec)-((A).tv_sec))*1000000) + ((((B).tv_nsec)-((A).tv_nsec))/1000))
-#define GET_TIME_INTERVAL_NSEC(A, B) (((((B).tv_sec)-((A).tv_sec))*1000000000LL) + ((((B).tv_nsec)-((A).tv_nsec))))
-#endif
-
 #ifdef DUMP
 #define DUMPCNT 30
 int dumpCnt = 0;
@@ -60,15 +48,9 @@ static FILE* fp_dump = NULL;
 
 using namespace android;
 
-enum GraphicBufferStatus {
-    OWNED_BY_RENDER,
-    OWNED_BY_NATIVE_WINDOW,
-    WAIT_FOR_PROVIDE,       // Graphics buffer have been dequeued, wait for provide to OMX
-};
-
+// the ownership of each buffer is kept in mBufferTable, under the same index
 typedef struct AllocatedBufferInfo {
     sp<GraphicBuffer> mGraphicBuffer;
-    GraphicBufferStatus mStatus;
 }AllocatedBufferInfo;
 
 struct DrmPlayerNativeWindowRenderer : public AwesomeRenderer {
@@ -79,6 +61,7 @@ struct DrmPlayerNativeWindowRenderer : public AwesomeRenderer {
         mDisplayWidth = 0;
         mDisplayHeight = 0;
         mColorFormat = OMX_COLOR_FormatCbYCrY;
+        mPacer = NULL;
         LOGD("----- 2011.11.17 DrmPlayerNativeWindowRenderer Ver 1.1 -----");
     }
 
@@ -91,39 +74,68 @@ struct DrmPlayerNativeWindowRenderer : public AwesomeRenderer {
         }
 
         android_native_buffer_t* buf = buffer;
+        int64_t startUs = DrmRenderPacer::nowUs();
         status_t err = mNativeWindow->queueBuffer(mNativeWindow.get(), buf);
+        int64_t endUs = DrmRenderPacer::nowUs();
 
-#ifdef PERF
-        clock_gettime(CLOCK_REALTIME, &t_stop_base);
-        render_interval = ((GET_TIME_INTERVAL_USEC(t_start_base, t_stop_base)));
-        if(frameCount > 0){
-            if((oldDisplayWidth==mDisplayWidth)&&(oldDisplayHeight==mDisplayHeight)){
-                LOGD("----- w = %d, h = %d, render interval = %ld us -----", mDisplayWidth, mDisplayHeight, render_interval);
-            }else{
-                LOGD("----- Resolution changed! w = %d, h = %d, render interval = %ld us -----", mDisplayWidth, mDisplayHeight, render_interval);
+        if (err != 0) {
+            LOGE("queueBuffer failed with error %s (%d)", strerror(-err), -err);
+            mStats.onQueueError();
+            return;
+        }
+        mStats.onQueued(endUs - startUs, endUs);
+
+        Mutex::Autolock autoLock(mLock);
+        int idx = mBufferTable.find(buf->handle);
+        if(idx != DRM_BUFFER_NONE){
+            mBufferTable.setStatus(idx, OWNED_BY_NATIVE_WINDOW);
+        }
+    }
+
+    // Show buffer at ptsUs when pacing is on, right away otherwise.
+    void present(android_native_buffer_t* buffer, int64_t ptsUs){
+        RWLock::AutoRLock pacerLock(mPacerLock);
+        if(mPacer){
+            // counted first, the pacer may release the frame before push returns
+            mStats.onPending(1);
+            if(mPacer->push(buffer, ptsUs)){
+                return;
             }
-            time_tot_base += render_interval;
+            mStats.onPending(-1);
         }
-        oldDisplayWidth = mDisplayWidth;
-        oldDisplayHeight = mDisplayHeight;
-        t_start_base = t_stop_base;
-        frameCount++;
-#endif
+        render(buffer);
+    }
 
+    // A late frame goes back to the native window without being shown.
+    void drop(android_native_buffer_t* buffer){
+        status_t err = mNativeWindow->cancelBuffer(mNativeWindow.get(), buffer);
         if (err != 0) {
-            LOGE("queueBuffer failed with error %s (%d)", strerror(-err), -err);
+            LOGE("cancelBuffer failed w/ error 0x%08x", err);
             return;
         }
+        mStats.onDropped();
 
-        for (List<AllocatedBufferInfo>::iterator it = mGraphicBuffersAllocated.begin();
-            it != mGraphicBuffersAllocated.end(); ++it){
-            if(((*it).mGraphicBuffer)->handle == buf->handle){
-                (*it).mStatus = OWNED_BY_NATIVE_WINDOW;
-                break;
-            }
+        Mutex::Autolock autoLock(mLock);
+        int idx = mBufferTable.find(buffer->handle);
+        if(idx != DRM_BUFFER_NONE){
+            mBufferTable.setStatus(idx, OWNED_BY_NATIVE_WINDOW);
+        }
+    }
+
+    static void pacerRelease(void *pCtx, void *pBuf, bool bDrop){
+        DrmPlayerNativeWindowRenderer *pRender = (DrmPlayerNativeWindowRenderer *)pCtx;
+        pRender->mStats.onPending(-1);
+        if(bDrop){
+            pRender->drop((android_native_buffer_t*)pBuf);
+        }else{
+            pRender->render((android_native_buffer_t*)pBuf);
         }
     }
 
+    static void pacerReanchor(void *pCtx){
+        ((DrmPlayerNativeWindowRenderer *)pCtx)->mStats.onReanchored();
+    }
+
     void render(
         const void *data, size_t size, void *platformPrivate){
     }
@@ -137,18 +149,32 @@ struct DrmPlayerNativeWindowRenderer : public AwesomeRenderer {
     status_t getNewGraphicsBuffer(void** pBufferHandle);
     status_t getProvideGraphicsBuffer(void** pBufferHandle);
     status_t configSurface(DRM_CONFIG_SET_SURFACE *pSurfaceSet);
+    OMX_BUFFERHEADERTYPE *findBufferHeader(void *pBufHandle, int bufferCount, OMX_BUFFERHEADERTYPE **pBufferQ);
+    status_t setPacing(bool bEnable, int nQueue, int64_t lateDropUs);
+    void setClockRef(int64_t mediaUs, int64_t monoUs);
+    void flushPacer();
+    void getStats(DRM_RENDER_STATS *pStats);
 
 //protected:
     ~DrmPlayerNativeWindowRenderer() {
+        delete mPacer;
     }
     int32_t mDecodedWidth, mDecodedHeight;
     int32_t mDisplayWidth, mDisplayHeight;
     OMX_COLOR_FORMATTYPE mColorFormat;
 private:
+    // Read-held by every user of mPacer, write-held by setPacing() while it
+    // replaces it. Not mLock: the pacing thread takes mLock in its release
+    // callback, and setPacing() waits for that thread to exit.
+    RWLock mPacerLock;
+    DrmRenderPacer *mPacer;     // NULL: buffers are queued as soon as they are rendered
     sp<SurfaceComposerClient> mSurfCC;
     sp<SurfaceControl> mSurfCtrl;
     sp<ANativeWindow> mNativeWindow;
-    List<AllocatedBufferInfo> mGraphicBuffersAllocated;
+    Vector<AllocatedBufferInfo> mGraphicBuffersAllocated;
+    DrmBufferTable mBufferTable;
+    Mutex mLock;                // mBufferTable, shared with the pacing thread
+    DrmRenderStats mStats;
 
     void applyRotation(int32_t rotationDegrees) {
         uint32_t transform;
@@ -325,9 +351,14 @@ status_t DrmPlayerNativeWindowRenderer::allocateOutputBuffersFromNativeWindow(in
 
         AllocatedBufferInfo info;
         info.mGraphicBuffer = graphicBuffer;
-        info.mStatus = WAIT_FOR_PROVIDE;
 
         // mGraphicBuffersAllocated record the entries of the buffers have been allocated..
+        if(mBufferTable.add(graphicBuffer->handle, WAIT_FOR_PROVIDE) == DRM_BUFFER_NONE){
+            LOGE("too many graphics buffers, %d are tracked", DRM_BUFFER_TABLE_MAX);
+            mNativeWindow->cancelBuffer(mNativeWindow.get(), buf);
+            err = NO_MEMORY;
+            break;
+        }
         mGraphicBuffersAllocated.push_back(info);
     }
 
@@ -345,53 +376,45 @@ status_t DrmPlayerNativeWindowRenderer::allocateOutputBuffersFromNativeWindow(in
         cancelEnd = newBufferCount;
     }
 
-    unsigned int i=0;
-    for (List<AllocatedBufferInfo>::iterator it = mGraphicBuffersAllocated.begin();
-         it != mGraphicBuffersAllocated.end(); ++it,i++){
-         if(i>=cancelStart && i < cancelEnd){
-            int err = mNativeWindow->cancelBuffer(mNativeWindow.get(), (*it).mGraphicBuffer.get());
-            if (err != 0) {
-                LOGE("cancelBuffer failed w/ error 0x%08x", err);
-                return err;
-            }
-            (*it).mStatus = OWNED_BY_NATIVE_WINDOW;
-         }
+    for (unsigned int i = cancelStart; i < cancelEnd && i < mGraphicBuffersAllocated.size(); i++){
+        int err = mNativeWindow->cancelBuffer(mNativeWindow.get(), mGraphicBuffersAllocated[i].mGraphicBuffer.get());
+        if (err != 0) {
+            LOGE("cancelBuffer failed w/ error 0x%08x", err);
+            return err;
+        }
+        mBufferTable.setStatus(i, OWNED_BY_NATIVE_WINDOW);
     }
 
     return OK;
 }
 
 status_t DrmPlayerNativeWindowRenderer::getGraphicBufferInfo(int nIndex, char ** ppVirAddress, char ** ppPhyAddress, void **pBufferHandle){
-    int i = 0;
     status_t state;
 
-    for (List<AllocatedBufferInfo>::iterator it = mGraphicBuffersAllocated.begin();
-         it != mGraphicBuffersAllocated.end(); ++it,i++){
-         if(i==nIndex){
-            sp<GraphicBuffer> graphicBuffer = (*it).mGraphicBuffer;
-            void* vaddr;
+    if(nIndex >= 0 && nIndex < (int)mGraphicBuffersAllocated.size()){
+        sp<GraphicBuffer> graphicBuffer = mGraphicBuffersAllocated[nIndex].mGraphicBuffer;
+        void* vaddr;
 
-            android_native_buffer_t* bufHandle = graphicBuffer->getNativeBuffer();
-            // return the buffer handle of the graphicBuffer
-            *pBufferHandle = bufHandle;
+        android_native_buffer_t* bufHandle = graphicBuffer->getNativeBuffer();
+        // return the buffer handle of the graphicBuffer
+        *pBufferHandle = bufHandle;
 
-            private_handle_t *priHandle = private_handle_t::dynamicCast(bufHandle->handle);
-            if(priHandle == NULL){
-                LOGE("getGraphicBufferInfo dynamicCast() failed.");
-            }
+        private_handle_t *priHandle = private_handle_t::dynamicCast(bufHandle->handle);
+        if(priHandle == NULL){
+            LOGE("getGraphicBufferInfo dynamicCast() failed.");
+        }
 
-            unsigned long paddr = priHandle->physAddr;
-            unsigned long usage = GRALLOC_USAGE_SW_READ_OFTEN|GRALLOC_USAGE_SW_WRITE_OFTEN;
-            state = graphicBuffer->lock(usage, &vaddr);
-            if(state){
-                LOGE("getGraphicBufferInfo() : lock graphic buffer failed.");
-                return state;
-            }
+        unsigned long paddr = priHandle->physAddr;
+        unsigned long usage = GRALLOC_USAGE_SW_READ_OFTEN|GRALLOC_USAGE_SW_WRITE_OFTEN;
+        state = graphicBuffer->lock(usage, &vaddr);
+        if(state){
+            LOGE("getGraphicBufferInfo() : lock graphic buffer failed.");
+            return state;
+        }
 
-            (*ppPhyAddress) = (char*)paddr;
-            (*ppVirAddress) = (char*)vaddr;
-            return 0;
-         }
+        (*ppPhyAddress) = (char*)paddr;
+        (*ppVirAddress) = (char*)vaddr;
+        return 0;
     }
 
     LOGE("getGraphicBufferInfo failed.");
@@ -401,27 +424,29 @@ status_t DrmPlayerNativeWindowRenderer::getGraphicBufferInfo(int nIndex, char **
 status_t DrmPlayerNativeWindowRenderer::destroyNativeWindow(){
     int err;
 
-    for (List<AllocatedBufferInfo>::iterator it = mGraphicBuffersAllocated.begin();
-        it != mGraphicBuffersAllocated.end(); ++it){
+    flushPacer();
+    Mutex::Autolock autoLock(mLock);
+    for (size_t i = 0; i < mGraphicBuffersAllocated.size(); i++){
 
-        sp<GraphicBuffer> graphicBuffer = (*it).mGraphicBuffer;
+        sp<GraphicBuffer> graphicBuffer = mGraphicBuffersAllocated[i].mGraphicBuffer;
         err = graphicBuffer->unlock();
         if(err){
             LOGE("destroyNativeWindow() : unlock graphic buffer failed.");
             return err;
         }
 
-        if(OWNED_BY_RENDER == (*it).mStatus){
+        if(OWNED_BY_RENDER == mBufferTable.status(i)){
             err = mNativeWindow->cancelBuffer(mNativeWindow.get(), graphicBuffer.get());
             if (err != 0) {
                 LOGE("cancelBuffer failed w/ error 0x%08x", err);
                 return err;
             }
-            (*it).mStatus = OWNED_BY_NATIVE_WINDOW;
+            mBufferTable.setStatus(i, OWNED_BY_NATIVE_WINDOW);
         }
     }
 
     mGraphicBuffersAllocated.clear();
+    mBufferTable.clear();
     mSurfCC->dispose();
     mSurfCC.clear();
     mSurfCtrl.clear();
@@ -433,27 +458,29 @@ status_t DrmPlayerNativeWindowRenderer::destroyNativeWindow(){
 status_t DrmPlayerNativeWindowRenderer::reconfigNativeWindow(){
     int err;
 
-    for (List<AllocatedBufferInfo>::iterator it = mGraphicBuffersAllocated.begin();
-        it != mGraphicBuffersAllocated.end(); ++it){
+    flushPacer();
+    Mutex::Autolock autoLock(mLock);
+    for (size_t i = 0; i < mGraphicBuffersAllocated.size(); i++){
 
-        sp<GraphicBuffer> graphicBuffer = (*it).mGraphicBuffer;
+        sp<GraphicBuffer> graphicBuffer = mGraphicBuffersAllocated[i].mGraphicBuffer;
         err = graphicBuffer->unlock();
         if(err){
             LOGE("reconfigNativeWindow() : unlock graphic buffer failed.");
             return err;
         }
 
-        if(OWNED_BY_RENDER == (*it).mStatus){
+        if(OWNED_BY_RENDER == mBufferTable.status(i)){
             err = mNativeWindow->cancelBuffer(mNativeWindow.get(), graphicBuffer.get());
             if (err != 0) {
                 LOGE("cancelBuffer failed w/ error 0x%08x", err);
                 return err;
             }
-            (*it).mStatus = OWNED_BY_NATIVE_WINDOW;
+            mBufferTable.setStatus(i, OWNED_BY_NATIVE_WINDOW);
         }
     }
 
     mGraphicBuffersAllocated.clear();
+    mBufferTable.clear();
 
     return OK;
 }
@@ -462,12 +489,14 @@ status_t DrmPlayerNativeWindowRenderer::returnAllGraphicsBuffers(int *pNum){
     int err;
     int Count = 0;
 
-    for (List<AllocatedBufferInfo>::iterator it = mGraphicBuffersAllocated.begin();
-        it != mGraphicBuffersAllocated.end(); ++it){
-        if(OWNED_BY_RENDER == (*it).mStatus){
-            (*it).mStatus = WAIT_FOR_PROVIDE;
-            Count++;
-        }
+    // frames waiting for their PTS are still owned by the render
+    flushPacer();
+
+    Mutex::Autolock autoLock(mLock);
+    int idx;
+    while((idx = mBufferTable.first(OWNED_BY_RENDER)) != DRM_BUFFER_NONE){
+        mBufferTable.setStatus(idx, WAIT_FOR_PROVIDE);
+        Count++;
     }
     *pNum = Count;
     LOGD("Total %d buffers wait for provide.", Count);
@@ -478,17 +507,20 @@ status_t DrmPlayerNativeWindowRenderer::getNewGraphicsBuffer(void** pBufferHandl
     int err;
     android_native_buffer_t* newBuf = NULL;
 
+    int64_t startUs = DrmRenderPacer::nowUs();
     err = mNativeWindow->dequeueBuffer(mNativeWindow.get(), &newBuf);
     if (err != 0) {
         LOGE("dequeueBuffer failed w/ error 0x%08x", err);
+        mStats.onDequeueError();
         return err;
     }
+    mStats.onDequeued(DrmRenderPacer::nowUs() - startUs);
 
-    for (List<AllocatedBufferInfo>::iterator it = mGraphicBuffersAllocated.begin();
-         it != mGraphicBuffersAllocated.end(); ++it){
-        if(((*it).mGraphicBuffer)->handle == newBuf->handle){
-            (*it).mStatus = OWNED_BY_RENDER;
-            break;
+    {
+        Mutex::Autolock autoLock(mLock);
+        int idx = mBufferTable.find(newBuf->handle);
+        if(idx != DRM_BUFFER_NONE){
+            mBufferTable.setStatus(idx, OWNED_BY_RENDER);
         }
     }
 
@@ -507,12 +539,12 @@ status_t DrmPlayerNativeWindowRenderer::getProvideGraphicsBuffer(void** pBufferH
     int err;
     android_native_buffer_t* provideBuf = NULL;
 
-    for (List<AllocatedBufferInfo>::iterator it = mGraphicBuffersAllocated.begin();
-         it != mGraphicBuffersAllocated.end(); ++it){
-        if(WAIT_FOR_PROVIDE == (*it).mStatus){
-            (*it).mStatus = OWNED_BY_RENDER;
-            provideBuf = (*it).mGraphicBuffer->getNativeBuffer();
-            break;
+    {
+        Mutex::Autolock autoLock(mLock);
+        int idx = mBufferTable.first(WAIT_FOR_PROVIDE);
+        if(idx != DRM_BUFFER_NONE){
+            mBufferTable.setStatus(idx, OWNED_BY_RENDER);
+            provideBuf = mGraphicBuffersAllocated[idx].mGraphicBuffer->getNativeBuffer();
         }
     }
 
@@ -531,6 +563,90 @@ status_t DrmPlayerNativeWindowRenderer::getProvideGraphicsBuffer(void** pBufferH
     return OK;
 }
 
+status_t DrmPlayerNativeWindowRenderer::setPacing(bool bEnable, int nQueue, int64_t lateDropUs){
+    RWLock::AutoWLock pacerLock(mPacerLock);
+    if(mPacer){
+        // queued frames are shown before the pacer goes away
+        mPacer->stop();
+        delete mPacer;
+        mPacer = NULL;
+    }
+    if(!bEnable){
+        return OK;
+    }
+
+    mPacer = new DrmRenderPacer(pacerRelease, pacerReanchor, this, nQueue, lateDropUs);
+    if(mPacer == NULL || mPacer->start() != 0){
+        LOGE("setPacing() : failed to start pacing thread");
+        delete mPacer;
+        mPacer = NULL;
+        return -1;
+    }
+    LOGD("presentation pacing on: queue %d, drop frames later than %lld us", nQueue, lateDropUs);
+    return OK;
+}
+
+void DrmPlayerNativeWindowRenderer::setClockRef(int64_t mediaUs, int64_t monoUs){
+    RWLock::AutoRLock pacerLock(mPacerLock);
+    if(mPacer){
+        mPacer->setClockRef(mediaUs, monoUs);
+    }
+}
+
+void DrmPlayerNativeWindowRenderer::flushPacer(){
+    RWLock::AutoRLock pacerLock(mPacerLock);
+    if(mPacer){
+        int n = mPacer->flush();
+        mStats.onPending(-n);
+        if(n){
+            LOGD("%d frames waiting for presentation flushed", n);
+        }
+    }
+    mStats.breakInterval();
+}
+
+// Lock-free, and never touches mPacer, which setPacing() may be replacing.
+void DrmPlayerNativeWindowRenderer::getStats(DRM_RENDER_STATS *pStats){
+    mStats.snapshot(pStats);
+    pStats->nBuffersOwnedByRender = mBufferTable.count(OWNED_BY_RENDER);
+    pStats->nBuffersOwnedByNativeWindow = mBufferTable.count(OWNED_BY_NATIVE_WINDOW);
+    pStats->nBuffersWaitForProvide = mBufferTable.count(WAIT_FOR_PROVIDE);
+}
+
+// Map a buffer handed out by the native window to the OMX header wrapping it.
+// The headers are bound to the table entries on the first lookup, later
+// lookups only check that the binding still holds. Runs under mLock, the
+// table may be cleared by a reconfig meanwhile.
+OMX_BUFFERHEADERTYPE *DrmPlayerNativeWindowRenderer::findBufferHeader(void *pBufHandle, int bufferCount, OMX_BUFFERHEADERTYPE **pBufferQ){
+    const void *handle = ((android_native_buffer_t*)pBufHandle)->handle;
+    Mutex::Autolock autoLock(mLock);
+    int idx = mBufferTable.find(handle);
+    OMX_BUFFERHEADERTYPE *pHeader;
+
+    if(idx != DRM_BUFFER_NONE){
+        pHeader = (OMX_BUFFERHEADERTYPE*)mBufferTable.header(idx);
+        if(pHeader && ((android_native_buffer_t*)(pHeader->pAppPrivate))->handle == handle){
+            return pHeader;
+        }
+    }
+
+    pHeader = NULL;
+    for (int i = 0; i < bufferCount; i++){
+        if(pBufferQ[i]==NULL){
+            LOGE(" ACCESS NULL POINTER i=%d ", i);
+            continue;
+        }
+        const void *h = ((android_native_buffer_t*)(pBufferQ[i]->pAppPrivate))->handle;
+        int n = mBufferTable.find(h);
+        if(n != DRM_BUFFER_NONE){
+            mBufferTable.setHeader(n, pBufferQ[i]);
+        }
+        if(h == handle){
+            pHeader = pBufferQ[i];
+        }
+    }
+    return pHeader;
+}
 
 status_t DrmPlayerNativeWindowRenderer::configSurface(DRM_CONFIG_SET_SURFACE *pSurfaceSet){
     int err = NO_ERROR;
@@ -571,10 +687,6 @@ status_t DrmPlayerNativeWindowRenderer::configSurface(DRM_CONFIG_SET_SURFACE *pS
 extern "C"  void *drmplayer_videorender_init(void *pRenderHandle){
     DrmPlayerNativeWindowRenderer *handle;
 
-#ifdef PERF
-    time_tot_base = 0;
-    frameCount = 0;
-#endif
     handle = new DrmPlayerNativeWindowRenderer(0);
     if (handle == NULL){
         LOGE("drmplayer_videorender_init() : failed at create render");
@@ -586,6 +698,11 @@ extern "C"  void *drmplayer_videorender_init(void *pRenderHandle){
         return NULL;
     }
 
+    char value[PROPERTY_VALUE_MAX];
+    if(property_get("drmplayer.video.pacing", value, "0") && atoi(value) > 0){
+        handle->setPacing(true, DRM_PACER_QUEUE_DEFAULT, DRM_PACER_LATE_DROP_US);
+    }
+
     return (void *)handle;
 }
 
@@ -647,7 +764,6 @@ extern "C" int drmplayer_videorender_getNewGraphicsBuffer(void *pRenderHandle, i
         return -1;
     }
 
-    int i;
     void * pBufHandle=NULL;
 
     DrmPlayerNativeWindowRenderer *pDrmPlayerRenderHandle = ( DrmPlayerNativeWindowRenderer *)pRenderHandle;
@@ -661,17 +777,9 @@ extern "C" int drmplayer_videorender_getNewGraphicsBuffer(void *pRenderHandle, i
             return -1;
         }
 
-        for (i=0; i<bufferCount; i++){
-            if(pBufferQ[i]==NULL){
-                LOGE(" ACCESS NULL POINTER i=%d ", i);
-            }
-            if(((android_native_buffer_t*)(pBufferQ[i]->pAppPrivate))->handle == ((android_native_buffer_t*)pBufHandle)->handle){
-                (*pNewBufferHeader) = pBufferQ[i];
-                break;
-            }
-        }
+        (*pNewBufferHeader) = pDrmPlayerRenderHandle->findBufferHeader(pBufHandle, bufferCount, pBufferQ);
 
-        if(i == bufferCount){
+        if((*pNewBufferHeader) == NULL){
             LOGE("drmplayer_videorender_getNewGraphicsBuffer() : find new buffer header failed!");
             return -1;
         }
@@ -686,7 +794,6 @@ extern "C" int drmplayer_videorender_getProvideGraphicsBuffer(void *pRenderHandl
         return -1;
     }
 
-    int i;
     void * pBufHandle=NULL;
 
     DrmPlayerNativeWindowRenderer *pDrmPlayerRenderHandle = ( DrmPlayerNativeWindowRenderer *)pRenderHandle;
@@ -700,17 +807,9 @@ extern "C" int drmplayer_videorender_getProvideGraphicsBuffer(void *pRenderHandl
             return -1;
         }
 
-        for (i=0; i<bufferCount; i++){
-            if(pBufferQ[i]==NULL){
-                LOGE(" ACCESS NULL POINTER i=%d ", i);
-            }
-            if(((android_native_buffer_t*)(pBufferQ[i]->pAppPrivate))->handle == ((android_native_buffer_t*)pBufHandle)->handle){
-                (*pNewBufferHeader) = pBufferQ[i];
-                break;
-            }
-        }
+        (*pNewBufferHeader) = pDrmPlayerRenderHandle->findBufferHeader(pBufHandle, bufferCount, pBufferQ);
 
-        if(i == bufferCount){
+        if((*pNewBufferHeader) == NULL){
             LOGE("drmplayer_videorender_getNewGraphicsBuffer() : find new buffer header failed!");
             return -1;
         }
@@ -734,6 +833,7 @@ extern "C" void drmplayer_videorender(void *pRenderHandle, const void *data, siz
 
     DrmPlayerNativeWindowRenderer *pDrmPlayerRenderHandle = ( DrmPlayerNativeWindowRenderer *)pRenderHandle;
     android_native_buffer_t *pBufferHandle = (android_native_buffer_t*)(((OMX_BUFFERHEADERTYPE*)platformPrivate)->pAppPrivate);
+    int64_t ptsUs = ((OMX_BUFFERHEADERTYPE*)platformPrivate)->nTimeStamp;
 
 #ifdef DUMP
     if(dumpCnt > 0){
@@ -754,10 +854,49 @@ extern "C" void drmplayer_videorender(void *pRenderHandle, const void *data, siz
 #endif
 
     if (pDrmPlayerRenderHandle){
-        pDrmPlayerRenderHandle->render(pBufferHandle);
+        pDrmPlayerRenderHandle->present(pBufferHandle, ptsUs);
     }
 }
 
+// nQueue frames are held at most, frames later than lateDropMs are dropped.
+extern "C" int drmplayer_videorender_setPacing(void *pRenderHandle, int bEnable, int nQueue, int lateDropMs){
+    if(pRenderHandle == NULL){
+        LOGE("drmplayer_videorender_setPacing() : Bad parameter!");
+        return -1;
+    }
+
+    DrmPlayerNativeWindowRenderer *pDrmPlayerRenderHandle = ( DrmPlayerNativeWindowRenderer *)pRenderHandle;
+    return pDrmPlayerRenderHandle->setPacing(bEnable != 0,
+            nQueue > 0 ? nQueue : DRM_PACER_QUEUE_DEFAULT,
+            lateDropMs > 0 ? (int64_t)lateDropMs * 1000 : DRM_PACER_LATE_DROP_US);
+}
+
+// Media time mediaTimeUs is heard at CLOCK_MONOTONIC time monoTimeUs (0: now),
+// call it again whenever the audio position is read to follow the audio clock.
+extern "C" int drmplayer_videorender_setClockRef(void *pRenderHandle, int64_t mediaTimeUs, int64_t monoTimeUs){
+    if(pRenderHandle == NULL){
+        LOGE("drmplayer_videorender_setClockRef() : Bad parameter!");
+        return -1;
+    }
+
+    DrmPlayerNativeWindowRenderer *pDrmPlayerRenderHandle = ( DrmPlayerNativeWindowRenderer *)pRenderHandle;
+    pDrmPlayerRenderHandle->setClockRef(mediaTimeUs, monoTimeUs > 0 ? monoTimeUs : DrmRenderPacer::nowUs());
+    return 0;
+}
+
+// Snapshot of the render counters, cheap enough to poll every frame.
+extern "C" int drmplayer_videorender_getStats(void *pRenderHandle, DRM_RENDER_STATS *pStats){
+    if((pRenderHandle == NULL) || (pStats == NULL)){
+        LOGE("drmplayer_videorender_getStats() : Bad parameter!");
+        return -1;
+    }
+
+    DrmPlayerNativeWindowRenderer *pDrmPlayerRenderHandle = ( DrmPlayerNativeWindowRenderer *)pRenderHandle;
+    memset(pStats, 0, sizeof(*pStats));
+    pDrmPlayerRenderHandle->getStats(pStats);
+    return 0;
+}
+
 extern "C" int drmplayer_videorender_configSurface(void *pRenderHandle, void *pSurfaceSet){
     if((pRenderHandle==NULL) || (pSurfaceSet==NULL)){
         LOGE("drmplayer_videorender_configSurface() : Bad parameter!");
@@ -783,12 +922,6 @@ extern "C" void drmplayer_videorender_deinit(void *pRenderHandle){
         return;
     }
 
-#ifdef PERF
-    LOGD("----- Total Time = %ldus, Total Frame Count = %d, Avg Render Interval = %lfus, Fps = %lf -----", time_tot_base, frameCount-1, (double)(time_tot_base)/(frameCount-1), (double)(frameCount-1)*1000000/(time_tot_base));
-    time_tot_base = 0;
-    frameCount = 0;
-#endif
-
 #ifdef DUMP
     int dumpCnt = 0;
     int dumpInx = 0;
@@ -797,6 +930,14 @@ extern "C" void drmplayer_videorender_deinit(void *pRenderHandle){
 
     DrmPlayerNativeWindowRenderer *pDrmPlayerRenderHandle = ( DrmPlayerNativeWindowRenderer *)pRenderHandle;
 
+    DRM_RENDER_STATS stats;
+    pDrmPlayerRenderHandle->getStats(&stats);
+    LOGD("----- Frames rendered = %lu, dropped = %lu, Avg Render Interval = %.1lfus, Avg queue = %.1lfus, Max dequeue = %luus -----",
+        (unsigned long)stats.nFramesRendered, (unsigned long)stats.nFramesDropped,
+        stats.nRenderIntervals ? (double)stats.nRenderIntervalTotUs / stats.nRenderIntervals : 0.0,
+        stats.nFramesRendered ? (double)stats.nQueueLatencyTotUs / stats.nFramesRendered : 0.0,
+        (unsigned long)stats.nDequeueLatencyMaxUs);
+
     if (pDrmPlayerRenderHandle){
         if(OK != pDrmPlayerRenderHandle->destroyNativeWindow()){
             LOGE("drmplayer_videorender_deinit() : destroyNativeWindow failed!");
@@ -0,0 +1,107 @@
+// Cost of one playback buffer cycle against a stub native window with
+// 32 buffers: dequeue, mark OWNED_BY_RENDER, find the OMX header wrapping
+// the buffer, queue, mark OWNED_BY_NATIVE_WINDOW. The window hands buffers
+// back in FIFO order. Compares the linear scans the renderer used before
+// DrmBufferTable with the table itself.
+
+#include <list>
+
+#include "drm_test.h"
+#include "stub_native_window.h"
+#include "drmplayer_buffer_table.h"
+
+#define NUM_BUFFERS 32
+#define CYCLES      2000000
+
+struct AllocatedBufferInfo {
+    const native_handle_t *mHandle;
+    int mStatus;
+};
+
+static native_handle_t gHandle[NUM_BUFFERS];
+static android_native_buffer_t gBuf[NUM_BUFFERS];
+static void *gBufferQ[NUM_BUFFERS];     // OMX headers, not in window order
+
+static void *findHeaderLinear(const native_handle_t *handle) {
+    for (int i = 0; i < NUM_BUFFERS; i++) {
+        if (((android_native_buffer_t *)gBufferQ[i])->handle == handle) {
+            return gBufferQ[i];
+        }
+    }
+    return NULL;
+}
+
+static void setStatusLinear(std::list<AllocatedBufferInfo> &l, const native_handle_t *handle, int status) {
+    for (std::list<AllocatedBufferInfo>::iterator it = l.begin(); it != l.end(); ++it) {
+        if (it->mHandle == handle) {
+            it->mStatus = status;
+            return;
+        }
+    }
+}
+
+static double runLinear() {
+    StubNativeWindow w;
+    std::list<AllocatedBufferInfo> l;
+    android_native_buffer_t *buf;
+    void * volatile pHeader;
+
+    for (int i = 0; i < NUM_BUFFERS; i++) {
+        AllocatedBufferInfo info = { gBuf[i].handle, OWNED_BY_NATIVE_WINDOW };
+        l.push_back(info);
+        w.give(&gBuf[i]);
+    }
+    long long t = test_now_ns();
+    for (int n = 0; n < CYCLES; n++) {
+        CHECK(w.dequeueBuffer(&w, &buf) == 0);
+        setStatusLinear(l, buf->handle, OWNED_BY_RENDER);
+        pHeader = findHeaderLinear(buf->handle);
+        w.queueBuffer(&w, buf);
+        setStatusLinear(l, buf->handle, OWNED_BY_NATIVE_WINDOW);
+    }
+    (void)pHeader;
+    return (double)(test_now_ns() - t) / CYCLES;
+}
+
+static double runTable() {
+    StubNativeWindow w;
+    DrmBufferTable table;
+    android_native_buffer_t *buf;
+    void * volatile pHeader;
+
+    for (int i = 0; i < NUM_BUFFERS; i++) {
+        CHECK(table.add(gBuf[i].handle, OWNED_BY_NATIVE_WINDOW) == i);
+        w.give(&gBuf[i]);
+    }
+    long long t = test_now_ns();
+    for (int n = 0; n < CYCLES; n++) {
+        CHECK(w.dequeueBuffer(&w, &buf) == 0);
+        int idx = table.find(buf->handle);
+        table.setStatus(idx, OWNED_BY_RENDER);
+        void *h = table.header(idx);
+        if (h == NULL || ((android_native_buffer_t *)h)->handle != buf->handle) {
+            // first sight of this buffer: bind every header, as findBufferHeader does
+            for (int i = 0; i < NUM_BUFFERS; i++) {
+                table.setHeader(table.find(((android_native_buffer_t *)gBufferQ[i])->handle), gBufferQ[i]);
+            }
+            h = table.header(idx);
+        }
+        pHeader = h;
+        w.queueBuffer(&w, buf);
+        table.setStatus(table.find(buf->handle), OWNED_BY_NATIVE_WINDOW);
+    }
+    (void)pHeader;
+    CHECK(table.count(OWNED_BY_NATIVE_WINDOW) == NUM_BUFFERS);
+    return (double)(test_now_ns() - t) / CYCLES;
+}
+
+int main() {
+    for (int i = 0; i < NUM_BUFFERS; i++) {
+        gBuf[i].handle = &gHandle[i];
+        gBufferQ[i] = &gBuf[(i * 7) % NUM_BUFFERS];
+    }
+    printf("%d buffers, %d cycles of dequeue + header lookup + queue:\n", NUM_BUFFERS, CYCLES);
+    printf("  linear list: %.1f ns per cycle\n", runLinear());
+    printf("  hash table:  %.1f ns per cycle\n", runTable());
+    return 0;
+}
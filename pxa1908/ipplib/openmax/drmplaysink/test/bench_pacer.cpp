@@ -0,0 +1,113 @@
+// Presentation jitter and drop rate of DrmRenderPacer against the stub
+// native window, which timestamps every queueBuffer. A simulated decoder
+// produces 30 fps frames with random decode times; each load is run once
+// queueing frames as soon as they are decoded, as the renderer did before
+// pacing, and once through the pacer on the system clock.
+//
+//   bench_pacer [-n frames]
+
+#include <math.h>
+#include <unistd.h>
+#include <vector>
+
+#include "drm_test.h"
+#include "stub_native_window.h"
+#include "drmplayer_render_pacer.h"
+
+#define FRAME_US    33333
+
+struct Load {
+    const char *mName;
+    int mMinUs;         // decode time is uniform in [mMinUs, mMaxUs)
+    int mMaxUs;
+    int mStallEvery;    // one mStallUs decode every mStallEvery frames, 0: none
+    int mStallUs;
+};
+
+static const Load gLoads[] = {
+    { "steady",     20000, 30000,  0,      0 },
+    { "bursty",     13000, 26000,  50, 72000 },
+    { "overloaded", 28000, 44000,  0,      0 },
+};
+
+static android_native_buffer_t gBuf;
+
+static void release(void *pCtx, void *pBuf, bool bDrop) {
+    StubNativeWindow *w = (StubNativeWindow *)pCtx;
+    if (bDrop) {
+        w->cancelBuffer(w, (android_native_buffer_t *)pBuf);
+    } else {
+        w->queueBuffer(w, (android_native_buffer_t *)pBuf);
+    }
+}
+
+static void report(const char *mode, StubNativeWindow &w, int frames) {
+    int n = w.mQueued < STUB_WINDOW_MAX_QUEUED ? w.mQueued : STUB_WINDOW_MAX_QUEUED;
+    double sum = 0, sum2 = 0, dev = 0;
+    for (int i = 1; i < n; i++) {
+        double d = (w.mQueuedUs[i] - w.mQueuedUs[i - 1]) / 1000.0;
+        sum += d;
+        sum2 += d * d;
+        if (fabs(d - FRAME_US / 1000.0) > dev) {
+            dev = fabs(d - FRAME_US / 1000.0);
+        }
+    }
+    double mean = n > 1 ? sum / (n - 1) : 0;
+    double var = n > 1 ? sum2 / (n - 1) - mean * mean : 0;
+    printf("  %-9s shown %4d, dropped %3d (%4.1f%%), interval mean %5.1f ms, "
+           "stddev %4.1f ms, worst %5.1f ms off\n", mode, w.mQueued, w.mCancelled,
+           100.0 * w.mCancelled / frames, mean, sqrt(var > 0 ? var : 0), dev);
+}
+
+static void run(const Load &load, int frames) {
+    std::vector<int> dec(frames);
+    srand(1);
+    for (int i = 0; i < frames; i++) {
+        dec[i] = load.mMinUs + rand() % (load.mMaxUs - load.mMinUs);
+        if (load.mStallEvery && i % load.mStallEvery == load.mStallEvery / 2) {
+            dec[i] = load.mStallUs;
+        }
+    }
+    printf("%s decode, %d frames at 30 fps:\n", load.mName, frames);
+
+    StubNativeWindow immediate;
+    for (int i = 0; i < frames; i++) {
+        usleep(dec[i]);
+        immediate.queueBuffer(&immediate, &gBuf);
+    }
+    report("immediate", immediate, frames);
+
+    StubNativeWindow paced;
+    DrmRenderPacer p(release, NULL, &paced, DRM_PACER_QUEUE_DEFAULT, DRM_PACER_LATE_DROP_US);
+    CHECK(p.start() == 0);
+    for (int i = 0; i < frames; i++) {
+        usleep(dec[i]);
+        CHECK(p.push(&gBuf, (int64_t)i * FRAME_US));
+    }
+    while (p.queued()) {    // stop() would release the rest at once
+        usleep(1000);
+    }
+    p.stop();
+    report("paced", paced, frames);
+}
+
+int main(int argc, char **argv) {
+    int frames = 300, c;
+
+    while ((c = getopt(argc, argv, "n:")) != -1) {
+        if (c == 'n') {
+            frames = atoi(optarg);
+        } else {
+            printf("usage: %s [-n frames]\n", argv[0]);
+            return 0;
+        }
+    }
+    if (frames < 2 || frames > STUB_WINDOW_MAX_QUEUED) {
+        frames = 300;
+    }
+    setvbuf(stdout, NULL, _IONBF, 0);
+    for (size_t i = 0; i < sizeof(gLoads) / sizeof(gLoads[0]); i++) {
+        run(gLoads[i], frames);
+    }
+    return 0;
+}
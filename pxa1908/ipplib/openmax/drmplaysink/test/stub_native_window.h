@@ -0,0 +1,100 @@
+#ifndef STUB_NATIVE_WINDOW_H
+#define STUB_NATIVE_WINDOW_H
+
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+// Host stand-in for the ANativeWindow the renderer draws into: the same
+// dequeueBuffer/queueBuffer/cancelBuffer entry points over a FIFO of
+// buffers, like a BufferQueue in async mode. Every queue is timestamped
+// with CLOCK_MONOTONIC so benchmarks can measure the presentation cadence.
+
+#define STUB_WINDOW_MAX_BUFFERS     64
+#define STUB_WINDOW_MAX_QUEUED      4096
+
+typedef struct native_handle {
+    int fd;
+} native_handle_t;
+
+typedef struct android_native_buffer_t {
+    const native_handle_t *handle;
+    void *pHeader;                  // OMX header wrapping the buffer, like pAppPrivate
+} android_native_buffer_t;
+
+struct ANativeWindow {
+    int (*dequeueBuffer)(ANativeWindow *pWindow, android_native_buffer_t **ppBuf);
+    int (*queueBuffer)(ANativeWindow *pWindow, android_native_buffer_t *pBuf);
+    int (*cancelBuffer)(ANativeWindow *pWindow, android_native_buffer_t *pBuf);
+};
+
+struct StubNativeWindow : public ANativeWindow {
+    android_native_buffer_t *mFree[STUB_WINDOW_MAX_BUFFERS];
+    unsigned mRead;
+    unsigned mWrite;
+    pthread_mutex_t mLock;
+
+    int64_t mQueuedUs[STUB_WINDOW_MAX_QUEUED];     // shown frames, in queue order
+    int mQueued;
+    int mCancelled;
+
+    StubNativeWindow() : mRead(0), mWrite(0), mQueued(0), mCancelled(0) {
+        dequeueBuffer = doDequeue;
+        queueBuffer = doQueue;
+        cancelBuffer = doCancel;
+        pthread_mutex_init(&mLock, NULL);
+    }
+
+    ~StubNativeWindow() {
+        pthread_mutex_destroy(&mLock);
+    }
+
+    // The window owns pBuf until it is dequeued.
+    void give(android_native_buffer_t *pBuf) {
+        pthread_mutex_lock(&mLock);
+        mFree[mWrite++ % STUB_WINDOW_MAX_BUFFERS] = pBuf;
+        pthread_mutex_unlock(&mLock);
+    }
+
+private:
+    static StubNativeWindow *self(ANativeWindow *pWindow) {
+        return static_cast<StubNativeWindow *>(pWindow);
+    }
+
+    static int doDequeue(ANativeWindow *pWindow, android_native_buffer_t **ppBuf) {
+        StubNativeWindow *w = self(pWindow);
+        int err = -1;
+        pthread_mutex_lock(&w->mLock);
+        if (w->mRead != w->mWrite) {
+            *ppBuf = w->mFree[w->mRead++ % STUB_WINDOW_MAX_BUFFERS];
+            err = 0;
+        }
+        pthread_mutex_unlock(&w->mLock);
+        return err;
+    }
+
+    static int doQueue(ANativeWindow *pWindow, android_native_buffer_t *pBuf) {
+        StubNativeWindow *w = self(pWindow);
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        pthread_mutex_lock(&w->mLock);
+        if (w->mQueued < STUB_WINDOW_MAX_QUEUED) {
+            w->mQueuedUs[w->mQueued] = (int64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+        }
+        w->mQueued++;
+        w->mFree[w->mWrite++ % STUB_WINDOW_MAX_BUFFERS] = pBuf;
+        pthread_mutex_unlock(&w->mLock);
+        return 0;
+    }
+
+    static int doCancel(ANativeWindow *pWindow, android_native_buffer_t *pBuf) {
+        StubNativeWindow *w = self(pWindow);
+        pthread_mutex_lock(&w->mLock);
+        w->mCancelled++;
+        w->mFree[w->mWrite++ % STUB_WINDOW_MAX_BUFFERS] = pBuf;
+        pthread_mutex_unlock(&w->mLock);
+        return 0;
+    }
+};
+
+#endif
@@ -0,0 +1,117 @@
+// DrmBufferTable against a reference model: random state transitions,
+// clears and re-adds of up to DRM_BUFFER_TABLE_MAX handles. After every
+// step the per-state counts, the status of every entry and the order of
+// every state list (oldest entry first) must match the model.
+
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+#include "drm_test.h"
+#include "drmplayer_buffer_table.h"
+
+#define STEPS       1000000
+#define MAX_HANDLES (DRM_BUFFER_TABLE_MAX + 8)
+
+struct Model {
+    std::vector<const void *> mHandle;
+    std::vector<int> mStatus;
+    std::vector<int> mList[GRAPHIC_BUFFER_STATUS_NUM];
+
+    int add(const void *handle, int status) {
+        if ((int)mHandle.size() >= DRM_BUFFER_TABLE_MAX ||
+            std::find(mHandle.begin(), mHandle.end(), handle) != mHandle.end()) {
+            return DRM_BUFFER_NONE;
+        }
+        mHandle.push_back(handle);
+        mStatus.push_back(status);
+        mList[status].push_back((int)mHandle.size() - 1);
+        return (int)mHandle.size() - 1;
+    }
+
+    void setStatus(int idx, int status) {
+        if (mStatus[idx] == status) {
+            return;
+        }
+        std::vector<int> &l = mList[mStatus[idx]];
+        l.erase(std::find(l.begin(), l.end(), idx));
+        mStatus[idx] = status;
+        mList[status].push_back(idx);
+    }
+
+    void clear() {
+        mHandle.clear();
+        mStatus.clear();
+        for (int s = 0; s < GRAPHIC_BUFFER_STATUS_NUM; s++) {
+            mList[s].clear();
+        }
+    }
+};
+
+static void compare(const DrmBufferTable &t, const Model &m, const void **handles) {
+    for (int s = 0; s < GRAPHIC_BUFFER_STATUS_NUM; s++) {
+        CHECK(t.count(s) == (int)m.mList[s].size());
+        size_t n = 0;
+        for (int idx = t.first(s); idx != DRM_BUFFER_NONE; idx = t.next(idx), n++) {
+            CHECK(n < m.mList[s].size() && idx == m.mList[s][n]);
+            CHECK(t.status(idx) == s);
+        }
+        CHECK(n == m.mList[s].size());
+    }
+    for (int i = 0; i < MAX_HANDLES; i++) {
+        std::vector<const void *>::const_iterator it = std::find(m.mHandle.begin(), m.mHandle.end(), handles[i]);
+        int idx = t.find(handles[i]);
+        if (it == m.mHandle.end()) {
+            CHECK(idx == DRM_BUFFER_NONE);
+        } else {
+            CHECK(idx == it - m.mHandle.begin());
+            CHECK(t.status(idx) == m.mStatus[idx]);
+        }
+    }
+}
+
+int main() {
+    static char storage[MAX_HANDLES * 64];
+    const void *handles[MAX_HANDLES];
+    DrmBufferTable t;
+    Model m;
+    int adds = 0, clears = 0;
+
+    setvbuf(stdout, NULL, _IONBF, 0);
+    // gralloc handles are 8 byte aligned heap pointers, close together
+    for (int i = 0; i < MAX_HANDLES; i++) {
+        handles[i] = storage + i * 64;
+    }
+
+    srand(1);
+    for (int step = 0; step < STEPS; step++) {
+        int r = rand() % 1000;
+        if (r == 0) {
+            t.clear();
+            m.clear();
+            clears++;
+        } else if (r < 100) {
+            const void *h = handles[rand() % MAX_HANDLES];
+            int s = rand() % GRAPHIC_BUFFER_STATUS_NUM;
+            int idx = t.add(h, s);
+            CHECK(idx == m.add(h, s));
+            if (idx != DRM_BUFFER_NONE) {
+                CHECK(t.header(idx) == NULL);
+                t.setHeader(idx, (void *)h);
+                adds++;
+            }
+        } else if (!m.mHandle.empty()) {
+            int idx = rand() % (int)m.mHandle.size();
+            int s = rand() % GRAPHIC_BUFFER_STATUS_NUM;
+            t.setStatus(idx, s);
+            m.setStatus(idx, s);
+            CHECK(t.header(idx) == m.mHandle[idx]);
+        }
+        if (step % 64 == 0) {
+            compare(t, m, handles);
+        }
+    }
+    compare(t, m, handles);
+    printf("%d steps, %d adds, %d clears: table matches the reference model\n", STEPS, adds, clears);
+    return 0;
+}
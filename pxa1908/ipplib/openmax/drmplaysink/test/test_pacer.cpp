@@ -0,0 +1,152 @@
+// DrmRenderPacer against the stub native window: frames are shown at their
+// PTS; late frames are cancelled, or on the system clock with nothing newer
+// queued, shown with the clock slipped; a PTS jump either way re-anchors the
+// system clock reference instead of stalling or dropping everything after
+// it. With an audio reference the pacer follows the reference and never
+// re-anchors on its own.
+
+#include <unistd.h>
+
+#include "drm_test.h"
+#include "stub_native_window.h"
+#include "drmplayer_render_pacer.h"
+
+#define FRAME_US    33333
+#define SLACK_US    15000       // scheduling noise allowed on a loaded host
+
+static android_native_buffer_t gBuf;
+static volatile int gReanchored;   // bumped by the pacing thread
+
+static void release(void *pCtx, void *pBuf, bool bDrop) {
+    StubNativeWindow *w = (StubNativeWindow *)pCtx;
+    if (bDrop) {
+        w->cancelBuffer(w, (android_native_buffer_t *)pBuf);
+    } else {
+        w->queueBuffer(w, (android_native_buffer_t *)pBuf);
+    }
+}
+
+static void reanchor(void *pCtx) {
+    gReanchored++;
+}
+
+static void waitIdle(DrmRenderPacer &p) {
+    for (int n = 0; p.queued() && n < 2000; n++) {
+        usleep(1000);
+    }
+    usleep(2000);   // let the last release finish
+}
+
+// frames are shown FRAME_US apart, counted from the first one
+static void test_cadence() {
+    StubNativeWindow w;
+    DrmRenderPacer p(release, reanchor, &w, 4, DRM_PACER_LATE_DROP_US);
+    gReanchored = 0;
+    CHECK(p.start() == 0);
+    for (int i = 0; i < 10; i++) {
+        CHECK(p.push(&gBuf, 5000000 + (int64_t)i * FRAME_US));
+    }
+    waitIdle(p);
+    CHECK(w.mQueued == 10 && w.mCancelled == 0);
+    for (int i = 1; i < 10; i++) {
+        int64_t d = w.mQueuedUs[i] - w.mQueuedUs[0] - (int64_t)i * FRAME_US;
+        CHECK(d > -SLACK_US && d < SLACK_US);
+    }
+    CHECK(gReanchored == 0);
+    printf("cadence: 10 frames on their PTS\n");
+}
+
+// on the audio clock a frame behind by more than the threshold is cancelled
+static void test_late_drop() {
+    StubNativeWindow w;
+    DrmRenderPacer p(release, reanchor, &w, 4, DRM_PACER_LATE_DROP_US);
+    gReanchored = 0;
+    CHECK(p.start() == 0);
+    p.setClockRef(1000000, DrmRenderPacer::nowUs());
+    CHECK(p.push(&gBuf, 1000000 - 200000));      // due 200 ms ago
+    CHECK(p.push(&gBuf, 1000000 - 20000));       // late, but under the threshold
+    CHECK(p.push(&gBuf, 1000000 + FRAME_US));
+    waitIdle(p);
+    CHECK(w.mQueued == 2 && w.mCancelled == 1);
+    CHECK(gReanchored == 0);
+    printf("late drop: 1 of 3 frames cancelled\n");
+}
+
+// on the system clock a late frame with nothing newer queued is shown and
+// the cadence continues from it
+static void test_slip() {
+    StubNativeWindow w;
+    DrmRenderPacer p(release, reanchor, &w, 4, DRM_PACER_LATE_DROP_US);
+    gReanchored = 0;
+    CHECK(p.start() == 0);
+    CHECK(p.push(&gBuf, 1000000));
+    waitIdle(p);
+    usleep(200000);
+    CHECK(p.push(&gBuf, 1000000 + FRAME_US));    // due 167 ms ago
+    waitIdle(p);
+    CHECK(p.push(&gBuf, 1000000 + 2 * FRAME_US));
+    waitIdle(p);
+    CHECK(w.mQueued == 3 && w.mCancelled == 0);
+    int64_t d = w.mQueuedUs[2] - w.mQueuedUs[1] - FRAME_US;
+    CHECK(d > -SLACK_US && d < SLACK_US);
+    CHECK(gReanchored == 0);
+    printf("slip: late frame shown, cadence kept from it\n");
+}
+
+// PTS jumps 10 s back, then 10 s ahead: both re-anchor and show right away
+static void test_jumps() {
+    StubNativeWindow w;
+    DrmRenderPacer p(release, reanchor, &w, 4, DRM_PACER_LATE_DROP_US);
+    gReanchored = 0;
+    CHECK(p.start() == 0);
+    CHECK(p.push(&gBuf, 10000000));
+    waitIdle(p);
+
+    long long t = test_now_ns();
+    for (int i = 0; i < 3; i++) {
+        CHECK(p.push(&gBuf, (int64_t)i * FRAME_US));
+    }
+    waitIdle(p);
+    CHECK(w.mQueued == 4 && w.mCancelled == 0);
+    CHECK(gReanchored == 1);
+
+    for (int i = 0; i < 3; i++) {
+        CHECK(p.push(&gBuf, 20000000 + (int64_t)i * FRAME_US));
+    }
+    waitIdle(p);
+    CHECK(w.mQueued == 7 && w.mCancelled == 0);
+    CHECK(gReanchored == 2);
+    CHECK((test_now_ns() - t) / 1000 < 4 * FRAME_US + 2 * SLACK_US + 10000);
+    printf("PTS jumps: re-anchored back and forward, nothing dropped\n");
+}
+
+// the audio reference moves the schedule, the pacer does not override it
+static void test_audio_ref() {
+    StubNativeWindow w;
+    DrmRenderPacer p(release, reanchor, &w, 4, DRM_PACER_LATE_DROP_US);
+    gReanchored = 0;
+    CHECK(p.start() == 0);
+    int64_t now = DrmRenderPacer::nowUs();
+    p.setClockRef(0, now + 100000);             // media time 0 is heard in 100 ms
+    CHECK(p.push(&gBuf, 0));
+    CHECK(p.push(&gBuf, 5000000));              // 5 s ahead, kept waiting
+    usleep(200000);
+    CHECK(w.mQueued == 1);
+    int64_t d = w.mQueuedUs[0] - (now + 100000);
+    CHECK(d > -SLACK_US && d < SLACK_US);
+    p.setClockRef(4950000, DrmRenderPacer::nowUs());
+    waitIdle(p);
+    CHECK(w.mQueued == 2 && w.mCancelled == 0);
+    CHECK(gReanchored == 0);
+    printf("audio reference: frames follow the reference\n");
+}
+
+int main() {
+    setvbuf(stdout, NULL, _IONBF, 0);
+    test_cadence();
+    test_late_drop();
+    test_slip();
+    test_jumps();
+    test_audio_ref();
+    return 0;
+}
@@ -0,0 +1,130 @@
+// Lock-free polling of the render statistics, the way the renderer uses
+// them: a queueing thread and a dequeueing thread update DrmRenderStats, a
+// control thread breaks the render interval as a seek would, and a buffer
+// thread moves DrmBufferTable entries between states under its lock, while
+// the main thread snapshots everything without taking any lock. Counters
+// must never go backwards, buffer counts must stay in range, and at the
+// end every update must be accounted for.
+
+#include <pthread.h>
+
+#include "drm_test.h"
+#include "drmplayer_buffer_table.h"
+#include "drmplayer_render_stats.h"
+
+#define FRAMES      1000000
+#define NUM_BUFFERS 32
+
+static DrmRenderStats gStats;
+static DrmBufferTable gTable;
+static pthread_mutex_t gTableLock = PTHREAD_MUTEX_INITIALIZER;
+static volatile int gDone;
+
+static void *queueThread(void *arg) {
+    for (int i = 0; i < FRAMES; i++) {
+        gStats.onPending(1);
+        gStats.onQueued(i % 1000, test_now_ns() / 1000);
+        gStats.onPending(-1);
+        if (i % 100 == 0) {
+            gStats.onReanchored();
+        }
+    }
+    return NULL;
+}
+
+static void *dequeueThread(void *arg) {
+    for (int i = 0; i < FRAMES; i++) {
+        gStats.onDequeued(i % 5000);
+        if (i % 10 == 0) {
+            gStats.onDropped();
+        }
+    }
+    return NULL;
+}
+
+static void *seekThread(void *arg) {
+    while (!gDone) {
+        gStats.breakInterval();
+    }
+    return NULL;
+}
+
+static void *bufferThread(void *arg) {
+    unsigned r = 1;
+    while (!gDone) {
+        r = r * 1103515245 + 12345;
+        pthread_mutex_lock(&gTableLock);
+        gTable.setStatus((r >> 8) % NUM_BUFFERS, (r >> 16) % GRAPHIC_BUFFER_STATUS_NUM);
+        pthread_mutex_unlock(&gTableLock);
+    }
+    return NULL;
+}
+
+int main() {
+    static char handles[NUM_BUFFERS * 64];
+    pthread_t pt[4];
+    DRM_RENDER_STATS s, last;
+    int polls = 0;
+
+    setvbuf(stdout, NULL, _IONBF, 0);
+    for (int i = 0; i < NUM_BUFFERS; i++) {
+        CHECK(gTable.add(handles + i * 64, OWNED_BY_NATIVE_WINDOW) == i);
+    }
+    memset(&last, 0, sizeof(last));
+
+    long long t = test_now_ns();
+    CHECK(pthread_create(&pt[0], NULL, queueThread, NULL) == 0);
+    CHECK(pthread_create(&pt[1], NULL, dequeueThread, NULL) == 0);
+    CHECK(pthread_create(&pt[2], NULL, seekThread, NULL) == 0);
+    CHECK(pthread_create(&pt[3], NULL, bufferThread, NULL) == 0);
+    while (last.nFramesRendered < FRAMES || last.nFramesDropped < FRAMES / 10) {
+        gStats.snapshot(&s);
+        CHECK(s.nFramesRendered >= last.nFramesRendered);
+        CHECK(s.nFramesDropped >= last.nFramesDropped);
+        CHECK(s.nClockReanchored >= last.nClockReanchored);
+        CHECK(s.nRenderIntervals >= last.nRenderIntervals);
+        CHECK(s.nFramesPending <= 1);
+        for (int st = 0; st < GRAPHIC_BUFFER_STATUS_NUM; st++) {
+            int n = gTable.count(st);
+            CHECK(n >= 0 && n <= NUM_BUFFERS);
+        }
+        last = s;
+        polls++;
+    }
+    gDone = 1;
+    for (int i = 0; i < 4; i++) {
+        pthread_join(pt[i], NULL);
+    }
+    long long elapsedUs = (test_now_ns() - t) / 1000;
+
+    gStats.snapshot(&s);
+    CHECK(s.nFramesRendered == FRAMES);
+    CHECK(s.nFramesDropped == FRAMES / 10);
+    CHECK(s.nFramesPending == 0);
+    CHECK(s.nClockReanchored == FRAMES / 100);
+    CHECK(s.nQueueLatencyMaxUs == 999);
+    CHECK(s.nDequeueLatencyMaxUs == 4999);
+    OMX_U32 queued = 0, dequeued = 0;
+    for (int b = 0; b < DRM_RENDER_STATS_HIST_BINS; b++) {
+        queued += s.nQueueLatencyHist[b];
+        dequeued += s.nDequeueLatencyHist[b];
+    }
+    CHECK(queued == FRAMES && dequeued == FRAMES);
+    // an interval racing a seek must not be measured from 0
+    CHECK(s.nRenderIntervals < FRAMES);
+    CHECK((long long)s.nRenderIntervalTotUs <= elapsedUs);
+
+    int total = 0;
+    for (int st = 0; st < GRAPHIC_BUFFER_STATUS_NUM; st++) {
+        int n = 0;
+        for (int idx = gTable.first(st); idx != DRM_BUFFER_NONE; idx = gTable.next(idx)) {
+            n++;
+        }
+        CHECK(gTable.count(st) == n);
+        total += n;
+    }
+    CHECK(total == NUM_BUFFERS);
+    printf("%d frames, %d lock-free polls: all updates counted, %lu of %d render "
+           "intervals survived the seeks\n", FRAMES, polls, (unsigned long)s.nRenderIntervals, FRAMES);
+    return 0;
+}
@@ -2,6 +2,8 @@
 #ifndef _IppOmxDrmPlayerExt_H_
 #define _IppOmxDrmPlayerExt_H_
 
+#include <stdint.h>
+
 #define DRM_INDEX_CONFIG_LICENSE_CHALLENGE "DRM.index.config.licensechallenge"
 #define DRM_INDEX_CONFIG_LICENSE_RESPONSE "DRM.index.config.licenseresponse"
 #define DRM_INDEX_CONFIG_DELETE_LICENSE "DRM.index.config.deletelicense"
@@ -46,6 +48,50 @@ typedef struct DRM_CONFIG_SET_SURFACE{
     OMX_U32 componentNameSize;          // (actual data size send from IL component to IL Client)
     OMX_U8  componentName[1];           // Variable length array of component name(send from IL client to IL component)
 }DRM_CONFIG_SET_SURFACE;
+
+#define DRM_RENDER_STATS_HIST_BINS  12
+
+// Video render counters, see drmplayer_videorender_getStats(). Latency
+// histogram bin 0 counts calls under 128 us, bin i calls in [64<<i, 128<<i) us,
+// the last bin everything longer.
+typedef struct DRM_RENDER_STATS{
+    OMX_U32 nFramesRendered;            // queued to the native window
+    OMX_U32 nFramesDropped;             // late frames given back without being shown
+    OMX_U32 nFramesPending;             // waiting in the pacing queue
+    OMX_U32 nQueueErrors;
+    OMX_U32 nDequeueErrors;
+    OMX_U32 nClockReanchored;           // pacing clock restarted on a PTS jump
+    OMX_U32 nBuffersOwnedByRender;
+    OMX_U32 nBuffersOwnedByNativeWindow;
+    OMX_U32 nBuffersWaitForProvide;
+    OMX_U32 nQueueLatencyMaxUs;
+    OMX_U32 nDequeueLatencyMaxUs;
+    OMX_U32 nRenderIntervals;           // frame to frame intervals in nRenderIntervalTotUs
+    OMX_U64 nQueueLatencyTotUs;
+    OMX_U64 nDequeueLatencyTotUs;
+    OMX_U64 nRenderIntervalTotUs;       // seek and reconfig gaps excluded
+    OMX_U32 nQueueLatencyHist[DRM_RENDER_STATS_HIST_BINS];
+    OMX_U32 nDequeueLatencyHist[DRM_RENDER_STATS_HIST_BINS];
+}DRM_RENDER_STATS;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Snapshot of the render counters, lock-free, cheap enough to poll every frame.
+int drmplayer_videorender_getStats(void *pRenderHandle, DRM_RENDER_STATS *pStats);
+// Present frames at their PTS: nQueue frames are held at most, frames later
+// than lateDropMs are dropped; 0 picks the defaults.
+int drmplayer_videorender_setPacing(void *pRenderHandle, int bEnable, int nQueue, int lateDropMs);
+// Media time mediaTimeUs is heard at CLOCK_MONOTONIC time monoTimeUs (0: now).
+int drmplayer_videorender_setClockRef(void *pRenderHandle, int64_t mediaTimeUs, int64_t monoTimeUs);
+// Audio consumed by the mixer since the track started, -1 on error.
+int64_t drmplayer_audiosink_getPositionUs(void *Handle);
+
+#ifdef __cplusplus
+}
+#endif
+
 int DrmPlaySetVideoRenderer(void *pHandle);
 
 #endif /* _IppOmxDrmPlayerExt_H_ */
@@ -45,3 +45,27 @@ LOCAL_MODULE := libvmeta
 
 include $(BUILD_SHARED_LIBRARY)
 
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	vmeta_stat.c
+
+LOCAL_SHARED_LIBRARIES := libvmeta
+
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE := vmeta-stat
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	vmeta_simd.c
+
+LOCAL_LDLIBS := -lpthread
+
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE := vmeta-simd
+
+include $(BUILD_HOST_EXECUTABLE)
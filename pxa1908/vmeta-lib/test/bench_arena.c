@@ -0,0 +1,135 @@
+/*
+ *  bench_arena.c
+ *
+ *  vmalloc/vfree churn of a 1080p decode. Every frame allocates and frees
+ *  the per-frame temporaries of a 1920x1088 picture (8160 macroblocks)
+ *  while the per-stream tables stay allocated. Runs once with an arena
+ *  bound and once on the plain heap path, from one and from four
+ *  threads, and prints the time per call pair and the memory reserved.
+ *
+ *  bench_arena [-n frames]
+ *
+ * Copyright (C) 2009 Marvell International Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vmeta_test.h"
+
+#define MB_NUM		(120 * 68)
+#define THREADS		4
+
+/* per-stream tables, allocated once */
+static const UNSG32 stream_size[] = {
+	MB_NUM * 64, 64 * 1024, 16 * 1024, 4096, 2048
+};
+
+/* per-frame temporaries: slice headers, mb info, ref lists, sei, rows */
+static const UNSG32 frame_size[] = {
+	256, 256, 256, 256, MB_NUM * 32, 1024, 1024, 512, 1920 * 4, 1920 * 4,
+	96, 96, 96, 96, 96, 96, 96, 96
+};
+
+#define STREAM_NUM	(sizeof(stream_size) / sizeof(stream_size[0]))
+#define FRAME_NUM	(sizeof(frame_size) / sizeof(frame_size[0]))
+
+static int frames = 2000;
+static int use_arena;
+
+struct result {
+	long long ns;
+	long long calls;
+	vmeta_arena_stat stat;
+};
+
+static void *decode(void *arg)
+{
+	struct result *res = (struct result *)arg;
+	vmeta_arena *arena = NULL;
+	void *stream[STREAM_NUM], *frame[FRAME_NUM];
+	long long t0;
+	unsigned int i, f;
+
+	if (use_arena) {
+		arena = vdec_os_api_arena_create(0);
+		CHECK(arena != NULL);
+		vdec_os_api_arena_bind(arena);
+	}
+	for (i = 0; i < STREAM_NUM; i++)
+		CHECK((stream[i] = vdec_os_api_vmalloc(stream_size[i], 32)));
+
+	t0 = test_now_ns();
+	for (f = 0; f < (unsigned int)frames; f++) {
+		/* the decoder drops the sizes out of order */
+		for (i = 0; i < FRAME_NUM; i++) {
+			frame[i] = vdec_os_api_vmalloc(frame_size[(i + f) % FRAME_NUM], 8);
+			CHECK(frame[i] != NULL);
+			*(unsigned char *)frame[i] = (unsigned char)f;
+		}
+		for (i = 0; i < FRAME_NUM; i++)
+			vdec_os_api_vfree(frame[(i * 7 + f) % FRAME_NUM]);
+	}
+	res->ns = test_now_ns() - t0;
+	res->calls = (long long)frames * FRAME_NUM;
+
+	for (i = 0; i < STREAM_NUM; i++)
+		vdec_os_api_vfree(stream[i]);
+	vdec_os_api_arena_get_stat(arena, &res->stat);
+	if (use_arena) {
+		vdec_os_api_arena_bind(NULL);
+		vdec_os_api_arena_destroy(arena);
+	}
+	return NULL;
+}
+
+static void run(int arena, int threads)
+{
+	struct result res[THREADS];
+	pthread_t pt[THREADS];
+	long long ns = 0, calls = 0;
+	int i;
+
+	use_arena = arena;
+	memset(res, 0, sizeof(res));
+	for (i = 0; i < threads; i++)
+		CHECK(pthread_create(&pt[i], NULL, decode, &res[i]) == 0);
+	for (i = 0; i < threads; i++) {
+		pthread_join(pt[i], NULL);
+		ns += res[i].ns;
+		calls += res[i].calls;
+	}
+
+	printf("%-5s %d thread%s: %4lld ns per vmalloc/vfree pair",
+	       arena ? "arena" : "heap", threads, threads > 1 ? "s" : " ",
+	       ns / calls);
+	if (arena)
+		printf(", reserved %u bytes, %u of %u calls reused",
+		       res[0].stat.reserved_bytes, res[0].stat.reuse_count,
+		       res[0].stat.alloc_count);
+	printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		if (opt == 'n')
+			frames = atoi(optarg);
+	}
+
+	printf("1080p, %d frames, %d temporaries per frame\n", frames,
+	       (int)FRAME_NUM);
+	run(1, 1);
+	run(0, 1);
+	run(1, THREADS);
+	run(0, THREADS);
+	return 0;
+}
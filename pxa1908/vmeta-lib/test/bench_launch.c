@@ -0,0 +1,136 @@
+/*
+ *  bench_launch.c
+ *
+ *  Launch latency of short lived workers: each launch is a fresh
+ *  fork + exec of this program, which times driver init to the end of
+ *  its first frame (user id, lock, power and clock on, picture buffer,
+ *  hw object, sync, unlock). Run once reading the uio descriptor from
+ *  sysfs in every process and once with the VMETA_DESC_CACHE file, and
+ *  print the mean and percentiles of both, plus the mean of the init
+ *  part (driver init and user id) on its own.
+ *
+ *  bench_launch [-n launches]
+ *
+ * Copyright (C) 2009 Marvell International Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ */
+
+#include <sys/wait.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vmeta_test.h"
+
+#define PIC_SIZE	(1920 * 1088 * 3 / 2)
+
+/* the worker: init to first frame, the times go back over fd */
+static int launch_child(int fd)
+{
+	long long t0, t[2];
+	UNSG32 pa, va;
+	int user_id;
+	void *pic;
+
+	t0 = test_now_ns();
+	user_id = test_open_user();
+	t[1] = test_now_ns() - t0;
+	CHECK(vdec_os_api_lock(user_id, 1000) >= 0);
+	CHECK(vdec_os_api_power_on() == VDEC_OS_DRIVER_OK);
+	CHECK(vdec_os_api_clock_on() == VDEC_OS_DRIVER_OK);
+	pic = vdec_os_api_dma_alloc(PIC_SIZE, 4096, &pa);
+	CHECK(pic != NULL);
+	CHECK(vdec_os_api_get_hw_obj_addr(&va, 0x1000) == VDEC_OS_DRIVER_OK);
+	vdec_os_api_set_sync_timeout_isr(1000);
+	CHECK(vdec_os_api_sync_event() == VDEC_OS_DRIVER_OK);
+	CHECK(vdec_os_api_unlock(user_id) == VDEC_OS_DRIVER_OK);
+	t[0] = test_now_ns() - t0;
+
+	vdec_os_api_dma_free(pic);
+	vdec_os_api_clock_off();
+	vdec_os_api_power_off();
+	test_close_user(user_id);
+	return write(fd, t, sizeof(t)) == sizeof(t) ? 0 : 1;
+}
+
+static int cmp_ll(const void *a, const void *b)
+{
+	long long x = *(const long long *)a, y = *(const long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void run(const char *name, int n, long long *lat)
+{
+	long long t0, t[2], wall, sum = 0, init = 0;
+	int i, fds[2], status;
+	char arg[16];
+	pid_t pid;
+
+	t0 = test_now_ns();
+	for (i = 0; i < n; i++) {
+		CHECK(pipe(fds) == 0);
+		pid = fork();
+		CHECK(pid >= 0);
+		if (pid == 0) {
+			close(fds[0]);
+			snprintf(arg, sizeof(arg), "%d", fds[1]);
+			execl("/proc/self/exe", "bench_launch", "-C", arg,
+			      (char *)NULL);
+			_exit(127);
+		}
+		close(fds[1]);
+		CHECK(read(fds[0], t, sizeof(t)) == sizeof(t));
+		close(fds[0]);
+		CHECK(waitpid(pid, &status, 0) == pid);
+		CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+		lat[i] = t[0];
+		sum += t[0];
+		init += t[1];
+	}
+	wall = test_now_ns() - t0;
+
+	qsort(lat, n, sizeof(lat[0]), cmp_ll);
+	printf("%-6s %d launches: init to first frame mean %lld us, "
+	       "p50 %lld us, p99 %lld us, max %lld us; init %lld us; "
+	       "%lld us per launch\n", name, n, sum / n / 1000,
+	       lat[n / 2] / 1000, lat[n * 99 / 100] / 1000,
+	       lat[n - 1] / 1000, init / n / 1000, wall / n / 1000);
+}
+
+int main(int argc, char **argv)
+{
+	char cache[] = "/tmp/vmeta_desc.XXXXXX";
+	long long *lat;
+	int n = 1000, c, fd;
+
+	while ((c = getopt(argc, argv, "n:C:")) != -1) {
+		switch (c) {
+		case 'n': n = atoi(optarg); break;
+		case 'C': return launch_child(atoi(optarg));
+		default:
+			printf("usage: %s [-n launches]\n", argv[0]);
+			return 0;
+		}
+	}
+	if (n < 1)
+		n = 1000;
+	lat = malloc(n * sizeof(*lat));
+	CHECK(lat != NULL);
+
+	unsetenv(UIO_DESC_CACHE_ENV);
+	run("sysfs", n, lat);
+
+	fd = mkstemp(cache);
+	CHECK(fd >= 0);
+	close(fd);
+	CHECK(setenv(UIO_DESC_CACHE_ENV, cache, 1) == 0);
+	run("cached", n, lat);
+	unlink(cache);
+
+	free(lat);
+	return 0;
+}
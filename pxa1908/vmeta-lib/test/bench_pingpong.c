@@ -0,0 +1,201 @@
+/*
+ *  bench_pingpong.c
+ *
+ *  Two process ping-pong over shared DMA buffers. The parent allocates
+ *  the pictures and exports them to a forked child over a unix socket;
+ *  then each frame the parent writes a picture, syncs it for the device
+ *  and passes its index, the child syncs it for the CPU, checks it and
+ *  passes the index back. Prints the round trip per frame.
+ *
+ *  bench_pingpong [-n frames] [-w width] [-h height] [-b buffers] [-c] [-f]
+ *    -c  cached buffers, so every hand-over runs the sync path
+ *    -f  write and check the whole picture instead of one line
+ *
+ * Copyright (C) 2009 Marvell International Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ */
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vmeta_test.h"
+
+#define MAX_BUF		16
+
+static int send_fd(int sock, int fd)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char cbuf[CMSG_SPACE(sizeof(int))];
+	char c = 0;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &c;
+	iov.iov_len = 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+	return sendmsg(sock, &msg, 0) == 1 ? 0 : -1;
+}
+
+static int recv_fd(int sock)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char cbuf[CMSG_SPACE(sizeof(int))];
+	char c;
+	int fd;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &c;
+	iov.iov_len = 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+	if (recvmsg(sock, &msg, 0) != 1)
+		return -1;
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS)
+		return -1;
+	memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+	return fd;
+}
+
+static void fill(unsigned char *p, int len, int frame)
+{
+	memset(p, frame & 0xff, len);
+}
+
+static int check(unsigned char *p, int len, int frame)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		if (p[i] != (frame & 0xff))
+			return -1;
+	return 0;
+}
+
+static int child(int sock, int nbuf, int len)
+{
+	unsigned char *buf[MAX_BUF];
+	vmeta_dma_desc desc;
+	int i, idx[2], bad;
+
+	for (i = 0; i < nbuf; i++) {
+		CHECK(read(sock, &desc, sizeof(desc)) == sizeof(desc));
+		desc.fd = recv_fd(sock);
+		CHECK(desc.fd >= 0);
+		buf[i] = vdec_os_api_dma_import(&desc);
+		CHECK(buf[i] != NULL);
+	}
+
+	/* idx[0] picture, idx[1] frame number, -1 ends */
+	while (read(sock, idx, sizeof(idx)) == sizeof(idx) && idx[0] >= 0) {
+		vdec_os_api_dma_sync(buf[idx[0]], DMA_FROM_DEVICE, 1);
+		bad = check(buf[idx[0]], len, idx[1]);
+		vdec_os_api_dma_sync(buf[idx[0]], DMA_FROM_DEVICE, 0);
+		if (bad < 0)
+			idx[0] = -1;
+		CHECK(write(sock, idx, sizeof(idx)) == sizeof(idx));
+	}
+
+	for (i = 0; i < nbuf; i++)
+		vdec_os_api_dma_free(buf[i]);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned char *buf[MAX_BUF];
+	vmeta_dma_desc desc;
+	int frames = 1000, width = 1920, height = 1088, nbuf = 4;
+	int cached = 0, full = 0;
+	int sv[2], i, idx[2], size, len, opt, status;
+	long long t0, t, total = 0, worst = 0;
+	UNSG32 pa;
+	pid_t pid;
+
+	while ((opt = getopt(argc, argv, "n:w:h:b:cf")) != -1) {
+		switch (opt) {
+		case 'n': frames = atoi(optarg); break;
+		case 'w': width = atoi(optarg); break;
+		case 'h': height = atoi(optarg); break;
+		case 'b': nbuf = atoi(optarg); break;
+		case 'c': cached = 1; break;
+		case 'f': full = 1; break;
+		default:
+			printf("usage: %s [-n frames] [-w width] [-h height] "
+			       "[-b buffers] [-c] [-f]\n", argv[0]);
+			return 0;
+		}
+	}
+	if (nbuf < 1 || nbuf > MAX_BUF)
+		nbuf = 4;
+
+	/* 4:2:2 interleaved, the decoder default output */
+	size = width * height * 2;
+	len = full ? size : width * 2;
+
+	CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	pid = fork();
+	CHECK(pid >= 0);
+	if (pid == 0) {
+		close(sv[0]);
+		exit(child(sv[1], nbuf, len));
+	}
+	close(sv[1]);
+
+	for (i = 0; i < nbuf; i++) {
+		buf[i] = vdec_os_api_dma_alloc_shared(size, 4096, &pa, cached);
+		CHECK(buf[i] != NULL);
+		CHECK(vdec_os_api_dma_export(buf[i], &desc) == VDEC_OS_DRIVER_OK);
+		CHECK(write(sv[0], &desc, sizeof(desc)) == sizeof(desc));
+		CHECK(send_fd(sv[0], desc.fd) == 0);
+		close(desc.fd);
+	}
+
+	for (i = 0; i < frames; i++) {
+		t0 = test_now_ns();
+		idx[0] = i % nbuf;
+		idx[1] = i;
+		vdec_os_api_dma_sync(buf[idx[0]], DMA_TO_DEVICE, 1);
+		fill(buf[idx[0]], len, i);
+		vdec_os_api_dma_sync(buf[idx[0]], DMA_TO_DEVICE, 0);
+		CHECK(write(sv[0], idx, sizeof(idx)) == sizeof(idx));
+		CHECK(read(sv[0], idx, sizeof(idx)) == sizeof(idx));
+		CHECK(idx[0] == i % nbuf);
+		t = test_now_ns() - t0;
+		total += t;
+		if (t > worst)
+			worst = t;
+	}
+
+	idx[0] = -1;
+	CHECK(write(sv[0], idx, sizeof(idx)) == sizeof(idx));
+	waitpid(pid, &status, 0);
+	CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	for (i = 0; i < nbuf; i++)
+		vdec_os_api_dma_free(buf[i]);
+
+	printf("pingpong %dx%d %s %s, %d buffers: %d frames, "
+	       "%lld us per round trip, worst %lld us\n", width, height,
+	       cached ? "cached" : "non-cached", full ? "full" : "one line",
+	       nbuf, frames, total / frames / 1000, worst / 1000);
+	return 0;
+}
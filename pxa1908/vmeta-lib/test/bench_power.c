@@ -0,0 +1,233 @@
+/*
+ *  bench_power.c
+ *
+ *  Power model harness for the OP selection. Replays multi-instance
+ *  traces through the library against vmeta-simd and reports the OP
+ *  chosen at every event, the number of switches and an energy estimate,
+ *  next to the policy it replaced (VMETA_OP_MAX as soon as two users are
+ *  registered, left there on unregister).
+ *
+ *  bench_power [-f trace] [-v]
+ *
+ *  A trace has one event per line, times in ms:
+ *    <ms> open <slot> <dec|enc> <strm_fmt> <width> <height> <fps>
+ *    <ms> close <slot>
+ *    <ms> end
+ *  Without -f the built-in traces are replayed.
+ *
+ *  Energy is a relative estimate: the OPs are assumed linear from 156 to
+ *  624MHz and 0.95 to 1.25V, dynamic power f*V^2 scaled to 400mW at
+ *  VMETA_OP_MAX, plus a fixed cost per clock switch.
+ *
+ * Copyright (C) 2009 Marvell International Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ */
+
+#include <string.h>
+#include <unistd.h>
+
+#include "vmeta_test.h"
+
+#define SLOT_NUM	8
+#define P_MAX_MW	400.0
+#define SWITCH_UJ	100.0
+
+struct policy {
+	int op;
+	int switches;
+	double energy_uj;
+};
+
+static int verbose;
+static int user[SLOT_NUM];
+static vmeta_user_info slot_info[SLOT_NUM];
+
+static double op_power_mw(int op)
+{
+	double f = 156 + (624 - 156) * (double)op / VMETA_OP_MAX;
+	double v = 0.95 + 0.30 * (double)op / VMETA_OP_MAX;
+
+	return P_MAX_MW * f * v * v / (624 * 1.25 * 1.25);
+}
+
+/* -1 is clock off, turning it on or off is not counted as a switch */
+static void set_op(struct policy *p, int op)
+{
+	if (op != p->op && op >= 0 && p->op >= 0) {
+		p->switches++;
+		p->energy_uj += SWITCH_UJ;
+	}
+	p->op = op;
+}
+
+static void run_for(struct policy *p, int dt_ms)
+{
+	if (p->op >= 0)
+		p->energy_uj += op_power_mw(p->op) * dt_ms;
+}
+
+/*
+The replaced policy: one user gets its default OP, more get the max; a
+decoder caller adds one OP on top.
+*/
+static int old_op(int users, vmeta_user_info *info)
+{
+	int reso = info->width * info->height;
+	int op;
+
+	if (users > 1)
+		op = VMETA_OP_MAX;
+	else if (info->strm_fmt == 4 && reso <= RESO_720P_SIZE)
+		op = VMETA_OP_720P;
+	else if (reso <= RESO_VGA_SIZE)
+		op = info->usertype == 0 ? VMETA_OP_VGA : VMETA_OP_VGA_ENC;
+	else if (reso <= RESO_720P_SIZE)
+		op = VMETA_OP_720P;
+	else
+		op = VMETA_OP_1080P;
+
+	if (info->usertype == 0)
+		op++;
+	return op > VMETA_OP_MAX ? VMETA_OP_MAX : op;
+}
+
+static int replay(const char *name, FILE *fp)
+{
+	struct policy cur = { -1, 0, 0 }, old = { -1, 0, 0 };
+	char line[128], cmd[16], type[8];
+	int ms, last_ms = 0, slot, fmt, w, h, fps, users = 0;
+	int old_next = -1;
+
+	memset(user, -1, sizeof(user));
+	printf("%s\n", name);
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (line[0] == '#' || sscanf(line, "%d %15s", &ms, cmd) != 2)
+			continue;
+
+		run_for(&cur, ms - last_ms);
+		run_for(&old, ms - last_ms);
+		last_ms = ms;
+
+		if (strcmp(cmd, "open") == 0) {
+			CHECK(sscanf(line, "%*d %*s %d %7s %d %d %d %d", &slot,
+				     type, &fmt, &w, &h, &fps) == 6);
+			CHECK(slot >= 0 && slot < SLOT_NUM && user[slot] < 0);
+			user[slot] = vdec_os_api_get_user_id();
+			CHECK(user[slot] >= 0);
+			CHECK(vdec_os_api_register_user_id(user[slot]) == 0);
+			memset(&slot_info[slot], 0, sizeof(vmeta_user_info));
+			slot_info[slot].usertype = strcmp(type, "enc") == 0;
+			slot_info[slot].strm_fmt = fmt;
+			slot_info[slot].width = w;
+			slot_info[slot].height = h;
+			CHECK(vdec_os_api_set_frame_rate(user[slot], fps) == 0);
+			CHECK(vdec_os_api_update_user_info(user[slot],
+							   &slot_info[slot]) >= 0);
+			users++;
+			old_next = old_op(users, &slot_info[slot]);
+		} else if (strcmp(cmd, "close") == 0) {
+			CHECK(sscanf(line, "%*d %*s %d", &slot) == 1);
+			CHECK(slot >= 0 && slot < SLOT_NUM && user[slot] >= 0);
+			CHECK(vdec_os_api_unregister_user_id(user[slot]) == 0);
+			CHECK(vdec_os_api_free_user_id(user[slot]) == 0);
+			user[slot] = -1;
+			users--;
+		} else if (strcmp(cmd, "end") == 0) {
+			break;
+		}
+		/* nobody left: the clock is off under both policies */
+		if (users == 0)
+			old_next = -1;
+		set_op(&cur, users ? vdec_driver_get_cb()->curr_op : -1);
+		set_op(&old, old_next);
+		if (verbose)
+			printf("  %6d ms %-5s users %d  op %2d  old %2d\n", ms,
+			       cmd, users, cur.op, old.op);
+	}
+
+	printf("  aggregate: %2d switches, %8.1f mJ\n", cur.switches,
+	       cur.energy_uj / 1000);
+	printf("  replaced:  %2d switches, %8.1f mJ\n", old.switches,
+	       old.energy_uj / 1000);
+	return cur.energy_uj <= old.energy_uj ? 0 : -1;
+}
+
+static const char *trace_call =
+	"# video call: VGA decode plus VGA encode, then the encoder stops\n"
+	"0 open 0 dec 5 640 480 30\n"
+	"200 open 1 enc 5 640 480 30\n"
+	"60000 close 1\n"
+	"90000 close 0\n"
+	"90000 end\n";
+
+static const char *trace_thumb =
+	"# 1080p playback while the gallery decodes VGA thumbnails\n"
+	"0 open 0 dec 5 1920 1080 30\n"
+	"5000 open 1 dec 2 640 480 30\n"
+	"5400 close 1\n"
+	"5500 open 1 dec 2 640 480 30\n"
+	"5900 close 1\n"
+	"6000 open 1 dec 5 320 240 30\n"
+	"6300 close 1\n"
+	"60000 close 0\n"
+	"60000 end\n";
+
+static const char *trace_trans =
+	"# 720p transcode next to a CIF preview, preview stops halfway\n"
+	"0 open 0 dec 5 1280 720 30\n"
+	"0 open 1 enc 5 1280 720 30\n"
+	"100 open 2 dec 4 352 288 15\n"
+	"30000 close 2\n"
+	"60000 close 1\n"
+	"60000 close 0\n"
+	"60000 end\n";
+
+static int replay_string(const char *name, const char *trace)
+{
+	FILE *fp = fmemopen((void *)trace, strlen(trace), "r");
+	int ret;
+
+	CHECK(fp != NULL);
+	ret = replay(name, fp);
+	fclose(fp);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *path = NULL;
+	FILE *fp;
+	int opt, ret = 0;
+
+	while ((opt = getopt(argc, argv, "f:v")) != -1) {
+		switch (opt) {
+		case 'f':
+			path = optarg;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			printf("usage: %s [-f trace] [-v]\n", argv[0]);
+			return 0;
+		}
+	}
+
+	CHECK(vdec_os_driver_init() == VDEC_OS_DRIVER_OK);
+	if (path) {
+		fp = fopen(path, "r");
+		CHECK(fp != NULL);
+		ret = replay(path, fp);
+		fclose(fp);
+	} else {
+		ret |= replay_string("video call", trace_call);
+		ret |= replay_string("thumbnails during 1080p", trace_thumb);
+		ret |= replay_string("transcode with preview", trace_trans);
+	}
+	CHECK(vdec_os_driver_clean() == VDEC_OS_DRIVER_OK);
+	return ret ? 1 : 0;
+}
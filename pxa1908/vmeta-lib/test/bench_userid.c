@@ -0,0 +1,140 @@
+/*
+ *  bench_userid.c
+ *
+ *  User id contention: 4 processes of 8 threads each open and close
+ *  decoder instances (get, register, unregister, free) as fast as they
+ *  can against the memfd kernel_share page of vmeta-simd. An id held by
+ *  two instances at once is an error. Prints the open/close pairs per
+ *  second and the latency per pair.
+ *
+ *  bench_userid [-p processes] [-t threads] [-n loops]
+ *
+ * Copyright (C) 2009 Marvell International Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ */
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "vmeta_test.h"
+
+#define MAX_THREADS	64
+
+struct shared {
+	int owner[MAX_VMETA_INSTANCE];		/* 0 free, else tid + 1 */
+	long long pairs;
+	long long full;
+	long long ns;
+	long long worst_ns;
+};
+
+static struct shared *sh;
+static int loops = 2000;
+
+static void *worker(void *arg)
+{
+	int tid = (int)(long)arg;
+	long long t0, t, worst = 0, start;
+	int i, id, full = 0;
+
+	start = test_now_ns();
+	for (i = 0; i < loops; i++) {
+		t0 = test_now_ns();
+		id = vdec_os_api_get_user_id();
+		if (id < 0) {
+			/* all ids taken by the other threads, try again */
+			full++;
+			i--;
+			sched_yield();
+			continue;
+		}
+		CHECK(__sync_bool_compare_and_swap(&sh->owner[id], 0, tid + 1));
+		CHECK(vdec_os_api_register_user_id(id) == VDEC_OS_DRIVER_OK);
+		CHECK(vdec_os_api_unregister_user_id(id) == VDEC_OS_DRIVER_OK);
+		CHECK(__sync_bool_compare_and_swap(&sh->owner[id], tid + 1, 0));
+		CHECK(vdec_os_api_free_user_id(id) == VDEC_OS_DRIVER_OK);
+		t = test_now_ns() - t0;
+		if (t > worst)
+			worst = t;
+	}
+
+	__sync_fetch_and_add(&sh->pairs, loops);
+	__sync_fetch_and_add(&sh->full, full);
+	__sync_fetch_and_add(&sh->ns, test_now_ns() - start);
+	while ((t = sh->worst_ns) < worst
+	       && !__sync_bool_compare_and_swap(&sh->worst_ns, t, worst))
+		;
+	return NULL;
+}
+
+static int process(int base, int threads)
+{
+	pthread_t pt[MAX_THREADS];
+	int i;
+
+	CHECK(vdec_os_driver_init() == VDEC_OS_DRIVER_OK);
+	for (i = 0; i < threads; i++)
+		CHECK(pthread_create(&pt[i], NULL, worker,
+				     (void *)(long)(base + i)) == 0);
+	for (i = 0; i < threads; i++)
+		pthread_join(pt[i], NULL);
+	CHECK(vdec_os_driver_clean() == VDEC_OS_DRIVER_OK);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int procs = 4, threads = 8, i, opt, status, ret = 0;
+	long long t0, wall;
+	pid_t pid[16];
+
+	while ((opt = getopt(argc, argv, "p:t:n:")) != -1) {
+		switch (opt) {
+		case 'p': procs = atoi(optarg); break;
+		case 't': threads = atoi(optarg); break;
+		case 'n': loops = atoi(optarg); break;
+		default:
+			printf("usage: %s [-p processes] [-t threads] "
+			       "[-n loops]\n", argv[0]);
+			return 0;
+		}
+	}
+	if (procs < 1 || procs > 16)
+		procs = 4;
+	if (threads < 1 || threads > MAX_THREADS)
+		threads = 8;
+
+	sh = mmap(NULL, sizeof(*sh), PROT_READ | PROT_WRITE,
+		  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	CHECK(sh != MAP_FAILED);
+
+	t0 = test_now_ns();
+	for (i = 0; i < procs; i++) {
+		pid[i] = fork();
+		CHECK(pid[i] >= 0);
+		if (pid[i] == 0)
+			exit(process(i * threads, threads));
+	}
+	for (i = 0; i < procs; i++) {
+		waitpid(pid[i], &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			ret = 1;
+	}
+	wall = test_now_ns() - t0;
+
+	CHECK(ret == 0);
+	for (i = 0; i < MAX_VMETA_INSTANCE; i++)
+		CHECK(sh->owner[i] == 0);
+	printf("%d processes x %d threads: %lld open/close pairs in %lld ms, "
+	       "%lld pairs/s, %lld ns per pair per thread, worst %lld us, "
+	       "%lld retries on a full table\n", procs, threads, sh->pairs,
+	       wall / 1000000, sh->pairs * 1000000000 / wall,
+	       sh->ns / sh->pairs, sh->worst_ns / 1000, sh->full);
+	return 0;
+}
@@ -0,0 +1,28 @@
+/*
+ *  cpufreqd_xpu_clnt.h
+ *
+ *  Host stand-in for the platform cpufreqd client header, declaring only
+ *  what vmeta_lib.c uses. The calls are implemented by fake_cpufreqd.c.
+ *
+ * Copyright (C) 2009 Marvell International Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ */
+
+#ifndef __CPUFREQD_XPU_CLNT_H
+#define __CPUFREQD_XPU_CLNT_H
+
+#define XPU_USR_VMETA	1
+
+struct xpu_head {
+	int flags;
+};
+
+int cpufreq_xpu_open(void);
+int cpufreq_xpu_close(int sock);
+int cpufreq_xpu_update(int sock, struct xpu_head *head, int len);
+
+#endif /* __CPUFREQD_XPU_CLNT_H */
@@ -0,0 +1,38 @@
+/*
+ *  cpufreqd_xpu_vmeta.h
+ *
+ *  Host stand-in for the platform cpufreqd vmeta message header.
+ *
+ * Copyright (C) 2009 Marvell International Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ */
+
+#ifndef __CPUFREQD_XPU_VMETA_H
+#define __CPUFREQD_XPU_VMETA_H
+
+enum {
+	VMETA_DECODE,
+	VMETA_ENCODE,
+	VMETA_IDLE,
+};
+
+enum {
+	VMETA_STREAM_LOW,
+	VMETA_STREAM_MEDIUM,
+};
+
+struct xpu_vmeta_info {
+	struct xpu_head head;
+	int func;
+	int width;
+	int height;
+	int bias;
+	int stream;
+	int high;
+};
+
+#endif /* __CPUFREQD_XPU_VMETA_H */
@@ -0,0 +1,159 @@
+/*
+ *  fake_cpufreqd.c
+ *
+ *  In-process cpufreqd stand-in, see fake_cpufreqd.h.
+ *
+ * Copyright (C) 2009 Marvell International Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cpufreqd_xpu_clnt.h"
+#include "cpufreqd_xpu_vmeta.h"
+#include "fake_cpufreqd.h"
+
+static pthread_mutex_t fake_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fake_cond = PTHREAD_COND_INITIALIZER;
+static int fake_open_fail, fake_update_fail, fake_delay_us;
+static int fake_opens, fake_updates, fake_failures;
+static int fake_socks, fake_closes;
+static int fake_next_sock = 100;
+static int fake_width[FAKE_CPUFREQD_TAGS];
+
+static pthread_once_t fake_once = PTHREAD_ONCE_INIT;
+
+/* forked children get a fresh daemon state, as if they had their own */
+static void fake_child(void)
+{
+	pthread_mutex_init(&fake_mutex, NULL);
+	pthread_cond_init(&fake_cond, NULL);
+}
+
+static void fake_atfork(void)
+{
+	pthread_atfork(NULL, NULL, fake_child);
+}
+
+void fake_cpufreqd_config(int open_fail, int update_fail, int delay_us)
+{
+	pthread_once(&fake_once, fake_atfork);
+	pthread_mutex_lock(&fake_mutex);
+	fake_open_fail = open_fail;
+	fake_update_fail = update_fail;
+	fake_delay_us = delay_us;
+	pthread_mutex_unlock(&fake_mutex);
+}
+
+int fake_cpufreqd_wait(int tag, int width, int to_ms)
+{
+	struct timespec ts;
+	int ret = 0;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += to_ms / 1000;
+	ts.tv_nsec += (to_ms % 1000) * 1000000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+
+	pthread_mutex_lock(&fake_mutex);
+	while (fake_width[tag] != width && ret == 0)
+		ret = pthread_cond_timedwait(&fake_cond, &fake_mutex, &ts);
+	pthread_mutex_unlock(&fake_mutex);
+	return ret == 0 ? 0 : -1;
+}
+
+void fake_cpufreqd_socks(int *socks, int *closes)
+{
+	pthread_mutex_lock(&fake_mutex);
+	*socks = fake_socks;
+	*closes = fake_closes;
+	pthread_mutex_unlock(&fake_mutex);
+}
+
+void fake_cpufreqd_stats(int *opens, int *updates, int *failures)
+{
+	pthread_mutex_lock(&fake_mutex);
+	*opens = fake_opens;
+	*updates = fake_updates;
+	*failures = fake_failures;
+	pthread_mutex_unlock(&fake_mutex);
+}
+
+/* each call costs the configured delay, then returns with fake_mutex held */
+static void fake_call(void)
+{
+	int delay;
+
+	pthread_mutex_lock(&fake_mutex);
+	delay = fake_delay_us;
+	pthread_mutex_unlock(&fake_mutex);
+	usleep(delay);
+	pthread_mutex_lock(&fake_mutex);
+}
+
+/* consume one injected failure, -1 means fail forever */
+static int fake_fail(int *count)
+{
+	if (*count == 0)
+		return 0;
+	if (*count > 0)
+		(*count)--;
+	fake_failures++;
+	return 1;
+}
+
+int cpufreq_xpu_open(void)
+{
+	int sock;
+
+	fake_call();
+	fake_opens++;
+	if (fake_fail(&fake_open_fail)) {
+		pthread_mutex_unlock(&fake_mutex);
+		errno = ECONNREFUSED;
+		return -1;
+	}
+	sock = fake_next_sock++;
+	fake_socks++;
+	pthread_mutex_unlock(&fake_mutex);
+	return sock;
+}
+
+int cpufreq_xpu_close(int sock)
+{
+	pthread_mutex_lock(&fake_mutex);
+	fake_socks--;
+	fake_closes++;
+	pthread_mutex_unlock(&fake_mutex);
+	return 0;
+}
+
+int cpufreq_xpu_update(int sock, struct xpu_head *head, int len)
+{
+	struct xpu_vmeta_info *info = (struct xpu_vmeta_info *)head;
+
+	fake_call();
+	fake_updates++;
+	if (fake_fail(&fake_update_fail)) {
+		pthread_mutex_unlock(&fake_mutex);
+		errno = EPIPE;
+		return -1;
+	}
+	if (head->flags == XPU_USR_VMETA && len == sizeof(*info)
+	    && info->height >= 0 && info->height < FAKE_CPUFREQD_TAGS) {
+		fake_width[info->height] = info->width;
+		pthread_cond_broadcast(&fake_cond);
+	}
+	pthread_mutex_unlock(&fake_mutex);
+	return len;
+}
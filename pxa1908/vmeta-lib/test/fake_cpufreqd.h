@@ -0,0 +1,33 @@
+/*
+ *  fake_cpufreqd.h
+ *
+ *  In-process cpufreqd stand-in for the NEW_POWEROPT_SOLUTION notifier
+ *  tests. Opens and updates can be made slow or failing, and the last
+ *  vmeta message is kept per tag. Messages are filed by their height,
+ *  so tests put the user id there.
+ *
+ * Copyright (C) 2009 Marvell International Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ */
+
+#ifndef __FAKE_CPUFREQD_H
+#define __FAKE_CPUFREQD_H
+
+#define FAKE_CPUFREQD_TAGS	32
+
+/* the next n opens / updates fail, -1 for all; each call takes delay_us */
+void fake_cpufreqd_config(int open_fail, int update_fail, int delay_us);
+
+/* wait until tag's last message has this width, 0 or -1 on timeout */
+int fake_cpufreqd_wait(int tag, int width, int to_ms);
+
+void fake_cpufreqd_stats(int *opens, int *updates, int *failures);
+
+/* sockets open right now and closes so far */
+void fake_cpufreqd_socks(int *socks, int *closes);
+
+#endif /* __FAKE_CPUFREQD_H */
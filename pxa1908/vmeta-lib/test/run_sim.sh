@@ -0,0 +1,49 @@
+#!/bin/sh
+#
+# run_sim.sh [-l irq_latency_us] [-k kern_ver] command [args]
+#
+# Start a private vmeta-simd in a temporary directory, point vmeta-lib at
+# it through VMETA_UIO_DEV/VMETA_UIO_SYSFS and run command. The exit status
+# is the one of command.
+#
+
+SIMD=${SIMD:-$(dirname "$0")/vmeta-simd}
+SIM_ARGS=
+
+while [ $# -gt 0 ]; do
+	case "$1" in
+	-l|-k)
+		SIM_ARGS="$SIM_ARGS $1 $2"
+		shift 2
+		;;
+	*)
+		break
+		;;
+	esac
+done
+
+DIR=$(mktemp -d /tmp/vmeta-test.XXXXXX) || exit 1
+"$SIMD" -s "$DIR/sock" -d "$DIR/sysfs" $SIM_ARGS > "$DIR/simd.log" 2>&1 &
+SIMD_PID=$!
+
+# wait for the socket, the simulator writes sysfs before it listens
+i=0
+while [ ! -S "$DIR/sock" ] && [ $i -lt 50 ]; do
+	sleep 0.1
+	i=$((i + 1))
+done
+if [ ! -S "$DIR/sock" ]; then
+	echo "vmeta-simd did not start:"
+	cat "$DIR/simd.log"
+	kill $SIMD_PID 2>/dev/null
+	rm -rf "$DIR"
+	exit 1
+fi
+
+VMETA_UIO_DEV="$DIR/sock" VMETA_UIO_SYSFS="$DIR/sysfs" "$@"
+RET=$?
+
+kill $SIMD_PID 2>/dev/null
+wait $SIMD_PID 2>/dev/null
+rm -rf "$DIR"
+exit $RET
@@ -0,0 +1,156 @@
+/*
+ *  test_carveout.c
+ *
+ *  Carve-out sizing and a fragmentation stress run. A 1080p 4:2:2 region
+ *  must hold exactly one picture per block. Random picture and sub-picture
+ *  allocations must never overlap, and once everything is freed every
+ *  block must again be available as a whole picture.
+ *
+ * Copyright (C) 2009 Marvell International Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "vmeta_test.h"
+
+#define PIC_NUM		8
+#define SLOTS		64
+#define LOOPS		200000
+#define PAGE_ALIGN(x)	(((x) + 4095) & ~4095)
+
+struct slot {
+	unsigned char *ptr;
+	UNSG32 size;
+	UNSG32 pa;
+	unsigned char tag;
+};
+
+static struct slot slot[SLOTS];
+
+static int in_region(vmeta_carveout *co, unsigned char *p, unsigned char *base)
+{
+	vmeta_carveout_stat st;
+
+	vdec_os_api_carveout_get_stat(co, &st);
+	return p >= base && p < base + st.size;
+}
+
+static void test_sizing(void)
+{
+	vmeta_carveout_stat st;
+	vmeta_carveout *co;
+	UNSG32 pic, pa;
+	void *p[PIC_NUM + 1];
+	int i;
+
+	pic = vdec_os_api_carveout_pic_size(1920, 1080, 16);
+	CHECK(pic == (1920 + 64) * (1088 + 64) * 2);
+
+	co = vdec_os_api_carveout_reserve(1920, 1080, PIC_NUM, pic);
+	CHECK(co != NULL);
+	vdec_os_api_carveout_get_stat(co, &st);
+	CHECK(st.size == PIC_NUM * PAGE_ALIGN(pic));
+
+	/* every picture comes from the region, the next one falls back */
+	for (i = 0; i < PIC_NUM + 1; i++) {
+		p[i] = vdec_os_api_carveout_alloc(co, pic, 4096, &pa);
+		CHECK(p[i] != NULL);
+	}
+	vdec_os_api_carveout_get_stat(co, &st);
+	CHECK(st.alloc_count == PIC_NUM && st.fail_count == 1);
+	CHECK(st.used_bytes == st.size);
+	for (i = 0; i < PIC_NUM + 1; i++)
+		vdec_os_api_dma_free(p[i]);
+	vdec_os_api_carveout_get_stat(co, &st);
+	CHECK(st.used_bytes == 0);
+	vdec_os_api_carveout_release(co);
+
+	/* the default 20 pictures are capped, not 80MB */
+	co = vdec_os_api_carveout_reserve(1920, 1080, 20, pic);
+	CHECK(co != NULL);
+	vdec_os_api_carveout_get_stat(co, &st);
+	CHECK(st.size <= VMETA_CARVEOUT_MAX);
+	CHECK(st.size == VMETA_CARVEOUT_MAX / PAGE_ALIGN(pic) * PAGE_ALIGN(pic));
+	printf("1080p 4:2:2: %u bytes per picture, 20 pictures capped to %u "
+	       "bytes\n", pic, st.size);
+	vdec_os_api_carveout_release(co);
+}
+
+static void test_stress(void)
+{
+	vmeta_carveout_stat st;
+	vmeta_carveout *co;
+	unsigned char *base;
+	UNSG32 pic, pa, size;
+	void *whole[PIC_NUM];
+	unsigned int seed = 1;
+	int i, j, k, allocs = 1;
+
+	pic = vdec_os_api_carveout_pic_size(1280, 720, 16);
+	co = vdec_os_api_carveout_reserve(1280, 720, PIC_NUM, pic);
+	CHECK(co != NULL);
+	/* the first whole picture is the first block */
+	base = vdec_os_api_carveout_alloc(co, pic, 4096, &pa);
+	CHECK(base != NULL);
+	vdec_os_api_dma_free(base);
+
+	for (i = 0; i < LOOPS; i++) {
+		k = rand_r(&seed) % SLOTS;
+		if (slot[k].ptr) {
+			for (j = 0; j < 64; j++)
+				CHECK(slot[k].ptr[rand_r(&seed) % slot[k].size]
+				      == slot[k].tag);
+			vdec_os_api_dma_free(slot[k].ptr);
+			slot[k].ptr = NULL;
+			continue;
+		}
+
+		/* a third whole pictures, the rest down to one page */
+		if (rand_r(&seed) % 3 == 0)
+			size = pic;
+		else
+			size = 1 + rand_r(&seed) % (pic / 2);
+		slot[k].ptr = vdec_os_api_carveout_alloc(co, size, 4096,
+							 &slot[k].pa);
+		CHECK(slot[k].ptr != NULL);
+		CHECK(((uintptr_t)slot[k].ptr & 4095) == 0);
+		slot[k].size = size;
+		slot[k].tag = (unsigned char)i;
+		memset(slot[k].ptr, slot[k].tag, size);
+		if (in_region(co, slot[k].ptr, base))
+			allocs++;
+	}
+
+	for (k = 0; k < SLOTS; k++) {
+		if (slot[k].ptr)
+			vdec_os_api_dma_free(slot[k].ptr);
+		slot[k].ptr = NULL;
+	}
+	vdec_os_api_carveout_get_stat(co, &st);
+	CHECK(st.used_bytes == 0);
+	CHECK(st.alloc_count == (UNSG32)allocs);
+	printf("stress: %u from the region, %u fell back, peak %u of %u\n",
+	       st.alloc_count, st.fail_count, st.peak_bytes, st.size);
+
+	/* no page may be stranded: all blocks whole again */
+	for (i = 0; i < PIC_NUM; i++) {
+		whole[i] = vdec_os_api_carveout_alloc(co, pic, 4096, &pa);
+		CHECK(in_region(co, whole[i], base));
+	}
+	for (i = 0; i < PIC_NUM; i++)
+		vdec_os_api_dma_free(whole[i]);
+	vdec_os_api_carveout_release(co);
+}
+
+int main(void)
+{
+	test_sizing();
+	test_stress();
+	return 0;
+}
@@ -0,0 +1,259 @@
+/*
+ *  test_governor.c
+ *
+ *  Deterministic simulator for the closed-loop governor. Time is
+ *  simulated through vmeta_sim_time_us, so nothing sleeps: frames arrive
+ *  every 1/fps, each one costs a synthetic amount of work that takes
+ *  work * f(VMETA_OP_MAX) / f(OP) of hw time at the OP the library has
+ *  chosen, and it must finish before the next frame is due. The real
+ *  lock/unlock path against vmeta-simd feeds the governor. Reports the
+ *  deadline misses, OP switches and the time spent at each OP, next to
+ *  the same load at a fixed floor OP and at VMETA_OP_MAX, and checks
+ *  them. The OPs are assumed linear from 156 to 624MHz as in bench_power.
+ *
+ * Copyright (C) 2009 Marvell International Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vmeta_test.h"
+
+#define FPS		30
+#define BUDGET_US	(1000000 / FPS)
+#define LIGHT_US	4000	/* work per frame, in us at VMETA_OP_MAX */
+#define HEAVY_US	12000
+#define JITTER_US	1500	/* heavy frames cost HEAVY_US +- JITTER_US */
+#define LIGHT_FRAMES	150
+#define HEAVY_FRAMES	300
+#define FRAMES		(2 * LIGHT_FRAMES + HEAVY_FRAMES)
+#define OP_NUM		(VMETA_OP_MAX + 1)
+
+#define GOV_OFF		-1	/* stay at the OP update_user_info picks */
+#define GOV_ON		-2
+
+static vmeta_governor_param gov = { 1, 90, 50, 4, 100 };
+static int work_us[FRAMES];
+static int gov_floor;		/* aggregate OP, the lowest the governor picks */
+
+struct sim_result {
+	int misses;
+	int heavy_misses;
+	int tail_misses;		/* last third of the heavy phase */
+	int switches;
+	int low_op;
+	int end_op;
+	unsigned long long op_us[OP_NUM];	/* time spent at each OP */
+	unsigned long long light_floor_us;	/* light phase time at the floor */
+	unsigned long long light_us;
+};
+
+static int agg_op(void)
+{
+	static kernel_share ks;
+
+	CHECK(vdec_os_api_get_ks_snapshot(&ks, 0) == VDEC_OS_DRIVER_OK);
+	return ks.agg_op;
+}
+
+static int curr_op(void)
+{
+	return vdec_driver_get_cb()->curr_op;
+}
+
+static unsigned long long op_busy_us(int work, int op)
+{
+	return (unsigned long long)work * 624 * VMETA_OP_MAX
+		/ (156 * VMETA_OP_MAX + (624 - 156) * op);
+}
+
+static void set_info(int user_id, int width, int height)
+{
+	vmeta_user_info info;
+
+	memset(&info, 0, sizeof(info));
+	info.usertype = 0;
+	info.strm_fmt = 5;
+	info.width = width;
+	info.height = height;
+	CHECK(vdec_os_api_set_frame_rate(user_id, FPS) == VDEC_OS_DRIVER_OK);
+	CHECK(vdec_os_api_update_user_info(user_id, &info) >= 0);
+}
+
+static void make_load(void)
+{
+	unsigned int r = 1;
+	int i;
+
+	for (i = 0; i < FRAMES; i++) {
+		r = r * 1103515245 + 12345;
+		if (i < LIGHT_FRAMES || i >= LIGHT_FRAMES + HEAVY_FRAMES)
+			work_us[i] = LIGHT_US;
+		else
+			work_us[i] = HEAVY_US - JITTER_US
+				+ (int)((r >> 16) % (2 * JITTER_US + 1));
+	}
+}
+
+static void advance(struct sim_result *p_res, int op, unsigned long long to,
+		    int frame)
+{
+	unsigned long long dt = to - vmeta_sim_time_us;
+
+	p_res->op_us[op] += dt;
+	if (frame < LIGHT_FRAMES || frame >= LIGHT_FRAMES + HEAVY_FRAMES) {
+		p_res->light_us += dt;
+		if (op == gov_floor)
+			p_res->light_floor_us += dt;
+	}
+	vmeta_sim_time_us = to;
+}
+
+/*
+mode is a fixed OP, GOV_OFF for the floor OP or GOV_ON for the governor.
+The fixed OPs are modelled without the library.
+*/
+static void run(int user_id, int mode, struct sim_result *p_res)
+{
+	unsigned long long t0, arrive, start;
+	int i, op, prev;
+
+	memset(p_res, 0, sizeof(*p_res));
+	gov.enable = (mode == GOV_ON);
+	CHECK(vdec_os_api_set_governor(&gov) == VDEC_OS_DRIVER_OK);
+	set_info(user_id, 640, 480);	/* back to the default OP */
+	gov_floor = agg_op();
+	t0 = vmeta_sim_time_us;
+	prev = p_res->low_op = mode >= 0 ? mode : curr_op();
+
+	for (i = 0; i < FRAMES; i++) {
+		arrive = t0 + (unsigned long long)i * BUDGET_US;
+		op = mode >= 0 ? mode : curr_op();
+		start = vmeta_sim_time_us > arrive ? vmeta_sim_time_us : arrive;
+		advance(p_res, op, start, i);
+
+		if (mode < 0)
+			CHECK(vdec_os_api_lock(user_id, 1000) >= 0);
+		advance(p_res, op, start + op_busy_us(work_us[i], op), i);
+		if (mode < 0) {
+			CHECK(vdec_os_api_unlock(user_id) == VDEC_OS_DRIVER_OK);
+			op = curr_op();
+		}
+
+		if (vmeta_sim_time_us > arrive + BUDGET_US) {
+			p_res->misses++;
+			if (i >= LIGHT_FRAMES && i < LIGHT_FRAMES + HEAVY_FRAMES)
+				p_res->heavy_misses++;
+			if (i >= LIGHT_FRAMES + HEAVY_FRAMES * 2 / 3
+			    && i < LIGHT_FRAMES + HEAVY_FRAMES)
+				p_res->tail_misses++;
+		}
+		if (op != prev)
+			p_res->switches++;
+		if (op < p_res->low_op)
+			p_res->low_op = op;
+		prev = op;
+	}
+	p_res->end_op = prev;
+	/* idle to the end of the last frame period */
+	if (vmeta_sim_time_us < t0 + (unsigned long long)FRAMES * BUDGET_US)
+		advance(p_res, prev, t0 + (unsigned long long)FRAMES * BUDGET_US,
+			FRAMES - 1);
+}
+
+static void report(const char *name, struct sim_result *p_res)
+{
+	unsigned long long total = 0;
+	int op;
+
+	for (op = 0; op < OP_NUM; op++)
+		total += p_res->op_us[op];
+	printf("%-9s misses %3d (heavy %3d, heavy tail %2d), switches %3d, "
+	       "time at OP:", name, p_res->misses, p_res->heavy_misses,
+	       p_res->tail_misses, p_res->switches);
+	for (op = 0; op < OP_NUM; op++)
+		if (p_res->op_us[op])
+			printf(" %d:%llu%%", op, p_res->op_us[op] * 100 / total);
+	printf("\n");
+}
+
+static volatile int churn_stop;
+
+static void *churn(void *arg)
+{
+	while (!churn_stop)
+		CHECK(vdec_os_api_set_governor(&gov) == VDEC_OS_DRIVER_OK);
+	return NULL;
+}
+
+int main(void)
+{
+	struct sim_result def_res, max_res, res, again;
+	pthread_t pt;
+	int a, b, floor_op;
+
+	setvbuf(stdout, NULL, _IONBF, 0);
+	vmeta_sim_time_us = 1000000;
+	make_load();
+	a = test_open_user();
+	set_info(a, 640, 480);
+	floor_op = agg_op();
+	CHECK(floor_op >= VMETA_OP_VGA && curr_op() >= floor_op);
+	printf("%d light, %d heavy, %d light frames at %d fps, default OP %d, "
+	       "floor OP %d\n", LIGHT_FRAMES, HEAVY_FRAMES, LIGHT_FRAMES, FPS,
+	       curr_op(), floor_op);
+
+	run(a, GOV_OFF, &def_res);
+	report("default", &def_res);
+	run(a, VMETA_OP_MAX, &max_res);
+	report("max", &max_res);
+	run(a, GOV_ON, &res);
+	report("governor", &res);
+
+	/* the default OP cannot carry the heavy phase, the max OP always can */
+	CHECK(def_res.heavy_misses > HEAVY_FRAMES / 2);
+	CHECK(max_res.misses == 0);
+	/* the governor steps up under load and settles without misses */
+	CHECK(res.heavy_misses * 10 < def_res.heavy_misses);
+	CHECK(res.tail_misses == 0);
+	CHECK(res.op_us[VMETA_OP_MAX] == 0);
+	/* and comes back down: light frames run at the floor, never below */
+	CHECK(res.light_floor_us * 10 >= res.light_us * 9);
+	CHECK(res.low_op == floor_op && res.end_op == floor_op);
+	CHECK(res.misses == res.heavy_misses);
+
+	/* simulated time makes the run repeatable */
+	run(a, GOV_ON, &again);
+	CHECK(memcmp(&res, &again, sizeof(res)) == 0);
+
+	/* a CIF user joins: the aggregate floor rises to the 720p OP */
+	b = vdec_os_api_get_user_id();
+	CHECK(b >= 0 && vdec_os_api_register_user_id(b) == VDEC_OS_DRIVER_OK);
+	set_info(b, 352, 288);
+	CHECK(agg_op() >= VMETA_OP_720P);
+	run(a, GOV_ON, &res);
+	report("2 users", &res);
+	CHECK(res.low_op >= agg_op() && res.end_op == agg_op());
+	CHECK(res.tail_misses == 0);
+
+	/* reconfiguring from another thread must not break the floor */
+	churn_stop = 0;
+	CHECK(pthread_create(&pt, NULL, churn, NULL) == 0);
+	run(a, GOV_ON, &res);
+	churn_stop = 1;
+	pthread_join(pt, NULL);
+	report("churn", &res);
+	CHECK(res.low_op >= agg_op());
+
+	vmeta_sim_time_us = 0;
+	CHECK(vdec_os_api_unregister_user_id(b) == VDEC_OS_DRIVER_OK);
+	CHECK(vdec_os_api_free_user_id(b) == VDEC_OS_DRIVER_OK);
+	test_close_user(a);
+	return 0;
+}
@@ -0,0 +1,210 @@
+/*
+ *  test_reclaim.c
+ *
+ *  Fault injection for the hw lock: a holder process is SIGKILLed in the
+ *  middle of a frame and the next locker must get the lock back with
+ *  LOCK_RET_FORCE_INIT long before the 3 s steal. Also checks that a live
+ *  holder is never reclaimed and that a reused pid does not keep a dead
+ *  holder's lock alive.
+ *
+ * Copyright (C) 2009 Marvell International Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ */
+
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "vmeta_test.h"
+
+#define ROUNDS		20
+#define LOCK_TO_MS	5000
+#define RECLAIM_MAX_MS	500
+
+static kernel_share *test_ks(void)
+{
+	return (kernel_share *)(uintptr_t)(UNSG32)
+		vdec_driver_get_cb()->kernel_share_va;
+}
+
+/* holder: take the lock, report, then hang "mid-frame" until killed */
+static pid_t start_holder(void)
+{
+	int fds[2], user_id;
+	pid_t pid;
+	char c;
+
+	CHECK(pipe(fds) == 0);
+	pid = fork();
+	CHECK(pid >= 0);
+	if (pid == 0) {
+		close(fds[0]);
+		user_id = test_open_user();
+		if (vdec_os_api_lock(user_id, LOCK_TO_MS) < 0)
+			_exit(1);
+		c = 1;
+		if (write(fds[1], &c, 1) != 1)
+			_exit(1);
+		for (;;)
+			pause();
+	}
+	close(fds[1]);
+	CHECK(read(fds[0], &c, 1) == 1);
+	close(fds[0]);
+	return pid;
+}
+
+static void kill_holder(pid_t pid)
+{
+	int status;
+
+	CHECK(kill(pid, SIGKILL) == 0);
+	CHECK(waitpid(pid, &status, 0) == pid);
+	CHECK(WIFSIGNALED(status));
+}
+
+static int holder_ids(kernel_share *p_ks, pid_t pid)
+{
+	int i, n = 0;
+
+	for (i = 0; i < MAX_VMETA_INSTANCE; i++)
+		if (p_ks->user_id_list[i].pid == pid
+		    && p_ks->user_id_list[i].status != 0)
+			n++;
+	return n;
+}
+
+static unsigned long long test_pid_start(pid_t pid)
+{
+	unsigned long long start = 0;
+	char path[32], buf[512], *p;
+	int field;
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return 0;
+	p = fgets(buf, sizeof(buf), fp);
+	fclose(fp);
+	if (p == NULL || (p = strrchr(buf, ')')) == NULL)
+		return 0;
+	for (field = 2; field < 22 && p != NULL; field++)
+		p = strchr(p + 1, ' ');
+	if (p != NULL)
+		start = strtoull(p + 1, NULL, 10);
+	return start;
+}
+
+/* holder SIGKILLed with the lock held */
+static void test_dead_holder(void)
+{
+	long long t, total = 0, worst = 0;
+	unsigned int reclaimed;
+	kernel_share *p_ks;
+	int round, user_id;
+	pid_t pid;
+
+	for (round = 0; round < ROUNDS; round++) {
+		pid = start_holder();
+		user_id = test_open_user();
+		p_ks = test_ks();
+		CHECK(p_ks->lock_pid == pid);
+		CHECK(p_ks->lock_pid_start == test_pid_start(pid));
+		CHECK(holder_ids(p_ks, pid) == 1);
+		reclaimed = p_ks->reclaim_count;
+
+		usleep((round % 5) * 2000);
+		kill_holder(pid);
+
+		t = test_now_ns();
+		CHECK(vdec_os_api_lock(user_id, LOCK_TO_MS) ==
+		      LOCK_RET_FORCE_INIT);
+		t = test_now_ns() - t;
+		total += t;
+		if (t > worst)
+			worst = t;
+
+		CHECK(p_ks->reclaim_count == reclaimed + 1);
+		CHECK(holder_ids(p_ks, pid) == 0);
+		CHECK(p_ks->lock_pid == getpid());
+		CHECK(vdec_os_api_unlock(user_id) == LOCK_RET_OHTERS_NORM);
+		CHECK(p_ks->lock_pid == 0 && p_ks->lock_pid_start == 0);
+		test_close_user(user_id);
+	}
+
+	printf("dead holder: %d rounds, recovery avg %lld us, max %lld us\n",
+	       ROUNDS, total / ROUNDS / 1000, worst / 1000);
+	CHECK(worst / 1000000 < RECLAIM_MAX_MS);
+}
+
+/* a live holder is never reclaimed, even one kill() cannot signal */
+static void test_live_holder(void)
+{
+	unsigned long long init_start, start;
+	unsigned int reclaimed;
+	kernel_share *p_ks;
+	int user_id;
+	pid_t pid;
+
+	pid = start_holder();
+	user_id = test_open_user();
+	p_ks = test_ks();
+	start = p_ks->lock_pid_start;
+	reclaimed = p_ks->reclaim_count;
+
+	CHECK(vdec_os_api_lock(user_id, 200) == LOCK_RET_ERROR_TIMEOUT);
+
+	/* pid 1 answers kill(1, 0) with EPERM unless we are root */
+	init_start = test_pid_start(1);
+	if (init_start != 0) {
+		p_ks->lock_pid = 1;
+		p_ks->lock_pid_start = init_start;
+		CHECK(vdec_os_api_lock(user_id, 200) ==
+		      LOCK_RET_ERROR_TIMEOUT);
+		p_ks->lock_pid = pid;
+		p_ks->lock_pid_start = start;
+	}
+	CHECK(p_ks->reclaim_count == reclaimed);
+	CHECK(holder_ids(p_ks, pid) == 1);
+
+	kill_holder(pid);
+	CHECK(vdec_os_api_lock(user_id, LOCK_TO_MS) == LOCK_RET_FORCE_INIT);
+	CHECK(vdec_os_api_unlock(user_id) == LOCK_RET_OHTERS_NORM);
+	test_close_user(user_id);
+}
+
+/* the holder's pid now names another process: the holder is gone */
+static void test_reused_pid(void)
+{
+	kernel_share *p_ks;
+	int user_id;
+	pid_t pid;
+
+	pid = start_holder();
+	user_id = test_open_user();
+	p_ks = test_ks();
+
+	p_ks->lock_pid_start++;
+	CHECK(vdec_os_api_lock(user_id, LOCK_TO_MS) == LOCK_RET_FORCE_INIT);
+	CHECK(holder_ids(p_ks, pid) == 0);
+	CHECK(vdec_os_api_unlock(user_id) == LOCK_RET_OHTERS_NORM);
+
+	kill_holder(pid);
+	test_close_user(user_id);
+}
+
+int main(void)
+{
+	setvbuf(stdout, NULL, _IONBF, 0);
+	test_dead_holder();
+	test_live_holder();
+	test_reused_pid();
+	return 0;
+}
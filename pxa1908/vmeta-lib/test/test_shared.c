@@ -0,0 +1,105 @@
+/*
+ *  test_shared.c
+ *
+ *  Shared DMA buffers: reference counting, export/import inside one
+ *  process, and free racing against dma_get/dma_sync from other threads.
+ *  The last put must be decided once, under the list lock.
+ *
+ * Copyright (C) 2009 Marvell International Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vmeta_test.h"
+
+#define RACE_THREADS	4
+#define RACE_LOOPS	200000
+#define BUF_SIZE	(64 * 1024)
+
+static void *race_buf;
+
+static void *race_thread(void *arg)
+{
+	int i;
+
+	for (i = 0; i < RACE_LOOPS; i++) {
+		CHECK(vdec_os_api_dma_get(race_buf) >= 2);
+		vdec_os_api_dma_sync(race_buf, DMA_BIDIRECTIONAL, i & 1);
+		vdec_os_api_dma_free(race_buf);
+	}
+	return NULL;
+}
+
+static void test_refcount(void)
+{
+	UNSG32 pa;
+	char *p;
+
+	p = vdec_os_api_dma_alloc_shared(BUF_SIZE, 4096, &pa, 1);
+	CHECK(p != NULL);
+	CHECK(vdec_os_api_dma_get(p) == 2);
+	vdec_os_api_dma_free(p);
+	memset(p, 1, BUF_SIZE);
+	CHECK(vdec_os_api_dma_sync(p, DMA_TO_DEVICE, 0) == VDEC_OS_DRIVER_OK);
+	vdec_os_api_dma_free(p);
+	CHECK(vdec_os_api_dma_get(p) < 0);
+	CHECK(vdec_os_api_dma_sync(p, DMA_TO_DEVICE, 0) < 0);
+}
+
+static void test_export_import(void)
+{
+	vmeta_dma_desc desc;
+	UNSG32 pa;
+	char *p, *q;
+
+	p = vdec_os_api_dma_alloc_shared(BUF_SIZE, 4096, &pa, 0);
+	CHECK(p != NULL);
+	CHECK(vdec_os_api_dma_export(p, &desc) == VDEC_OS_DRIVER_OK);
+	CHECK(desc.size == BUF_SIZE && desc.cached == 0);
+
+	q = vdec_os_api_dma_import(&desc);
+	CHECK(q != NULL && q != p);
+	strcpy(p, "vmeta");
+	CHECK(strcmp(q, "vmeta") == 0);
+
+	/* each mapping is released on its own */
+	vdec_os_api_dma_free(p);
+	CHECK(strcmp(q, "vmeta") == 0);
+	vdec_os_api_dma_free(q);
+	CHECK(vdec_os_api_dma_get(q) < 0);
+}
+
+static void test_race(void)
+{
+	pthread_t pt[RACE_THREADS];
+	UNSG32 pa;
+	int i;
+
+	race_buf = vdec_os_api_dma_alloc_shared(BUF_SIZE, 4096, &pa, 1);
+	CHECK(race_buf != NULL);
+	for (i = 0; i < RACE_THREADS; i++)
+		CHECK(pthread_create(&pt[i], NULL, race_thread, NULL) == 0);
+	for (i = 0; i < RACE_THREADS; i++)
+		pthread_join(pt[i], NULL);
+
+	/* only the allocation reference is left */
+	CHECK(vdec_os_api_dma_get(race_buf) == 2);
+	vdec_os_api_dma_free(race_buf);
+	vdec_os_api_dma_free(race_buf);
+	CHECK(vdec_os_api_dma_get(race_buf) < 0);
+}
+
+int main(void)
+{
+	test_refcount();
+	test_export_import();
+	test_race();
+	return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ *  test_smoke.c
+ *
+ *  Walk the basic driver API against vmeta-simd: init, user ids, the
+ *  hardware lock, register access, DMA and vmalloc memory, an interrupt
+ *  and clean. Pointers handed through the 32 bit API words must survive
+ *  the round trip, which is what breaks first on a 64 bit host.
+ *
+ * Copyright (C) 2009 Marvell International Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "vmeta_test.h"
+
+int main(void)
+{
+	vmeta_lock_info info;
+	UNSG32 pa, va, reg;
+	kernel_share ks;
+	unsigned char *p;
+	void *v;
+	int user_id, i, status;
+	pid_t pid;
+
+	user_id = test_open_user();
+	CHECK(vdec_os_api_get_user_count() == 1);
+
+	CHECK(vdec_os_api_lock(user_id, 1000) == VDEC_OS_DRIVER_OK);
+
+	/* the register window is mapped below 4G and readable back */
+	reg = vdec_os_api_get_regbase_addr();
+	CHECK(reg != 0);
+	vdec_os_api_wr32(reg + 0x10, 0x12345678);
+	CHECK(vdec_os_api_rd32(reg + 0x10) == 0x12345678);
+
+	CHECK(vdec_os_api_get_hw_obj_addr(&va, 0x1000) == VDEC_OS_DRIVER_OK);
+	CHECK(va != 0);
+	memset((void *)(uintptr_t)va, 0x5a, 0x1000);
+
+	/* DMA buffers come back aligned and translate both ways */
+	for (i = 0; i < 16; i++) {
+		p = vdec_os_api_dma_alloc(64 * 1024 + i * 4096, 4096, &pa);
+		CHECK(p != NULL);
+		CHECK(((uintptr_t)p & 4095) == 0);
+		CHECK((uintptr_t)p < 0x100000000ULL);
+		CHECK(vdec_os_api_get_va(pa) == (UNSG32)(uintptr_t)p);
+		CHECK(vdec_os_api_get_pa((UNSG32)(uintptr_t)p) == pa);
+		memset(p, i, 64 * 1024);
+		vdec_os_api_dma_free(p);
+	}
+
+	v = vdec_os_api_vmalloc(1000, 128);
+	CHECK(v != NULL && ((uintptr_t)v & 127) == 0);
+	memset(v, 0, 1000);
+	vdec_os_api_vfree(v);
+
+	/* one fake interrupt from the simulator */
+	vdec_os_api_set_sync_timeout_isr(1000);
+	CHECK(vdec_os_api_sync_event() == VDEC_OS_DRIVER_OK);
+
+	CHECK(vdec_os_api_unlock(user_id) == VDEC_OS_DRIVER_OK);
+	CHECK(vdec_os_api_get_lock_info(user_id, &info) == VDEC_OS_DRIVER_OK);
+	CHECK(info.lock_count == 1);
+	CHECK(vdec_os_api_unregister_user_id(user_id) == VDEC_OS_DRIVER_OK);
+	CHECK(vdec_os_api_free_user_id(user_id) == VDEC_OS_DRIVER_OK);
+
+	/* the next owner of the slot starts from zero, the totals do not */
+	CHECK(vdec_os_api_get_user_id() == user_id);
+	CHECK(vdec_os_api_register_user_id(user_id) == VDEC_OS_DRIVER_OK);
+	CHECK(vdec_os_api_get_lock_info(user_id, &info) == VDEC_OS_DRIVER_OK);
+	CHECK(info.lock_count == 0);
+	CHECK(vdec_os_api_lock(user_id, 1000) == VDEC_OS_DRIVER_OK);
+	CHECK(vdec_os_api_unlock(user_id) == VDEC_OS_DRIVER_OK);
+	CHECK(vdec_os_api_get_lock_info(user_id, &info) == VDEC_OS_DRIVER_OK);
+	CHECK(info.lock_count == 1);
+	CHECK(vdec_os_api_get_ks_snapshot(&ks, 0) == VDEC_OS_DRIVER_OK);
+	CHECK(ks.lock_stat_list[user_id].lock_count == 2);
+
+	/* a closed id stays claimed by this process until clean */
+	CHECK(vdec_os_api_unregister_user_id(user_id) == VDEC_OS_DRIVER_OK);
+	CHECK(vdec_os_api_free_user_id(user_id) == VDEC_OS_DRIVER_OK);
+	CHECK(vdec_os_api_get_user_count() == 0);
+	CHECK(vdec_os_api_get_ks_snapshot(&ks, 0) == VDEC_OS_DRIVER_OK);
+	CHECK(ks.user_id_list[user_id].status == 1 << VMETA_STATUS_BIT_USED);
+
+	/* a forked child does not inherit it */
+	pid = fork();
+	CHECK(pid >= 0);
+	if (pid == 0) {
+		i = vdec_os_api_get_user_id();
+		_exit(i >= 0 && i != user_id ? 0 : 1);
+	}
+	CHECK(waitpid(pid, &status, 0) == pid);
+	CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+	CHECK(vdec_os_api_get_user_id() == user_id);
+	CHECK(vdec_os_api_register_user_id(user_id) == VDEC_OS_DRIVER_OK);
+	test_close_user(user_id);
+
+	CHECK(vdec_os_driver_init() == VDEC_OS_DRIVER_OK);
+	CHECK(vdec_os_api_get_ks_snapshot(&ks, 0) == VDEC_OS_DRIVER_OK);
+	CHECK(ks.user_id_list[user_id].status == 0);
+	CHECK(vdec_os_driver_clean() == VDEC_OS_DRIVER_OK);
+	return 0;
+}
@@ -0,0 +1,75 @@
+/*
+ *  test_trace.c
+ *
+ *  The trace ring against writers that need no driver init: threads
+ *  keep calling vdec_os_api_vmalloc()/vfree(), which trace, while the
+ *  main thread starts and stops the trace through driver init and clean.
+ *  Built with AddressSanitizer, so a write into a ring freed by the stop
+ *  fails the test. Every session must still write its records.
+ *
+ * Copyright (C) 2009 Marvell International Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "vmeta_test.h"
+
+#define WRITERS		3
+#define SESSIONS	200
+
+static volatile int writers_stop;
+
+static void *writer(void *arg)
+{
+	void *p;
+
+	while (!writers_stop) {
+		p = vdec_os_api_vmalloc(64, 16);
+		CHECK(p != NULL);
+		vdec_os_api_vfree(p);
+	}
+	return NULL;
+}
+
+int main(void)
+{
+	char path[] = "/tmp/vmeta_trace.XXXXXX";
+	pthread_t pt[WRITERS];
+	struct stat st;
+	off_t last = 0;
+	int i, fd;
+
+	setvbuf(stdout, NULL, _IONBF, 0);
+	fd = mkstemp(path);
+	CHECK(fd >= 0);
+	close(fd);
+	CHECK(setenv(VMETA_TRACE_ENV, path, 1) == 0);
+
+	for (i = 0; i < WRITERS; i++)
+		CHECK(pthread_create(&pt[i], NULL, writer, NULL) == 0);
+	for (i = 0; i < SESSIONS; i++) {
+		CHECK(vdec_os_driver_init() == VDEC_OS_DRIVER_OK);
+		usleep(500);
+		CHECK(vdec_os_driver_clean() == VDEC_OS_DRIVER_OK);
+		CHECK(stat(path, &st) == 0);
+		CHECK(st.st_size > last);	/* the session was traced */
+		last = st.st_size;
+	}
+	writers_stop = 1;
+	for (i = 0; i < WRITERS; i++)
+		pthread_join(pt[i], NULL);
+
+	printf("trace: %d start/stop sessions under %d writers, %lld "
+	       "records written\n", SESSIONS, WRITERS,
+	       (long long)last / (long long)sizeof(vmeta_trace_rec));
+	unlink(path);
+	return 0;
+}
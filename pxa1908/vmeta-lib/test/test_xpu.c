@@ -0,0 +1,227 @@
+/*
+ *  test_xpu.c
+ *
+ *  NEW_POWEROPT_SOLUTION notifier against fake_cpufreqd: decoder create
+ *  must not wait for a slow or failing cpufreqd, repeated updates of one
+ *  user id collapse into its latest state, a close is never collapsed
+ *  away by a later update, a cpufreqd that refuses every connection is
+ *  survived, and a fork while the notifier is busy leaves the child a
+ *  working notifier of its own while the updates the parent had queued
+ *  are sent by the parent only.
+ *
+ * Copyright (C) 2009 Marvell International Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "vmeta_test.h"
+#include "fake_cpufreqd.h"
+
+#define CREATE_IDS	8
+#define CALLER_MAX_US	10000	/* the synchronous path could take 500 ms */
+#define UPDATES		200
+#define FORKS		100
+
+static long long update(int user_id, int width, int option)
+{
+	vmeta_user_info_ext info;
+	long long t;
+
+	memset(&info, 0, sizeof(info));
+	info.width = width;
+	info.height = user_id;	/* fake_cpufreqd files messages by height */
+	t = test_now_ns();
+	CHECK(vdec_os_api_update_user_info_ext(user_id, &info, option) == 0);
+	return test_now_ns() - t;
+}
+
+/* every open and update slow, the first opens and updates failing */
+static void test_create_latency(void)
+{
+	long long t, worst = 0, start;
+	int id;
+
+	fake_cpufreqd_config(4, 4, 50000);
+	start = test_now_ns();
+	for (id = 0; id < CREATE_IDS; id++) {
+		t = update(id, 1920, 0);
+		if (t > worst)
+			worst = t;
+	}
+	for (id = 0; id < CREATE_IDS; id++)
+		CHECK(fake_cpufreqd_wait(id, 1920, 10000) == 0);
+	printf("create x %d: worst caller latency %lld us, all delivered "
+	       "after %lld ms\n", CREATE_IDS, worst / 1000,
+	       (test_now_ns() - start) / 1000000);
+	CHECK(worst / 1000 < CALLER_MAX_US);
+}
+
+static void test_coalesce(void)
+{
+	long long t, worst = 0;
+	int i, opens, updates, failures, before;
+
+	fake_cpufreqd_config(0, 0, 20000);
+	fake_cpufreqd_stats(&opens, &before, &failures);
+	for (i = 1; i <= UPDATES; i++) {
+		t = update(0, i, 1);
+		if (t > worst)
+			worst = t;
+	}
+	CHECK(fake_cpufreqd_wait(0, UPDATES, 10000) == 0);
+	fake_cpufreqd_stats(&opens, &updates, &failures);
+	printf("update x %d: worst caller latency %lld us, %d reached "
+	       "cpufreqd\n", UPDATES, worst / 1000, updates - before);
+	CHECK(worst / 1000 < CALLER_MAX_US);
+	CHECK(updates - before < UPDATES / 4);
+}
+
+/* a dead cpufreqd costs the notifier, never the caller */
+static void test_refused(void)
+{
+	int opens, updates, failures, before;
+
+	update(5, 0, 2);
+	fake_cpufreqd_config(-1, 0, 0);
+	fake_cpufreqd_stats(&opens, &updates, &before);
+	CHECK(update(5, 640, 0) / 1000 < CALLER_MAX_US);
+	CHECK(fake_cpufreqd_wait(5, 640, 1000) < 0);
+	fake_cpufreqd_stats(&opens, &updates, &failures);
+	CHECK(failures > before);
+
+	fake_cpufreqd_config(0, 0, 0);
+	update(5, 720, 0);
+	CHECK(fake_cpufreqd_wait(5, 720, 5000) == 0);
+}
+
+static int wait_closes(int n, int to_ms)
+{
+	int socks, closes;
+
+	for (; to_ms > 0; to_ms--) {
+		fake_cpufreqd_socks(&socks, &closes);
+		if (closes >= n)
+			return 0;
+		usleep(1000);
+	}
+	return -1;
+}
+
+/* close then update while the notifier is busy with another user id */
+static void test_close_kept(void)
+{
+	int socks, closes, before, opened;
+
+	fake_cpufreqd_config(0, 0, 0);
+	update(6, 100, 0);
+	CHECK(fake_cpufreqd_wait(6, 100, 5000) == 0);
+	fake_cpufreqd_socks(&opened, &before);
+
+	fake_cpufreqd_config(0, 0, 50000);
+	update(7, 100, 1);	/* keeps the notifier busy for 50 ms */
+	usleep(10000);
+	update(6, 0, 2);
+	update(6, 200, 1);
+	CHECK(fake_cpufreqd_wait(6, 200, 5000) == 0);
+	CHECK(fake_cpufreqd_wait(7, 100, 5000) == 0);
+	fake_cpufreqd_socks(&socks, &closes);
+	CHECK(closes == before + 1);	/* the close of 6 was sent */
+
+	fake_cpufreqd_config(0, 0, 0);
+	update(6, 0, 2);
+	update(7, 0, 2);
+	CHECK(wait_closes(before + 3, 5000) == 0);
+	fake_cpufreqd_socks(&socks, &closes);
+	CHECK(socks == opened - 2);
+	printf("close then update: close sent, update on a new socket\n");
+}
+
+static volatile int hammer_stop;
+
+static void *hammer(void *arg)
+{
+	int i = 0;
+
+	while (!hammer_stop)
+		update(1, ++i, 1);
+	return NULL;
+}
+
+static void test_fork(void)
+{
+	pthread_t pt;
+	int i, status;
+	pid_t pid;
+
+	fake_cpufreqd_config(0, 0, 1000);
+	CHECK(pthread_create(&pt, NULL, hammer, NULL) == 0);
+	for (i = 1; i <= FORKS; i++) {
+		pid = fork();
+		CHECK(pid >= 0);
+		if (pid == 0) {
+			alarm(5);	//a notifier mutex left locked hangs here
+			update(2, i, 0);
+			_exit(fake_cpufreqd_wait(2, i, 3000) == 0 ? 0 : 1);
+		}
+		CHECK(waitpid(pid, &status, 0) == pid);
+		CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	}
+	hammer_stop = 1;
+	pthread_join(pt, NULL);
+	printf("fork x %d with the notifier busy: all children notified\n",
+	       FORKS);
+}
+
+/*
+updates queued in the parent at fork time are the parent's: the child
+drops them, the parent still sends them
+*/
+static void test_fork_pending(void)
+{
+	int opens, updates, failures, before, id, status;
+	pid_t pid;
+
+	fake_cpufreqd_config(0, 0, 50000);
+	for (id = 3; id <= 5; id++)
+		update(id, 1000 + id, 1);
+	fake_cpufreqd_stats(&opens, &before, &failures);
+	pid = fork();
+	CHECK(pid >= 0);
+	if (pid == 0) {
+		usleep(300000);
+		fake_cpufreqd_stats(&opens, &updates, &failures);
+		_exit(updates == before ? 0 : 1);
+	}
+	for (id = 3; id <= 5; id++)
+		CHECK(fake_cpufreqd_wait(id, 1000 + id, 5000) == 0);
+	CHECK(waitpid(pid, &status, 0) == pid);
+	CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	fake_cpufreqd_config(0, 0, 0);
+	printf("fork with updates queued: sent by the parent, not the child\n");
+}
+
+int main(void)
+{
+	setvbuf(stdout, NULL, _IONBF, 0);
+	CHECK(vdec_os_driver_init() == VDEC_OS_DRIVER_OK);
+	CHECK(vdec_os_api_get_poweropt_solution() == 1);
+
+	test_create_latency();
+	test_coalesce();
+	test_refused();
+	test_close_kept();
+	test_fork();
+	test_fork_pending();
+
+	CHECK(vdec_os_driver_clean() == VDEC_OS_DRIVER_OK);
+	return 0;
+}
@@ -0,0 +1,59 @@
+/*
+ *  vmeta_test.h
+ *
+ *  Helpers shared by the vmeta-lib host tests and benchmarks.
+ *
+ * Copyright (C) 2009 Marvell International Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ */
+
+#ifndef __VMETA_TEST_H
+#define __VMETA_TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "vmeta_lib.h"
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			printf("%s:%d: check failed: %s\n", __FILE__, \
+			       __LINE__, #cond); \
+			exit(1); \
+		} \
+	} while (0)
+
+static inline long long test_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* driver init plus a registered user id */
+static inline int test_open_user(void)
+{
+	int user_id;
+
+	CHECK(vdec_os_driver_init() == VDEC_OS_DRIVER_OK);
+	user_id = vdec_os_api_get_user_id();
+	CHECK(user_id >= 0);
+	CHECK(vdec_os_api_register_user_id(user_id) == VDEC_OS_DRIVER_OK);
+	return user_id;
+}
+
+static inline void test_close_user(int user_id)
+{
+	CHECK(vdec_os_api_unregister_user_id(user_id) == VDEC_OS_DRIVER_OK);
+	CHECK(vdec_os_api_free_user_id(user_id) == VDEC_OS_DRIVER_OK);
+	CHECK(vdec_os_driver_clean() == VDEC_OS_DRIVER_OK);
+}
+
+#endif /* __VMETA_TEST_H */
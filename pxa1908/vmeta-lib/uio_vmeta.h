@@ -19,6 +19,21 @@ typedef struct _id_instance
 
 #define MAX_VMETA_INSTANCE 32
 
+/* lock statistics, log2 histogram buckets of (time_us >> VMETA_STAT_SHIFT) */
+#define VMETA_STAT_BUCKETS	8
+#define VMETA_STAT_SHIFT	10
+
+typedef struct _lock_stat
+{
+	unsigned int	lock_count;
+	unsigned int	timeout_count;
+	unsigned int	steal_count;	//forced steals done by this user
+	unsigned int	wait_ms;	//total time waited for the lock
+	unsigned int	hold_ms;	//total time the lock was held
+	unsigned int	wait_hist[VMETA_STAT_BUCKETS];
+	unsigned int	hold_hist[VMETA_STAT_BUCKETS];
+}lock_stat;
+
 typedef enum _VMETA_LOCK_FLAG{
 	VMETA_LOCK_OFF = 0,
 	VMETA_LOCK_ON,
@@ -33,6 +48,12 @@ typedef struct _kernel_share
 	int active_user_id;
 	struct timeval lock_start_tv;
 	id_instance user_id_list[MAX_VMETA_INSTANCE];
+	int agg_op;	//last OP chosen from the aggregate load, 0 if none yet
+	pid_t lock_pid;		//process holding the hw lock, 0 if none
+	unsigned int lock_gen;	//bumped on every lock hand-over
+	unsigned int reclaim_count;	//locks reclaimed from dead holders
+	lock_stat lock_stat_list[MAX_VMETA_INSTANCE];
+	unsigned long long lock_pid_start;	//start time of lock_pid, guards against pid reuse
 }kernel_share;
 
 #define IOP_MAGIC	'v'
@@ -134,6 +134,69 @@ UNSG32 vdec_os_api_get_va(UNSG32 paddr);
 UNSG32 vdec_os_api_get_pa(UNSG32 vaddr);
 UNSG32 vdec_os_api_flush_cache(UNSG32 vaddr, UNSG32 size, enum dma_data_direction direction);
 
+/*per-instance arena: while an arena is bound to the calling thread,
+  vdec_os_api_vmalloc serves power-of-two size classes from it and
+  vdec_os_api_vfree returns the block to its class for reuse; the chunks
+  go back in one step on destroy, which must come after the codec
+  instance using it has been freed*/
+typedef struct _vmeta_arena vmeta_arena;
+
+typedef struct{
+    UNSG32 alloc_count;      //vmalloc calls served
+    UNSG32 free_count;       //vfree calls seen
+    UNSG32 reuse_count;      //vmalloc calls served from freed blocks
+    UNSG32 chunk_count;      //backing malloc calls
+    UNSG32 req_bytes;        //bytes requested by the callers
+    UNSG32 used_bytes;       //bytes consumed, including headers and alignment
+    UNSG32 reserved_bytes;   //bytes obtained from malloc
+}vmeta_arena_stat;
+
+vmeta_arena *vdec_os_api_arena_create(UNSG32 chunk_size);
+void vdec_os_api_arena_destroy(vmeta_arena *arena);
+vmeta_arena *vdec_os_api_arena_bind(vmeta_arena *arena);	// returns the previous binding, NULL unbinds
+SIGN32 vdec_os_api_arena_get_stat(vmeta_arena *arena, vmeta_arena_stat *p_stat);	// NULL arena: process-wide malloc path
+
+/*shared DMA buffers: allocations backed by a dma-buf fd that another process
+  can import without a copy. Pass fd with SCM_RIGHTS and the other fields as
+  plain bytes; the buffer lives until every process has released it*/
+typedef struct{
+    SIGN32 fd;               //dma-buf fd, owned by the receiver of the descriptor
+    UNSG32 size;
+    UNSG32 phy_addr;         //physical address, valid in every process
+    SIGN32 cached;           //1: cached mapping, use vdec_os_api_dma_sync
+}vmeta_dma_desc;
+
+void *vdec_os_api_dma_alloc_shared(UNSG32 size, UNSG32 align, UNSG32 *pPhysical, SIGN32 cached);
+SIGN32 vdec_os_api_dma_export(void *ptr, vmeta_dma_desc *p_desc);	// p_desc->fd is a new fd, close it after sending
+void *vdec_os_api_dma_import(vmeta_dma_desc *p_desc);	// takes over p_desc->fd
+SIGN32 vdec_os_api_dma_get(void *ptr);	// vdec_os_api_dma_free drops the reference
+//begin = 1 before the CPU accesses a cached shared buffer, begin = 0 after
+SIGN32 vdec_os_api_dma_sync(void *ptr, enum dma_data_direction direction, SIGN32 begin);
+
+/*carve-out: one physically contiguous region reserved for a session's display
+  pictures and split with a buddy allocator. Pictures that do not fit fall back
+  to vdec_os_api_dma_alloc; vdec_os_api_dma_free releases either kind*/
+typedef struct _vmeta_carveout vmeta_carveout;
+
+typedef struct{
+    UNSG32 reserve_us;       //time spent reserving the region
+    UNSG32 size;             //region size in bytes
+    UNSG32 alloc_count;      //pictures served from the region
+    UNSG32 fail_count;       //requests the region could not serve
+    UNSG32 fallback_fail;    //of those, also failed in vdec_os_api_dma_alloc
+    UNSG32 free_count;
+    UNSG32 used_bytes;
+    UNSG32 peak_bytes;
+}vmeta_carveout_stat;
+
+//padded picture size of width x height, 12 bits per pixel for 4:2:0, 16 for 4:2:2
+UNSG32 vdec_os_api_carveout_pic_size(UNSG32 width, UNSG32 height, UNSG32 bits_per_pixel);
+//pic_size 0: 4:2:0 estimate from max_width x max_height; the region is capped, extra pictures fall back
+vmeta_carveout *vdec_os_api_carveout_reserve(UNSG32 max_width, UNSG32 max_height, UNSG32 pic_num, UNSG32 pic_size);
+void *vdec_os_api_carveout_alloc(vmeta_carveout *co, UNSG32 size, UNSG32 align, UNSG32 *pPhysical);
+void vdec_os_api_carveout_release(vmeta_carveout *co);	// after every picture has been freed
+SIGN32 vdec_os_api_carveout_get_stat(vmeta_carveout *co, vmeta_carveout_stat *p_stat);
+
 //---------------------------------------------------------------------------
 // Mem/IO R/W API
 //---------------------------------------------------------------------------
@@ -184,6 +247,21 @@ SIGN32 vdec_os_api_get_poweropt_solution(void);
 //option 0: create; option 1: update; option 2: close
 SIGN32 vdec_os_api_update_user_info_ext(SIGN32 user_id, vmeta_user_info_ext *info, SIGN32 option);
 
+//frames per second of the stream, used for OP selection and the frame budget
+SIGN32 vdec_os_api_set_frame_rate(SIGN32 user_id, SIGN32 fps);
+
+/*closed-loop governor: hw busy time between lock and unlock is averaged over
+  window frames and compared with the 1/fps frame budget*/
+typedef struct{
+    int enable;      //0: off(default), 1: on
+    int up_pct;      //step OP up when busy time > up_pct% of the budget
+    int down_pct;    //step OP down when busy time < down_pct% of the budget
+    int window;      //number of frames averaged before a decision
+    int hold_ms;     //minimum interval between two OP switches
+}vmeta_governor_param;
+
+SIGN32 vdec_os_api_set_governor(vmeta_governor_param *param);
+
 //---------------------------------------------------------------------------
 // Multi-instance API
 //---------------------------------------------------------------------------
@@ -198,6 +276,17 @@ SIGN32 vdec_os_api_unlock(SIGN32 user_id);
 SIGN32 vdec_os_api_get_user_count(void);
 SIGN32 vdec_os_api_force_ini(void);
 
+//hw lock statistics of a user id since this process got it from vdec_os_api_get_user_id;
+//the totals in kernel_share (vmeta_stat) stay cumulative over all owners of the id
+typedef struct{
+    UNSG32 lock_count;
+    UNSG32 timeout_count;
+    UNSG32 wait_ms;          //time spent waiting for the lock
+    UNSG32 hold_ms;          //time the lock was held
+}vmeta_lock_info;
+
+SIGN32 vdec_os_api_get_lock_info(SIGN32 user_id, vmeta_lock_info *p_info);
+
 #endif // end of #ifndef __KERNEL__
 
 #ifdef __cplusplus
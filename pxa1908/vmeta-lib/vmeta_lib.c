@@ -24,6 +24,8 @@
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 #include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -33,20 +35,29 @@
 #include <time.h>
 #include <errno.h>
 #include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #include "vmeta_lib.h"
+#include "vmeta_sim.h"
+#ifndef VMETA_SIM_DMA
 #include "phycontmem.h"
+#endif
 #include "sys/poll.h"
 
 #ifdef ANDROID
 #define LOG_TAG "VMetaLib"
 #include <cutils/log.h>
+#include <linux/ion.h>
 #else
+#include <sys/syscall.h>
 #define LOGV(...)
 #define LOGD(...)
 #define LOGI(...)
 #define LOGW(...)
 #define LOGE(...)
+#define ALOGD(...)
 #endif
 
 #ifdef NEW_POWEROPT_SOLUTION
@@ -54,12 +65,123 @@
 #include "cpufreqd_xpu_vmeta.h"
 #endif
 
+/*
+Virtual addresses go through the API as 32 bit words. On a 64 bit host
+every mapping handed out as such a word is placed below 4G (MAP_32BIT),
+so these conversions are exact there as well.
+*/
+#define VMETA_VA(x)		((void *)(uintptr_t)(UNSG32)(x))
+#define VMETA_U32(p)		((UNSG32)(uintptr_t)(p))
+#ifdef MAP_32BIT
+#define VMETA_MAP_LOW		(sizeof(void *) > 4 ? MAP_32BIT : 0)
+#else
+#define VMETA_MAP_LOW		0
+#endif
+
 #define ALIGN(x,a)		__ALIGN_MASK(x,(typeof(x))(a)-1)
 #define __ALIGN_MASK(x,mask)	(((x)+(mask))&~(mask))
 #ifndef PAGE_SIZE
 #define PAGE_SIZE				(1<<12)
 #endif
 
+#ifdef VMETA_SIM_DMA
+/*
+Host builds run against vmeta-simd have no phycontmem. Contiguous memory
+is simulated with anonymous mappings below 4G aligned to
+VMETA_SIM_DMA_ALIGN, and the physical address of a buffer is its virtual
+address, which is unique and keeps the alignment callers check. Cache
+maintenance is a memory barrier.
+*/
+#define PHY_CONT_MEM_ATTR_DEFAULT	0
+#define PHY_CONT_MEM_ATTR_NONCACHED	1
+#define PHY_CONT_MEM_FLUSH_BIDIRECTION	0
+#define PHY_CONT_MEM_FLUSH_TO_DEVICE	1
+#define PHY_CONT_MEM_FLUSH_FROM_DEVICE	2
+#define VMETA_SIM_DMA_ALIGN		(64 * 1024)
+
+struct vmeta_sim_dma {
+	struct vmeta_sim_dma *next;
+	unsigned char *va;
+	size_t size;
+};
+
+static struct vmeta_sim_dma *sim_dma_list;
+static pthread_mutex_t sim_dma_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void *phy_cont_malloc(size_t size, int attr)
+{
+	struct vmeta_sim_dma *p_dma;
+	unsigned char *map, *va;
+	size_t len;
+
+	size = ALIGN(size, (size_t)PAGE_SIZE);
+	len = size + VMETA_SIM_DMA_ALIGN;
+	p_dma = (struct vmeta_sim_dma *)malloc(sizeof(*p_dma));
+	if (p_dma == NULL)
+		return NULL;
+	map = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS | VMETA_MAP_LOW, -1, 0);
+	if (map == MAP_FAILED) {
+		free(p_dma);
+		return NULL;
+	}
+
+	va = (unsigned char *)ALIGN((uintptr_t)map, VMETA_SIM_DMA_ALIGN);
+	if (va > map)
+		munmap(map, va - map);
+	if (map + len > va + size)
+		munmap(va + size, map + len - (va + size));
+
+	p_dma->va = va;
+	p_dma->size = size;
+	pthread_mutex_lock(&sim_dma_mutex);
+	p_dma->next = sim_dma_list;
+	sim_dma_list = p_dma;
+	pthread_mutex_unlock(&sim_dma_mutex);
+	return va;
+}
+
+static void phy_cont_free(void *ptr)
+{
+	struct vmeta_sim_dma **pp, *p_dma = NULL;
+
+	pthread_mutex_lock(&sim_dma_mutex);
+	for (pp = &sim_dma_list; *pp != NULL; pp = &(*pp)->next) {
+		if ((*pp)->va == ptr) {
+			p_dma = *pp;
+			*pp = p_dma->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&sim_dma_mutex);
+
+	if (p_dma != NULL) {
+		munmap(p_dma->va, p_dma->size);
+		free(p_dma);
+	}
+}
+
+static unsigned long phy_cont_getpa(void *ptr)
+{
+	return (unsigned long)(uintptr_t)ptr;
+}
+
+static void *phy_cont_getva(unsigned long pa)
+{
+	return (void *)(uintptr_t)pa;
+}
+
+static void phy_cont_flush_cache_range(void *ptr, UNSG32 size, int dir)
+{
+	__sync_synchronize();
+}
+
+static void phy_cont_flush_cache(void *ptr, int dir)
+{
+	__sync_synchronize();
+}
+#endif
+
 // these APIs are used for vmeta driver only, not for export purpose.
 #define VMETA_PRIVATE_LOCK_HANDLE "vmeta_private_lock"
 #define NEED_MONITOR 0
@@ -67,76 +189,87 @@
 static SIGN32 vmeta_private_lock();
 static SIGN32 vmeta_private_unlock();
 static SIGN32 vdec_os_api_get_ks(kernel_share **pp_ks);	//get kernel shared resources
+static SIGN32 vmeta_power_op(kernel_share *p_ks, SIGN32 user_id);
+static unsigned long long vmeta_get_time_us(void);
+static void vmeta_trace_start(void);
+static void vmeta_trace_stop(void);
+static void vmeta_release_parked(kernel_share *p_ks);
 
 // global variable
 vdec_os_driver_cb_t *vdec_iface = NULL;
 UNSG32 globalDbgLevel = VDEC_DEBUG_NONE;
 UNSG32 syncTimeout = 500;
 pthread_mutex_t pmt = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 #define INVALID_SOCKET_NO (-1)
 #define SOCKET_RETRY_TIMES 5
 #define SOCKET_SLEEP_US 50000
 static SIGN32 vmeta_socket[MAX_VMETA_INSTANCE] = {0};
 
+static vmeta_governor_param vmeta_gov = {
+	0, VMETA_GOV_UP_PCT, VMETA_GOV_DOWN_PCT,
+	VMETA_GOV_WINDOW, VMETA_GOV_HOLD_MS
+};
+static struct gov_data vmeta_gov_st[MAX_VMETA_INSTANCE];
+/* guards vmeta_gov, vmeta_gov_st and curr_op updates, never held across an ioctl */
+static pthread_mutex_t gov_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+The status words live in the page shared by all vmeta processes, so the
+bit operations are atomic and user ids can be taken and released
+without the driver private lock.
+*/
 static inline int get_bit(int nr, unsigned int *addr)
 {
 	unsigned int mask = 1 << nr;
 
-	return ((*addr) & mask) != 0;
+	return ((*(volatile unsigned int *)addr) & mask) != 0;
 }
 
 static inline int set_bit(int nr, unsigned int *addr)
 {
 	unsigned int mask = 1 << nr;
-	unsigned int old;
 
-	old = *addr;
-	*addr = old | mask;
-
-	return (old & mask) != 0;
+	return (__sync_fetch_and_or(addr, mask) & mask) != 0;
 }
 
 static inline int clear_bit(int nr, unsigned int *addr)
 {
 	unsigned int mask = 1 << nr;
-	unsigned int old;
-
-	old = *addr;
-	*addr = old & ~mask;
 
-	return (old & mask) != 0;
+	return (__sync_fetch_and_and(addr, ~mask) & mask) != 0;
 }
 
 //Add for hal mmap
 UNSG8 vdec_os_api_rd8(UNSG32 addr)
 {
-	return *((volatile UNSG8 *)addr);
+	return *((volatile UNSG8 *)VMETA_VA(addr));
 }
 
 UNSG16 vdec_os_api_rd16(UNSG32 addr)
 {
-	return *((volatile UNSG16 *)addr);
+	return *((volatile UNSG16 *)VMETA_VA(addr));
 }
 
 UNSG32 vdec_os_api_rd32(UNSG32 addr)
 {
-	return *((volatile UNSG32 *)addr);
+	return *((volatile UNSG32 *)VMETA_VA(addr));
 }
 
 void vdec_os_api_wr8(UNSG32 addr, UNSG8 data)
 {
-	*((volatile UNSG8 *)addr) = data;
+	*((volatile UNSG8 *)VMETA_VA(addr)) = data;
 }
 
 void vdec_os_api_wr16(UNSG32 addr, UNSG16 data)
 {
-	*((volatile UNSG16 *)addr) = data;
+	*((volatile UNSG16 *)VMETA_VA(addr)) = data;
 }
 
 void vdec_os_api_wr32(UNSG32 addr, UNSG32 data)
 {
-	*((volatile UNSG32 *)addr) = data;
+	*((volatile UNSG32 *)VMETA_VA(addr)) = data;
 }
 
 UNSG32 vdec_os_api_get_regbase_addr(void)
@@ -149,33 +282,262 @@ UNSG32 vdec_os_api_get_regbase_addr(void)
 
 UNSG32 vdec_os_api_get_pa(UNSG32 vaddr)
 {
-	return ((UNSG32) phy_cont_getpa((void *)vaddr));
+	return ((UNSG32) phy_cont_getpa(VMETA_VA(vaddr)));
 }
 
 UNSG32 vdec_os_api_get_va(UNSG32 paddr)
 {
-	return ((UNSG32) phy_cont_getva(paddr));
+	return VMETA_U32(phy_cont_getva(paddr));
+}
+
+/*
+vmalloc arenas. Requests are rounded up to power-of-two size classes and
+carved from the arena chunks; vfree puts the block on the free list of its
+class, where the next request of that class picks it up, so per-frame
+churn settles on a fixed set of blocks. An allocation served by an arena
+is preceded by a vmeta_arena_hdr ending in a zero word; the malloc path
+always stores a non-zero offset there, which is how vfree tells the two
+apart.
+*/
+struct vmeta_arena_chunk {
+	struct vmeta_arena_chunk *next;
+	UNSG32 size;
+	UNSG32 used;
+};
+
+struct vmeta_arena_hdr {
+	UNSG32 back;			// ptr - block start
+	UNSG32 order;			// block is 1 << order bytes
+	vmeta_arena *arena;
+	unsigned int zero;
+};
+
+#define VMETA_ARENA_ORDERS	32
+#define VMETA_ARENA_MIN_ORDER	5
+
+struct _vmeta_arena {
+	pthread_mutex_t mutex;
+	UNSG32 chunk_size;
+	struct vmeta_arena_chunk *chunk;	// current chunk first
+	void *free_list[VMETA_ARENA_ORDERS];	// next pointer in the block
+	vmeta_arena_stat stat;
+};
+
+/* up to the zero word, which must end right at the pointer */
+#define VMETA_ARENA_HDR	(offsetof(struct vmeta_arena_hdr, zero) + sizeof(unsigned int))
+#define VMETA_CHUNK_HDR	ALIGN(sizeof(struct vmeta_arena_chunk), 8)
+
+static pthread_once_t arena_once = PTHREAD_ONCE_INIT;
+static pthread_key_t arena_key;
+static vmeta_arena_stat malloc_stat;
+
+static void vmeta_arena_key_init(void)
+{
+	pthread_key_create(&arena_key, NULL);
+}
+
+static vmeta_arena *vmeta_arena_current(void)
+{
+	pthread_once(&arena_once, vmeta_arena_key_init);
+	return (vmeta_arena *)pthread_getspecific(arena_key);
+}
+
+vmeta_arena *vdec_os_api_arena_create(UNSG32 chunk_size)
+{
+	vmeta_arena *arena;
+
+	arena = (vmeta_arena *)malloc(sizeof(vmeta_arena));
+	if (arena == NULL)
+		return NULL;
+
+	memset(arena, 0, sizeof(vmeta_arena));
+	pthread_mutex_init(&arena->mutex, NULL);
+	arena->chunk_size = chunk_size ? chunk_size : VMETA_ARENA_CHUNK;
+	dbg_printf(VDEC_DEBUG_MEM, "vdec_os_api_arena_create arena=0x%x "
+		   "chunk=0x%x\n", arena, arena->chunk_size);
+
+	return arena;
+}
+
+void vdec_os_api_arena_destroy(vmeta_arena *arena)
+{
+	struct vmeta_arena_chunk *chunk, *next;
+
+	if (arena == NULL)
+		return;
+
+	if (vmeta_arena_current() == arena)
+		pthread_setspecific(arena_key, NULL);
+
+	dbg_printf(VDEC_DEBUG_MEM, "vdec_os_api_arena_destroy arena=0x%x "
+		   "allocs=%u frees=%u reused=%u chunks=%u req=%u used=%u "
+		   "reserved=%u\n", arena, arena->stat.alloc_count,
+		   arena->stat.free_count, arena->stat.reuse_count,
+		   arena->stat.chunk_count, arena->stat.req_bytes,
+		   arena->stat.used_bytes, arena->stat.reserved_bytes);
+
+	for (chunk = arena->chunk; chunk != NULL; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+	pthread_mutex_destroy(&arena->mutex);
+	free(arena);
+}
+
+vmeta_arena *vdec_os_api_arena_bind(vmeta_arena *arena)
+{
+	vmeta_arena *prev = vmeta_arena_current();
+
+	pthread_setspecific(arena_key, arena);
+	return prev;
+}
+
+SIGN32 vdec_os_api_arena_get_stat(vmeta_arena *arena, vmeta_arena_stat *p_stat)
+{
+	if (p_stat == NULL)
+		return -VDEC_OS_DRIVER_INIT_FAIL;
+
+	/* the malloc path counters are atomic, each field is exact */
+	if (arena == NULL) {
+		memcpy(p_stat, &malloc_stat, sizeof(vmeta_arena_stat));
+		return VDEC_OS_DRIVER_OK;
+	}
+
+	pthread_mutex_lock(&arena->mutex);
+	memcpy(p_stat, &arena->stat, sizeof(vmeta_arena_stat));
+	pthread_mutex_unlock(&arena->mutex);
+
+	return VDEC_OS_DRIVER_OK;
+}
+
+static void *vmeta_arena_alloc(vmeta_arena *arena, UNSG32 size, UNSG32 align)
+{
+	struct vmeta_arena_chunk *chunk;
+	struct vmeta_arena_hdr hdr;
+	unsigned char *base, *block, *ptr;
+	UNSG32 need, start;
+	int order = VMETA_ARENA_MIN_ORDER;
+
+	/* worst case header plus alignment */
+	need = size + VMETA_ARENA_HDR + align;
+	while ((1U << order) < need)
+		order++;
+	if (order >= VMETA_ARENA_ORDERS)
+		return NULL;
+
+	pthread_mutex_lock(&arena->mutex);
+
+	block = arena->free_list[order];
+	if (block != NULL) {
+		memcpy(&arena->free_list[order], block, sizeof(void *));
+		arena->stat.reuse_count++;
+	} else {
+		chunk = arena->chunk;
+		if (chunk != NULL) {
+			base = (unsigned char *)chunk + VMETA_CHUNK_HDR;
+			start = ALIGN(chunk->used, 8);
+			if (start + (1U << order) > chunk->size)
+				chunk = NULL;
+		}
+
+		if (chunk == NULL) {
+			/* the tail of the old chunk is left unused until
+			   the arena is destroyed */
+			need = 1U << order;
+			if (need < arena->chunk_size)
+				need = arena->chunk_size;
+			chunk = (struct vmeta_arena_chunk *)
+				malloc(VMETA_CHUNK_HDR + need);
+			if (chunk == NULL) {
+				pthread_mutex_unlock(&arena->mutex);
+				return NULL;
+			}
+			chunk->next = arena->chunk;
+			chunk->size = need;
+			chunk->used = 0;
+			arena->chunk = chunk;
+			arena->stat.chunk_count++;
+			arena->stat.reserved_bytes += need;
+
+			base = (unsigned char *)chunk + VMETA_CHUNK_HDR;
+			start = 0;
+		}
+
+		block = base + start;
+		arena->stat.used_bytes += start + (1U << order) - chunk->used;
+		chunk->used = start + (1U << order);
+	}
+
+	ptr = (unsigned char *)ALIGN((uintptr_t)(block + VMETA_ARENA_HDR),
+				     align);
+	hdr.back = ptr - block;
+	hdr.order = order;
+	hdr.arena = arena;
+	hdr.zero = 0;
+	memcpy(ptr - VMETA_ARENA_HDR, &hdr, VMETA_ARENA_HDR);
+
+	arena->stat.alloc_count++;
+	arena->stat.req_bytes += size;
+
+	pthread_mutex_unlock(&arena->mutex);
+
+	return ptr;
 }
 
 void vdec_os_api_vfree(void *ptr)
 {
 	unsigned int offset = 0;
 	unsigned int *paddr = NULL;
+	struct vmeta_arena_hdr hdr;
+	unsigned char *block;
 
 	paddr = (unsigned int *)(ptr);
 	offset = *(paddr - 1);
-	paddr = (unsigned int *)((unsigned int)paddr - offset);
+	if (offset == 0) {
+		/* back on the free list of its size class */
+		VMETA_TRACE(VMETA_EV_VFREE, 0, VMETA_U32(ptr));
+		memcpy(&hdr, (unsigned char *)ptr - VMETA_ARENA_HDR,
+		       VMETA_ARENA_HDR);
+		block = (unsigned char *)ptr - hdr.back;
+		pthread_mutex_lock(&hdr.arena->mutex);
+		memcpy(block, &hdr.arena->free_list[hdr.order], sizeof(void *));
+		hdr.arena->free_list[hdr.order] = block;
+		hdr.arena->stat.free_count++;
+		pthread_mutex_unlock(&hdr.arena->mutex);
+		return;
+	}
+
+	VMETA_TRACE(VMETA_EV_VFREE, 0, VMETA_U32(ptr));
+	paddr = (unsigned int *)((uintptr_t)paddr - offset);
 	dbg_printf(VDEC_DEBUG_MEM, "vdec_os_api_vfree "
 		   "ptr=0x%x\n paddr=0x%x offset=0x%x\n", ptr, paddr, offset);
 	free((void *)paddr);
+
+	__sync_fetch_and_add(&malloc_stat.free_count, 1);
 }
 
 void *vdec_os_api_vmalloc(UNSG32 size, UNSG32 align)
 {
 	unsigned int *ptr = NULL;
 	unsigned int tmp = 0;
+	vmeta_arena *arena;
 
 	align = ALIGN(align, sizeof(int));
+
+	arena = vmeta_arena_current();
+	if (arena != NULL) {
+		if (align < sizeof(int))
+			align = sizeof(int);
+		ptr = vmeta_arena_alloc(arena, size, align);
+		dbg_printf(VDEC_DEBUG_MEM, "vdec_os_api_vmalloc arena=0x%x "
+			   "size=0x%x ptr: 0x%x\n", arena, size, ptr);
+		if (ptr) {
+			VMETA_TRACE(VMETA_EV_VMALLOC, size, VMETA_U32(ptr));
+			return ptr;
+		}
+		/* chunk allocation failed, try the plain heap */
+	}
+
 	size += align;
 	dbg_printf(VDEC_DEBUG_MEM,
 		   "vdec_os_api_vmalloc size=0x%x, align=0x%x\n", size, align);
@@ -186,18 +548,32 @@ void *vdec_os_api_vmalloc(UNSG32 size, UNSG32 align)
 		return NULL;
 	}
 
-	tmp = (unsigned int)((unsigned int)(ptr) & (align - 1));
+	tmp = (unsigned int)((uintptr_t)(ptr) & (align - 1));
 	tmp = (unsigned int)(align - tmp);
-	ptr = (unsigned int *)((unsigned int)ptr + tmp);
+	ptr = (unsigned int *)((uintptr_t)ptr + tmp);
 	*(ptr - 1) = tmp;
 
+	/* process wide and hot, so no lock */
+	__sync_fetch_and_add(&malloc_stat.alloc_count, 1);
+	__sync_fetch_and_add(&malloc_stat.chunk_count, 1);
+	__sync_fetch_and_add(&malloc_stat.req_bytes, size - align);
+	__sync_fetch_and_add(&malloc_stat.used_bytes, size);
+	__sync_fetch_and_add(&malloc_stat.reserved_bytes, size);
+
+	VMETA_TRACE(VMETA_EV_VMALLOC, size - align, VMETA_U32(ptr));
 	dbg_printf(VDEC_DEBUG_MEM, "vdec_os_api_vmalloc ptr: 0x%x\n", ptr);
 	return ptr;
 }
 
+static SIGN32 vmeta_shared_put(void *ptr);
+static SIGN32 vmeta_carveout_put(void *ptr);
+
 void vdec_os_api_dma_free(void *ptr)
 {
 	dbg_printf(VDEC_DEBUG_MEM, "vdec_os_api_dma_free ptr: 0x%x\n", ptr);
+	VMETA_TRACE(VMETA_EV_DMA_FREE, 0, VMETA_U32(ptr));
+	if (vmeta_carveout_put(ptr) == 0 || vmeta_shared_put(ptr) == 0)
+		return;
 	phy_cont_free((void *)ptr);
 }
 
@@ -222,7 +598,7 @@ void *vdec_os_api_dma_alloc(UNSG32 size, UNSG32 align, UNSG32 * pPhysical)
 
 	*pPhysical = (unsigned long)phy_cont_getpa(ptr);
 
-	if (((UNSG32) ptr & (align - 1)) != 0
+	if ((VMETA_U32(ptr) & (align - 1)) != 0
 	    || ((*pPhysical) & (align - 1)) != 0) {
 		dbg_printf(VDEC_DEBUG_MEM,
 			   "vdec_os_api_dma_alloc not aligned"
@@ -234,6 +610,7 @@ void *vdec_os_api_dma_alloc(UNSG32 size, UNSG32 align, UNSG32 * pPhysical)
 
 	dbg_printf(VDEC_DEBUG_MEM, "vdec_os_api_dma_alloc ptr: 0x%x\n", ptr);
 
+	VMETA_TRACE(VMETA_EV_DMA_ALLOC, size, VMETA_U32(ptr));
 	return ptr;
 }
 
@@ -258,7 +635,7 @@ void *vdec_os_api_dma_alloc_cached(UNSG32 size, UNSG32 align,
 
 	*pPhysical = (unsigned long)phy_cont_getpa(ptr);
 
-	if (((UNSG32) ptr & (align - 1)) != 0
+	if ((VMETA_U32(ptr) & (align - 1)) != 0
 	    || ((*pPhysical) & (align - 1)) != 0) {
 		dbg_printf(VDEC_DEBUG_MEM,
 			   "vdec_os_api_dma_alloc_cached not aligned"
@@ -271,6 +648,7 @@ void *vdec_os_api_dma_alloc_cached(UNSG32 size, UNSG32 align,
 	dbg_printf(VDEC_DEBUG_MEM, "vdec_os_api_dma_alloc_cached ptr: 0x%x\n",
 		   ptr);
 
+	VMETA_TRACE(VMETA_EV_DMA_ALLOC, size, VMETA_U32(ptr));
 	return ptr;
 }
 
@@ -295,7 +673,7 @@ void *vdec_os_api_dma_alloc_writecombine(UNSG32 size, UNSG32 align,
 
 	*pPhysical = (unsigned long)phy_cont_getpa(ptr);
 
-	if (((UNSG32) ptr & (align - 1)) != 0
+	if ((VMETA_U32(ptr) & (align - 1)) != 0
 	    || ((*pPhysical) & (align - 1)) != 0) {
 		dbg_printf(VDEC_DEBUG_MEM,
 			   "vdec_os_api_dma_alloc_writecombine not aligned"
@@ -308,6 +686,7 @@ void *vdec_os_api_dma_alloc_writecombine(UNSG32 size, UNSG32 align,
 	dbg_printf(VDEC_DEBUG_MEM,
 		   "vdec_os_api_dma_alloc_writecombine ptr: 0x%x\n", ptr);
 
+	VMETA_TRACE(VMETA_EV_DMA_ALLOC, size, VMETA_U32(ptr));
 	return ptr;
 }
 
@@ -325,12 +704,816 @@ UNSG32 vdec_os_api_flush_cache(UNSG32 vaddr, UNSG32 size,
 		return -1;
 
 	if (0 < size)
-		phy_cont_flush_cache_range((void *)vaddr, size, dir);
+		phy_cont_flush_cache_range(VMETA_VA(vaddr), size, dir);
 	else
-		phy_cont_flush_cache((void *)vaddr, dir);
+		phy_cont_flush_cache(VMETA_VA(vaddr), dir);
+	return 0;
+}
+
+/*
+Shared DMA buffers. The backing store is a dma-buf fd: ion on the target,
+memfd on host builds run against vmeta-simd. Each process keeps its own
+mapping and reference count here; the kernel keeps the buffer alive until
+the last fd and mapping in any process are gone.
+*/
+struct vmeta_shared_buf {
+	struct vmeta_shared_buf *next;
+	void *va;
+	UNSG32 size;
+	UNSG32 pa;
+	int fd;
+	int cached;
+	int ref;
+};
+
+static struct vmeta_shared_buf *shared_list;
+static pthread_mutex_t shared_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+#ifdef ANDROID
+#define VMETA_ION_DEV "/dev/ion"
+#ifndef VMETA_ION_HEAP_MASK
+#define VMETA_ION_HEAP_MASK ION_HEAP_CARVEOUT_MASK
+#endif
+/* pxa ion custom command returning the physical address of a buffer */
+#define ION_PXA_PHYS	1
+struct ion_pxa_region {
+	ion_user_handle_t handle;
+	unsigned long addr;
+	size_t len;
+};
+
+static int vmeta_shared_new_fd(UNSG32 size, UNSG32 align, SIGN32 cached,
+			       UNSG32 *p_pa)
+{
+	struct ion_allocation_data alloc;
+	struct ion_handle_data handle;
+	struct ion_custom_data custom;
+	struct ion_pxa_region region;
+	struct ion_fd_data share;
+	int ion_fd, fd = -1;
+
+	ion_fd = open(VMETA_ION_DEV, O_RDONLY);
+	if (ion_fd < 0)
+		return -1;
+
+	memset(&alloc, 0, sizeof(alloc));
+	alloc.len = size;
+	alloc.align = align;
+	alloc.heap_id_mask = VMETA_ION_HEAP_MASK;
+	alloc.flags = cached ? ION_FLAG_CACHED : 0;
+	if (ioctl(ion_fd, ION_IOC_ALLOC, &alloc) < 0)
+		goto out;
+
+	memset(&region, 0, sizeof(region));
+	region.handle = alloc.handle;
+	custom.cmd = ION_PXA_PHYS;
+	custom.arg = (unsigned long)&region;
+	share.handle = alloc.handle;
+	if (ioctl(ion_fd, ION_IOC_CUSTOM, &custom) == 0
+	    && ioctl(ion_fd, ION_IOC_SHARE, &share) == 0) {
+		fd = share.fd;
+		*p_pa = region.addr;
+	}
+
+	/* the dma-buf fd holds the buffer from here on */
+	handle.handle = alloc.handle;
+	ioctl(ion_fd, ION_IOC_FREE, &handle);
+out:
+	close(ion_fd);
+	return fd;
+}
+
+static void vmeta_shared_sync_fd(struct vmeta_shared_buf *p_buf)
+{
+	struct ion_fd_data data;
+	int ion_fd;
+
+	ion_fd = open(VMETA_ION_DEV, O_RDONLY);
+	if (ion_fd < 0)
+		return;
+	data.fd = p_buf->fd;
+	ioctl(ion_fd, ION_IOC_SYNC, &data);
+	close(ion_fd);
+}
+#else
+static int vmeta_shared_new_fd(UNSG32 size, UNSG32 align, SIGN32 cached,
+			       UNSG32 *p_pa)
+{
+	int fd = -1;
+
+#ifdef SYS_memfd_create
+	fd = syscall(SYS_memfd_create, "vmeta-dma", 0);
+#endif
+	if (fd >= 0 && ftruncate(fd, size) < 0) {
+		close(fd);
+		fd = -1;
+	}
+	/* no device behind it, the simulator never dereferences this */
+	*p_pa = 0;
+	return fd;
+}
+
+static void vmeta_shared_sync_fd(struct vmeta_shared_buf *p_buf)
+{
+	__sync_synchronize();
+}
+#endif
+
+static struct vmeta_shared_buf *vmeta_shared_find(void *ptr)
+{
+	struct vmeta_shared_buf *p_buf;
+
+	for (p_buf = shared_list; p_buf != NULL; p_buf = p_buf->next)
+		if (p_buf->va == ptr)
+			return p_buf;
+	return NULL;
+}
+
+static void *vmeta_shared_add(int fd, UNSG32 size, UNSG32 pa, SIGN32 cached)
+{
+	struct vmeta_shared_buf *p_buf;
+	void *va;
+
+	va = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | VMETA_MAP_LOW,
+		  fd, 0);
+	if (va == MAP_FAILED)
+		return NULL;
+
+	p_buf = (struct vmeta_shared_buf *)malloc(sizeof(*p_buf));
+	if (p_buf == NULL) {
+		munmap(va, size);
+		return NULL;
+	}
+	p_buf->va = va;
+	p_buf->size = size;
+	p_buf->pa = pa;
+	p_buf->fd = fd;
+	p_buf->cached = cached;
+	p_buf->ref = 1;
+
+	pthread_mutex_lock(&shared_mutex);
+	p_buf->next = shared_list;
+	shared_list = p_buf;
+	pthread_mutex_unlock(&shared_mutex);
+
+	return va;
+}
+
+/* returns 0 if ptr was a shared buffer, -1 if it came from phycontmem */
+static SIGN32 vmeta_shared_put(void *ptr)
+{
+	struct vmeta_shared_buf **pp, *p_buf = NULL;
+	int last = 0;
+
+	/* decide under the lock, once unlinked only we can see p_buf */
+	pthread_mutex_lock(&shared_mutex);
+	for (pp = &shared_list; *pp != NULL; pp = &(*pp)->next) {
+		if ((*pp)->va == ptr) {
+			p_buf = *pp;
+			last = (--p_buf->ref == 0);
+			if (last)
+				*pp = p_buf->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&shared_mutex);
+
+	if (p_buf == NULL)
+		return -1;
+
+	if (last) {
+		munmap(p_buf->va, p_buf->size);
+		close(p_buf->fd);
+		free(p_buf);
+	}
 	return 0;
 }
 
+void *vdec_os_api_dma_alloc_shared(UNSG32 size, UNSG32 align,
+				   UNSG32 *pPhysical, SIGN32 cached)
+{
+	void *ptr;
+	UNSG32 pa = 0;
+	int fd;
+
+	if (size <= 0 || pPhysical == NULL)
+		return NULL;
+
+	align = ALIGN(align, PAGE_SIZE);
+	size = ALIGN(size, align);
+	fd = vmeta_shared_new_fd(size, align, cached, &pa);
+	if (fd < 0) {
+		dbg_printf(VDEC_DEBUG_MEM,
+			   "vdec_os_api_dma_alloc_shared no dma-buf\n");
+		return NULL;
+	}
+
+	if ((pa & (align - 1)) != 0) {
+		dbg_printf(VDEC_DEBUG_MEM, "vdec_os_api_dma_alloc_shared not "
+			   "aligned align(0x%x) PA(0x%x)\n", align, pa);
+		close(fd);
+		return NULL;
+	}
+
+	ptr = vmeta_shared_add(fd, size, pa, cached);
+	if (ptr == NULL) {
+		close(fd);
+		return NULL;
+	}
+	*pPhysical = pa;
+
+	dbg_printf(VDEC_DEBUG_MEM, "vdec_os_api_dma_alloc_shared ptr: 0x%x "
+		   "fd=%d\n", ptr, fd);
+	VMETA_TRACE(VMETA_EV_DMA_ALLOC, size, VMETA_U32(ptr));
+	return ptr;
+}
+
+SIGN32 vdec_os_api_dma_export(void *ptr, vmeta_dma_desc *p_desc)
+{
+	struct vmeta_shared_buf *p_buf;
+
+	if (p_desc == NULL)
+		return -VDEC_OS_DRIVER_NO_SYS_MEM_FAIL;
+
+	pthread_mutex_lock(&shared_mutex);
+	p_buf = vmeta_shared_find(ptr);
+	if (p_buf == NULL) {
+		pthread_mutex_unlock(&shared_mutex);
+		dbg_printf(VDEC_DEBUG_MEM, "vdec_os_api_dma_export 0x%x is "
+			   "not a shared buffer\n", ptr);
+		return -VDEC_OS_DRIVER_NO_SYS_MEM_FAIL;
+	}
+	p_desc->fd = dup(p_buf->fd);
+	p_desc->size = p_buf->size;
+	p_desc->phy_addr = p_buf->pa;
+	p_desc->cached = p_buf->cached;
+	pthread_mutex_unlock(&shared_mutex);
+
+	if (p_desc->fd < 0)
+		return -VDEC_OS_DRIVER_NO_SYS_MEM_FAIL;
+
+	return VDEC_OS_DRIVER_OK;
+}
+
+void *vdec_os_api_dma_import(vmeta_dma_desc *p_desc)
+{
+	void *ptr;
+
+	if (p_desc == NULL || p_desc->fd < 0 || p_desc->size == 0)
+		return NULL;
+
+	ptr = vmeta_shared_add(p_desc->fd, p_desc->size, p_desc->phy_addr,
+			       p_desc->cached);
+	if (ptr == NULL) {
+		dbg_printf(VDEC_DEBUG_MEM, "vdec_os_api_dma_import fd=%d "
+			   "mmap failed\n", p_desc->fd);
+		return NULL;
+	}
+
+	dbg_printf(VDEC_DEBUG_MEM, "vdec_os_api_dma_import fd=%d ptr: 0x%x\n",
+		   p_desc->fd, ptr);
+	return ptr;
+}
+
+SIGN32 vdec_os_api_dma_get(void *ptr)
+{
+	struct vmeta_shared_buf *p_buf;
+	SIGN32 ref = -VDEC_OS_DRIVER_NO_SYS_MEM_FAIL;
+
+	pthread_mutex_lock(&shared_mutex);
+	p_buf = vmeta_shared_find(ptr);
+	if (p_buf != NULL)
+		ref = ++p_buf->ref;
+	pthread_mutex_unlock(&shared_mutex);
+
+	return ref;
+}
+
+SIGN32 vdec_os_api_dma_sync(void *ptr, enum dma_data_direction direction,
+			    SIGN32 begin)
+{
+	struct vmeta_shared_buf *p_buf;
+	int cached = 0;
+
+	/* the ref keeps fd alive if another thread frees ptr meanwhile */
+	pthread_mutex_lock(&shared_mutex);
+	p_buf = vmeta_shared_find(ptr);
+	if (p_buf != NULL) {
+		cached = p_buf->cached;
+		if (cached)
+			p_buf->ref++;
+	}
+	pthread_mutex_unlock(&shared_mutex);
+
+	if (p_buf == NULL)
+		return -VDEC_OS_DRIVER_NO_SYS_MEM_FAIL;
+	if (!cached)
+		return VDEC_OS_DRIVER_OK;
+
+	/* before CPU reads the device data must be visible, after CPU writes
+	   they must reach memory; writes to device need nothing at begin */
+	if ((begin && direction != DMA_TO_DEVICE)
+	    || (!begin && direction != DMA_FROM_DEVICE))
+		vmeta_shared_sync_fd(p_buf);
+
+	vmeta_shared_put(ptr);
+	return VDEC_OS_DRIVER_OK;
+}
+
+/*
+Carve-out. The region is split into one block per declared picture, each
+exactly one picture long. A picture-sized request takes a whole block;
+smaller requests are served by a buddy allocator inside the blocks, which
+are seeded as the binary decomposition of the block length so no page is
+lost to power-of-two rounding. The bookkeeping lives outside the region,
+which is mapped non-cached.
+*/
+struct _vmeta_carveout {
+	struct _vmeta_carveout *next;
+	pthread_mutex_t mutex;
+	unsigned char *va;
+	UNSG32 pa;
+	int pages;
+	int blocks;
+	int blk_pages;
+	int max_order;			// largest buddy order inside a block
+	int free_head[VMETA_BUDDY_ORDERS];
+	int *free_next;
+	int *free_prev;
+	signed char *head_order;	// block order at its first page, -1 elsewhere
+	unsigned char *head_free;
+	int *blk_used;			// pages in use per block
+	unsigned char *blk_whole;	// block handed out as one picture
+	vmeta_carveout_stat stat;
+};
+
+static vmeta_carveout *carveout_list;
+static pthread_mutex_t carveout_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int vmeta_buddy_order(UNSG32 pages)
+{
+	int order = 0;
+
+	while ((1U << order) < pages)
+		order++;
+	return order;
+}
+
+static void vmeta_buddy_add(vmeta_carveout *co, int order, int page)
+{
+	co->head_order[page] = order;
+	co->head_free[page] = 1;
+	co->free_prev[page] = -1;
+	co->free_next[page] = co->free_head[order];
+	if (co->free_head[order] >= 0)
+		co->free_prev[co->free_head[order]] = page;
+	co->free_head[order] = page;
+}
+
+static void vmeta_buddy_del(vmeta_carveout *co, int order, int page)
+{
+	if (co->free_prev[page] >= 0)
+		co->free_next[co->free_prev[page]] = co->free_next[page];
+	else
+		co->free_head[order] = co->free_next[page];
+	if (co->free_next[page] >= 0)
+		co->free_prev[co->free_next[page]] = co->free_prev[page];
+	co->head_free[page] = 0;
+}
+
+/* seed (add) or take (del) the free pieces of an unused block */
+static void vmeta_buddy_block(vmeta_carveout *co, int blk, int add)
+{
+	int base = blk * co->blk_pages;
+	int off = 0, order;
+
+	for (order = co->max_order; order >= 0; order--) {
+		if (!(co->blk_pages & (1 << order)))
+			continue;
+		if (add)
+			vmeta_buddy_add(co, order, base + off);
+		else
+			vmeta_buddy_del(co, order, base + off);
+		off += 1 << order;
+	}
+}
+
+static int vmeta_buddy_alloc(vmeta_carveout *co, int order)
+{
+	int j, page;
+
+	for (j = order; j <= co->max_order; j++)
+		if (co->free_head[j] >= 0)
+			break;
+	if (j > co->max_order)
+		return -1;
+
+	page = co->free_head[j];
+	vmeta_buddy_del(co, j, page);
+	while (j > order) {
+		j--;
+		vmeta_buddy_add(co, j, page + (1 << j));
+	}
+	co->head_order[page] = order;
+	co->head_free[page] = 0;
+	co->blk_used[page / co->blk_pages] += 1 << order;
+
+	return page;
+}
+
+static void vmeta_buddy_free(vmeta_carveout *co, int page)
+{
+	int order = co->head_order[page];
+	int base = page / co->blk_pages * co->blk_pages;
+	int rel = page - base;
+	int buddy;
+
+	co->blk_used[page / co->blk_pages] -= 1 << order;
+	while (order < co->max_order) {
+		buddy = rel ^ (1 << order);
+		if (buddy + (1 << order) > co->blk_pages
+		    || !co->head_free[base + buddy]
+		    || co->head_order[base + buddy] != order)
+			break;
+		vmeta_buddy_del(co, order, base + buddy);
+		co->head_order[base + (rel > buddy ? rel : buddy)] = -1;
+		if (buddy < rel)
+			rel = buddy;
+		order++;
+	}
+	vmeta_buddy_add(co, order, base + rel);
+}
+
+/* a whole unused block, for requests longer than any buddy piece */
+static int vmeta_block_alloc(vmeta_carveout *co)
+{
+	int blk;
+
+	for (blk = 0; blk < co->blocks; blk++)
+		if (co->blk_used[blk] == 0)
+			break;
+	if (blk == co->blocks)
+		return -1;
+
+	vmeta_buddy_block(co, blk, 0);
+	co->blk_used[blk] = co->blk_pages;
+	co->blk_whole[blk] = 1;
+	return blk * co->blk_pages;
+}
+
+UNSG32 vdec_os_api_carveout_pic_size(UNSG32 width, UNSG32 height,
+				     UNSG32 bits_per_pixel)
+{
+	return (ALIGN(width, 16) + 2 * VMETA_CARVEOUT_PAD)
+		* (ALIGN(height, 16) + 2 * VMETA_CARVEOUT_PAD)
+		* bits_per_pixel / 8;
+}
+
+vmeta_carveout *vdec_os_api_carveout_reserve(UNSG32 max_width,
+					     UNSG32 max_height,
+					     UNSG32 pic_num, UNSG32 pic_size)
+{
+	vmeta_carveout *co;
+	unsigned long long start;
+	UNSG32 size;
+	int i;
+
+	if (pic_num == 0)
+		return NULL;
+	if (pic_size == 0)
+		pic_size = vdec_os_api_carveout_pic_size(max_width, max_height, 12);
+	if (pic_size == 0)
+		return NULL;
+
+	co = (vmeta_carveout *)malloc(sizeof(vmeta_carveout));
+	if (co == NULL)
+		return NULL;
+	memset(co, 0, sizeof(vmeta_carveout));
+
+	co->blk_pages = ALIGN(pic_size, PAGE_SIZE) / PAGE_SIZE;
+	co->max_order = vmeta_buddy_order(co->blk_pages + 1) - 1;
+	if (co->max_order >= VMETA_BUDDY_ORDERS) {
+		free(co);
+		return NULL;
+	}
+	/* pictures past the cap fall back to vdec_os_api_dma_alloc */
+	if (pic_num > VMETA_CARVEOUT_MAX / (co->blk_pages * PAGE_SIZE)) {
+		dbg_printf(VDEC_DEBUG_MEM, "vdec_os_api_carveout_reserve "
+			   "%u pictures of 0x%x capped at 0x%x\n", pic_num,
+			   co->blk_pages * PAGE_SIZE, VMETA_CARVEOUT_MAX);
+		pic_num = VMETA_CARVEOUT_MAX / (co->blk_pages * PAGE_SIZE);
+		if (pic_num == 0) {
+			free(co);
+			return NULL;
+		}
+	}
+	co->blocks = pic_num;
+	co->pages = co->blk_pages * pic_num;
+	size = co->pages * PAGE_SIZE;
+
+	start = vmeta_get_time_us();
+	co->va = phy_cont_malloc(size, PHY_CONT_MEM_ATTR_NONCACHED);
+	co->stat.reserve_us = (UNSG32)(vmeta_get_time_us() - start);
+	co->free_next = (int *)malloc(co->pages * sizeof(int));
+	co->free_prev = (int *)malloc(co->pages * sizeof(int));
+	co->head_order = (signed char *)malloc(co->pages);
+	co->head_free = (unsigned char *)malloc(co->pages);
+	co->blk_used = (int *)calloc(pic_num, sizeof(int));
+	co->blk_whole = (unsigned char *)calloc(pic_num, 1);
+	if (co->va == NULL || co->free_next == NULL || co->free_prev == NULL
+	    || co->head_order == NULL || co->head_free == NULL
+	    || co->blk_used == NULL || co->blk_whole == NULL) {
+		dbg_printf(VDEC_DEBUG_MEM, "vdec_os_api_carveout_reserve "
+			   "size=0x%x failed\n", size);
+		if (co->va)
+			phy_cont_free(co->va);
+		free(co->free_next);
+		free(co->free_prev);
+		free(co->head_order);
+		free(co->head_free);
+		free(co->blk_used);
+		free(co->blk_whole);
+		free(co);
+		return NULL;
+	}
+	co->pa = (UNSG32)phy_cont_getpa(co->va);
+	co->stat.size = size;
+
+	pthread_mutex_init(&co->mutex, NULL);
+	memset(co->head_order, -1, co->pages);
+	memset(co->head_free, 0, co->pages);
+	for (i = 0; i < VMETA_BUDDY_ORDERS; i++)
+		co->free_head[i] = -1;
+	for (i = pic_num - 1; i >= 0; i--)
+		vmeta_buddy_block(co, i, 1);
+
+	pthread_mutex_lock(&carveout_mutex);
+	co->next = carveout_list;
+	carveout_list = co;
+	pthread_mutex_unlock(&carveout_mutex);
+
+	dbg_printf(VDEC_DEBUG_MEM, "vdec_os_api_carveout_reserve va=0x%x "
+		   "pa=0x%x size=0x%x blocks=%d of %d pages in %uus\n", co->va,
+		   co->pa, size, pic_num, co->blk_pages, co->stat.reserve_us);
+	return co;
+}
+
+void *vdec_os_api_carveout_alloc(vmeta_carveout *co, UNSG32 size,
+				 UNSG32 align, UNSG32 *pPhysical)
+{
+	void *ptr;
+	int pages, order, page = -1;
+
+	if (co == NULL)
+		return vdec_os_api_dma_alloc(size, align, pPhysical);
+	if (size <= 0)
+		return NULL;
+
+	align = ALIGN(align, PAGE_SIZE);
+	pages = ALIGN(size, PAGE_SIZE) / PAGE_SIZE;
+	order = vmeta_buddy_order(pages);
+
+	pthread_mutex_lock(&co->mutex);
+	if (order <= co->max_order)
+		page = vmeta_buddy_alloc(co, order);
+	else if (pages <= co->blk_pages)
+		page = vmeta_block_alloc(co);
+	if (page >= 0 && ((co->pa + page * PAGE_SIZE) & (align - 1)) != 0) {
+		if (co->blk_whole[page / co->blk_pages]) {
+			co->blk_whole[page / co->blk_pages] = 0;
+			co->blk_used[page / co->blk_pages] = 0;
+			vmeta_buddy_block(co, page / co->blk_pages, 1);
+		} else {
+			vmeta_buddy_free(co, page);
+		}
+		page = -1;
+	}
+	if (page >= 0) {
+		co->stat.alloc_count++;
+		co->stat.used_bytes += (order <= co->max_order ?
+			(1 << order) : co->blk_pages) * PAGE_SIZE;
+		if (co->stat.used_bytes > co->stat.peak_bytes)
+			co->stat.peak_bytes = co->stat.used_bytes;
+	} else {
+		co->stat.fail_count++;
+	}
+	pthread_mutex_unlock(&co->mutex);
+
+	if (page < 0) {
+		dbg_printf(VDEC_DEBUG_MEM, "vdec_os_api_carveout_alloc "
+			   "size=0x%x falls back\n", size);
+		ptr = vdec_os_api_dma_alloc(size, align, pPhysical);
+		if (ptr == NULL) {
+			pthread_mutex_lock(&co->mutex);
+			co->stat.fallback_fail++;
+			pthread_mutex_unlock(&co->mutex);
+		}
+		return ptr;
+	}
+
+	ptr = co->va + page * PAGE_SIZE;
+	*pPhysical = co->pa + page * PAGE_SIZE;
+	dbg_printf(VDEC_DEBUG_MEM, "vdec_os_api_carveout_alloc ptr: 0x%x "
+		   "pages=%d\n", ptr, pages);
+	VMETA_TRACE(VMETA_EV_DMA_ALLOC, size, VMETA_U32(ptr));
+	return ptr;
+}
+
+/* returns 0 if ptr was carved out of a reserved region */
+static SIGN32 vmeta_carveout_put(void *ptr)
+{
+	vmeta_carveout *co;
+	int page, blk;
+
+	pthread_mutex_lock(&carveout_mutex);
+	for (co = carveout_list; co != NULL; co = co->next)
+		if ((unsigned char *)ptr >= co->va
+		    && (unsigned char *)ptr < co->va + co->stat.size)
+			break;
+	pthread_mutex_unlock(&carveout_mutex);
+
+	if (co == NULL)
+		return -1;
+
+	page = ((unsigned char *)ptr - co->va) / PAGE_SIZE;
+	pthread_mutex_lock(&co->mutex);
+	blk = page / co->blk_pages;
+	if (co->blk_whole[blk] && page == blk * co->blk_pages) {
+		co->blk_whole[blk] = 0;
+		co->blk_used[blk] = 0;
+		vmeta_buddy_block(co, blk, 1);
+		co->stat.free_count++;
+		co->stat.used_bytes -= co->blk_pages * PAGE_SIZE;
+		pthread_mutex_unlock(&co->mutex);
+		return 0;
+	}
+	if (co->blk_whole[blk] || co->head_order[page] < 0
+	    || co->head_free[page]) {
+		pthread_mutex_unlock(&co->mutex);
+		dbg_printf(VDEC_DEBUG_MEM, "carveout free of unallocated "
+			   "0x%x\n", ptr);
+		return 0;
+	}
+	co->stat.free_count++;
+	co->stat.used_bytes -= (1 << co->head_order[page]) * PAGE_SIZE;
+	vmeta_buddy_free(co, page);
+	pthread_mutex_unlock(&co->mutex);
+
+	return 0;
+}
+
+void vdec_os_api_carveout_release(vmeta_carveout *co)
+{
+	vmeta_carveout **pp;
+
+	if (co == NULL)
+		return;
+
+	pthread_mutex_lock(&carveout_mutex);
+	for (pp = &carveout_list; *pp != NULL; pp = &(*pp)->next) {
+		if (*pp == co) {
+			*pp = co->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&carveout_mutex);
+
+	dbg_printf(VDEC_DEBUG_MEM, "vdec_os_api_carveout_release va=0x%x "
+		   "allocs=%u fails=%u peak=%u in use=%u\n", co->va,
+		   co->stat.alloc_count, co->stat.fail_count,
+		   co->stat.peak_bytes, co->stat.used_bytes);
+
+	phy_cont_free(co->va);
+	pthread_mutex_destroy(&co->mutex);
+	free(co->free_next);
+	free(co->free_prev);
+	free(co->head_order);
+	free(co->head_free);
+	free(co->blk_used);
+	free(co->blk_whole);
+	free(co);
+}
+
+SIGN32 vdec_os_api_carveout_get_stat(vmeta_carveout *co,
+				     vmeta_carveout_stat *p_stat)
+{
+	if (co == NULL || p_stat == NULL)
+		return -VDEC_OS_DRIVER_INIT_FAIL;
+
+	pthread_mutex_lock(&co->mutex);
+	memcpy(p_stat, &co->stat, sizeof(vmeta_carveout_stat));
+	pthread_mutex_unlock(&co->mutex);
+
+	return VDEC_OS_DRIVER_OK;
+}
+
+static int vmeta_sim_connect(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* send one request to vmeta-simd, return its connection or -1 */
+static int vmeta_sim_request(int op, unsigned int cmd, unsigned int arg)
+{
+	vmeta_sim_req req;
+	int fd;
+
+	fd = vmeta_sim_connect(vdec_iface->dev_name);
+	if (fd < 0) {
+		dbg_printf(VDEC_DEBUG_ALL, "vmeta sim: connect %s failed\n",
+			   vdec_iface->dev_name);
+		return -1;
+	}
+
+	memset(&req, 0, sizeof(req));
+	req.op = op;
+	req.cmd = cmd;
+	req.arg = arg;
+	req.pid = getpid();
+	if (write(fd, &req, sizeof(req)) != sizeof(req)) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int vmeta_ioctl(unsigned int cmd, unsigned long arg)
+{
+	int fd, ret = -1;
+
+	if (!vdec_iface->sim)
+		return ioctl(vdec_iface->uiofd, cmd, arg);
+
+	fd = vmeta_sim_request(VMETA_SIM_OP_IOCTL, cmd, (unsigned int)arg);
+	if (fd < 0)
+		return -1;
+	if (read(fd, &ret, sizeof(ret)) != sizeof(ret))
+		ret = -1;
+	close(fd);
+	return ret;
+}
+
+/* map the index-th uio memory area */
+static void *vmeta_mmap(UNSG32 size, int index)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char cbuf[CMSG_SPACE(sizeof(int))];
+	void *ptr;
+	int fd, map_fd = -1, ret = -1;
+
+	if (!vdec_iface->sim)
+		return mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			    vdec_iface->uiofd, index * getpagesize());
+
+	fd = vmeta_sim_request(VMETA_SIM_OP_MMAP, index, size);
+	if (fd < 0)
+		return MAP_FAILED;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &ret;
+	iov.iov_len = sizeof(ret);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+	if (recvmsg(fd, &msg, 0) == sizeof(ret) && ret == 0) {
+		cmsg = CMSG_FIRSTHDR(&msg);
+		if (cmsg && cmsg->cmsg_type == SCM_RIGHTS)
+			memcpy(&map_fd, CMSG_DATA(cmsg), sizeof(int));
+	}
+	close(fd);
+
+	if (map_fd < 0)
+		return MAP_FAILED;
+	ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | VMETA_MAP_LOW, map_fd, 0);
+	close(map_fd);
+	return ptr;
+}
+
+/* buf holds UIO_SYSFS_PATH_MAX bytes, enough for the dir and any name */
+static char *vmeta_sysfs_path(char *buf, const char *name)
+{
+	snprintf(buf, UIO_SYSFS_PATH_MAX, "%s/%s", vdec_iface->sysfs_dir, name);
+	return buf;
+}
+
 // enable vmeta interrupt
 void vdec_os_api_irq_enable(void)
 {
@@ -361,8 +1544,11 @@ SIGN32 vdec_os_api_sync_event()
 
 	vdec_os_api_irq_enable();
 	result = poll(&ufds, 1, syncTimeout);
-	if (result > 0)
+	if (result > 0) {
+		if (vdec_iface->sim)	//consume the fake interrupt
+			read(vdec_iface->uiofd, &result, sizeof(result));
 		return VDEC_OS_DRIVER_OK;
+	}
 	else
 		return -VDEC_OS_DRIVER_SYNC_TIMEOUT_FAIL;
 }
@@ -440,16 +1626,77 @@ UNSG32 get_mem_addr(char *msg)
 	return result;
 }
 
+/*
+Read the version and all map sizes/addresses in one pass. The result is
+kept for the life of the process (and its forked children), and with
+VMETA_DESC_CACHE set it is also stored in that file, keyed by the kernel
+driver version, so other processes only need to read the version.
+*/
+static uio_desc_t uio_desc_cache;
+
+static int vmeta_read_desc(uio_desc_t *p_desc)
+{
+	char path[UIO_SYSFS_PATH_MAX];
+	char name[UIO_SYSFS_NAME_MAX];
+	char *cache;
+	FILE *fp;
+	int ver, i;
+
+	ver = get_version(vmeta_sysfs_path(path, UIO_IO_VERSION));
+	if (ver < 0)
+		return -1;
+
+	if (uio_desc_cache.kern_ver == ver
+	    && strcmp(uio_desc_cache.sysfs_dir, vdec_iface->sysfs_dir) == 0) {
+		memcpy(p_desc, &uio_desc_cache, sizeof(uio_desc_t));
+		return 0;
+	}
+
+	cache = getenv(UIO_DESC_CACHE_ENV);
+	if (cache && (fp = fopen(cache, "rb")) != NULL) {
+		i = fread(p_desc, sizeof(uio_desc_t), 1, fp);
+		fclose(fp);
+		if (i == 1 && p_desc->kern_ver == ver
+		    && strcmp(p_desc->sysfs_dir, vdec_iface->sysfs_dir) == 0)
+			goto read_desc_done;
+	}
+
+	memset(p_desc, 0, sizeof(uio_desc_t));
+	p_desc->kern_ver = ver;
+	snprintf(p_desc->sysfs_dir, UIO_PATH_MAX, "%s", vdec_iface->sysfs_dir);
+	for (i = 0; i < UIO_MAP_NUM; i++) {
+		snprintf(name, sizeof(name), UIO_MAP_SIZE, i);
+		p_desc->map_size[i] = get_mem_size(vmeta_sysfs_path(path, name));
+		if (p_desc->map_size[i] == (UNSG32)-VDEC_OS_DRIVER_OPEN_FAIL)
+			p_desc->map_size[i] = 0;
+		snprintf(name, sizeof(name), UIO_MAP_ADDR, i);
+		/* register windows sit above 2G, only the error value is bad */
+		p_desc->map_addr[i] = get_mem_addr(vmeta_sysfs_path(path, name));
+		if (p_desc->map_addr[i] == (UNSG32)-VDEC_OS_DRIVER_OPEN_FAIL)
+			p_desc->map_addr[i] = 0;
+	}
+
+	if (cache && (fp = fopen(cache, "wb")) != NULL) {
+		fwrite(p_desc, sizeof(uio_desc_t), 1, fp);
+		fclose(fp);
+	}
+
+read_desc_done:
+	memcpy(&uio_desc_cache, p_desc, sizeof(uio_desc_t));
+	return 0;
+}
+
 // init vdec os driver
 SIGN32 vdec_os_driver_init(void)
 {
 	int ret = 0;
 	int rv;
 	int i;
-
-#if VMETA_LOG_ON
-	FILE *fp_log;
-#endif
+	char *env;
+	struct stat st;
+	vmeta_sim_req req;
+	kernel_share *p_ks;
+	UNSG32 va;
 
 	pthread_mutex_lock(&pmt);
 	if (vdec_iface != NULL) {	// already been initiated in this process
@@ -463,16 +1710,11 @@ SIGN32 vdec_os_driver_init(void)
 			vmeta_socket[i] = INVALID_SOCKET_NO;
 	}
 
-#if (VMETA_LOG_ON && 0)
-
-	fp_log = fopen(VMETA_LOG_FILE, "w");
-	if (fp_log == NULL) {
-		pthread_mutex_unlock(&pmt);
-		return -1;
-	}
-	fclose(fp_log);
 
-#endif
+	env = getenv(VMETA_LOG_LEVEL_ENV);
+	if (env)
+		globalDbgLevel = strtoul(env, NULL, 0);
+	vmeta_trace_start();
 
 	// Prepare the vdec os driver control interface
 	vdec_iface =
@@ -485,16 +1727,36 @@ SIGN32 vdec_os_driver_init(void)
 	// initialize reference count
 	vdec_iface->refcount++;
 
-	// Open the vdec uio driver
-	vdec_iface->uiofd = open(UIO_DEV, O_RDWR);
+	env = getenv(UIO_DEV_ENV);
+	strncpy(vdec_iface->dev_name, env ? env : UIO_DEV, UIO_PATH_MAX - 1);
+	env = getenv(UIO_SYSFS_ENV);
+	strncpy(vdec_iface->sysfs_dir, env ? env : UIO_SYSFS_DIR, UIO_PATH_MAX - 1);
+
+	// Open the vdec uio driver, or connect to the simulator
+	if (stat(vdec_iface->dev_name, &st) == 0 && S_ISSOCK(st.st_mode)) {
+		vdec_iface->sim = 1;
+		vdec_iface->uiofd = vmeta_sim_connect(vdec_iface->dev_name);
+		if (vdec_iface->uiofd >= 0) {
+			memset(&req, 0, sizeof(req));
+			req.op = VMETA_SIM_OP_IRQ;
+			req.pid = getpid();
+			write(vdec_iface->uiofd, &req, sizeof(req));
+		}
+	} else {
+		vdec_iface->uiofd = open(vdec_iface->dev_name, O_RDWR);
+	}
 	if (vdec_iface->uiofd < 0) {
 		ret = -VDEC_OS_DRIVER_OPEN_FAIL;
 		goto err_open_fail;
 	}
 	dbg_printf(VDEC_DEBUG_ALL, "vdec os driver open: %s uiofd=%d\n",
-		   UIO_DEV, vdec_iface->uiofd);
+		   vdec_iface->dev_name, vdec_iface->uiofd);
 
-	vdec_iface->kern_ver = get_version(UIO_IO_VERSION);
+	if (vmeta_read_desc(&vdec_iface->desc) < 0) {
+		ret = -VDEC_OS_DRIVER_VER_FAIL;
+		goto err_open_fail;
+	}
+	vdec_iface->kern_ver = vdec_iface->desc.kern_ver;
 	if (vdec_iface->kern_ver < VMETA_KERN_MIN_VER) {
 		ret = -VDEC_OS_DRIVER_VER_FAIL;
 		goto err_open_fail;
@@ -503,7 +1765,7 @@ SIGN32 vdec_os_driver_init(void)
 		   vdec_iface->kern_ver, VMETA_USER_VER);
 
 	// Get the IO mem size of vPro's register
-	vdec_iface->io_mem_size = get_mem_size(UIO_IO_MEM_SIZE);
+	vdec_iface->io_mem_size = vdec_iface->desc.map_size[UIO_IO_MEM_INDEX];
 	if (vdec_iface->io_mem_size <= 0) {
 		ret = -VDEC_OS_DRIVER_MMAP_FAIL;
 		goto err_mmap_fail;
@@ -512,7 +1774,7 @@ SIGN32 vdec_os_driver_init(void)
 		   vdec_iface->io_mem_size);
 
 	// Get the IO mem phy addr
-	vdec_iface->io_mem_phy_addr = get_mem_addr(UIO_IO_MEM_ADDR);
+	vdec_iface->io_mem_phy_addr = vdec_iface->desc.map_addr[UIO_IO_MEM_INDEX];
 	if (vdec_iface->io_mem_phy_addr <= 0) {
 		ret = -VDEC_OS_DRIVER_MMAP_FAIL;
 		goto err_mmap_fail;
@@ -522,8 +1784,7 @@ SIGN32 vdec_os_driver_init(void)
 
 	// mmap the io mem area
 	vdec_iface->io_mem_virt_addr =
-	    (SIGN32) mmap(NULL, vdec_iface->io_mem_size, PROT_READ | PROT_WRITE,
-			  MAP_SHARED, vdec_iface->uiofd, 0);
+	    (SIGN32)VMETA_U32(vmeta_mmap(vdec_iface->io_mem_size, UIO_IO_MEM_INDEX));
 
 	if (vdec_iface->io_mem_virt_addr == -1) {
 		ret = -VDEC_OS_DRIVER_MMAP_FAIL;
@@ -534,15 +1795,23 @@ SIGN32 vdec_os_driver_init(void)
 
 	vdec_iface->curr_op = VMETA_OP_INVALID;
 
+	// map the kernel share and hw object areas now, a failure here is
+	// reported again by the lazy getters
+	vdec_os_api_get_ks(&p_ks);
+	if (vdec_iface->desc.map_size[UIO_IO_VMETA_OBJ_INDEX] > 0)
+		vdec_os_api_get_hw_obj_addr(&va,
+			vdec_iface->desc.map_size[UIO_IO_VMETA_OBJ_INDEX]);
+
 	pthread_mutex_unlock(&pmt);
 	return ret;
 
 err_mmap_fail:
 	if (vdec_iface->io_mem_virt_addr > 0)
-		munmap((void *)vdec_iface->io_mem_virt_addr,
+		munmap(VMETA_VA(vdec_iface->io_mem_virt_addr),
 		       vdec_iface->io_mem_size);
 	close(vdec_iface->uiofd);
 err_open_fail:
+	vmeta_trace_stop();
 	free((void *)vdec_iface);
 	vdec_iface = NULL;
 
@@ -568,6 +1837,9 @@ SIGN32 vdec_os_driver_clean(void)
 		pthread_mutex_unlock(&pmt);
 		return 0;
 	}
+	if (vdec_iface->kernel_share_va > 0)
+		vmeta_release_parked((kernel_share *)VMETA_VA(vdec_iface->kernel_share_va));
+
 	// close clock and power
 	if (vdec_os_api_get_user_count() <= 0) {
 		vdec_os_api_clock_off();
@@ -580,7 +1852,7 @@ SIGN32 vdec_os_driver_clean(void)
 		dbg_printf(VDEC_DEBUG_MEM,
 			   "munmap with io_mem_virt_addr = 0x%x\n",
 			   vdec_iface->io_mem_virt_addr);
-		munmap((void *)vdec_iface->io_mem_virt_addr,
+		munmap(VMETA_VA(vdec_iface->io_mem_virt_addr),
 		       vdec_iface->io_mem_size);
 		vdec_iface->io_mem_virt_addr = vdec_iface->io_mem_size = 0;
 	}
@@ -590,7 +1862,7 @@ SIGN32 vdec_os_driver_clean(void)
 			   "munmap with kernel_share_va = 0x%x size=%d\n",
 			   vdec_iface->kernel_share_va,
 			   vdec_iface->kernel_share_size);
-		munmap((void *)vdec_iface->kernel_share_va,
+		munmap(VMETA_VA(vdec_iface->kernel_share_va),
 		       vdec_iface->kernel_share_size);
 		vdec_iface->kernel_share_va = vdec_iface->kernel_share_size = 0;
 	}
@@ -599,7 +1871,7 @@ SIGN32 vdec_os_driver_clean(void)
 		dbg_printf(VDEC_DEBUG_MEM,
 			   "munmap with vdec_obj_va = 0x%x size=%d\n",
 			   vdec_iface->vdec_obj_va, vdec_iface->vdec_obj_size);
-		munmap((void *)vdec_iface->vdec_obj_va,
+		munmap(VMETA_VA(vdec_iface->vdec_obj_va),
 		       vdec_iface->vdec_obj_size);
 		vdec_iface->vdec_obj_va = vdec_iface->vdec_obj_size = 0;
 	}
@@ -615,61 +1887,230 @@ SIGN32 vdec_os_driver_clean(void)
 		vdec_iface = NULL;
 	}
 
+	vmeta_trace_stop();
+
 	dbg_printf(VDEC_DEBUG_ALL, "vmeta clean done\n");
 	pthread_mutex_unlock(&pmt);
 	return 0;
 }
 
 /* display debug message */
-int dbg_printf(UNSG32 dbglevel, const char *format, ...)
+#if VMETA_LOG_ON
+static FILE *fp_log;
+#endif
+
+int (dbg_printf)(UNSG32 dbglevel, const char *format, ...)
 {
-	char dbgBuf[256] = { '\0' };
 	va_list var;
+
+	/* direct callers bypass the macro, so test the level here too */
+	if (!VMETA_LOG_ENABLED(dbglevel))
+		return 0;
+
+	va_start(var, format);
 #if VMETA_LOG_ON
-	FILE *fp_log = fopen(VMETA_LOG_FILE, "a+");
+	/* opened once and kept line buffered */
 	if (fp_log == NULL) {
-		return -1;
+		pthread_mutex_lock(&log_mutex);
+		if (fp_log == NULL) {
+			fp_log = fopen(VMETA_LOG_FILE, "a+");
+			if (fp_log)
+				setvbuf(fp_log, NULL, _IOLBF, 0);
+		}
+		pthread_mutex_unlock(&log_mutex);
+		if (fp_log == NULL) {
+			va_end(var);
+			return -1;
+		}
 	}
+	vfprintf(fp_log, format, var);
+#else
+	vprintf(format, var);
 #endif
+	va_end(var);
 
-	if (VDEC_DEBUG_NONE == globalDbgLevel)
-		goto DBG_EXIT;
-	else {
-		va_start(var, format);
-		vsprintf(dbgBuf, format, var);
-		va_end(var);
-
-		if (VDEC_DEBUG_ALL & globalDbgLevel)
-			goto DBG_PRINT;
-		else if ((VDEC_DEBUG_MEM & globalDbgLevel)
-			 && (dbglevel == VDEC_DEBUG_MEM))
-			goto DBG_PRINT;
-		else if ((VDEC_DEBUG_LOCK & globalDbgLevel)
-			 && (dbglevel == VDEC_DEBUG_LOCK))
-			goto DBG_PRINT;
-		else if ((VDEC_DEBUG_VER & globalDbgLevel)
-			 && (dbglevel == VDEC_DEBUG_VER))
-			goto DBG_PRINT;
-		else if ((VDEC_DEBUG_POWER & globalDbgLevel)
-			 && (dbglevel == VDEC_DEBUG_POWER))
-			goto DBG_PRINT;
-		else
-			goto DBG_EXIT;
+	return 0;
+}
+
+#ifndef VMETA_NO_TRACE
+/*
+Trace ring. Writers reserve a slot with an atomic increment and publish it by
+storing seq last; the flusher copies published records to the trace file from
+its own trace thread every VMETA_TRACE_FLUSH_MS, on vdec_os_api_trace_flush()
+and at driver clean. Records overwritten before or while they were copied are
+counted as lost. VMETA_TRACE is used by calls that need no driver init, so a
+writer can still be in vmeta_trace_event() after the trace is stopped: the
+ring and copy buffer are kept for the life of the process once allocated.
+*/
+int vmeta_trace_on;
+static vmeta_trace_rec *trace_ring;
+static vmeta_trace_rec *trace_buf;
+static UNSG32 trace_head;
+static UNSG32 trace_tail;
+static UNSG32 trace_lost;
+static int trace_fd = -1;
+static int trace_stop;
+static pthread_t trace_thread;
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t trace_cond = PTHREAD_COND_INITIALIZER;
+
+void vmeta_trace_event(UNSG32 event, UNSG32 arg0, UNSG32 arg1)
+{
+	UNSG32 seq = __sync_fetch_and_add(&trace_head, 1);
+	vmeta_trace_rec *p_rec = &trace_ring[seq & (VMETA_TRACE_SIZE - 1)];
+
+	p_rec->seq = 0;
+	__sync_synchronize();
+	p_rec->ts_us = vmeta_get_time_us();
+	p_rec->pid = getpid();
+	p_rec->event = event;
+	p_rec->arg0 = arg0;
+	p_rec->arg1 = arg1;
+	__sync_synchronize();
+	p_rec->seq = seq + 1;
+}
+
+SIGN32 vdec_os_api_trace_flush(void)
+{
+	UNSG32 head;
+	int n = 0;
+
+	pthread_mutex_lock(&trace_mutex);
+	if (trace_fd < 0) {
+		pthread_mutex_unlock(&trace_mutex);
+		return 0;
 	}
-DBG_PRINT:
-#if VMETA_LOG_ON
-	fprintf(fp_log, "%s", dbgBuf);
-#else
-	printf("%s", dbgBuf);
-#endif
 
-DBG_EXIT:
-#if VMETA_LOG_ON
-	fclose(fp_log);
-#endif
+	head = *(volatile UNSG32 *)&trace_head;
+	if (head - trace_tail > VMETA_TRACE_SIZE) {
+		trace_lost += head - trace_tail - VMETA_TRACE_SIZE;
+		trace_tail = head - VMETA_TRACE_SIZE;
+	}
+
+	while (trace_tail != head) {
+		vmeta_trace_rec *p_slot = &trace_ring[trace_tail & (VMETA_TRACE_SIZE - 1)];
+		vmeta_trace_rec *p_rec = &trace_buf[n];
+		UNSG32 seq = *(volatile UNSG32 *)&p_slot->seq;
+
+		if ((SIGN32)(seq - (trace_tail + 1)) < 0)
+			break;	/* still being written, pick it up next time */
+		if (seq == trace_tail + 1) {
+			__sync_synchronize();
+			memcpy(p_rec, p_slot, sizeof(vmeta_trace_rec));
+			__sync_synchronize();
+			/* a writer one lap ahead may have reused the slot meanwhile */
+			if (*(volatile UNSG32 *)&p_slot->seq == seq) {
+				p_rec->seq = seq;
+				n++;
+			} else {
+				trace_lost++;
+			}
+		} else {
+			trace_lost++;
+		}
+		trace_tail++;
+	}
+
+	if (n > 0 && write(trace_fd, trace_buf, n * sizeof(vmeta_trace_rec)) < 0)
+		dbg_printf(VDEC_DEBUG_ALL, "trace write failed %d\n", errno);
+	pthread_mutex_unlock(&trace_mutex);
+
+	return n;
+}
+
+static void *vmeta_trace_thread(void *arg)
+{
+	struct timespec ts;
+
+	pthread_mutex_lock(&trace_mutex);
+	while (!trace_stop) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += VMETA_TRACE_FLUSH_MS / 1000;
+		ts.tv_nsec += (VMETA_TRACE_FLUSH_MS % 1000) * 1000000;
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+		pthread_cond_timedwait(&trace_cond, &trace_mutex, &ts);
+		pthread_mutex_unlock(&trace_mutex);
+		vdec_os_api_trace_flush();
+		pthread_mutex_lock(&trace_mutex);
+	}
+	pthread_mutex_unlock(&trace_mutex);
+
+	return NULL;
+}
+
+static void vmeta_trace_start(void)
+{
+	char *path = getenv(VMETA_TRACE_ENV);
+
+	if (path == NULL || trace_fd >= 0)
+		return;
+
+	if (trace_ring == NULL)
+		trace_ring = (vmeta_trace_rec *)calloc(VMETA_TRACE_SIZE,
+						       sizeof(vmeta_trace_rec));
+	if (trace_buf == NULL)
+		trace_buf = (vmeta_trace_rec *)malloc(VMETA_TRACE_SIZE
+						      * sizeof(vmeta_trace_rec));
+	trace_fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if (trace_ring == NULL || trace_buf == NULL || trace_fd < 0)
+		goto fail;
+
+	/* late writers of an earlier session may still bump trace_head */
+	trace_tail = *(volatile UNSG32 *)&trace_head;
+	trace_lost = 0;
+	trace_stop = 0;
+	if (pthread_create(&trace_thread, NULL, vmeta_trace_thread, NULL) != 0)
+		goto fail;
+
+	vmeta_trace_on = 1;
+	return;
+
+fail:
+	dbg_printf(VDEC_DEBUG_ALL, "trace %s disabled\n", path);
+	if (trace_fd >= 0)
+		close(trace_fd);
+	trace_fd = -1;
+}
+
+static void vmeta_trace_stop(void)
+{
+	if (!vmeta_trace_on)
+		return;
+
+	vmeta_trace_on = 0;
+	pthread_mutex_lock(&trace_mutex);
+	trace_stop = 1;
+	pthread_cond_signal(&trace_cond);
+	pthread_mutex_unlock(&trace_mutex);
+	pthread_join(trace_thread, NULL);
+
+	vdec_os_api_trace_flush();
+	dbg_printf(VDEC_DEBUG_ALL, "trace lost %u records\n", trace_lost);
+
+	/* the ring stays, writers may still be inside vmeta_trace_event() */
+	pthread_mutex_lock(&trace_mutex);
+	close(trace_fd);
+	trace_fd = -1;
+	pthread_mutex_unlock(&trace_mutex);
+}
+#else
+SIGN32 vdec_os_api_trace_flush(void)
+{
 	return 0;
 }
 
+static void vmeta_trace_start(void)
+{
+}
+
+static void vmeta_trace_stop(void)
+{
+}
+#endif
+
 /* vdec driver get cb */
 vdec_os_driver_cb_t *vdec_driver_get_cb(void)
 {
@@ -688,7 +2129,7 @@ SIGN32 vdec_os_api_get_hw_obj_addr(UNSG32 *vaddr, UNSG32 size)
 		return VDEC_OS_DRIVER_OK;
 	}
 
-	io_mem_size = get_mem_size(UIO_IO_VMETA_OBJ_SIZE);
+	io_mem_size = vdec_iface->desc.map_size[UIO_IO_VMETA_OBJ_INDEX];
 	if (io_mem_size <= 0 || io_mem_size < size) {
 		ret = -VDEC_OS_DRIVER_MMAP_FAIL;
 		dbg_printf(VDEC_DEBUG_MEM,
@@ -700,11 +2141,7 @@ SIGN32 vdec_os_api_get_hw_obj_addr(UNSG32 *vaddr, UNSG32 size)
 		   "vdec_os_api_get_hw_obj_addr: get_mem_size io_mem_size=%d, requested size=%d\n",
 		   io_mem_size, size);
 
-	io_mem_virt_addr = (SIGN32) mmap(NULL, size,
-					 PROT_READ | PROT_WRITE, MAP_SHARED,
-					 vdec_iface->uiofd,
-					 UIO_IO_VMETA_OBJ_INDEX *
-					 getpagesize());
+	io_mem_virt_addr = (SIGN32)VMETA_U32(vmeta_mmap(size, UIO_IO_VMETA_OBJ_INDEX));
 	if (io_mem_virt_addr == -1) {
 		ret = -VDEC_OS_DRIVER_MMAP_FAIL;
 		dbg_printf(VDEC_DEBUG_MEM,
@@ -738,7 +2175,7 @@ SIGN32 vdec_os_api_get_hw_context_addr(UNSG32 *paddr, UNSG32 *vaddr,
 		return VDEC_OS_DRIVER_OK;
 	}
 
-	io_mem_size = get_mem_size(UIO_IO_HW_CONTEXT_SIZE);
+	io_mem_size = vdec_iface->desc.map_size[UIO_IO_HW_CONTEXT_INDEX];
 	if (io_mem_size <= 0 || io_mem_size < size) {
 		ret = -VDEC_OS_DRIVER_MMAP_FAIL;
 		dbg_printf(VDEC_DEBUG_MEM,
@@ -750,7 +2187,7 @@ SIGN32 vdec_os_api_get_hw_context_addr(UNSG32 *paddr, UNSG32 *vaddr,
 		   "vdec_os_api_get_hw_context_addr: get_mem_size io_mem_size=%d, requested size=%d\n",
 		   io_mem_size, size);
 
-	io_mem_addr = get_mem_addr(UIO_IO_HW_CONTEXT_ADDR);
+	io_mem_addr = vdec_iface->desc.map_addr[UIO_IO_HW_CONTEXT_INDEX];
 	if (io_mem_addr <= 0) {
 		ret = -VDEC_OS_DRIVER_MMAP_FAIL;
 		dbg_printf(VDEC_DEBUG_MEM,
@@ -780,7 +2217,7 @@ SIGN32 vdec_os_api_get_ks(kernel_share **pp_ks)
 		return 0;
 	}
 
-	io_mem_size = get_mem_size(UIO_IO_KERNEL_SHARE_SIZE);
+	io_mem_size = vdec_iface->desc.map_size[UIO_IO_KERNEL_SHARE_INDEX];
 	if (io_mem_size <= 0) {
 		ret = -VDEC_OS_DRIVER_MMAP_FAIL;
 		dbg_printf(VDEC_DEBUG_MEM,
@@ -791,11 +2228,16 @@ SIGN32 vdec_os_api_get_ks(kernel_share **pp_ks)
 		   "vdec_os_api_get_ks: get_mem_size io_mem_size=%d\n",
 		   io_mem_size);
 
-	io_mem_virt_addr = (SIGN32) mmap(NULL, io_mem_size,
-					 PROT_READ | PROT_WRITE, MAP_SHARED,
-					 vdec_iface->uiofd,
-					 UIO_IO_KERNEL_SHARE_INDEX *
-					 getpagesize());
+	if (ALIGN(io_mem_size, PAGE_SIZE) < sizeof(kernel_share)) {
+		ret = -VDEC_OS_DRIVER_MMAP_FAIL;
+		dbg_printf(VDEC_DEBUG_MEM,
+			   "vdec_os_api_get_ks: ks area %d smaller than %d\n",
+			   io_mem_size, sizeof(kernel_share));
+		goto get_vos_fail;
+	}
+
+	io_mem_virt_addr = (SIGN32)VMETA_U32(vmeta_mmap(io_mem_size,
+					       UIO_IO_KERNEL_SHARE_INDEX));
 	if (io_mem_virt_addr == -1) {
 		ret = -VDEC_OS_DRIVER_MMAP_FAIL;
 		dbg_printf(VDEC_DEBUG_MEM,
@@ -807,7 +2249,7 @@ SIGN32 vdec_os_api_get_ks(kernel_share **pp_ks)
 		   "kernel share virtual address: 0x%x size=%d \n",
 		   io_mem_virt_addr, io_mem_size);
 
-	*pp_ks = (kernel_share *) io_mem_virt_addr;
+	*pp_ks = (kernel_share *)VMETA_VA(io_mem_virt_addr);
 	vdec_iface->kernel_share_va = (UNSG32) io_mem_virt_addr;
 	vdec_iface->kernel_share_size = io_mem_size;
 
@@ -819,10 +2261,9 @@ int find_user_id(id_instance *list)	//return unoccupied id
 {
 	int i;
 	for (i = 0; i < MAX_VMETA_INSTANCE; i++) {
-		if (get_bit(VMETA_STATUS_BIT_USED, &(list[i].status)) == 0) {
-			set_bit(VMETA_STATUS_BIT_USED, &(list[i].status));
-			return i;
-		}
+		if (get_bit(VMETA_STATUS_BIT_USED, &(list[i].status)) == 0
+		    && set_bit(VMETA_STATUS_BIT_USED, &(list[i].status)) == 0)
+			return i;	//nobody took it in between
 	}
 	return -VDEC_OS_DRIVER_USER_ID_FAIL;
 }
@@ -839,17 +2280,113 @@ SIGN32 vdec_os_api_force_ini(void)
 			return -1;
 		}
 	} else {
-		p_ks = (kernel_share *) p_cb->kernel_share_va;
+		p_ks = (kernel_share *)VMETA_VA(p_cb->kernel_share_va);
+	}
+
+	vmeta_private_lock();
+	memset(p_ks, 0, sizeof(kernel_share));
+	p_ks->active_user_id = MAX_VMETA_INSTANCE;
+	vmeta_private_unlock();
+
+	vmeta_ioctl(VMETA_CMD_UNLOCK, 0);
+
+	return 0;
+}
+
+/*
+The lock statistics in kernel_share are cumulative per id slot, across all
+its owners, as vmeta_stat shows them. vdec_os_api_get_lock_info reports the
+owner's share: the totals minus what they were when this process got the id.
+*/
+static vmeta_lock_info lock_info_base[MAX_VMETA_INSTANCE];
+
+static void vmeta_lock_info_read(lock_stat *p_stat, vmeta_lock_info *p_info)
+{
+	p_info->lock_count = p_stat->lock_count;
+	p_info->timeout_count = p_stat->timeout_count;
+	p_info->wait_ms = p_stat->wait_ms;
+	p_info->hold_ms = p_stat->hold_ms;
+}
+
+/*
+VMETA_CMD_REG_UNREG tells the driver which ids this process owns so that
+it can clear their slots when the process dies. An id is registered with
+the driver the first time this process registers it, and a closed
+instance's id is parked: it stays claimed in kernel_share and registered
+with the driver, and the next vdec_os_api_get_user_id in this process takes
+it back, so open/close churn issues no ioctl. At most VMETA_PARK_MAX ids
+are parked per process so that other processes still find free slots; the
+rest are unregistered and released in vdec_os_api_free_user_id, parked ones
+in vdec_os_driver_clean.
+*/
+#define VMETA_PARK_MAX	2
+
+static unsigned int user_id_kreg;	//ids registered with the driver
+static unsigned int user_id_park;	//registered ids free for reuse
+static pthread_once_t user_id_atfork_once = PTHREAD_ONCE_INIT;
+
+/* the child shares the parent's registrations, it must not reuse its ids */
+static void vmeta_user_id_postfork_child(void)
+{
+	user_id_kreg = 0;
+	user_id_park = 0;
+}
+
+static void vmeta_user_id_atfork(void)
+{
+	pthread_atfork(NULL, NULL, vmeta_user_id_postfork_child);
+}
+
+static int vmeta_unpark_user_id(void)
+{
+	unsigned int park;
+	int id;
+
+	for (;;) {
+		park = *(volatile unsigned int *)&user_id_park;
+		if (park == 0)
+			return -1;
+		id = __builtin_ctz(park);
+		if (__sync_bool_compare_and_swap(&user_id_park, park,
+						 park & ~(1u << id)))
+			return id;
+	}
+}
+
+static int vmeta_park_user_id(SIGN32 user_id)
+{
+	unsigned int park;
+
+	for (;;) {
+		park = *(volatile unsigned int *)&user_id_park;
+		if (__builtin_popcount(park) >= VMETA_PARK_MAX)
+			return 0;
+		if (__sync_bool_compare_and_swap(&user_id_park, park,
+						 park | (1u << user_id)))
+			return 1;
 	}
+}
 
-	vmeta_private_lock();
-	memset(p_ks, 0, sizeof(kernel_share));
-	p_ks->active_user_id = MAX_VMETA_INSTANCE;
-	vmeta_private_unlock();
+/* drop the driver registration, the slot must still be claimed */
+static void vmeta_unreg_user_id(SIGN32 user_id)
+{
+	unsigned int mask = 1u << user_id;
+
+	if (__sync_fetch_and_and(&user_id_kreg, ~mask) & mask)
+		vmeta_ioctl(VMETA_CMD_REG_UNREG, (unsigned long)user_id);
+}
 
-	ioctl(vdec_iface->uiofd, VMETA_CMD_UNLOCK);
+static void vmeta_release_parked(kernel_share *p_ks)
+{
+	unsigned int park = __sync_lock_test_and_set(&user_id_park, 0);
+	int id;
 
-	return 0;
+	while (park) {
+		id = __builtin_ctz(park);
+		park &= ~(1u << id);
+		vmeta_unreg_user_id(id);
+		clear_bit(VMETA_STATUS_BIT_USED, &(p_ks->user_id_list[id].status));
+	}
 }
 
 SIGN32 vdec_os_api_get_user_id(void)
@@ -865,16 +2402,21 @@ SIGN32 vdec_os_api_get_user_id(void)
 			return -1;
 		}
 	} else {
-		p_ks = (kernel_share *) p_cb->kernel_share_va;
+		p_ks = (kernel_share *)VMETA_VA(p_cb->kernel_share_va);
 	}
 
-	vmeta_private_lock();
-	ret = find_user_id(p_ks->user_id_list);
+	pthread_once(&user_id_atfork_once, vmeta_user_id_atfork);
+
+	ret = vmeta_unpark_user_id();
+	if (ret < 0)
+		ret = find_user_id(p_ks->user_id_list);
 	if (ret < 0) {
 		dbg_printf(VDEC_DEBUG_ALL,
 			   "vdec_os_api_get_user_id: find_user_id error\n");
+	} else {
+		/* kernel_share keeps the slot's totals, the owner sees its share */
+		vmeta_lock_info_read(&p_ks->lock_stat_list[ret], &lock_info_base[ret]);
 	}
-	vmeta_private_unlock();
 
 	return ret;
 
@@ -896,16 +2438,16 @@ SIGN32 vdec_os_api_free_user_id(SIGN32 user_id)
 			   "vdec_os_api_free_user_id error: exceeds max user_id\n");
 		return VDEC_OS_DRIVER_USER_ID_FAIL;
 	}
-	p_ks = (kernel_share *) p_cb->kernel_share_va;
-
-	vmeta_private_lock();
+	p_ks = (kernel_share *)VMETA_VA(p_cb->kernel_share_va);
 
 	clear_bit(VMETA_STATUS_BIT_REGISTED,
 		  &(p_ks->user_id_list[user_id].status));
+	if ((*(volatile unsigned int *)&user_id_kreg & (1u << user_id))
+	    && vmeta_park_user_id(user_id))
+		return VDEC_OS_DRIVER_OK;	//kept for the next instance
+	vmeta_unreg_user_id(user_id);
 	clear_bit(VMETA_STATUS_BIT_USED, &(p_ks->user_id_list[user_id].status));
 
-	vmeta_private_unlock();
-
 	return VDEC_OS_DRIVER_OK;
 }
 
@@ -943,7 +2485,7 @@ void *vmeta_thread_monitor(void *pmd)
 		   ((struct monitor_data *)pmd)->user_id, p_md->pt,
 		   p_md->user_id);
 
-	p_ks = (kernel_share *) p_cb->kernel_share_va;
+	p_ks = (kernel_share *)VMETA_VA(p_cb->kernel_share_va);
 
 	if (pthread_getattr_np(p_md->pt, &pat) != 0) {
 		dbg_printf(VDEC_DEBUG_LOCK, "get thread attr failed\n");
@@ -973,7 +2515,7 @@ void *vmeta_thread_monitor(void *pmd)
 
 	if (p_cb) {
 		if (p_cb->kernel_share_va) {
-			p_ks = (kernel_share *) p_cb->kernel_share_va;
+			p_ks = (kernel_share *)VMETA_VA(p_cb->kernel_share_va);
 			if (p_md->user_id == p_ks->active_user_id) {
 				dbg_printf(VDEC_DEBUG_LOCK,
 					   "vmeta thread exit abnormally, instance id=%d lock flag=%d\n",
@@ -1039,7 +2581,7 @@ SIGN32 vdec_os_api_register_user_id(SIGN32 user_id)
 			return VDEC_OS_DRIVER_USER_ID_FAIL;
 		}
 	} else {
-		p_ks = (kernel_share *) p_cb->kernel_share_va;
+		p_ks = (kernel_share *)VMETA_VA(p_cb->kernel_share_va);
 	}
 
 	if (set_bit
@@ -1057,7 +2599,7 @@ SIGN32 vdec_os_api_register_user_id(SIGN32 user_id)
 		return VDEC_OS_DRIVER_USER_ID_FAIL;
 	}
 	#endif
-	p_ks->ref_count++;
+	__sync_fetch_and_add(&p_ks->ref_count, 1);
 	p_ks->user_id_list[user_id].pid = getpid();
 	p_ks->user_id_list[user_id].pt = (unsigned int)pthread_self();
 	#if NEED_MONITOR
@@ -1065,7 +2607,9 @@ SIGN32 vdec_os_api_register_user_id(SIGN32 user_id)
 	p_md->user_id = user_id;
 	pthread_create(&tmp, NULL, vmeta_thread_monitor, p_md);
 	#endif
-	ioctl(p_cb->uiofd, VMETA_CMD_REG_UNREG, (unsigned long)user_id);
+	if ((__sync_fetch_and_or(&user_id_kreg, 1u << user_id)
+	     & (1u << user_id)) == 0)
+		vmeta_ioctl(VMETA_CMD_REG_UNREG, (unsigned long)user_id);
 
 	dbg_printf(VDEC_DEBUG_LOCK,
 		   "pid=%d,pt=0x%x are monitored user_id(%d)\n",
@@ -1080,6 +2624,7 @@ SIGN32 vdec_os_api_unregister_user_id(SIGN32 user_id)
 {
 	kernel_share *p_ks;
 	vdec_os_driver_cb_t *p_cb = vdec_driver_get_cb();
+	SIGN32 op, prev_op, ret;
 
 	if (user_id >= MAX_VMETA_INSTANCE || user_id < 0) {
 		dbg_printf(VDEC_DEBUG_ALL,
@@ -1092,7 +2637,7 @@ SIGN32 vdec_os_api_unregister_user_id(SIGN32 user_id)
 			   "vdec_os_api_unregister_user_id error: not init yet\n");
 		return VDEC_OS_DRIVER_USER_ID_FAIL;
 	} else {
-		p_ks = (kernel_share *) p_cb->kernel_share_va;
+		p_ks = (kernel_share *)VMETA_VA(p_cb->kernel_share_va);
 	}
 
 	if (clear_bit
@@ -1104,21 +2649,37 @@ SIGN32 vdec_os_api_unregister_user_id(SIGN32 user_id)
 		return VDEC_OS_DRIVER_USER_ID_FAIL;
 	}
 
-	p_ks->ref_count--;
-	ioctl(p_cb->uiofd, VMETA_CMD_REG_UNREG, (unsigned long)user_id);
+	/* the driver registration goes with the slot, see user_id_kreg */
+	__sync_fetch_and_sub(&p_ks->ref_count, 1);
+
+	/* lower the clock once the remaining users need less */
+	if (p_ks->ref_count > 0 && p_ks->agg_op > 0) {
+		vmeta_private_lock();
+		prev_op = p_ks->agg_op;
+		op = vmeta_power_op(p_ks, -1);
+		vmeta_private_unlock();
+		if (op >= 0 && p_ks->agg_op != prev_op) {
+			ret = vdec_os_api_clock_switch(op << 16);
+			if (ret >= VMETA_OP_MIN && ret <= VMETA_OP_MAX) {
+				pthread_mutex_lock(&gov_mutex);
+				p_cb->curr_op = ret;
+				pthread_mutex_unlock(&gov_mutex);
+			}
+		}
+	}
+
 	return VDEC_OS_DRIVER_OK;
 }
 
 SIGN32 vmeta_private_lock()
 {
-	ioctl(vdec_iface->uiofd, VMETA_CMD_PRIV_LOCK,
-	      (unsigned long)0xffffffff);
+	vmeta_ioctl(VMETA_CMD_PRIV_LOCK, (unsigned long)0xffffffff);
 	return 0;
 }
 
 SIGN32 vmeta_private_unlock()
 {
-	ioctl(vdec_iface->uiofd, VMETA_CMD_PRIV_UNLOCK);
+	vmeta_ioctl(VMETA_CMD_PRIV_UNLOCK, 0);
 	return 0;
 }
 
@@ -1140,7 +2701,7 @@ SIGN32 vdec_os_api_get_user_count(void)
 			return -1;
 		}
 	} else {
-		p_ks = (kernel_share *) p_cb->kernel_share_va;
+		p_ks = (kernel_share *)VMETA_VA(p_cb->kernel_share_va);
 	}
 
 	dbg_printf(VDEC_DEBUG_ALL, "get_user_count=%d\n", p_ks->ref_count);
@@ -1148,6 +2709,379 @@ SIGN32 vdec_os_api_get_user_count(void)
 	return p_ks->ref_count;
 }
 
+#ifdef VMETA_SIM_CLOCK
+unsigned long long vmeta_sim_time_us;
+#endif
+
+static unsigned long long vmeta_get_time_us(void)
+{
+	struct timespec ts;
+
+#ifdef VMETA_SIM_CLOCK
+	if (vmeta_sim_time_us != 0)
+		return *(volatile unsigned long long *)&vmeta_sim_time_us;
+#endif
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+SIGN32 vdec_os_api_set_governor(vmeta_governor_param *param)
+{
+	if (param == NULL || param->window <= 0 || param->down_pct < 0
+	    || param->up_pct <= param->down_pct || param->hold_ms < 0) {
+		dbg_printf(VDEC_DEBUG_POWER,
+			   "vdec_os_api_set_governor error: invalid param\n");
+		return -VDEC_OS_DRIVER_UPDATE_FAIL;
+	}
+
+	pthread_mutex_lock(&gov_mutex);
+	memcpy(&vmeta_gov, param, sizeof(vmeta_governor_param));
+	memset(vmeta_gov_st, 0, sizeof(vmeta_gov_st));
+	pthread_mutex_unlock(&gov_mutex);
+
+	dbg_printf(VDEC_DEBUG_POWER,
+		   "governor enable=%d up=%d%% down=%d%% window=%d hold=%dms\n",
+		   param->enable, param->up_pct, param->down_pct,
+		   param->window, param->hold_ms);
+	return VDEC_OS_DRIVER_OK;
+}
+
+SIGN32 vdec_os_api_set_frame_rate(SIGN32 user_id, SIGN32 fps)
+{
+	kernel_share *p_ks;
+	vdec_os_driver_cb_t *p_cb = vdec_driver_get_cb();
+
+	if (user_id >= MAX_VMETA_INSTANCE || user_id < 0 || fps < 0) {
+		dbg_printf(VDEC_DEBUG_POWER,
+			   "vdec_os_api_set_frame_rate error: invalid param\n");
+		return -VDEC_OS_DRIVER_UPDATE_FAIL;
+	}
+
+	if (p_cb == NULL)
+		return -VDEC_OS_DRIVER_UPDATE_FAIL;
+
+	if (p_cb->kernel_share_va == 0) {
+		if(VDEC_OS_DRIVER_OK != vdec_os_api_get_ks(&p_ks)) {
+			dbg_printf(VDEC_DEBUG_POWER,
+				"vdec_os_api_set_frame_rate: init error\n");
+			return -VDEC_OS_DRIVER_UPDATE_FAIL;
+		}
+	} else {
+		p_ks = (kernel_share *)VMETA_VA(p_cb->kernel_share_va);
+	}
+
+	p_ks->user_id_list[user_id].frame_rate = fps;
+	return VDEC_OS_DRIVER_OK;
+}
+
+static void vmeta_governor_lock(SIGN32 user_id)
+{
+	if (user_id < 0 || user_id >= MAX_VMETA_INSTANCE)
+		return;
+
+	pthread_mutex_lock(&gov_mutex);
+	if (vmeta_gov.enable)
+		vmeta_gov_st[user_id].lock_us = vmeta_get_time_us();
+	pthread_mutex_unlock(&gov_mutex);
+}
+
+/*
+Average the hw busy time of user_id over the governor window and step
+the OP by one when it is outside [down_pct, up_pct] of the frame budget.
+The OP never goes below the aggregate-load choice of vmeta_power_op.
+The decision is taken under gov_mutex, the switch itself outside it;
+curr_op only changes under gov_mutex.
+*/
+static void vmeta_governor_unlock(SIGN32 user_id, kernel_share *p_ks)
+{
+	vdec_os_driver_cb_t *p_cb = vdec_driver_get_cb();
+	struct gov_data *p_gov;
+	unsigned long long now, busy_us, budget_us;
+	SIGN32 min_op, step, ret;
+	int fps;
+
+	if (user_id < 0 || user_id >= MAX_VMETA_INSTANCE)
+		return;
+
+	pthread_mutex_lock(&gov_mutex);
+	p_gov = &vmeta_gov_st[user_id];
+	if (!vmeta_gov.enable || p_gov->lock_us == 0)
+		goto out;
+
+	now = vmeta_get_time_us();
+	p_gov->busy_us += now - p_gov->lock_us;
+	p_gov->lock_us = 0;
+	if (++p_gov->frames < vmeta_gov.window)
+		goto out;
+
+	fps = p_ks->user_id_list[user_id].frame_rate;
+	if (fps <= 0)
+		fps = VMETA_DEFAULT_FPS;
+	budget_us = 1000000 / fps;
+	busy_us = p_gov->busy_us / p_gov->frames;
+	p_gov->busy_us = 0;
+	p_gov->frames = 0;
+
+	if (busy_us * 100 > budget_us * vmeta_gov.up_pct)
+		step = 1;
+	else if (busy_us * 100 < budget_us * vmeta_gov.down_pct)
+		step = -1;
+	else
+		goto out;
+
+	if (p_gov->last_switch_us != 0
+	    && now - p_gov->last_switch_us < (unsigned long long)vmeta_gov.hold_ms * 1000)
+		goto out;
+
+	if (p_cb->curr_op < VMETA_OP_MIN || p_cb->curr_op > VMETA_OP_MAX)
+		goto out;	//no OP set yet
+
+	min_op = p_ks->agg_op >= VMETA_OP_MIN ? p_ks->agg_op : VMETA_OP_MIN;
+	if (p_cb->curr_op + step > VMETA_OP_MAX
+	    || p_cb->curr_op + step < min_op)
+		goto out;
+	pthread_mutex_unlock(&gov_mutex);
+
+	dbg_printf(VDEC_DEBUG_POWER,
+		   "governor user %d busy=%lluus budget=%lluus step=%d\n",
+		   user_id, busy_us, budget_us, step);
+	ret = vdec_os_api_clock_switch((1 | (step << 8)) & 0xffff);
+	if (ret >= 0) {
+		pthread_mutex_lock(&gov_mutex);
+		p_cb->curr_op += step;
+		p_gov->last_switch_us = now;
+		pthread_mutex_unlock(&gov_mutex);
+	}
+	return;
+out:
+	pthread_mutex_unlock(&gov_mutex);
+}
+
+static inline int vmeta_stat_bucket(unsigned long long us)
+{
+	int b = 0;
+
+	us >>= VMETA_STAT_SHIFT;
+	while (us && b < VMETA_STAT_BUCKETS - 1) {
+		us >>= 1;
+		b++;
+	}
+	return b;
+}
+
+static void vmeta_stat_wait(kernel_share *p_ks, SIGN32 user_id,
+			    unsigned long long wait_us)
+{
+	lock_stat *p_stat;
+
+	VMETA_TRACE(VMETA_EV_LOCK, user_id, (UNSG32)wait_us);
+	if (user_id < 0 || user_id >= MAX_VMETA_INSTANCE)
+		return;
+
+	p_stat = &p_ks->lock_stat_list[user_id];
+	p_stat->lock_count++;
+	p_stat->wait_ms += wait_us / 1000;
+	p_stat->wait_hist[vmeta_stat_bucket(wait_us)]++;
+}
+
+static void vmeta_stat_hold(kernel_share *p_ks, SIGN32 user_id)
+{
+	lock_stat *p_stat;
+	struct timeval tv;
+	long long hold_us;
+
+	if (user_id < 0 || user_id >= MAX_VMETA_INSTANCE)
+		return;
+
+	gettimeofday(&tv, NULL);
+	hold_us = (long long)(tv.tv_sec - p_ks->lock_start_tv.tv_sec) * 1000000
+		+ (tv.tv_usec - p_ks->lock_start_tv.tv_usec);
+	if (hold_us < 0)
+		hold_us = 0;
+	VMETA_TRACE(VMETA_EV_UNLOCK, user_id, (UNSG32)hold_us);
+
+	p_stat = &p_ks->lock_stat_list[user_id];
+	p_stat->hold_ms += hold_us / 1000;
+	p_stat->hold_hist[vmeta_stat_bucket(hold_us)]++;
+}
+
+SIGN32 vdec_os_api_get_lock_info(SIGN32 user_id, vmeta_lock_info *p_info)
+{
+	vdec_os_driver_cb_t *p_cb = vdec_driver_get_cb();
+	vmeta_lock_info *p_base;
+	lock_stat *p_stat;
+
+	if (p_cb == NULL || p_cb->kernel_share_va == 0 || p_info == NULL
+	    || user_id < 0 || user_id >= MAX_VMETA_INSTANCE)
+		return -VDEC_OS_DRIVER_USER_ID_FAIL;
+
+	p_stat = &((kernel_share *)VMETA_VA(p_cb->kernel_share_va))->lock_stat_list[user_id];
+	vmeta_lock_info_read(p_stat, p_info);
+	p_base = &lock_info_base[user_id];
+	/* a reset by vmeta_stat -r since the id was handed out drops the base */
+	if (p_info->lock_count >= p_base->lock_count
+	    && p_info->timeout_count >= p_base->timeout_count
+	    && p_info->wait_ms >= p_base->wait_ms
+	    && p_info->hold_ms >= p_base->hold_ms) {
+		p_info->lock_count -= p_base->lock_count;
+		p_info->timeout_count -= p_base->timeout_count;
+		p_info->wait_ms -= p_base->wait_ms;
+		p_info->hold_ms -= p_base->hold_ms;
+	}
+
+	return VDEC_OS_DRIVER_OK;
+}
+
+SIGN32 vdec_os_api_get_ks_snapshot(kernel_share *p_snap, SIGN32 reset_stat)
+{
+	kernel_share *p_ks;
+	vdec_os_driver_cb_t *p_cb = vdec_driver_get_cb();
+
+	if (p_cb == NULL || p_snap == NULL) {
+		dbg_printf(VDEC_DEBUG_ALL,
+			   "vdec_os_api_get_ks_snapshot error: point is NULL\n");
+		return -1;
+	}
+
+	if (p_cb->kernel_share_va == 0) {
+		if(VDEC_OS_DRIVER_OK != vdec_os_api_get_ks(&p_ks)) {
+			dbg_printf(VDEC_DEBUG_ALL,
+				"vdec_os_api_get_ks_snapshot: init error\n");
+			return -1;
+		}
+	} else {
+		p_ks = (kernel_share *)VMETA_VA(p_cb->kernel_share_va);
+	}
+
+	vmeta_private_lock();
+	memcpy(p_snap, p_ks, sizeof(kernel_share));
+	if (reset_stat) {
+		memset(p_ks->lock_stat_list, 0, sizeof(p_ks->lock_stat_list));
+		p_ks->reclaim_count = 0;
+	}
+	vmeta_private_unlock();
+
+	return VDEC_OS_DRIVER_OK;
+}
+
+/*
+Start time of a process in clock ticks since boot, field 22 of
+/proc/<pid>/stat. Together with the pid it names one process even after
+the pid has been reused. Returns 0 if it cannot be read.
+*/
+static unsigned long long vmeta_pid_start(pid_t pid)
+{
+	char path[32], buf[512], *p;
+	unsigned long long start = 0;
+	int fd, len, field;
+
+	snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 0;
+	len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len <= 0)
+		return 0;
+	buf[len] = '\0';
+
+	/* comm may contain spaces and ')', fields restart after the last ')' */
+	p = strrchr(buf, ')');
+	if (p == NULL)
+		return 0;
+	for (field = 2; field < 22 && p != NULL; field++)
+		p = strchr(p + 1, ' ');
+	if (p != NULL)
+		start = strtoull(p + 1, NULL, 10);
+	return start;
+}
+
+static unsigned long long vmeta_self_start(void)
+{
+	static pid_t self_pid;
+	static unsigned long long self_start;
+	pid_t pid = getpid();
+
+	if (self_pid != pid) {	//first call, or a forked child
+		self_start = vmeta_pid_start(pid);
+		self_pid = pid;
+	}
+	return self_start;
+}
+
+/*
+The recorded holder is gone if kill() says ESRCH, or if its pid now
+belongs to a process that started at another time. Any other kill()
+error (EPERM for a holder running as another uid) means it is alive.
+*/
+static int vmeta_holder_alive(pid_t pid, unsigned long long start)
+{
+	unsigned long long now;
+
+	if (kill(pid, 0) != 0 && errno == ESRCH)
+		return 0;
+	if (start == 0)
+		return 1;
+	now = vmeta_pid_start(pid);
+	return now == 0 || now == start;
+}
+
+/*
+Release the hw lock on behalf of a holder process that died with it,
+the same way the monitor thread does for a dead thread. Its user ids are
+cleared and the next locker gets LOCK_RET_FORCE_INIT. lock_gen makes
+sure only one waiter reclaims a given hand-over.
+Returns 1 if the lock was reclaimed.
+*/
+static int vmeta_reclaim_dead_holder(kernel_share *p_ks)
+{
+	pid_t pid;
+	unsigned long long start;
+	unsigned int gen;
+	int i;
+
+	if (p_ks->lock_flag != VMETA_LOCK_ON)
+		return 0;
+
+	gen = p_ks->lock_gen;
+	pid = p_ks->lock_pid;
+	start = p_ks->lock_pid_start;
+	if (pid <= 0 || pid == getpid())
+		return 0;
+	if (vmeta_holder_alive(pid, start))
+		return 0;
+
+	vmeta_private_lock();
+	if (p_ks->lock_gen != gen || p_ks->lock_flag != VMETA_LOCK_ON) {
+		vmeta_private_unlock();
+		return 0;	//somebody else handled it
+	}
+
+	dbg_printf(VDEC_DEBUG_LOCK,
+		   "lock holder pid=%d user_id=%d died, reclaim lock\n",
+		   pid, p_ks->active_user_id);
+	for (i = 0; i < MAX_VMETA_INSTANCE; i++) {
+		if (p_ks->user_id_list[i].pid != pid
+		    || p_ks->user_id_list[i].status == 0)
+			continue;
+		if (get_bit(VMETA_STATUS_BIT_REGISTED,
+			    &(p_ks->user_id_list[i].status)))
+			__sync_fetch_and_sub(&p_ks->ref_count, 1);
+		memset(&(p_ks->user_id_list[i]), 0x0, sizeof(id_instance));
+	}
+
+	p_ks->active_user_id = MAX_VMETA_INSTANCE;
+	p_ks->lock_flag = VMETA_LOCK_FORCE_INIT;
+	p_ks->lock_pid = 0;
+	p_ks->lock_pid_start = 0;
+	p_ks->lock_gen++;
+	p_ks->reclaim_count++;
+	vmeta_private_unlock();
+
+	vmeta_ioctl(VMETA_CMD_UNLOCK, 0);
+	return 1;
+}
+
 SIGN32 vdec_os_api_lock(SIGN32 user_id, UNSG32 to_ms)
 {
 	vdec_os_driver_cb_t *p_cb = vdec_driver_get_cb();
@@ -1155,13 +3089,16 @@ SIGN32 vdec_os_api_lock(SIGN32 user_id, UNSG32 to_ms)
 	SIGN32 ret;
 	struct timeval tv;
 	struct timezone tz;
+	UNSG32 slice, waited = 0;
+	unsigned long long wait_start;
 
 	if (p_cb == NULL) {
 		dbg_printf(VDEC_DEBUG_ALL,
 			   "vdec_os_api_lock error: point is NULL\n");
 		return LOCK_RET_ERROR_UNKNOWN;
 	}
-	p_ks = (kernel_share *) p_cb->kernel_share_va;
+	p_ks = (kernel_share *)VMETA_VA(p_cb->kernel_share_va);
+	wait_start = vmeta_get_time_us();
 
 	if (p_ks->active_user_id == user_id) {
 		dbg_printf(VDEC_DEBUG_LOCK,
@@ -1170,8 +3107,13 @@ SIGN32 vdec_os_api_lock(SIGN32 user_id, UNSG32 to_ms)
 		return LOCK_RET_ME;	//just return since they are the same caller
 	} else if (p_ks->lock_flag == VMETA_LOCK_ON) {	/*Here, we can handle the second lock is not released by the first one */
 		gettimeofday(&tv, &tz);
+		if ((tv.tv_sec - p_ks->lock_start_tv.tv_sec) * 1000
+		    + (tv.tv_usec - p_ks->lock_start_tv.tv_usec) / 1000 > VMETA_LOCK_GRACE_MS)
+			vmeta_reclaim_dead_holder(p_ks);
+
 		vmeta_private_lock();
-		if (tv.tv_sec > p_ks->lock_start_tv.tv_sec + 3) {
+		if (p_ks->lock_flag == VMETA_LOCK_ON
+		    && tv.tv_sec > p_ks->lock_start_tv.tv_sec + 3) {
 			dbg_printf(VDEC_DEBUG_LOCK, "force lock to others\n");
 			dbg_printf(VDEC_DEBUG_LOCK, "interval sec=%ld us=%ld\n",
 				   tv.tv_sec - p_ks->lock_start_tv.tv_sec,
@@ -1185,19 +3127,41 @@ SIGN32 vdec_os_api_lock(SIGN32 user_id, UNSG32 to_ms)
 
 			vmeta_private_lock();
 			p_ks->active_user_id = user_id;
+			p_ks->lock_pid = getpid();
+			p_ks->lock_pid_start = vmeta_self_start();
+			p_ks->lock_gen++;
+			if (user_id >= 0 && user_id < MAX_VMETA_INSTANCE)
+				__sync_fetch_and_add(&p_ks->lock_stat_list[user_id].steal_count, 1);
+			vmeta_stat_wait(p_ks, user_id,
+					vmeta_get_time_us() - wait_start);
 			vmeta_private_unlock();
 
+			vmeta_governor_lock(user_id);
 			return LOCK_RET_FORCE_TO_OTHERS;
 		}
 
 		vmeta_private_unlock();
 	}
 
-	ret = ioctl(vdec_iface->uiofd, VMETA_CMD_LOCK, (unsigned long)to_ms);
-	if (ret != 0) {
-		dbg_printf(VDEC_DEBUG_LOCK, "lock timeout\n");
-		return LOCK_RET_ERROR_TIMEOUT;
+	/* wait in grace period slices so a dead holder is noticed early */
+	for (;;) {
+		slice = to_ms - waited;
+		if (to_ms > VMETA_LOCK_GRACE_MS && slice > VMETA_LOCK_GRACE_MS)
+			slice = VMETA_LOCK_GRACE_MS;
+		ret = vmeta_ioctl(VMETA_CMD_LOCK, (unsigned long)slice);
+		if (ret == 0)
+			break;
+		waited += slice;
+		if (vmeta_reclaim_dead_holder(p_ks))
+			continue;
+		if (waited >= to_ms) {
+			dbg_printf(VDEC_DEBUG_LOCK, "lock timeout\n");
+			if (user_id >= 0 && user_id < MAX_VMETA_INSTANCE)
+				__sync_fetch_and_add(&p_ks->lock_stat_list[user_id].timeout_count, 1);
+			return LOCK_RET_ERROR_TIMEOUT;
+		}
 	}
+	vmeta_governor_lock(user_id);
 
 	vmeta_private_lock();
 
@@ -1206,6 +3170,10 @@ SIGN32 vdec_os_api_lock(SIGN32 user_id, UNSG32 to_ms)
 	p_ks->lock_start_tv.tv_usec = tv.tv_usec;
 
 	p_ks->active_user_id = user_id;
+	p_ks->lock_pid = getpid();
+	p_ks->lock_pid_start = vmeta_self_start();
+	p_ks->lock_gen++;
+	vmeta_stat_wait(p_ks, user_id, vmeta_get_time_us() - wait_start);
 	if (p_ks->lock_flag == VMETA_LOCK_FORCE_INIT) {
 		p_ks->lock_flag = VMETA_LOCK_ON;
 		vmeta_private_unlock();
@@ -1229,11 +3197,14 @@ SIGN32 vdec_os_api_unlock(SIGN32 user_id)
 		return LOCK_RET_ERROR_UNKNOWN;
 	}
 
-	p_ks = (kernel_share *) p_cb->kernel_share_va;
+	p_ks = (kernel_share *)VMETA_VA(p_cb->kernel_share_va);
 	vmeta_private_lock();
 	if (p_ks->active_user_id == user_id) {
+		vmeta_stat_hold(p_ks, user_id);
 		p_ks->active_user_id = MAX_VMETA_INSTANCE;
 		p_ks->lock_flag = VMETA_LOCK_OFF;
+		p_ks->lock_pid = 0;
+		p_ks->lock_pid_start = 0;
 	} else {
 		dbg_printf(VDEC_DEBUG_LOCK,
 			   "vdec_os_api_unlock error: unlock other user id %d; active_user_id is %d\n",
@@ -1243,13 +3214,15 @@ SIGN32 vdec_os_api_unlock(SIGN32 user_id)
 	}
 	vmeta_private_unlock();
 
-	ret = ioctl(vdec_iface->uiofd, VMETA_CMD_UNLOCK);
+	ret = vmeta_ioctl(VMETA_CMD_UNLOCK, 0);
 	dbg_printf(VDEC_DEBUG_LOCK, "ID: %d after unlock\n", user_id);
 	if (ret != 0) {
 		dbg_printf(VDEC_DEBUG_LOCK, "vdec_os_api_unlock ioctl error\n");
 		return LOCK_RET_ERROR_UNKNOWN;
 	}
 
+	vmeta_governor_unlock(user_id, p_ks);
+
 	return LOCK_RET_OHTERS_NORM;
 }
 
@@ -1260,7 +3233,8 @@ SIGN32 vdec_os_api_power_on(void)
 	if (vdec_iface == NULL) {
 		return -1;
 	}
-	ret = ioctl(vdec_iface->uiofd, VMETA_CMD_POWER_ON);
+	ret = vmeta_ioctl(VMETA_CMD_POWER_ON, 0);
+	VMETA_TRACE(VMETA_EV_POWER, 1, ret);
 
 	return ret;
 }
@@ -1272,7 +3246,8 @@ SIGN32 vdec_os_api_power_off(void)
 	if (vdec_iface == NULL) {
 		return -1;
 	}
-	ret = ioctl(vdec_iface->uiofd, VMETA_CMD_POWER_OFF);
+	ret = vmeta_ioctl(VMETA_CMD_POWER_OFF, 0);
+	VMETA_TRACE(VMETA_EV_POWER, 0, ret);
 
 	return ret;
 }
@@ -1284,7 +3259,7 @@ SIGN32 vdec_os_api_clock_on(void)
 	if (vdec_iface == NULL) {
 		return -1;
 	}
-	ret = ioctl(vdec_iface->uiofd, VMETA_CMD_CLK_ON);
+	ret = vmeta_ioctl(VMETA_CMD_CLK_ON, 0);
 
 	return ret;
 }
@@ -1296,7 +3271,7 @@ SIGN32 vdec_os_api_clock_off(void)
 	if (vdec_iface == NULL) {
 		return -1;
 	}
-	ret = ioctl(vdec_iface->uiofd, VMETA_CMD_CLK_OFF);
+	ret = vmeta_ioctl(VMETA_CMD_CLK_OFF, 0);
 
 	return ret;
 }
@@ -1337,8 +3312,8 @@ SIGN32 vdec_os_api_clock_switch(UNSG32 vco)
 	}
 	dbg_printf(VDEC_DEBUG_POWER, "vdec_os_api_clock_switch vco= 0x%08x\n",
 		   vco);
-	ret =
-	    ioctl(vdec_iface->uiofd, VMETA_CMD_CLK_SWITCH, (unsigned long)vco);
+	ret = vmeta_ioctl(VMETA_CMD_CLK_SWITCH, (unsigned long)vco);
+	VMETA_TRACE(VMETA_EV_CLOCK, vco, ret);
 
 	return ret;
 }
@@ -1379,24 +3354,95 @@ static SIGN32 _vmeta_get_default_op(vmeta_user_info *p_info, SIGN32 *max_op)
 	return op;
 }
 
-static SIGN32 vmeta_power_op(id_instance *list, int num)
+/*
+Cost weight of each stream format in 1/16 units, relative to H264.
+H263 and VC1 SP&MP need a higher clock for the same pixel rate.
+*/
+static const int vmeta_codec_weight[] = {
+	16,	/* 0: mpeg1 */
+	16,	/* 1: mpeg2 */
+	16,	/* 2: mpeg4 */
+	16,	/* 3: h261 */
+	24,	/* 4: h263 */
+	16,	/* 5: h264 */
+	16,	/* 6: vc1 ap */
+	16,	/* 7: jpeg */
+	16,	/* 8: mjpeg */
+	16,	/* 9: reserved */
+	24,	/* 10: vc1 sp&mp */
+};
+
+static SIGN32 _vmeta_load_to_op(unsigned long long load)
 {
-	SIGN32 op = VMETA_OP_MAX;
-	SIGN32 max_op;
-	int id;
+	if (load <= LOAD_VGA)
+		return VMETA_OP_VGA;
+	else if (load <= LOAD_720P)
+		return VMETA_OP_720P;
+	else if (load <= LOAD_1080P)
+		return VMETA_OP_1080P;
+	return VMETA_OP_MAX;
+}
 
-	if (num > 1)
-		return VMETA_OP_MAX;
+/*
+Pick the OP for all registered users (plus user_id, which may not be
+registered yet). The pixel rate of every user is weighted by codec and
+summed; each user's own default OP is kept as a floor. Raising the OP is
+immediate, lowering it needs the load to fall VMETA_OP_HYST_PCT below
+the band so that register/unregister churn does not toggle the clock.
+*/
+static SIGN32 vmeta_power_op(kernel_share *p_ks, SIGN32 user_id)
+{
+	id_instance *list = p_ks->user_id_list;
+	unsigned long long load = 0;
+	SIGN32 op = -1;
+	SIGN32 floor_op, max_op, relaxed_op;
+	int id, fps, weight, has_dec = 0;
+
+	for (id = 0; id < MAX_VMETA_INSTANCE; id++) {
+		if (id != user_id
+		    && get_bit(VMETA_STATUS_BIT_REGISTED, &(list[id].status)) == 0)
+			continue;
+
+		floor_op = _vmeta_get_default_op(&(list[id].info), &max_op);
+		if (floor_op > op)
+			op = floor_op;
+
+		fps = list[id].frame_rate > 0 ? list[id].frame_rate : VMETA_DEFAULT_FPS;
+		if (list[id].info.strm_fmt >= 0
+		    && list[id].info.strm_fmt < (int)(sizeof(vmeta_codec_weight) / sizeof(vmeta_codec_weight[0])))
+			weight = vmeta_codec_weight[list[id].info.strm_fmt];
+		else
+			weight = 16;
+		load += (unsigned long long)list[id].info.width * list[id].info.height
+			* fps * weight / 16;
 
-	for (id = 0; id < MAX_VMETA_INSTANCE; id++)
-		if (list[id].status)
-			break;	//found the user id
+		if (list[id].info.usertype == 0)
+			has_dec = 1;
+	}
 
-	if (id >= MAX_VMETA_INSTANCE)
-		return -1;
+	if (op < 0)
+		return -1;	//no user found
 
-	op = _vmeta_get_default_op(&(list[id].info), &max_op);
-	dbg_printf(VDEC_DEBUG_POWER, "vmeta_power_op = %d\n", op);
+	floor_op = op;
+	if (_vmeta_load_to_op(load) > op)
+		op = _vmeta_load_to_op(load);
+
+	if (p_ks->agg_op > op) {
+		relaxed_op = _vmeta_load_to_op(load + load * VMETA_OP_HYST_PCT / 100);
+		if (relaxed_op < floor_op)
+			relaxed_op = floor_op;
+		op = relaxed_op < p_ks->agg_op ? relaxed_op : p_ks->agg_op;
+	}
+	p_ks->agg_op = op;
+
+	/* decoder needs one more OP than the table gives */
+	if (has_dec)
+		op++;
+	if (op > VMETA_OP_MAX)
+		op = VMETA_OP_MAX;
+
+	dbg_printf(VDEC_DEBUG_POWER, "vmeta_power_op = %d load=%llu\n",
+		   op, load);
 	return op;
 }
 
@@ -1421,7 +3467,7 @@ SIGN32 vdec_os_api_update_user_info(SIGN32 user_id, vmeta_user_info *info)
 			return -VDEC_OS_DRIVER_UPDATE_FAIL;
 		}
 	} else {
-		p_ks = (kernel_share *) p_cb->kernel_share_va;
+		p_ks = (kernel_share *)VMETA_VA(p_cb->kernel_share_va);
 	}
 
 	/*-99: expect lowest perf, -1: expect lower perf, 0: default perf,
@@ -1444,17 +3490,13 @@ SIGN32 vdec_os_api_update_user_info(SIGN32 user_id, vmeta_user_info *info)
 		vmeta_private_lock();
 		memcpy(&p_ks->user_id_list[user_id].info, info,
 		       sizeof(vmeta_user_info));
-		op = vmeta_power_op(p_ks->user_id_list, p_ks->ref_count);
+		op = vmeta_power_op(p_ks, user_id);
 		p_ks->user_id_list[user_id].info.curr_op = op;
 		vmeta_private_unlock();
 		if (op < 0) {
 			dbg_printf(VDEC_DEBUG_POWER, "cannot set correct op\n");
 			return -VDEC_OS_DRIVER_UPDATE_FAIL;
 		}
-		if (info->usertype == 0)
-			op++;
-		if(op > VMETA_OP_MAX)
-			op = VMETA_OP_MAX;
 		vco = 0 | op << 16;
 		break;
 	case (99):
@@ -1517,15 +3559,19 @@ SIGN32 vdec_os_api_update_user_info(SIGN32 user_id, vmeta_user_info *info)
 				info->curr_op = VMETA_OP_MIN;
 			ret = 0;
 		} else {
+			pthread_mutex_lock(&gov_mutex);
 			p_cb->curr_op += (SIGN32) step;
 			info->curr_op = p_cb->curr_op;
+			pthread_mutex_unlock(&gov_mutex);
 		}
 		dbg_printf(VDEC_DEBUG_POWER,
 			   "increase result current/return(%d/%d)\n",
 			   p_cb->curr_op, info->curr_op);
 	} else {
 		if (ret >= VMETA_OP_MIN && ret <= VMETA_OP_MAX) {
+			pthread_mutex_lock(&gov_mutex);
 			p_cb->curr_op = ret;
+			pthread_mutex_unlock(&gov_mutex);
 			info->curr_op = ret;
 		}
 	}
@@ -1545,19 +3591,18 @@ SIGN32 vdec_os_api_get_poweropt_solution(void)
 #endif
 }
 
-SIGN32 vdec_os_api_update_user_info_ext(SIGN32 user_id, vmeta_user_info_ext *info, SIGN32 option)
-{
 #ifdef NEW_POWEROPT_SOLUTION
+/*
+Talk to cpufreqd for one user id. This may retry for up to
+SOCKET_RETRY_TIMES * SOCKET_SLEEP_US, so it only runs on the notifier
+thread below.
+*/
+static SIGN32 vmeta_xpu_send(SIGN32 user_id, vmeta_user_info_ext *info, SIGN32 option)
+{
 	struct xpu_vmeta_info xpu_info;
 	int ret;
 	int i;
 
-	/*invalid user_id*/
-	if(user_id >= 32 || user_id < 0) {
-		ALOGD("%s() VMETA_INSTANCE_OVERANGE\n", __FUNCTION__);
-		return -VMETA_INSTANCE_OVERANGE;
-	}
-
 	/*option 0: create; option 1: update; option 2: close*/
 	switch(option) {
 	/*create stage, create socket for cpufreqd, and send the 1st packet*/
@@ -1579,6 +3624,9 @@ SIGN32 vdec_os_api_update_user_info_ext(SIGN32 user_id, vmeta_user_info_ext *inf
 		}
 		if(vmeta_socket[user_id] == INVALID_SOCKET_NO) {
 			ALOGD("%s() failed to open socket!\n", __FUNCTION__);
+			dbg_printf(VDEC_DEBUG_POWER,
+				   "cpufreqd: user id %d open failed after %d tries, errno %d\n",
+				   user_id, SOCKET_RETRY_TIMES, errno);
 			return -SOCKET_CANNOT_OPEN;
 		}
 
@@ -1631,6 +3679,9 @@ SIGN32 vdec_os_api_update_user_info_ext(SIGN32 user_id, vmeta_user_info_ext *inf
 
 		if(ret != sizeof(struct xpu_vmeta_info)) {
 			ALOGD("%s() failed to send socket message!\n", __FUNCTION__);
+			dbg_printf(VDEC_DEBUG_POWER,
+				   "cpufreqd: user id %d update failed after %d tries, ret %d errno %d\n",
+				   user_id, SOCKET_RETRY_TIMES, ret, errno);
 			return -SOCKET_CANNOT_SENDMSG;
 		}
 
@@ -1652,6 +3703,150 @@ SIGN32 vdec_os_api_update_user_info_ext(SIGN32 user_id, vmeta_user_info_ext *inf
 	}
 
 	ALOGD("%s(id:%d, perf:%d) ret no error", __FUNCTION__, user_id, info->perf_req);
+	return 0;
+}
+
+
+/*
+Per-process notifier. Callers only queue the latest state of their user
+id; repeated updates before the thread gets to them collapse into one,
+and a pending create stays a create when an update follows it. A close
+is never collapsed away: it is queued on its own and sent before any
+create or update queued after it.
+*/
+static pthread_mutex_t xpu_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t xpu_cond = PTHREAD_COND_INITIALIZER;
+static pid_t xpu_thread_pid = 0;	//process that owns the notifier thread
+static unsigned int xpu_pending = 0;	//bit n: user id n has a queued update
+static unsigned int xpu_closing = 0;	//bit n: user id n has a queued close
+static SIGN32 xpu_option[MAX_VMETA_INSTANCE];
+static vmeta_user_info_ext xpu_user_info[MAX_VMETA_INSTANCE];
+
+static void *vmeta_xpu_thread(void *arg)
+{
+	vmeta_user_info_ext info;
+	SIGN32 option;
+	int id, ret;
+
+	pthread_mutex_lock(&xpu_mutex);
+	for (;;) {
+		while ((xpu_pending | xpu_closing) == 0)
+			pthread_cond_wait(&xpu_cond, &xpu_mutex);
+
+		for (id = 0; id < MAX_VMETA_INSTANCE; id++)
+			if ((xpu_pending | xpu_closing) & (1u << id))
+				break;
+		if (xpu_closing & (1u << id)) {
+			xpu_closing &= ~(1u << id);
+			memset(&info, 0, sizeof(vmeta_user_info_ext));
+			option = 2;
+		} else {
+			xpu_pending &= ~(1u << id);
+			memcpy(&info, &xpu_user_info[id], sizeof(vmeta_user_info_ext));
+			option = xpu_option[id];
+		}
+		pthread_mutex_unlock(&xpu_mutex);
+
+		ret = vmeta_xpu_send(id, &info, option);
+		if (ret < 0) {
+			ALOGD("%s() UserID %d option %d failed %d", __FUNCTION__,
+			      id, option, ret);
+			dbg_printf(VDEC_DEBUG_POWER,
+				   "cpufreqd notifier: user id %d option %d dropped, error %d\n",
+				   id, option, ret);
+		}
+
+		pthread_mutex_lock(&xpu_mutex);
+	}
+
+	return NULL;
+}
+
+/*
+A fork while another thread holds xpu_mutex would leave it locked for
+good in the child. Hold it across the fork and give the child a fresh
+mutex and no notifier; its first update starts its own thread. Updates
+the parent had queued are dropped in the child: they belong to the
+parent's user ids and the parent's notifier still sends them.
+*/
+static pthread_once_t xpu_atfork_once = PTHREAD_ONCE_INIT;
+
+static void vmeta_xpu_prefork(void)
+{
+	pthread_mutex_lock(&xpu_mutex);
+}
+
+static void vmeta_xpu_postfork_parent(void)
+{
+	pthread_mutex_unlock(&xpu_mutex);
+}
+
+static void vmeta_xpu_postfork_child(void)
+{
+	pthread_mutex_init(&xpu_mutex, NULL);
+	pthread_cond_init(&xpu_cond, NULL);
+	xpu_thread_pid = 0;
+	xpu_pending = 0;
+	xpu_closing = 0;
+}
+
+static void vmeta_xpu_atfork(void)
+{
+	pthread_atfork(vmeta_xpu_prefork, vmeta_xpu_postfork_parent,
+		       vmeta_xpu_postfork_child);
+}
+#endif
+
+SIGN32 vdec_os_api_update_user_info_ext(SIGN32 user_id, vmeta_user_info_ext *info, SIGN32 option)
+{
+#ifdef NEW_POWEROPT_SOLUTION
+	pthread_attr_t attr;
+	pthread_t pt;
+
+	/*invalid user_id*/
+	if(user_id >= 32 || user_id < 0) {
+		ALOGD("%s() VMETA_INSTANCE_OVERANGE\n", __FUNCTION__);
+		return -VMETA_INSTANCE_OVERANGE;
+	}
+
+	/*option 0: create; option 1: update; option 2: close*/
+	if(option < 0 || option > 2) {
+		ALOGD("%s() UNSUPPORTED_OPERATION\n", __FUNCTION__);
+		return -UNSUPPORTED_OPERATION;
+	}
+
+	pthread_once(&xpu_atfork_once, vmeta_xpu_atfork);
+	pthread_mutex_lock(&xpu_mutex);
+	/*start the notifier, again in a forked child*/
+	if(xpu_thread_pid != getpid()) {
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		if(pthread_create(&pt, &attr, vmeta_xpu_thread, NULL) != 0) {
+			pthread_attr_destroy(&attr);
+			pthread_mutex_unlock(&xpu_mutex);
+			ALOGD("%s() no notifier thread, send synchronously", __FUNCTION__);
+			return vmeta_xpu_send(user_id, info, option);
+		}
+		pthread_attr_destroy(&attr);
+		xpu_thread_pid = getpid();
+		xpu_pending = 0;
+		xpu_closing = 0;
+	}
+
+	if(option == 2) {
+		/*a create or update still queued is moot once closed*/
+		xpu_pending &= ~(1u << user_id);
+		xpu_closing |= 1u << user_id;
+	} else {
+		if(!(xpu_pending & (1u << user_id)) || option != 1 || xpu_option[user_id] != 0)
+			xpu_option[user_id] = option;
+		if(info != NULL)
+			memcpy(&xpu_user_info[user_id], info, sizeof(vmeta_user_info_ext));
+		xpu_pending |= 1u << user_id;
+	}
+	pthread_cond_signal(&xpu_cond);
+	pthread_mutex_unlock(&xpu_mutex);
+
 	return 0;
 #else
 	return 0;
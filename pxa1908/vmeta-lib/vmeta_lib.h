@@ -18,23 +18,34 @@ extern "C"
 #define VDEC_DEBUG_NONE 0x0
 
 #define UIO_DEV "/dev/uio0"
-#define UIO_IO_MEM_SIZE "/sys/class/uio/uio0/maps/map0/size"
-#define UIO_IO_MEM_ADDR "/sys/class/uio/uio0/maps/map0/addr"
-#define UIO_IO_VERSION "/sys/class/uio/uio0/version"
-
-#define UIO_IO_HW_CONTEXT_SIZE "/sys/class/uio/uio0/maps/map1/size"
-#define UIO_IO_HW_CONTEXT_ADDR "/sys/class/uio/uio0/maps/map1/addr"
-
-#define UIO_IO_VMETA_OBJ_SIZE "/sys/class/uio/uio0/maps/map2/size"
-#define UIO_IO_VMETA_OBJ_ADDR "/sys/class/uio/uio0/maps/map2/addr"
+#define UIO_SYSFS_DIR "/sys/class/uio/uio0"
+/* environment overrides, e.g. to run against vmeta-simd */
+#define UIO_DEV_ENV "VMETA_UIO_DEV"
+#define UIO_SYSFS_ENV "VMETA_UIO_SYSFS"
+#define UIO_PATH_MAX 128
+/* a path below the sysfs dir, and the longest name relative to it */
+#define UIO_SYSFS_NAME_MAX 32
+#define UIO_SYSFS_PATH_MAX (UIO_PATH_MAX + UIO_SYSFS_NAME_MAX)
+
+/* below are relative to the sysfs dir */
+#define UIO_IO_VERSION "version"
+#define UIO_MAP_SIZE "maps/map%d/size"
+#define UIO_MAP_ADDR "maps/map%d/addr"
+#define UIO_MAP_NUM 4
+
+#define UIO_IO_MEM_INDEX 0
+#define UIO_IO_HW_CONTEXT_INDEX 1
 #define UIO_IO_VMETA_OBJ_INDEX 2
-
-#define UIO_IO_KERNEL_SHARE_SIZE "/sys/class/uio/uio0/maps/map3/size"
-#define UIO_IO_KERNEL_SHARE_ADDR "/sys/class/uio/uio0/maps/map3/addr"
 #define UIO_IO_KERNEL_SHARE_INDEX 3
 
+/* optional file keeping the uio descriptor across processes */
+#define UIO_DESC_CACHE_ENV "VMETA_DESC_CACHE"
+
 #define VMETA_SHARED_LOCK_HANDLE "vmeta_shared_lock"
 
+/* check lock holder liveness once the lock is held longer than this */
+#define VMETA_LOCK_GRACE_MS	20
+
 #define VMETA_KERN_MIN_VER	5
 #define VMETA_USER_VER		"build-006"
 //---------------------------------------------------------------------------
@@ -47,6 +58,32 @@ extern "C"
 #define RESO_WVGA_SIZE		(480*800)
 #define RESO_720P_SIZE		(720*1280)
 #define RESO_1080P_SIZE		(1080*1920)
+
+/* aggregate pixel rate (pixels per second) handled by each OP band */
+#define VMETA_DEFAULT_FPS	30
+#define LOAD_VGA		((unsigned long long)RESO_VGA_SIZE*VMETA_DEFAULT_FPS)
+#define LOAD_720P		((unsigned long long)RESO_720P_SIZE*VMETA_DEFAULT_FPS)
+#define LOAD_1080P		((unsigned long long)RESO_1080P_SIZE*VMETA_DEFAULT_FPS)
+/* load must drop this many percent below a band before the OP is lowered */
+#define VMETA_OP_HYST_PCT	15
+
+/* closed-loop governor defaults */
+#define VMETA_GOV_UP_PCT	90
+#define VMETA_GOV_DOWN_PCT	50
+#define VMETA_GOV_WINDOW	8
+#define VMETA_GOV_HOLD_MS	200
+
+/* vmalloc arena chunk size when the caller passes 0 */
+#define VMETA_ARENA_CHUNK	(64*1024)
+
+/* carve-out buddy orders, in pages; the largest piece is 2^(n-1) pages */
+#define VMETA_BUDDY_ORDERS	16
+/* padding per side assumed when estimating a display picture size */
+#define VMETA_CARVEOUT_PAD	32
+/* largest region reserved; pictures past it are dma allocated */
+#ifndef VMETA_CARVEOUT_MAX
+#define VMETA_CARVEOUT_MAX	(64*1024*1024)
+#endif
 //---------------------------------------------------------------------------
 // Driver initialization API
 //---------------------------------------------------------------------------
@@ -80,10 +117,81 @@ typedef enum _VPRO_CODEC_ERROR_CODE_ {
 
 /* display debug message */
 #define VMETA_LOG_ON 1
+#ifndef VMETA_LOG_FILE
 #define VMETA_LOG_FILE "/data/vmeta_dbg.log"
+#endif
+/* run-time level mask, read at driver init */
+#define VMETA_LOG_LEVEL_ENV "VMETA_DEBUG_LEVEL"
+/* levels compiled in, -DVMETA_LOG_LEVELS=0 drops every message */
+#ifndef VMETA_LOG_LEVELS
+#define VMETA_LOG_LEVELS	(VDEC_DEBUG_ALL | VDEC_DEBUG_MEM | VDEC_DEBUG_LOCK \
+				 | VDEC_DEBUG_VER | VDEC_DEBUG_POWER)
+#endif
+extern UNSG32 globalDbgLevel;
 int dbg_printf(UNSG32 dbglevel, const char* format, ...);
+/* the level is tested before any argument is evaluated or formatted */
+#define VMETA_LOG_ENABLED(level) \
+	(((level) & VMETA_LOG_LEVELS) \
+	 && (globalDbgLevel & (VDEC_DEBUG_ALL | (level))))
+#define dbg_printf(level, ...) \
+	do { \
+		if (VMETA_LOG_ENABLED(level)) \
+			(dbg_printf)(level, __VA_ARGS__); \
+	} while (0)
+
+/* binary trace of lock, power and memory events, enabled by naming the
+   output file in the environment */
+#define VMETA_TRACE_ENV "VMETA_TRACE_FILE"
+#define VMETA_TRACE_SIZE	1024	/* records in the ring, power of 2 */
+#define VMETA_TRACE_FLUSH_MS	1000
+
+enum {
+	VMETA_EV_LOCK = 1,	/* arg0 user id, arg1 wait us */
+	VMETA_EV_UNLOCK,	/* arg0 user id, arg1 hold us */
+	VMETA_EV_CLOCK,		/* arg0 vco, arg1 ioctl result */
+	VMETA_EV_POWER,		/* arg0 1 on / 0 off, arg1 ioctl result */
+	VMETA_EV_VMALLOC,	/* arg0 size, arg1 va */
+	VMETA_EV_VFREE,		/* arg0 0, arg1 va */
+	VMETA_EV_DMA_ALLOC,	/* arg0 size, arg1 va */
+	VMETA_EV_DMA_FREE,	/* arg0 0, arg1 va */
+};
+
+typedef struct vmeta_trace_rec_s {
+	unsigned long long ts_us;	/* CLOCK_MONOTONIC */
+	UNSG32 seq;			/* record number + 1, 0 while written */
+	UNSG32 pid;
+	UNSG32 event;
+	UNSG32 arg0;
+	UNSG32 arg1;
+	UNSG32 reserved;
+} vmeta_trace_rec;
+
+#ifdef VMETA_NO_TRACE
+#define VMETA_TRACE(ev, a0, a1)	do { } while (0)
+#else
+extern int vmeta_trace_on;
+void vmeta_trace_event(UNSG32 event, UNSG32 arg0, UNSG32 arg1);
+#define VMETA_TRACE(ev, a0, a1) \
+	do { \
+		if (vmeta_trace_on) \
+			vmeta_trace_event(ev, a0, a1); \
+	} while (0)
+#endif
+/* write the pending trace records now, returns the number written */
+SIGN32 vdec_os_api_trace_flush(void);
 
 typedef sem_t lock_t;
+
+//---------------------------------------------------------------------------
+// uio map descriptor, read from sysfs once and cached
+//---------------------------------------------------------------------------
+typedef struct uio_desc_s
+{
+	int kern_ver;
+	char sysfs_dir[UIO_PATH_MAX];
+	UNSG32 map_size[UIO_MAP_NUM];
+	UNSG32 map_addr[UIO_MAP_NUM];
+} uio_desc_t;
 //---------------------------------------------------------------------------
 // the control block of vdec os driver
 //---------------------------------------------------------------------------
@@ -101,6 +209,10 @@ typedef struct vdec_os_driver_cb_s
 	UNSG32 kernel_share_size;
 	int kern_ver;	//vmeta kernel version
 	SIGN32 curr_op;
+	int sim;			// uio device is a vmeta-simd socket
+	char dev_name[UIO_PATH_MAX];	// uio device node
+	char sysfs_dir[UIO_PATH_MAX];	// uio sysfs dir
+	uio_desc_t desc;		// uio map sizes and addresses
 } vdec_os_driver_cb_t;
 
 struct monitor_data{
@@ -108,9 +220,26 @@ struct monitor_data{
 	SIGN32 user_id;
 };
 
+/* per user id state of the closed-loop governor */
+struct gov_data{
+	unsigned long long lock_us;		// time the hw was locked, 0 if not held
+	unsigned long long busy_us;		// hw busy time in current window
+	int frames;				// frames in current window
+	unsigned long long last_switch_us;	// time of last OP switch
+};
+
 /* vdec driver get cb */
 vdec_os_driver_cb_t *vdec_driver_get_cb(void);
 
+/* copy the kernel share area for inspection, optionally clearing lock stats */
+SIGN32 vdec_os_api_get_ks_snapshot(kernel_share *p_snap, SIGN32 reset_stat);
+
+#ifdef VMETA_SIM_CLOCK
+/* host simulator builds: the library reads this clock instead of
+   CLOCK_MONOTONIC while it is not 0 */
+extern unsigned long long vmeta_sim_time_us;
+#endif
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,27 @@
+/*
+ * (C) Copyright 2010 Marvell International Ltd.
+ * All Rights Reserved
+ */
+
+#ifndef __VMETA_SIM_H
+#define __VMETA_SIM_H
+
+/*
+ * Protocol between vmeta-lib and the vmeta-simd simulator. When the uio
+ * device node is a unix socket, every ioctl and mmap is a request on a
+ * new connection, and the connection kept as uiofd carries the interrupt
+ * enable writes and the fake interrupts.
+ */
+#define VMETA_SIM_OP_IOCTL	0	//reply: int ret
+#define VMETA_SIM_OP_MMAP	1	//reply: int ret, map fd via SCM_RIGHTS
+#define VMETA_SIM_OP_IRQ	2	//connection becomes the irq channel
+
+typedef struct _vmeta_sim_req
+{
+	int		op;
+	unsigned int	cmd;	//ioctl cmd or map index
+	unsigned int	arg;
+	pid_t		pid;
+}vmeta_sim_req;
+
+#endif /* __VMETA_SIM_H */
@@ -0,0 +1,386 @@
+/*
+ *  vmeta_simd.c
+ *
+ *  User space stand-in for the vmeta uio driver, so that vmeta-lib can be
+ *  run and load tested on a host without the hardware. It serves the uio
+ *  memory maps from memfd, writes a fake sysfs tree, implements the
+ *  VMETA_CMD_* ioctls and raises fake interrupts after a fixed latency.
+ *
+ *  vmeta-simd -s /tmp/vmeta.sock -d /tmp/vmeta-sysfs &
+ *  VMETA_UIO_DEV=/tmp/vmeta.sock VMETA_UIO_SYSFS=/tmp/vmeta-sysfs app ...
+ *
+ * Copyright (C) 2009 Marvell International Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "vmeta_lib.h"
+#include "vmeta_sim.h"
+
+#define SIM_SOCK_DEFAULT	"/tmp/vmeta-sim.sock"
+#define SIM_SYSFS_DEFAULT	"/tmp/vmeta-sim"
+#define SIM_IRQ_LATENCY_US	5000
+#define SIM_MAP_NUM		4
+
+/* size and fake physical address of each uio map */
+static struct {
+	unsigned int size;
+	unsigned int addr;
+	int fd;
+} sim_map[SIM_MAP_NUM] = {
+	{0x10000,	0xf0400000, -1},	/* map0: register window */
+	{0x100000,	0x3f000000, -1},	/* map1: hw context */
+	{0x10000,	0x3f100000, -1},	/* map2: hw object */
+	{0,		0x3f110000, -1},	/* map3: kernel share */
+};
+
+static sem_t sim_hw_lock;
+static sem_t sim_priv_lock;
+static int sim_irq_latency = SIM_IRQ_LATENCY_US;
+static int sim_verbose = 0;
+
+static pthread_mutex_t sim_pm_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int sim_power = 0;
+static int sim_clock = 0;
+static int sim_op = VMETA_OP_MIN;
+static unsigned int sim_op_switches = 0;
+
+static int write_sysfs(const char *dir, const char *name, const char *fmt,
+		       unsigned int val)
+{
+	char path[UIO_PATH_MAX * 2];
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	fp = fopen(path, "w");
+	if (fp == NULL) {
+		printf("cannot write %s\n", path);
+		return -1;
+	}
+	fprintf(fp, fmt, val);
+	fprintf(fp, "\n");
+	fclose(fp);
+	return 0;
+}
+
+static int setup_maps(const char *dir, int kern_ver)
+{
+	char path[UIO_PATH_MAX * 2];
+	char name[32];
+	kernel_share *p_ks;
+	int i;
+
+	sim_map[UIO_IO_KERNEL_SHARE_INDEX].size =
+	    (sizeof(kernel_share) + getpagesize() - 1) & ~(getpagesize() - 1);
+
+	snprintf(path, sizeof(path), "%s/maps", dir);
+	mkdir(dir, 0755);
+	mkdir(path, 0755);
+
+	if (write_sysfs(dir, UIO_IO_VERSION, "build-%d", kern_ver) < 0)
+		return -1;
+
+	for (i = 0; i < SIM_MAP_NUM; i++) {
+		snprintf(name, sizeof(name), "vmeta-map%d", i);
+		sim_map[i].fd = memfd_create(name, 0);
+		if (sim_map[i].fd < 0
+		    || ftruncate(sim_map[i].fd, sim_map[i].size) < 0) {
+			printf("cannot create map%d\n", i);
+			return -1;
+		}
+
+		snprintf(path, sizeof(path), "%s/maps/map%d", dir, i);
+		mkdir(path, 0755);
+		snprintf(name, sizeof(name), "maps/map%d/size", i);
+		write_sysfs(dir, name, "0x%x", sim_map[i].size);
+		snprintf(name, sizeof(name), "maps/map%d/addr", i);
+		write_sysfs(dir, name, "0x%x", sim_map[i].addr);
+	}
+
+	/* the driver starts with nobody holding the lock */
+	p_ks = mmap(NULL, sim_map[UIO_IO_KERNEL_SHARE_INDEX].size,
+		    PROT_READ | PROT_WRITE, MAP_SHARED,
+		    sim_map[UIO_IO_KERNEL_SHARE_INDEX].fd, 0);
+	if (p_ks == MAP_FAILED)
+		return -1;
+	p_ks->active_user_id = MAX_VMETA_INSTANCE;
+	munmap(p_ks, sim_map[UIO_IO_KERNEL_SHARE_INDEX].size);
+
+	return 0;
+}
+
+static int sem_down(sem_t *sem, unsigned int to_ms)
+{
+	struct timespec ts;
+
+	if (to_ms == 0xffffffff)
+		return sem_wait(sem);
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += to_ms / 1000;
+	ts.tv_nsec += (to_ms % 1000) * 1000000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+	return sem_timedwait(sem, &ts);
+}
+
+static void sem_up(sem_t *sem)
+{
+	int val;
+
+	/* a binary semaphore, extra unlocks are dropped */
+	sem_getvalue(sem, &val);
+	if (val < 1)
+		sem_post(sem);
+}
+
+static int clock_switch(unsigned int vco)
+{
+	int op, step;
+
+	pthread_mutex_lock(&sim_pm_mutex);
+	op = sim_op;
+	step = (signed char)((vco >> 8) & 0xff);
+	switch (vco & 0xff) {
+	case 0:
+		op = (vco >> 16) & 0xff;
+		break;
+	case 1:
+		op += step;
+		break;
+	case 2:
+		op = VMETA_OP_MAX;
+		break;
+	case 3:
+		op = VMETA_OP_MIN;
+		break;
+	}
+
+	if (op < VMETA_OP_MIN || op > VMETA_OP_MAX) {
+		pthread_mutex_unlock(&sim_pm_mutex);
+		return -1;
+	}
+	if (op != sim_op)
+		sim_op_switches++;
+	sim_op = op;
+	pthread_mutex_unlock(&sim_pm_mutex);
+
+	if (sim_verbose)
+		printf("op -> %d (%u switches)\n", op, sim_op_switches);
+	return op;
+}
+
+static int do_ioctl(vmeta_sim_req *req)
+{
+	if (sim_verbose > 1)
+		printf("pid %d ioctl %u arg 0x%x\n", req->pid,
+		       _IOC_NR(req->cmd), req->arg);
+
+	switch (req->cmd) {
+	case VMETA_CMD_POWER_ON:
+	case VMETA_CMD_POWER_OFF:
+		pthread_mutex_lock(&sim_pm_mutex);
+		sim_power = (req->cmd == VMETA_CMD_POWER_ON);
+		pthread_mutex_unlock(&sim_pm_mutex);
+		return 0;
+	case VMETA_CMD_CLK_ON:
+	case VMETA_CMD_CLK_OFF:
+		pthread_mutex_lock(&sim_pm_mutex);
+		sim_clock = (req->cmd == VMETA_CMD_CLK_ON);
+		pthread_mutex_unlock(&sim_pm_mutex);
+		return 0;
+	case VMETA_CMD_CLK_SWITCH:
+		return clock_switch(req->arg);
+	case VMETA_CMD_LOCK:
+		return sem_down(&sim_hw_lock, req->arg) == 0 ? 0 : -1;
+	case VMETA_CMD_UNLOCK:
+		sem_up(&sim_hw_lock);
+		return 0;
+	case VMETA_CMD_PRIV_LOCK:
+		return sem_down(&sim_priv_lock, req->arg) == 0 ? 0 : -1;
+	case VMETA_CMD_PRIV_UNLOCK:
+		sem_up(&sim_priv_lock);
+		return 0;
+	case VMETA_CMD_REG_UNREG:
+		return 0;
+	}
+	return -1;
+}
+
+static void do_mmap(int fd, vmeta_sim_req *req)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char cbuf[CMSG_SPACE(sizeof(int))];
+	int ret = 0;
+
+	if (req->cmd >= SIM_MAP_NUM || req->arg > sim_map[req->cmd].size)
+		ret = -1;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &ret;
+	iov.iov_len = sizeof(ret);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	if (ret == 0) {
+		msg.msg_control = cbuf;
+		msg.msg_controllen = sizeof(cbuf);
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &sim_map[req->cmd].fd, sizeof(int));
+	}
+	sendmsg(fd, &msg, 0);
+}
+
+/* irq channel: every enable write is answered by an interrupt */
+static void do_irq(int fd)
+{
+	int irq_on;
+
+	while (read(fd, &irq_on, sizeof(irq_on)) == sizeof(irq_on)) {
+		if (irq_on != 1)
+			continue;
+		usleep(sim_irq_latency);
+		if (write(fd, &irq_on, sizeof(irq_on)) != sizeof(irq_on))
+			break;
+	}
+}
+
+static void *client_thread(void *arg)
+{
+	int fd = (int)(long)arg;
+	vmeta_sim_req req;
+	int ret;
+
+	if (read(fd, &req, sizeof(req)) == sizeof(req)) {
+		switch (req.op) {
+		case VMETA_SIM_OP_IOCTL:
+			ret = do_ioctl(&req);
+			write(fd, &ret, sizeof(ret));
+			break;
+		case VMETA_SIM_OP_MMAP:
+			do_mmap(fd, &req);
+			break;
+		case VMETA_SIM_OP_IRQ:
+			do_irq(fd);
+			break;
+		}
+	}
+
+	close(fd);
+	return NULL;
+}
+
+static void usage(const char *name)
+{
+	printf("usage: %s [-s socket] [-d sysfs_dir] [-l irq_latency_us] "
+	       "[-k kern_ver] [-v]\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *sock_path = SIM_SOCK_DEFAULT;
+	const char *sysfs_dir = SIM_SYSFS_DEFAULT;
+	int kern_ver = VMETA_KERN_MIN_VER;
+	struct sockaddr_un addr;
+	pthread_attr_t attr;
+	pthread_t pt;
+	int listen_fd, fd, opt;
+
+	while ((opt = getopt(argc, argv, "s:d:l:k:vh")) != -1) {
+		switch (opt) {
+		case 's':
+			sock_path = optarg;
+			break;
+		case 'd':
+			sysfs_dir = optarg;
+			break;
+		case 'l':
+			sim_irq_latency = atoi(optarg);
+			break;
+		case 'k':
+			kern_ver = atoi(optarg);
+			break;
+		case 'v':
+			sim_verbose++;
+			break;
+		default:
+			usage(argv[0]);
+			return 0;
+		}
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+	sem_init(&sim_hw_lock, 0, 1);
+	sem_init(&sim_priv_lock, 0, 1);
+
+	if (setup_maps(sysfs_dir, kern_ver) < 0)
+		return -1;
+
+	listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listen_fd < 0)
+		return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, sock_path, sizeof(addr.sun_path) - 1);
+	unlink(sock_path);
+	if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+	    || listen(listen_fd, 64) < 0) {
+		printf("cannot listen on %s: %s\n", sock_path, strerror(errno));
+		return -1;
+	}
+	printf("vmeta-simd: socket %s sysfs %s irq latency %dus\n",
+	       sock_path, sysfs_dir, sim_irq_latency);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	for (;;) {
+		fd = accept(listen_fd, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (pthread_create(&pt, &attr, client_thread, (void *)(long)fd) != 0)
+			close(fd);
+	}
+
+	close(listen_fd);
+	unlink(sock_path);
+	return 0;
+}
@@ -0,0 +1,206 @@
+/*
+ *  vmeta_stat.c
+ *
+ *  Dump the vmeta lock contention statistics kept in the kernel share area,
+ *  decode a binary trace file and time the lock/unlock path.
+ *
+ * Copyright (C) 2009 Marvell International Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <stdio.h>
+#include <time.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vmeta_lib.h"
+
+static void usage(const char *name)
+{
+	printf("usage: %s [-r] [-i interval_s] [-t trace_file] [-b loops]\n",
+	       name);
+	printf("  -r  reset the statistics after reading them\n");
+	printf("  -i  dump every interval_s seconds until killed\n");
+	printf("  -t  print the records of a %s file\n", VMETA_TRACE_ENV);
+	printf("  -b  time loops lock/unlock pairs with the current\n"
+	       "      %s and %s settings\n", VMETA_LOG_LEVEL_ENV,
+	       VMETA_TRACE_ENV);
+}
+
+static const char *ev_name[] = {
+	"?", "lock", "unlock", "clock", "power",
+	"vmalloc", "vfree", "dma_alloc", "dma_free"
+};
+
+static int dump_trace(const char *path)
+{
+	vmeta_trace_rec rec;
+	unsigned long long t0 = 0;
+	FILE *fp;
+
+	fp = fopen(path, "rb");
+	if (fp == NULL) {
+		printf("cannot open %s\n", path);
+		return -1;
+	}
+
+	while (fread(&rec, sizeof(rec), 1, fp) == 1) {
+		if (t0 == 0)
+			t0 = rec.ts_us;
+		printf("%12llu pid %5u %-9s 0x%08x 0x%08x\n", rec.ts_us - t0,
+		       rec.pid, rec.event <= VMETA_EV_DMA_FREE ?
+		       ev_name[rec.event] : ev_name[0], rec.arg0, rec.arg1);
+	}
+
+	fclose(fp);
+	return 0;
+}
+
+static int bench_lock(int loops)
+{
+	struct timespec t0, t1;
+	long long ns;
+	int user_id, i;
+
+	user_id = vdec_os_api_get_user_id();
+	if (user_id < 0 || vdec_os_api_register_user_id(user_id) < 0) {
+		printf("no free user id\n");
+		return -1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < loops; i++) {
+		if (vdec_os_api_lock(user_id, 1000) < 0) {
+			printf("lock failed after %d loops\n", i);
+			break;
+		}
+		vdec_os_api_unlock(user_id);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	ns = (long long)(t1.tv_sec - t0.tv_sec) * 1000000000
+		+ (t1.tv_nsec - t0.tv_nsec);
+	if (i > 0)
+		printf("%d lock/unlock pairs, %lld ns per pair\n", i, ns / i);
+
+	vdec_os_api_unregister_user_id(user_id);
+	vdec_os_api_free_user_id(user_id);
+	return 0;
+}
+
+static void print_hist(const char *name, unsigned int *hist)
+{
+	int i;
+
+	printf("    %-5s", name);
+	for (i = 0; i < VMETA_STAT_BUCKETS; i++)
+		printf(" %8u", hist[i]);
+	printf("\n");
+}
+
+static void print_ks(kernel_share *p_ks)
+{
+	lock_stat *p_stat;
+	int i, b;
+
+	printf("users=%d active_user_id=%d lock_flag=%d holder_pid=%d "
+	       "reclaimed=%u\n", p_ks->ref_count, p_ks->active_user_id,
+	       p_ks->lock_flag, p_ks->lock_pid, p_ks->reclaim_count);
+
+	printf("    %-5s", "ms");
+	printf(" %8s", "<1");
+	for (b = 1; b < VMETA_STAT_BUCKETS - 1; b++)
+		printf(" %8d", 1 << b);
+	printf(" %7d+\n", 1 << (VMETA_STAT_BUCKETS - 1));
+
+	for (i = 0; i < MAX_VMETA_INSTANCE; i++) {
+		p_stat = &p_ks->lock_stat_list[i];
+		if (p_stat->lock_count == 0 && p_stat->timeout_count == 0
+		    && p_ks->user_id_list[i].status == 0)
+			continue;
+
+		printf("id %2d pid %5d status 0x%x: locks %u timeouts %u "
+		       "steals %u wait %ums hold %ums\n", i,
+		       p_ks->user_id_list[i].pid, p_ks->user_id_list[i].status,
+		       p_stat->lock_count, p_stat->timeout_count,
+		       p_stat->steal_count, p_stat->wait_ms, p_stat->hold_ms);
+		print_hist("wait", p_stat->wait_hist);
+		print_hist("hold", p_stat->hold_hist);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	kernel_share *p_snap;
+	int reset = 0;
+	int interval = 0;
+	int loops = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "ri:t:b:h")) != -1) {
+		switch (opt) {
+		case 'r':
+			reset = 1;
+			break;
+		case 'i':
+			interval = atoi(optarg);
+			break;
+		case 't':
+			return dump_trace(optarg);
+		case 'b':
+			loops = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return 0;
+		}
+	}
+
+	p_snap = (kernel_share *)malloc(sizeof(kernel_share));
+	if (p_snap == NULL)
+		return -1;
+
+	if (vdec_os_driver_init() != VDEC_OS_DRIVER_OK) {
+		printf("vdec_os_driver_init failed\n");
+		free(p_snap);
+		return -1;
+	}
+
+	if (loops > 0) {
+		bench_lock(loops);
+		interval = 0;
+	}
+
+	do {
+		if (vdec_os_api_get_ks_snapshot(p_snap, reset) != VDEC_OS_DRIVER_OK) {
+			printf("cannot read kernel share area\n");
+			break;
+		}
+		print_ks(p_snap);
+		if (interval > 0) {
+			printf("\n");
+			sleep(interval);
+		}
+	} while (interval > 0);
+
+	vdec_os_driver_clean();
+	free(p_snap);
+	return 0;
+}